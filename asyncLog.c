@@ -0,0 +1,493 @@
+/*********************************************************************
+ * This module takes console output off the time-critical paths.  A record
+ * holds the format, the stream and the arguments, read with va_arg as the
+ * conversions in the format dictate.  The ring is a bounded multi-producer
+ * queue: producers claim a slot by advancing head with a compare-and-swap
+ * and publish it through the slot's sequence number, so a writer that is
+ * preempted part way through delays only the records behind its own.
+ *
+ * The writer thread wakes every LOG_FLUSH_MS (or when stopped), formats
+ * everything that is waiting and hands runs of lines for the same stream
+ * to one writev.
+ */
+#include <stdio.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include <sys/eventfd.h>
+#include "asyncLog.h"
+
+#define LOG_RING_MASK (LOG_RING_SIZE - 1)
+#define LOG_CACHE_LINE (64)
+#define LOG_FLUSH_MS (10)	// How long a record may wait before it is written
+#define LOG_BATCH (32)		// Lines per writev
+#define LOG_SPEC_MAX (32)
+
+#define LOG_STREAM_OUT (0)
+#define LOG_STREAM_ERR (1)
+
+union log_arg {
+	long long i;
+	unsigned long long u;
+	double d;
+	const void *p;
+};
+
+struct log_record {
+	uint32_t seq;		// Equals the slot position when free, position + 1 when filled
+	uint8_t stream;
+	uint8_t isError;	// Formatted as "fmt: strerror(err)"
+	uint8_t argCount;
+	int32_t err;
+	const char *fmt;
+	union log_arg args[LOG_MAX_ARGS];
+};
+
+static struct {
+	uint32_t head __attribute__((aligned(LOG_CACHE_LINE)));	// Claimed by producers
+	uint64_t dropped;
+	uint32_t tail __attribute__((aligned(LOG_CACHE_LINE)));	// Owned by the writer thread
+	struct log_record records[LOG_RING_SIZE] __attribute__((aligned(LOG_CACHE_LINE)));
+} ring;
+
+static pthread_t writerThread;
+static int32_t stopFd = -1;
+static uint32_t running;
+static uint32_t ringReady;
+
+/*******************************************************************************
+ * This method will put every slot of the ring into the free state.  It is
+ * done once, before the first record is stored.
+ ******************************************************************************/
+static void log_ring_init(void)
+{
+	uint32_t index;
+
+	if (__atomic_load_n(&ringReady, __ATOMIC_ACQUIRE)) {
+		return;
+	}
+	for (index = 0; index < LOG_RING_SIZE; index++) {
+		ring.records[index].seq = index;
+	}
+	__atomic_store_n(&ringReady, 1, __ATOMIC_RELEASE);
+}
+
+/*******************************************************************************
+ * This method will find the end of the conversion which starts at a '%'.
+ * @param const char *spec - This points at the '%'.
+ * @param char *conversion - This is where the conversion character is placed.
+ * @param int32_t *length - This is where the length modifier is placed: the
+ *        number of 'l's, minus the number of 'h's, with 'j', 'z' and 't' as two 'l's.
+ * @return A pointer to the character after the conversion.
+ ******************************************************************************/
+static const char* log_parse_spec(const char *spec, char *conversion, int32_t *length)
+{
+	const char *s = spec + 1;
+
+	*length = 0;
+	while ((*s != '\0') && (strchr("-+ #0'", *s) != NULL)) {
+		s++;
+	}
+	while (((*s >= '0') && (*s <= '9')) || (*s == '.')) {
+		s++;
+	}
+	for (;; s++) {
+		if (*s == 'l') {
+			(*length)++;
+		} else if (*s == 'h') {
+			(*length)--;
+		} else if ((*s == 'j') || (*s == 'z') || (*s == 't')) {
+			*length = 2;
+		} else if (*s != 'L') {
+			break;
+		}
+	}
+	*conversion = *s;
+	return (*s != '\0') ? s + 1 : s;
+}
+
+/*******************************************************************************
+ * This method will read the arguments of a format into a record.  Values are
+ * stored already narrowed to the width the length modifier asks for, so the
+ * writer can print every integer as a long long.
+ * @param struct log_record *rec - This is the record.
+ * @param const char *fmt - This is the format.
+ * @param va_list ap - These are the arguments.
+ ******************************************************************************/
+static void log_capture_args(struct log_record *rec, const char *fmt, va_list ap)
+{
+	const char *s = fmt;
+	char conversion;
+	int32_t length;
+	union log_arg *arg;
+
+	rec->argCount = 0;
+	while ((s = strchr(s, '%')) != NULL) {
+		s = log_parse_spec(s, &conversion, &length);
+		if ((conversion == '%') || (conversion == '\0')) {
+			continue;
+		}
+		if (rec->argCount == LOG_MAX_ARGS) {
+			break;
+		}
+		arg = &rec->args[rec->argCount++];
+
+		switch (conversion) {
+		case 'd': case 'i':
+			arg->i = (length >= 2) ? va_arg(ap, long long) :
+				(length == 1) ? va_arg(ap, long) :
+				(length == -1) ? (short)va_arg(ap, int) :
+				(length <= -2) ? (signed char)va_arg(ap, int) : va_arg(ap, int);
+			break;
+		case 'u': case 'o': case 'x': case 'X':
+			arg->u = (length >= 2) ? va_arg(ap, unsigned long long) :
+				(length == 1) ? va_arg(ap, unsigned long) :
+				(length == -1) ? (unsigned short)va_arg(ap, unsigned int) :
+				(length <= -2) ? (unsigned char)va_arg(ap, unsigned int) : va_arg(ap, unsigned int);
+			break;
+		case 'c':
+			arg->i = va_arg(ap, int);
+			break;
+		case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+			arg->d = va_arg(ap, double);
+			break;
+		default:	// s, p
+			arg->p = va_arg(ap, const void*);
+			break;
+		}
+	}
+}
+
+/*******************************************************************************
+ * This method will format a record as a line of text.
+ * @param const struct log_record *rec - This is the record.
+ * @param char *line - This is where the text is placed.
+ * @return The length of the text.
+ ******************************************************************************/
+static size_t log_format(const struct log_record *rec, char *line)
+{
+	const char *s = rec->fmt;
+	const char *spec;
+	char conversion, specBuf[LOG_SPEC_MAX], errBuf[LOG_LINE_MAX];
+	const union log_arg *arg;
+	size_t used = 0, specLen, lenAt;
+	int32_t length, n;
+	uint32_t argIndex = 0;
+
+	while ((*s != '\0') && (used < LOG_LINE_MAX - 1)) {
+		if (*s != '%') {
+			line[used++] = *s++;
+			continue;
+		}
+		spec = s;
+		s = log_parse_spec(spec, &conversion, &length);
+		if (conversion == '%') {
+			line[used++] = '%';
+			continue;
+		}
+		if (conversion == '\0') {
+			break;
+		}
+		if (argIndex == rec->argCount) {
+			continue;	// Past LOG_MAX_ARGS; the argument was not captured
+		}
+		arg = &rec->args[argIndex++];
+
+		// Copy the flags, width and precision, then put the modifier back as the writer needs it.
+		specLen = (size_t)(s - spec);
+		if (specLen >= LOG_SPEC_MAX - 3) {
+			break;
+		}
+		for (lenAt = 1; lenAt < specLen - 1; lenAt++) {
+			if (strchr("hljztL", spec[lenAt]) != NULL) {
+				break;
+			}
+		}
+		memcpy(specBuf, spec, lenAt);
+		switch (conversion) {
+		case 'd': case 'i': case 'u': case 'o': case 'x': case 'X':
+			memcpy(&specBuf[lenAt], "ll", 2);
+			lenAt += 2;
+			break;
+		default:
+			break;
+		}
+		specBuf[lenAt++] = conversion;
+		specBuf[lenAt] = '\0';
+
+		switch (conversion) {
+		case 'd': case 'i': case 'c':
+			n = (conversion == 'c') ? snprintf(&line[used], LOG_LINE_MAX - used, specBuf, (int)arg->i) :
+				snprintf(&line[used], LOG_LINE_MAX - used, specBuf, arg->i);
+			break;
+		case 'u': case 'o': case 'x': case 'X':
+			n = snprintf(&line[used], LOG_LINE_MAX - used, specBuf, arg->u);
+			break;
+		case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+			n = snprintf(&line[used], LOG_LINE_MAX - used, specBuf, arg->d);
+			break;
+		case 's':
+			n = snprintf(&line[used], LOG_LINE_MAX - used, specBuf, (arg->p != NULL) ? (const char*)arg->p : "(null)");
+			break;
+		default:
+			n = snprintf(&line[used], LOG_LINE_MAX - used, specBuf, arg->p);
+			break;
+		}
+		if (n > 0) {
+			used += ((size_t)n < LOG_LINE_MAX - used) ? (size_t)n : LOG_LINE_MAX - 1 - used;
+		}
+	}
+
+	if (rec->isError) {
+		strerror_r(rec->err, errBuf, sizeof(errBuf));
+		n = snprintf(&line[used], LOG_LINE_MAX - used, ": %s\n", errBuf);
+		if (n > 0) {
+			used += ((size_t)n < LOG_LINE_MAX - used) ? (size_t)n : LOG_LINE_MAX - 1 - used;
+		}
+	}
+	line[used] = '\0';
+	return used;
+}
+
+/*******************************************************************************
+ * This method will write a batch of lines to a descriptor, resuming after
+ * partial writes.
+ * @param int32_t fd - This is the descriptor.
+ * @param struct iovec *iov - These are the lines.  They are modified.
+ * @param uint32_t count - This is the number of lines.
+ ******************************************************************************/
+static void log_writev(int32_t fd, struct iovec *iov, uint32_t count)
+{
+	ssize_t written;
+
+	while (count > 0) {
+		written = writev(fd, iov, count);
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return;
+		}
+		while ((count > 0) && ((size_t)written >= iov->iov_len)) {
+			written -= iov->iov_len;
+			iov++;
+			count--;
+		}
+		if (count > 0) {
+			iov->iov_base = (char*)iov->iov_base + written;
+			iov->iov_len -= written;
+		}
+	}
+}
+
+/*******************************************************************************
+ * This method will format and write every record waiting in the ring.  It is
+ * only called by the writer thread, or by log_stop after the thread is joined.
+ ******************************************************************************/
+static void log_drain(void)
+{
+	static char lines[LOG_BATCH][LOG_LINE_MAX];
+	struct iovec iov[LOG_BATCH];
+	struct log_record *rec;
+	uint32_t count = 0, stream = LOG_STREAM_OUT;
+	uint32_t tail = ring.tail;
+
+	for (;;) {
+		rec = &ring.records[tail & LOG_RING_MASK];
+		if (__atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE) != tail + 1) {
+			break;	// Empty, or the next record is not yet complete
+		}
+		if ((count == LOG_BATCH) || ((count > 0) && (rec->stream != stream))) {
+			log_writev((stream == LOG_STREAM_ERR) ? STDERR_FILENO : STDOUT_FILENO, iov, count);
+			count = 0;
+		}
+		stream = rec->stream;
+		iov[count].iov_base = lines[count];
+		iov[count].iov_len = log_format(rec, lines[count]);
+		count++;
+
+		__atomic_store_n(&rec->seq, tail + LOG_RING_SIZE, __ATOMIC_RELEASE);
+		tail++;
+	}
+	ring.tail = tail;
+	if (count > 0) {
+		log_writev((stream == LOG_STREAM_ERR) ? STDERR_FILENO : STDOUT_FILENO, iov, count);
+	}
+}
+
+/*******************************************************************************
+ * This method will copy a record into the ring.  When the writer thread is not
+ * running the record is written at once instead.
+ * @param const struct log_record *local - This is the record.  Its seq is ignored.
+ * @return The return will be 0 if successful or -1 if the record was dropped.
+ ******************************************************************************/
+static int32_t log_store(const struct log_record *local)
+{
+	struct log_record *rec;
+	struct iovec iov;
+	char line[LOG_LINE_MAX];
+	uint32_t pos, seq;
+
+	if (!__atomic_load_n(&running, __ATOMIC_ACQUIRE)) {
+		iov.iov_base = line;
+		iov.iov_len = log_format(local, line);
+		log_writev((local->stream == LOG_STREAM_ERR) ? STDERR_FILENO : STDOUT_FILENO, &iov, 1);
+		return 0;
+	}
+
+	pos = __atomic_load_n(&ring.head, __ATOMIC_RELAXED);
+	for (;;) {
+		rec = &ring.records[pos & LOG_RING_MASK];
+		seq = __atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE);
+		if (seq == pos) {
+			if (__atomic_compare_exchange_n(&ring.head, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				break;
+			}
+		} else if ((int32_t)(seq - pos) < 0) {
+			// The writer has not freed this slot yet, so the ring is full.
+			__atomic_fetch_add(&ring.dropped, 1, __ATOMIC_RELAXED);
+			return -1;
+		} else {
+			pos = __atomic_load_n(&ring.head, __ATOMIC_RELAXED);
+		}
+	}
+
+	memcpy(&rec->stream, &local->stream, sizeof(*rec) - offsetof(struct log_record, stream));
+	__atomic_store_n(&rec->seq, pos + 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+/*******************************************************************************
+ * This method is the body of the writer thread.
+ * @param void *arg - This is unused.
+ * @return Always NULL.
+ ******************************************************************************/
+static void* log_writer_thread(void *arg)
+{
+	struct pollfd stop;
+
+	stop.fd = stopFd;
+	stop.events = POLLIN;
+	for (;;) {
+		stop.revents = 0;
+		if ((poll(&stop, 1, LOG_FLUSH_MS) > 0) && (stop.revents & POLLIN)) {
+			break;
+		}
+		log_drain();
+	}
+	return NULL;
+}
+
+/*******************************************************************************
+ * This method will start the writer thread.  From then on records are
+ * written in the background.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t log_start(void)
+{
+	int32_t rc;
+
+	if (__atomic_load_n(&running, __ATOMIC_ACQUIRE)) {
+		return 0;
+	}
+	log_ring_init();
+	fflush(stdout);
+
+	stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (stopFd < 0) {
+		perror("asynclog/start");
+		return -1;
+	}
+	rc = pthread_create(&writerThread, NULL, log_writer_thread, NULL);
+	if (rc != 0) {
+		errno = rc;
+		perror("asynclog/start");
+		close(stopFd);
+		stopFd = -1;
+		return -1;
+	}
+	__atomic_store_n(&running, 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will write every waiting record, report any dropped records on
+ * stderr and stop the writer thread.
+ ******************************************************************************/
+void log_stop(void)
+{
+	uint64_t one = 1;
+	uint64_t dropped;
+
+	if (!__atomic_load_n(&running, __ATOMIC_ACQUIRE)) {
+		return;
+	}
+	// Later records are written directly; the ring is emptied once the thread is gone.
+	__atomic_store_n(&running, 0, __ATOMIC_RELEASE);
+	(void)write(stopFd, &one, sizeof(one));
+	pthread_join(writerThread, NULL);
+	close(stopFd);
+	stopFd = -1;
+	log_drain();
+
+	dropped = log_dropped();
+	if (dropped > 0) {
+		fprintf(stderr, "asynclog: %llu records dropped\n", (unsigned long long)dropped);
+	}
+}
+
+/*******************************************************************************
+ * This method will queue a message for stdout.
+ * @param const char *fmt - This is the printf format.  It also identifies the record.
+ * @return The return will be 0 if successful or -1 if the record was dropped.
+ ******************************************************************************/
+int32_t log_printf(const char *fmt, ...)
+{
+	struct log_record rec;
+	va_list ap;
+
+	rec.stream = LOG_STREAM_OUT;
+	rec.isError = 0;
+	rec.err = 0;
+	rec.fmt = fmt;
+	va_start(ap, fmt);
+	log_capture_args(&rec, fmt, ap);
+	va_end(ap);
+	return log_store(&rec);
+}
+
+/*******************************************************************************
+ * This method will queue a message for stderr in the form perror uses,
+ * "msg: description of errno".  errno is not changed.
+ * @param const char *msg - This is the message.  It must stay valid until log_stop.
+ ******************************************************************************/
+void log_perror(const char *msg)
+{
+	struct log_record rec;
+	int32_t err = errno;
+
+	// The message goes in as an argument so a '%' in it is printed as it is.
+	rec.stream = LOG_STREAM_ERR;
+	rec.isError = 1;
+	rec.err = err;
+	rec.fmt = "%s";
+	rec.argCount = 1;
+	rec.args[0].p = msg;
+	(void)log_store(&rec);
+	errno = err;
+}
+
+/*******************************************************************************
+ * This method will return the number of records dropped because the ring was full.
+ * @return The number of dropped records.
+ ******************************************************************************/
+uint64_t log_dropped(void)
+{
+	return __atomic_load_n(&ring.dropped, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,56 @@
+/*********************************************************************
+ * This module takes console output off the time-critical paths.  Callers
+ * store a fixed-size binary record (the format string plus its arguments)
+ * into a lock-free ring, which takes no system call and never blocks; a
+ * background thread formats the records and writes them in batches with
+ * writev.  When the ring is full the record is dropped and counted.
+ *
+ * Any thread may log.  Formats take the usual printf conversions with at
+ * most LOG_MAX_ARGS arguments (no '*' widths).  Since a record is formatted
+ * later, strings passed for %s must stay valid until log_stop, for example
+ * string literals.  If the writer thread is not running, records are
+ * formatted and written at once, so library code may always log.
+ */
+#ifndef ASYNCLOG_H
+#define ASYNCLOG_H
+
+#include <stdint.h>
+
+#define LOG_RING_SIZE (256)	// Must be a power of two
+#define LOG_MAX_ARGS (6)
+#define LOG_LINE_MAX (256)	// Longer messages are truncated
+
+/*******************************************************************************
+ * This method will start the writer thread.  From then on records are
+ * written in the background.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t log_start(void);
+
+/*******************************************************************************
+ * This method will write every waiting record, report any dropped records on
+ * stderr and stop the writer thread.
+ ******************************************************************************/
+void log_stop(void);
+
+/*******************************************************************************
+ * This method will queue a message for stdout.
+ * @param const char *fmt - This is the printf format.  It also identifies the record.
+ * @return The return will be 0 if successful or -1 if the record was dropped.
+ ******************************************************************************/
+int32_t log_printf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+/*******************************************************************************
+ * This method will queue a message for stderr in the form perror uses,
+ * "msg: description of errno".  errno is not changed.
+ * @param const char *msg - This is the message.  It must stay valid until log_stop.
+ ******************************************************************************/
+void log_perror(const char *msg);
+
+/*******************************************************************************
+ * This method will return the number of records dropped because the ring was full.
+ * @return The number of dropped records.
+ ******************************************************************************/
+uint64_t log_dropped(void);
+
+#endif
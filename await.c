@@ -0,0 +1,250 @@
+/*********************************************************************
+ * This module runs many waiting tasks on one event loop.  See await.h.
+ */
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include "gpioInterface.h"
+#include "await.h"
+
+/*******************************************************************************
+ * This method sets up a wait for an edge on one pin.
+ * @param struct await_task *task - This is the waiting task.
+ * @param uint32_t pin - This is the pin.
+ * @param uint32_t edge - This is GPIO_RISING_EDGE, GPIO_FALLING_EDGE or GPIO_BOTH_EDGES.
+ * @param int32_t timeoutMs - This is the longest wait, or negative for no limit.
+ ******************************************************************************/
+void await_on_edge(struct await_task *task, uint32_t pin, uint32_t edge, int32_t timeoutMs)
+{
+	task->waits[0].pin = pin;
+	task->waits[0].edge = edge;
+	task->waitCount = 1;
+	task->deadline = (timeoutMs < 0) ? AWAIT_NEVER :
+		timens_add(timens_now(CLOCK_MONOTONIC), timens_from_ms(timeoutMs));
+}
+
+/*******************************************************************************
+ * This method sets up a wait for the first of several edges or a deadline.
+ * @param struct await_task *task - This is the waiting task.
+ * @param const struct await_edge_wait *waits - These are the edges.  Only the
+ *        first AWAIT_MAX_ANY are used.
+ * @param uint32_t count - This is the number of edges, which may be 0.
+ * @param timens_t when - This is the CLOCK_MONOTONIC deadline, or AWAIT_NEVER.
+ ******************************************************************************/
+void await_on_any(struct await_task *task, const struct await_edge_wait *waits, uint32_t count, timens_t when)
+{
+	task->waitCount = (count < AWAIT_MAX_ANY) ? count : AWAIT_MAX_ANY;
+	if (task->waitCount > 0) {
+		memcpy(task->waits, waits, task->waitCount * sizeof(waits[0]));
+	}
+	task->deadline = when;
+}
+
+/*******************************************************************************
+ * This method will set the timer for the earliest deadline of any task.
+ * @param struct await_scheduler *sched - This is the scheduler.
+ ******************************************************************************/
+static void await_rearm(struct await_scheduler *sched)
+{
+	struct itimerspec spec;
+	timens_t earliest = AWAIT_NEVER;
+	uint32_t index;
+
+	for (index = 0; index < sched->taskCount; index++) {
+		if ((sched->tasks[index]->body != NULL) && (sched->tasks[index]->deadline < earliest)) {
+			earliest = sched->tasks[index]->deadline;
+		}
+	}
+	if (earliest == sched->armedFor) {
+		return;
+	}
+
+	// A zero it_value disarms the timer.
+	memset(&spec, 0, sizeof(spec));
+	if (earliest != AWAIT_NEVER) {
+		timens_to_timespec((earliest > 0) ? earliest : 1, &spec.it_value);
+	}
+	(void)timerfd_settime(sched->timerFd, TFD_TIMER_ABSTIME, &spec, NULL);
+	sched->armedFor = earliest;
+}
+
+/*******************************************************************************
+ * This method will drop finished tasks, once no dispatch is walking the list.
+ * @param struct await_scheduler *sched - This is the scheduler.
+ ******************************************************************************/
+static void await_reap(struct await_scheduler *sched)
+{
+	uint32_t index, kept = 0;
+
+	if (sched->depth > 0) {
+		return;
+	}
+	for (index = 0; index < sched->taskCount; index++) {
+		if (sched->tasks[index]->body != NULL) {
+			sched->tasks[kept++] = sched->tasks[index];
+		}
+	}
+	sched->taskCount = kept;
+}
+
+/*******************************************************************************
+ * This method will run a task up to its next wait or its end.
+ * @param struct await_task *task - This is the task.
+ * @param uint32_t woken - This is why it is resumed (AWAIT_WOKE_...).
+ ******************************************************************************/
+static void await_resume(struct await_task *task, uint32_t woken)
+{
+	task->woken = woken;
+	if (task->body(task) == AWAIT_DONE) {
+		task->body = NULL;
+	}
+}
+
+/*******************************************************************************
+ * This method is called by the event loop when the earliest deadline passes.
+ * It will resume every task whose deadline has passed.
+ * @param int32_t fd - This is the timer.
+ * @param uint32_t events - This is the set of epoll events that occurred.
+ * @param void *ctx - This is the scheduler.
+ ******************************************************************************/
+static void await_timer(int32_t fd, uint32_t events, void *ctx)
+{
+	struct await_scheduler *sched = (struct await_scheduler*)ctx;
+	struct await_task *task;
+	uint64_t expirations;
+	uint32_t index, count = sched->taskCount;
+	timens_t now;
+
+	(void)read(fd, &expirations, sizeof(expirations));
+	sched->armedFor = AWAIT_NEVER;	// A single-shot timer is disarmed once it fires
+	now = timens_now(CLOCK_MONOTONIC);
+
+	// Tasks started from here are added past count and have already run.
+	sched->depth++;
+	for (index = 0; index < count; index++) {
+		task = sched->tasks[index];
+		if ((task->body != NULL) && (task->deadline <= now)) {
+			await_resume(task, AWAIT_WOKE_TIMEOUT);
+		}
+	}
+	sched->depth--;
+	await_reap(sched);
+	await_rearm(sched);
+}
+
+/*******************************************************************************
+ * This method will initialize a scheduler and register its timer with a loop.
+ * @param struct await_scheduler *sched - This is the scheduler that is to be initialized.
+ * @param struct event_loop *loop - This is the loop on which the tasks run.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t await_init(struct await_scheduler *sched, struct event_loop *loop)
+{
+	memset(sched, 0, sizeof(*sched));
+	sched->loop = loop;
+	sched->armedFor = AWAIT_NEVER;
+	sched->timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (sched->timerFd < 0) {
+		return -1;
+	}
+	if (event_loop_add_fd(loop, sched->timerFd, EPOLLIN, await_timer, sched) < 0) {
+		close(sched->timerFd);
+		sched->timerFd = -1;
+		return -1;
+	}
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will remove the scheduler's timer from its loop.
+ * @param struct await_scheduler *sched - This is the scheduler.
+ ******************************************************************************/
+void await_close(struct await_scheduler *sched)
+{
+	if (sched->timerFd >= 0) {
+		(void)event_loop_remove_fd(sched->loop, sched->timerFd);
+		close(sched->timerFd);
+		sched->timerFd = -1;
+	}
+	sched->taskCount = 0;
+}
+
+/*******************************************************************************
+ * This method will start a task.  It runs at once, up to its first wait.
+ * @param struct await_scheduler *sched - This is the scheduler.
+ * @param struct await_task *task - This is the task.
+ * @param await_fn body - This is the function of the task.
+ * @param void *ctx - This is the state of the task.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t await_spawn(struct await_scheduler *sched, struct await_task *task, await_fn body, void *ctx)
+{
+	if (sched->taskCount >= AWAIT_MAX_TASKS) {
+		errno = ENOSPC;
+		return -1;
+	}
+	memset(task, 0, sizeof(*task));
+	task->body = body;
+	task->ctx = ctx;
+	task->deadline = AWAIT_NEVER;
+	sched->tasks[sched->taskCount++] = task;
+
+	await_resume(task, AWAIT_WOKE_START);
+	await_reap(sched);
+	await_rearm(sched);
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will resume every task waiting for an edge like this one.
+ * @param const struct gpio_edge_event *event - This is the edge.
+ * @param void *ctx - This is the scheduler.
+ ******************************************************************************/
+void await_dispatch_edge(const struct gpio_edge_event *event, void *ctx)
+{
+	struct await_scheduler *sched = (struct await_scheduler*)ctx;
+	struct await_task *task;
+	uint32_t index, wait, count = sched->taskCount;
+	uint32_t edge = event->value ? GPIO_RISING_EDGE : GPIO_FALLING_EDGE;
+
+	sched->depth++;
+	for (index = 0; index < count; index++) {
+		task = sched->tasks[index];
+		if (task->body == NULL) {
+			continue;
+		}
+		for (wait = 0; wait < task->waitCount; wait++) {
+			if ((task->waits[wait].pin == event->pin) && (task->waits[wait].edge & edge)) {
+				break;
+			}
+		}
+		if (wait < task->waitCount) {
+			task->fired = wait;
+			task->edge = *event;
+			await_resume(task, AWAIT_WOKE_EDGE);
+		}
+	}
+	sched->depth--;
+	await_reap(sched);
+	await_rearm(sched);
+}
+
+/*******************************************************************************
+ * This method will return the number of tasks which have not finished.
+ * @param struct await_scheduler *sched - This is the scheduler.
+ * @return The number of tasks.
+ ******************************************************************************/
+uint32_t await_running(struct await_scheduler *sched)
+{
+	uint32_t index, running = 0;
+
+	for (index = 0; index < sched->taskCount; index++) {
+		if (sched->tasks[index]->body != NULL) {
+			running++;
+		}
+	}
+	return running;
+}
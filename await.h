@@ -0,0 +1,138 @@
+/*********************************************************************
+ * This module runs many waiting tasks on one event loop, so that a flow
+ * such as "wait for a press or two seconds, then blink the LED" can be
+ * written as straight-line code rather than as another state machine.
+ *
+ * Tasks are stackless coroutines.  A task is a function which starts with
+ * AWAIT_BEGIN, ends with AWAIT_END and may wait with await_edge,
+ * await_sleep_until or await_any anywhere in between.  A wait returns
+ * from the function; when the edge arrives or the deadline passes the
+ * function is called again and continues after the wait.  Since the
+ * function really returns:
+ *   - local variables do not keep their values across a wait; keep state
+ *     in the task's context instead,
+ *   - no two waits may be on the same line, and
+ *   - a wait may not be inside a switch statement of the task.
+ *
+ * A task costs the size of struct await_task and no thread or stack of its
+ * own.  Edges reach the tasks through await_dispatch_edge, which has the
+ * signature of an edge_capture_cb so that it can follow the capture queue
+ * or the debounce filter.  Deadlines are on CLOCK_MONOTONIC and share one
+ * absolute timerfd, armed for the earliest of them.
+ */
+#ifndef AWAIT_H
+#define AWAIT_H
+
+#include <stdint.h>
+#include "edgeQueue.h"
+#include "eventLoop.h"
+#include "timeutil.h"
+
+#define AWAIT_MAX_TASKS (64)
+#define AWAIT_MAX_ANY (8)		// Edges a single await_any can wait for
+#define AWAIT_NEVER (INT64_MAX)	// A deadline which never passes
+
+// Returned by a task function.
+#define AWAIT_WAITING (0)
+#define AWAIT_DONE (1)
+
+// Why a task was last resumed, in await_task.woken.
+#define AWAIT_WOKE_START (0)
+#define AWAIT_WOKE_EDGE (1)
+#define AWAIT_WOKE_TIMEOUT (2)
+
+struct await_task;
+
+// The body of a task.  It returns AWAIT_WAITING from a wait and AWAIT_DONE at the end.
+typedef int32_t (*await_fn)(struct await_task *task);
+
+// One edge which ends a wait.  edge is GPIO_RISING_EDGE, GPIO_FALLING_EDGE or GPIO_BOTH_EDGES.
+struct await_edge_wait {
+	uint32_t pin;
+	uint32_t edge;
+};
+
+struct await_task {
+	await_fn body;		// NULL once the task has finished
+	void *ctx;
+	uint32_t resumeAt;	// The line to continue from, 0 at the start
+	uint32_t waitCount;
+	struct await_edge_wait waits[AWAIT_MAX_ANY];
+	timens_t deadline;
+	// Set before the task is resumed.
+	uint32_t woken;
+	uint32_t fired;		// The index in waits of the edge which ended the wait
+	struct gpio_edge_event edge;	// That edge
+};
+
+struct await_scheduler {
+	struct event_loop *loop;
+	int32_t timerFd;
+	timens_t armedFor;	// The deadline the timer is set for, or AWAIT_NEVER
+	uint32_t depth;		// Dispatches in progress; tasks are only removed at 0
+	uint32_t taskCount;
+	struct await_task *tasks[AWAIT_MAX_TASKS];
+};
+
+#define AWAIT_BEGIN(task) switch ((task)->resumeAt) { case 0:
+#define AWAIT_END(task) } return AWAIT_DONE
+#define AWAIT_SUSPEND(task) do { (task)->resumeAt = __LINE__; return AWAIT_WAITING; case __LINE__:; } while (0)
+
+// Wait for an edge on one pin, or timeoutMs (negative for no limit).
+#define await_edge(task, pin, edge, timeoutMs) \
+	do { await_on_edge((task), (pin), (edge), (timeoutMs)); AWAIT_SUSPEND(task); } while (0)
+// Wait until a CLOCK_MONOTONIC time.
+#define await_sleep_until(task, when) \
+	do { await_on_any((task), NULL, 0, (when)); AWAIT_SUSPEND(task); } while (0)
+// Wait for the first of several edges, or a CLOCK_MONOTONIC deadline (AWAIT_NEVER for none).
+#define await_any(task, waits, count, when) \
+	do { await_on_any((task), (waits), (count), (when)); AWAIT_SUSPEND(task); } while (0)
+
+/*******************************************************************************
+ * This method will initialize a scheduler and register its timer with a loop.
+ * @param struct await_scheduler *sched - This is the scheduler that is to be initialized.
+ * @param struct event_loop *loop - This is the loop on which the tasks run.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t await_init(struct await_scheduler *sched, struct event_loop *loop);
+
+/*******************************************************************************
+ * This method will remove the scheduler's timer from its loop.  Unfinished
+ * tasks are abandoned.
+ * @param struct await_scheduler *sched - This is the scheduler.
+ ******************************************************************************/
+void await_close(struct await_scheduler *sched);
+
+/*******************************************************************************
+ * This method will start a task.  It runs at once, up to its first wait.
+ * @param struct await_scheduler *sched - This is the scheduler.
+ * @param struct await_task *task - This is the task.  It must stay valid until
+ *        it has finished or the scheduler is closed.
+ * @param await_fn body - This is the function of the task.
+ * @param void *ctx - This is the state of the task, available as task->ctx.
+ * @return The return will be 0 if successful or a negative number if there are
+ *         already AWAIT_MAX_TASKS tasks.
+ ******************************************************************************/
+int32_t await_spawn(struct await_scheduler *sched, struct await_task *task, await_fn body, void *ctx);
+
+/*******************************************************************************
+ * This method will resume every task waiting for an edge like this one.
+ * @param const struct gpio_edge_event *event - This is the edge.
+ * @param void *ctx - This is the scheduler.
+ ******************************************************************************/
+void await_dispatch_edge(const struct gpio_edge_event *event, void *ctx);
+
+/*******************************************************************************
+ * This method will return the number of tasks which have not finished.
+ * @param struct await_scheduler *sched - This is the scheduler.
+ * @return The number of tasks.
+ ******************************************************************************/
+uint32_t await_running(struct await_scheduler *sched);
+
+/*******************************************************************************
+ * These methods set up the wait of the await_ macros.  They are not called directly.
+ ******************************************************************************/
+void await_on_edge(struct await_task *task, uint32_t pin, uint32_t edge, int32_t timeoutMs);
+void await_on_any(struct await_task *task, const struct await_edge_wait *waits, uint32_t count, timens_t when);
+
+#endif
@@ -0,0 +1,222 @@
+/*********************************************************************
+ * This module filters switch bounce out of the stream of captured edges.
+ * Decisions are made from the event timestamps, never by sleeping, and
+ * every suppressed edge is counted.
+ */
+#include <errno.h>
+#include <stdint.h>
+#include "edgeCapture.h"
+#include "timeutil.h"
+#include "debounce.h"
+
+/*******************************************************************************
+ * This method will find the filter state of a pin.
+ * @param struct debounce_filter *filter - This is the filter.
+ * @param uint32_t gpio - This is the pin.
+ * @return The state, or NULL if the pin is not filtered.
+ ******************************************************************************/
+static struct debounce_pin* debounce_find(struct debounce_filter *filter, uint32_t gpio)
+{
+	uint32_t index;
+
+	for (index = 0; index < filter->pinCount; index++) {
+		if (filter->pins[index].pin == gpio) {
+			return &filter->pins[index];
+		}
+	}
+	return NULL;
+}
+
+/*******************************************************************************
+ * This method will pass an edge on and make its level the reported one.
+ * @param struct debounce_filter *filter - This is the filter.
+ * @param struct debounce_pin *state - This is the state of the edge's pin.
+ * @param const struct gpio_edge_event *event - This is the edge.
+ ******************************************************************************/
+static void debounce_pass(struct debounce_filter *filter, struct debounce_pin *state,
+	const struct gpio_edge_event *event)
+{
+	state->level = event->value;
+	state->lastPassed = timens_from_timespec(&event->timestamp);
+	state->pending = 0;
+	state->passed++;
+	filter->next(event, filter->ctx);
+}
+
+/*******************************************************************************
+ * This method will initialize a filter without any pins.  Edges of pins which
+ * are never added are passed on unfiltered.
+ * @param struct debounce_filter *filter - This is the filter that is to be initialized.
+ * @param edge_capture_cb next - This is the callback which receives the edges that pass.
+ * @param void *ctx - This is passed to next.
+ ******************************************************************************/
+void debounce_init(struct debounce_filter *filter, edge_capture_cb next, void *ctx)
+{
+	filter->next = next;
+	filter->ctx = ctx;
+	filter->pinCount = 0;
+}
+
+/*******************************************************************************
+ * This method will set how the edges of a pin are filtered.
+ * @param struct debounce_filter *filter - This is the filter.
+ * @param uint32_t gpio - This is the pin.
+ * @param uint32_t mode - This is DEBOUNCE_NONE, DEBOUNCE_WINDOW or DEBOUNCE_CONSECUTIVE.
+ * @param uint32_t param - This is the window in microseconds for DEBOUNCE_WINDOW,
+ *                         or the number of events for DEBOUNCE_CONSECUTIVE.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t debounce_add_pin(struct debounce_filter *filter, uint32_t gpio, uint32_t mode, uint32_t param)
+{
+	struct debounce_pin *state = debounce_find(filter, gpio);
+
+	if ((mode > DEBOUNCE_CONSECUTIVE) || ((mode == DEBOUNCE_CONSECUTIVE) && (param == 0))) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (state == NULL) {
+		if (filter->pinCount == DEBOUNCE_MAX_PINS) {
+			errno = ENOSPC;
+			return -1;
+		}
+		state = &filter->pins[filter->pinCount++];
+		state->pin = gpio;
+		state->passed = 0;
+		state->suppressed = 0;
+	}
+
+	state->mode = mode;
+	state->window = (mode == DEBOUNCE_WINDOW) ? timens_from_us(param) : 0;
+	state->required = (mode == DEBOUNCE_CONSECUTIVE) ? param : 1;
+	state->level = DEBOUNCE_LEVEL_UNKNOWN;
+	state->candidate = DEBOUNCE_LEVEL_UNKNOWN;
+	state->seen = 0;
+	state->lastPassed = TIMENS_MIN;
+	state->pending = 0;
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will filter one edge, passing it to the next callback if it
+ * survives.  It has the edge_capture_cb signature so that it can be given
+ * directly to edge_capture_drain.
+ * @param const struct gpio_edge_event *event - This is the edge.
+ * @param void *ctx - This is the filter.
+ ******************************************************************************/
+void debounce_process(const struct gpio_edge_event *event, void *ctx)
+{
+	struct debounce_filter *filter = (struct debounce_filter*)ctx;
+	struct debounce_pin *state = debounce_find(filter, event->pin);
+	timens_t now;
+	uint32_t pass;
+
+	if ((state == NULL) || (state->mode == DEBOUNCE_NONE)) {
+		filter->next(event, filter->ctx);
+		return;
+	}
+
+	now = timens_from_timespec(&event->timestamp);
+	if (state->mode == DEBOUNCE_WINDOW) {
+		// The last edge held back by an earlier window is the level the pin settled at.
+		if (state->pending && (timens_sub(now, state->lastPassed) >= state->window)) {
+			state->suppressed--;
+			debounce_pass(filter, state, &state->latest);
+		}
+		// Inside the window everything is bounce.  After it, only a real change counts.
+		pass = (event->value != state->level) &&
+			(timens_sub(now, state->lastPassed) >= state->window);
+	} else {
+		if (event->value == state->candidate) {
+			state->seen++;
+		} else {
+			state->candidate = event->value;
+			state->seen = 1;
+		}
+		pass = (event->value != state->level) && (state->seen >= state->required);
+	}
+
+	if (!pass) {
+		state->suppressed++;
+		if (state->mode == DEBOUNCE_WINDOW) {
+			state->latest = *event;
+			state->pending = (event->value != state->level);
+		}
+		return;
+	}
+	debounce_pass(filter, state, event);
+}
+
+/*******************************************************************************
+ * This method will return how long until the earliest edge held back by a
+ * DEBOUNCE_WINDOW pin is due to be passed.  Each pin is measured against the
+ * clock of its own edges.
+ * @param struct debounce_filter *filter - This is the filter.
+ * @return The time remaining, 0 if an edge is already due, or -1 if none is held back.
+ ******************************************************************************/
+timens_t debounce_pending(struct debounce_filter *filter)
+{
+	timens_t earliest = -1;
+	timens_t remaining;
+	uint32_t index;
+
+	for (index = 0; index < filter->pinCount; index++) {
+		struct debounce_pin *state = &filter->pins[index];
+
+		if (!state->pending) {
+			continue;
+		}
+		remaining = timens_sub(timens_add(state->lastPassed, state->window), timens_now(state->latest.clock));
+		if (remaining < 0) {
+			remaining = 0;
+		}
+		if ((earliest < 0) || (remaining < earliest)) {
+			earliest = remaining;
+		}
+	}
+	return earliest;
+}
+
+/*******************************************************************************
+ * This method will pass on every held back edge whose window has ended.  The
+ * edges keep their own timestamps.
+ * @param struct debounce_filter *filter - This is the filter.
+ * @return The number of edges passed.
+ ******************************************************************************/
+uint32_t debounce_expire(struct debounce_filter *filter)
+{
+	uint32_t index;
+	uint32_t count = 0;
+
+	for (index = 0; index < filter->pinCount; index++) {
+		struct debounce_pin *state = &filter->pins[index];
+
+		if (state->pending &&
+			(timens_sub(timens_now(state->latest.clock), state->lastPassed) >= state->window)) {
+			state->suppressed--;
+			debounce_pass(filter, state, &state->latest);
+			count++;
+		}
+	}
+	return count;
+}
+
+/*******************************************************************************
+ * This method will return the counts of passed and suppressed edges of a pin.
+ * @param struct debounce_filter *filter - This is the filter.
+ * @param uint32_t gpio - This is the pin.
+ * @param uint64_t *passed - This is where the passed count is placed.
+ * @param uint64_t *suppressed - This is where the suppressed count is placed.
+ * @return The return will be 0 if successful or a negative number if the pin is not filtered.
+ ******************************************************************************/
+int32_t debounce_get_counts(struct debounce_filter *filter, uint32_t gpio, uint64_t *passed, uint64_t *suppressed)
+{
+	struct debounce_pin *state = debounce_find(filter, gpio);
+
+	if (state == NULL) {
+		errno = ENOENT;
+		return -1;
+	}
+	*passed = state->passed;
+	*suppressed = state->suppressed;
+	return 0;
+}
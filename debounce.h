@@ -0,0 +1,112 @@
+/*********************************************************************
+ * This module filters switch bounce out of the stream of captured edges.
+ * It sits between edge_capture_drain and the application callback: the
+ * filter is itself an edge_capture_cb, and passes on only the edges which
+ * survive it.  Decisions are made from the event timestamps, never by
+ * sleeping, and every suppressed edge is counted.
+ *
+ * Two modes are available per pin:
+ *  - DEBOUNCE_WINDOW passes a change of level at once and then ignores the
+ *    pin for a window, so the first edge of a press is reported with no
+ *    added latency.  If the last edge inside the window left the pin at
+ *    another level, for example a tap released within the window, that
+ *    edge is passed once the window ends: ahead of the next edge, if one
+ *    comes after the window, or else when the caller, having waited for
+ *    debounce_pending, calls debounce_expire.
+ *  - DEBOUNCE_CONSECUTIVE passes a change of level only once N events in a
+ *    row have reported the new level.  This suits backends which report
+ *    the sampled level (sysfs) rather than strictly alternating edges, and
+ *    needs no timer, but a level reported fewer than N times is never passed.
+ */
+#ifndef DEBOUNCE_H
+#define DEBOUNCE_H
+
+#include <stdint.h>
+#include "edgeCapture.h"
+#include "timeutil.h"
+
+#define DEBOUNCE_MAX_PINS (EDGE_CAPTURE_MAX_PINS)
+#define DEBOUNCE_LEVEL_UNKNOWN (2)	// Neither 0 nor 1, so the first event always passes
+
+#define DEBOUNCE_NONE (0)
+#define DEBOUNCE_WINDOW (1)
+#define DEBOUNCE_CONSECUTIVE (2)
+
+struct debounce_pin {
+	uint32_t pin;
+	uint32_t mode;
+	timens_t window;	// DEBOUNCE_WINDOW: the lockout after a passed edge
+	uint32_t required;	// DEBOUNCE_CONSECUTIVE: events needed to accept a level
+	uint32_t level;		// The last level passed on
+	uint32_t candidate;	// DEBOUNCE_CONSECUTIVE: the level being counted
+	uint32_t seen;		// DEBOUNCE_CONSECUTIVE: events in a row reporting candidate
+	timens_t lastPassed;
+	uint32_t pending;	// DEBOUNCE_WINDOW: latest disagrees with level and is still to be passed
+	struct gpio_edge_event latest;	// DEBOUNCE_WINDOW: the last edge suppressed
+	uint64_t passed;
+	uint64_t suppressed;
+};
+
+struct debounce_filter {
+	edge_capture_cb next;	// Receives the edges that pass
+	void *ctx;
+	uint32_t pinCount;
+	struct debounce_pin pins[DEBOUNCE_MAX_PINS];
+};
+
+/*******************************************************************************
+ * This method will initialize a filter without any pins.  Edges of pins which
+ * are never added are passed on unfiltered.
+ * @param struct debounce_filter *filter - This is the filter that is to be initialized.
+ * @param edge_capture_cb next - This is the callback which receives the edges that pass.
+ * @param void *ctx - This is passed to next.
+ ******************************************************************************/
+void debounce_init(struct debounce_filter *filter, edge_capture_cb next, void *ctx);
+
+/*******************************************************************************
+ * This method will set how the edges of a pin are filtered.
+ * @param struct debounce_filter *filter - This is the filter.
+ * @param uint32_t gpio - This is the pin.
+ * @param uint32_t mode - This is DEBOUNCE_NONE, DEBOUNCE_WINDOW or DEBOUNCE_CONSECUTIVE.
+ * @param uint32_t param - This is the window in microseconds for DEBOUNCE_WINDOW,
+ *                         or the number of events for DEBOUNCE_CONSECUTIVE.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t debounce_add_pin(struct debounce_filter *filter, uint32_t gpio, uint32_t mode, uint32_t param);
+
+/*******************************************************************************
+ * This method will filter one edge, passing it to the next callback if it
+ * survives.  It has the edge_capture_cb signature so that it can be given
+ * directly to edge_capture_drain.
+ * @param const struct gpio_edge_event *event - This is the edge.
+ * @param void *ctx - This is the filter.
+ ******************************************************************************/
+void debounce_process(const struct gpio_edge_event *event, void *ctx);
+
+/*******************************************************************************
+ * This method will return how long until the earliest edge held back by a
+ * DEBOUNCE_WINDOW pin is due to be passed.
+ * @param struct debounce_filter *filter - This is the filter.
+ * @return The time remaining, 0 if an edge is already due, or -1 if none is held back.
+ ******************************************************************************/
+timens_t debounce_pending(struct debounce_filter *filter);
+
+/*******************************************************************************
+ * This method will pass on every held back edge whose window has ended.  The
+ * edges keep their own timestamps.
+ * @param struct debounce_filter *filter - This is the filter.
+ * @return The number of edges passed.
+ ******************************************************************************/
+uint32_t debounce_expire(struct debounce_filter *filter);
+
+/*******************************************************************************
+ * This method will return the counts of passed and suppressed edges of a pin.
+ * @param struct debounce_filter *filter - This is the filter.
+ * @param uint32_t gpio - This is the pin.
+ * @param uint64_t *passed - This is where the passed count is placed.
+ * @param uint64_t *suppressed - This is where the suppressed count is placed.
+ * @return The return will be 0 if successful or a negative number if the pin is not filtered.
+ ******************************************************************************/
+int32_t debounce_get_counts(struct debounce_filter *filter, uint32_t gpio, uint64_t *passed, uint64_t *suppressed);
+
+#endif
@@ -0,0 +1,269 @@
+/*********************************************************************
+ * This program checks the debounce filter by feeding it sequences of
+ * timestamped edges and comparing the edges it passes on with the edges
+ * expected, in each mode.  The exit status is 0 if every check passed.
+ *   make -f makefile.bb CC=gcc check
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "timeutil.h"
+#include "debounce.h"
+
+#define TEST_PIN (60)
+#define WINDOW_US (20000)
+#define REQUIRED (3)
+#define MAX_EDGES (16)
+#define LONG_AGO_MS (10000)	// A base time every window in these sequences has ended by
+
+// One edge of a sequence: its time after the start of the sequence, and its level.
+struct test_edge {
+	int64_t us;
+	uint32_t value;
+};
+
+// The edges the filter has passed on.
+struct test_sink {
+	uint32_t count;
+	struct test_edge edges[MAX_EDGES];
+	timens_t base;
+};
+
+static uint32_t failures;
+static uint32_t checks;
+
+/*******************************************************************************
+ * This method will record one edge passed by the filter.
+ * @param const struct gpio_edge_event *event - This is the edge.
+ * @param void *ctx - This is the sink.
+ ******************************************************************************/
+static void record_edge(const struct gpio_edge_event *event, void *ctx)
+{
+	struct test_sink *sink = (struct test_sink*)ctx;
+
+	if (sink->count < MAX_EDGES) {
+		sink->edges[sink->count].us = timens_to_us(timens_sub(timens_from_timespec(&event->timestamp), sink->base));
+		sink->edges[sink->count].value = event->value;
+	}
+	sink->count++;
+}
+
+/*******************************************************************************
+ * This method will record the result of one check, and print it if it failed.
+ * @param int ok - This is nonzero if the check passed.
+ * @param const char *name - This is the name of the sequence.
+ * @param const char *what - This is what was checked.
+ ******************************************************************************/
+static void expect(int ok, const char *name, const char *what)
+{
+	checks++;
+	if (!ok) {
+		failures++;
+		printf("FAIL %s: %s\n", name, what);
+	}
+}
+
+/*******************************************************************************
+ * This method will set up a filter with one pin and a sink starting at base.
+ * @param struct debounce_filter *filter - This is the filter.
+ * @param struct test_sink *sink - This is the sink.
+ * @param uint32_t mode - This is the mode of the pin.
+ * @param uint32_t param - This is the window or the number of events.
+ * @param timens_t base - This is the time of the start of the sequence.
+ ******************************************************************************/
+static void start(struct debounce_filter *filter, struct test_sink *sink, uint32_t mode, uint32_t param, timens_t base)
+{
+	memset(sink, 0, sizeof(*sink));
+	sink->base = base;
+	debounce_init(filter, record_edge, sink);
+	(void)debounce_add_pin(filter, TEST_PIN, mode, param);
+}
+
+/*******************************************************************************
+ * This method will feed a sequence of edges to the filter.
+ * @param struct debounce_filter *filter - This is the filter.
+ * @param struct test_sink *sink - This is the sink, which holds the base time.
+ * @param const struct test_edge *edges - This is the sequence.
+ * @param uint32_t count - This is the number of edges in the sequence.
+ ******************************************************************************/
+static void feed(struct debounce_filter *filter, struct test_sink *sink, const struct test_edge *edges, uint32_t count)
+{
+	struct gpio_edge_event event;
+	uint32_t index;
+
+	memset(&event, 0, sizeof(event));
+	event.pin = TEST_PIN;
+	event.clock = CLOCK_MONOTONIC;
+	for (index = 0; index < count; index++) {
+		event.value = edges[index].value;
+		event.seqno++;
+		timens_to_timespec(timens_add(sink->base, timens_from_us(edges[index].us)), &event.timestamp);
+		debounce_process(&event, filter);
+	}
+}
+
+/*******************************************************************************
+ * This method will compare the edges passed with the edges expected.
+ * @param struct test_sink *sink - This is the sink.
+ * @param const char *name - This is the name of the sequence.
+ * @param const struct test_edge *edges - This is what is expected.
+ * @param uint32_t count - This is the number of edges expected.
+ ******************************************************************************/
+static void expect_passed(struct test_sink *sink, const char *name, const struct test_edge *edges, uint32_t count)
+{
+	uint32_t index;
+	int ok = (sink->count == count);
+
+	for (index = 0; ok && (index < count); index++) {
+		ok = (sink->edges[index].us == edges[index].us) && (sink->edges[index].value == edges[index].value);
+	}
+	expect(ok, name, "edges passed");
+	if (!ok) {
+		for (index = 0; (index < sink->count) && (index < MAX_EDGES); index++) {
+			printf("  passed %lld us: %u\n", (long long)sink->edges[index].us, sink->edges[index].value);
+		}
+	}
+}
+
+/*******************************************************************************
+ * This method will check that the counts of a pin add up to the edges fed.
+ * @param struct debounce_filter *filter - This is the filter.
+ * @param const char *name - This is the name of the sequence.
+ * @param uint64_t passed - This is the number of edges expected to pass.
+ * @param uint64_t suppressed - This is the number of edges expected to be suppressed.
+ ******************************************************************************/
+static void expect_counts(struct debounce_filter *filter, const char *name, uint64_t passed, uint64_t suppressed)
+{
+	uint64_t actualPassed, actualSuppressed;
+
+	expect((debounce_get_counts(filter, TEST_PIN, &actualPassed, &actualSuppressed) == 0) &&
+		(actualPassed == passed) && (actualSuppressed == suppressed), name, "counts");
+}
+
+#define COUNT(array) (sizeof(array) / sizeof((array)[0]))
+
+/*******************************************************************************
+ * This method will check DEBOUNCE_WINDOW, which passes the first edge at once
+ * and holds back a change made inside the window until the window ends.
+ ******************************************************************************/
+static void check_window(void)
+{
+	static const struct test_edge bouncy[] = { { 0, 1 }, { 1000, 0 }, { 2000, 1 }, { 3000, 0 }, { 4000, 1 },
+		{ 200000, 0 }, { 201000, 1 }, { 202000, 0 } };
+	static const struct test_edge bouncyPassed[] = { { 0, 1 }, { 200000, 0 } };
+	static const struct test_edge tap[] = { { 0, 1 }, { 5000, 0 } };
+	static const struct test_edge tapPressed[] = { { 0, 1 } };
+	static const struct test_edge tapThenPress[] = { { 0, 1 }, { 5000, 0 }, { 100000, 1 } };
+	static const struct test_edge tapThenBounce[] = { { 0, 1 }, { 5000, 0 }, { 22000, 1 } };
+	static const struct test_edge settled[] = { { 0, 1 }, { 1000, 0 }, { 2000, 1 } };
+	struct debounce_filter filter;
+	struct test_sink sink;
+	timens_t longAgo = timens_sub(timens_now(CLOCK_MONOTONIC), timens_from_ms(LONG_AGO_MS));
+	timens_t remaining;
+
+	// A bouncing press and release pass one edge each.
+	start(&filter, &sink, DEBOUNCE_WINDOW, WINDOW_US, longAgo);
+	feed(&filter, &sink, bouncy, COUNT(bouncy));
+	expect_passed(&sink, "window bouncy", bouncyPassed, COUNT(bouncyPassed));
+	expect_counts(&filter, "window bouncy", 2, 6);
+	expect(debounce_pending(&filter) == -1, "window bouncy", "nothing held back");
+
+	// A tap released inside the window is held back, then passed with its own time.
+	start(&filter, &sink, DEBOUNCE_WINDOW, WINDOW_US, longAgo);
+	feed(&filter, &sink, tap, COUNT(tap));
+	expect_passed(&sink, "window tap", tapPressed, COUNT(tapPressed));
+	expect(debounce_pending(&filter) == 0, "window tap", "release due");
+	expect(debounce_expire(&filter) == 1, "window tap", "release expired");
+	expect_passed(&sink, "window tap", tap, COUNT(tap));
+	expect_counts(&filter, "window tap", 2, 0);
+	expect(debounce_pending(&filter) == -1, "window tap", "nothing held back after expiry");
+	expect(debounce_expire(&filter) == 0, "window tap", "nothing expired twice");
+
+	// The same tap happening now is not due until its window ends.
+	start(&filter, &sink, DEBOUNCE_WINDOW, WINDOW_US, timens_now(CLOCK_MONOTONIC));
+	feed(&filter, &sink, tap, COUNT(tap));
+	remaining = debounce_pending(&filter);
+	expect((remaining > 0) && (remaining <= timens_from_us(WINDOW_US)), "window tap now", "release pending");
+	expect(debounce_expire(&filter) == 0, "window tap now", "release not yet expired");
+	expect_passed(&sink, "window tap now", tapPressed, COUNT(tapPressed));
+
+	// An edge after the window passes the held back release ahead of itself.
+	start(&filter, &sink, DEBOUNCE_WINDOW, WINDOW_US, longAgo);
+	feed(&filter, &sink, tapThenPress, COUNT(tapThenPress));
+	expect_passed(&sink, "window tap then press", tapThenPress, COUNT(tapThenPress));
+	expect_counts(&filter, "window tap then press", 3, 0);
+
+	// The released level opens its own window, which holds back the next press.
+	start(&filter, &sink, DEBOUNCE_WINDOW, WINDOW_US, longAgo);
+	feed(&filter, &sink, tapThenBounce, COUNT(tapThenBounce));
+	expect_passed(&sink, "window tap then bounce", tap, COUNT(tap));
+	expect(debounce_expire(&filter) == 1, "window tap then bounce", "press expired");
+	expect_passed(&sink, "window tap then bounce", tapThenBounce, COUNT(tapThenBounce));
+
+	// Bounce which settles back at the reported level holds nothing back.
+	start(&filter, &sink, DEBOUNCE_WINDOW, WINDOW_US, longAgo);
+	feed(&filter, &sink, settled, COUNT(settled));
+	expect_passed(&sink, "window settled", tapPressed, COUNT(tapPressed));
+	expect(debounce_pending(&filter) == -1, "window settled", "nothing held back");
+	expect(debounce_expire(&filter) == 0, "window settled", "nothing expired");
+	expect_counts(&filter, "window settled", 1, 2);
+}
+
+/*******************************************************************************
+ * This method will check DEBOUNCE_CONSECUTIVE, which passes a level once it
+ * has been reported REQUIRED times in a row, whatever the timing.
+ ******************************************************************************/
+static void check_consecutive(void)
+{
+	static const struct test_edge sampled[] = { { 0, 1 }, { 1, 1 }, { 2, 1 }, { 3, 0 }, { 4, 1 },
+		{ 5, 0 }, { 6, 0 }, { 7, 0 }, { 8, 0 } };
+	static const struct test_edge sampledPassed[] = { { 2, 1 }, { 7, 0 } };
+	static const struct test_edge brief[] = { { 0, 1 }, { 1, 1 }, { 2, 0 } };
+	struct debounce_filter filter;
+	struct test_sink sink;
+	timens_t longAgo = timens_sub(timens_now(CLOCK_MONOTONIC), timens_from_ms(LONG_AGO_MS));
+
+	start(&filter, &sink, DEBOUNCE_CONSECUTIVE, REQUIRED, longAgo);
+	feed(&filter, &sink, sampled, COUNT(sampled));
+	expect_passed(&sink, "consecutive sampled", sampledPassed, COUNT(sampledPassed));
+	expect_counts(&filter, "consecutive sampled", 2, 7);
+
+	// Too few reports never pass, and nothing is left for a timer.
+	start(&filter, &sink, DEBOUNCE_CONSECUTIVE, REQUIRED, longAgo);
+	feed(&filter, &sink, brief, COUNT(brief));
+	expect_passed(&sink, "consecutive brief", NULL, 0);
+	expect(debounce_pending(&filter) == -1, "consecutive brief", "nothing held back");
+	expect(debounce_expire(&filter) == 0, "consecutive brief", "nothing expired");
+}
+
+/*******************************************************************************
+ * This method will check that DEBOUNCE_NONE, and pins never added, pass every edge.
+ ******************************************************************************/
+static void check_unfiltered(void)
+{
+	static const struct test_edge bouncy[] = { { 0, 1 }, { 1000, 0 }, { 2000, 1 }, { 3000, 1 } };
+	struct debounce_filter filter;
+	struct test_sink sink;
+	timens_t longAgo = timens_sub(timens_now(CLOCK_MONOTONIC), timens_from_ms(LONG_AGO_MS));
+
+	start(&filter, &sink, DEBOUNCE_NONE, 0, longAgo);
+	feed(&filter, &sink, bouncy, COUNT(bouncy));
+	expect_passed(&sink, "none", bouncy, COUNT(bouncy));
+
+	memset(&sink, 0, sizeof(sink));
+	sink.base = longAgo;
+	debounce_init(&filter, record_edge, &sink);
+	feed(&filter, &sink, bouncy, COUNT(bouncy));
+	expect_passed(&sink, "not added", bouncy, COUNT(bouncy));
+}
+
+int main(int argc, char **argv)
+{
+	check_window();
+	check_consecutive();
+	check_unfiltered();
+
+	printf("debounce: %u checks, %u failed\n", checks, failures);
+	return (failures == 0) ? 0 : 1;
+}
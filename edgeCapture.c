@@ -0,0 +1,241 @@
+/*********************************************************************
+ * This module runs a dedicated edge-capture thread.  The thread polls the
+ * value descriptors of the registered input pins, stamps every edge with
+ * CLOCK_MONOTONIC_RAW as soon as poll() returns (or keeps the kernel's own
+ * timestamp when the backend supplies one), and pushes it into a lock-free
+ * queue.  It never blocks on the consumer, and only logs a descriptor which
+ * fails without an edge, which it then stops watching.
+ *
+ * The consumer is told about new events through an eventfd, which can be
+ * registered with the event loop, and empties the queue with edge_capture_drain.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include "gpioInterface.h"
+#include "edgeQueue.h"
+#include "edgeCapture.h"
+#include "latencyHist.h"
+#include "asyncLog.h"
+
+/*******************************************************************************
+ * This method is the body of the capture thread.
+ * @param void *arg - This is the capture object.
+ * @return Always NULL.
+ ******************************************************************************/
+static void* edge_capture_thread(void *arg)
+{
+	struct edge_capture *capture = (struct edge_capture*)arg;
+	struct pollfd fdset[EDGE_CAPTURE_MAX_PINS + 1];
+	struct gpio_edge_event event;
+	struct gpio_fd_event edge;
+	struct timespec now;
+	uint32_t index, queued;
+	uint64_t one = 1;
+	int32_t rc;
+	short edgeEvents = (short)gpio_fd_events();
+
+	for (index = 0; index < capture->pinCount; index++) {
+		fdset[index].fd = capture->fds[index];
+		fdset[index].events = edgeEvents;
+	}
+	fdset[capture->pinCount].fd = capture->stopFd;
+	fdset[capture->pinCount].events = POLLIN;
+
+	for (;;) {
+		rc = poll(fdset, capture->pinCount + 1, -1);
+		// Take the timestamp before anything else so it is as close to the edge as possible.
+		clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+		LATENCY_STAMP(wakeup, CLOCK_MONOTONIC);
+
+		if (rc < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			break;
+		}
+		if (fdset[capture->pinCount].revents & POLLIN) {
+			break;
+		}
+
+		queued = 0;
+		for (index = 0; index < capture->pinCount; index++) {
+			// A descriptor in error with no edge, such as a line request closed
+			// under it, would make every poll return at once.  It is dropped.
+			if ((fdset[index].revents & (POLLERR | POLLHUP | POLLNVAL)) &&
+				!(fdset[index].revents & edgeEvents)) {
+				log_printf("edgecapture: GPIO %u: poll revents 0x%x without an edge; no longer watched\n",
+					capture->pins[index], (uint32_t)fdset[index].revents);
+				fdset[index].fd = -1;
+				continue;
+			}
+			if ((fdset[index].revents & edgeEvents) &&
+				(gpio_fd_read_event(fdset[index].fd, &edge) == 0)) {
+				LATENCY_STAMP(readDone, CLOCK_MONOTONIC_RAW);
+				LATENCY_RECORD(LATENCY_STAGE_READ, timens_from_timespec(&now), readDone);
+				event.pin = capture->pins[index];
+				event.value = edge.value;
+				event.seqno = edge.seqno;
+				if (edge.timestamp != 0) {
+					// The kernel stamped the edge itself, which is better still.
+					event.clock = CLOCK_MONOTONIC;
+					event.timestamp.tv_sec = edge.timestamp / 1000000000ULL;
+					event.timestamp.tv_nsec = edge.timestamp % 1000000000ULL;
+					LATENCY_RECORD(LATENCY_STAGE_WAKEUP, (timens_t)edge.timestamp, wakeup);
+				} else {
+					event.clock = CLOCK_MONOTONIC_RAW;
+					event.timestamp = now;
+				}
+				if (edge_queue_push(&capture->queue, &event) == 0) {
+					queued++;
+				}
+			}
+		}
+
+		// One wakeup for the whole batch.  The eventfd is non-blocking.
+		if (queued > 0) {
+			(void)write(capture->notifyFd, &one, sizeof(one));
+		}
+	}
+	return NULL;
+}
+
+/*******************************************************************************
+ * This method will initialize an edge capture object.
+ * @param struct edge_capture *capture - This is the object that is to be initialized.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t edge_capture_init(struct edge_capture *capture)
+{
+	edge_queue_init(&capture->queue);
+	capture->pinCount = 0;
+
+	capture->notifyFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	capture->stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if ((capture->notifyFd < 0) || (capture->stopFd < 0)) {
+		log_perror("edgecapture/init");
+		if (capture->notifyFd >= 0) {
+			close(capture->notifyFd);
+		}
+		if (capture->stopFd >= 0) {
+			close(capture->stopFd);
+		}
+		return -1;
+	}
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will add a pin to be watched.  Pins must be added before the
+ * capture thread is started.
+ * @param struct edge_capture *capture - This is the capture object.
+ * @param uint32_t gpio - This is the pin.
+ * @param int32_t fd - This is the descriptor returned by gpio_fd_open for the pin.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t edge_capture_add_pin(struct edge_capture *capture, uint32_t gpio, int32_t fd)
+{
+	if (capture->pinCount == EDGE_CAPTURE_MAX_PINS) {
+		errno = ENOSPC;
+		return -1;
+	}
+	capture->pins[capture->pinCount] = gpio;
+	capture->fds[capture->pinCount] = fd;
+	capture->pinCount++;
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will start the capture thread.
+ * @param struct edge_capture *capture - This is the capture object.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t edge_capture_start(struct edge_capture *capture)
+{
+	int32_t rc;
+
+	rc = pthread_create(&capture->thread, NULL, edge_capture_thread, capture);
+	if (rc != 0) {
+		errno = rc;
+		log_perror("edgecapture/start");
+		return -1;
+	}
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will stop and join the capture thread and release the object's
+ * descriptors.  The pin descriptors are not closed.
+ * @param struct edge_capture *capture - This is the capture object.
+ ******************************************************************************/
+void edge_capture_stop(struct edge_capture *capture)
+{
+	uint64_t one = 1;
+
+	(void)write(capture->stopFd, &one, sizeof(one));
+	pthread_join(capture->thread, NULL);
+	close(capture->stopFd);
+	close(capture->notifyFd);
+}
+
+/*******************************************************************************
+ * This method will queue an event as if the capture thread had seen it, for
+ * example to replay a recorded trace.  It must only be called from one thread,
+ * and only while the capture thread has no pins to watch.
+ * @param struct edge_capture *capture - This is the capture object.
+ * @param const struct gpio_edge_event *event - This is the event.
+ * @return The return will be 0 if successful or -1 if the queue was full.
+ ******************************************************************************/
+int32_t edge_capture_inject(struct edge_capture *capture, const struct gpio_edge_event *event)
+{
+	uint64_t one = 1;
+
+	// A replay waits for room rather than dropping, so do not count it as a drop.
+	if ((capture->queue.head - __atomic_load_n(&capture->queue.tail, __ATOMIC_ACQUIRE)) == EDGE_QUEUE_CAPACITY) {
+		return -1;
+	}
+	(void)edge_queue_push(&capture->queue, event);
+	(void)write(capture->notifyFd, &one, sizeof(one));
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will return the descriptor which becomes readable when events
+ * are waiting in the queue.
+ * @param struct edge_capture *capture - This is the capture object.
+ * @return The notification descriptor.
+ ******************************************************************************/
+int32_t edge_capture_fd(struct edge_capture *capture)
+{
+	return capture->notifyFd;
+}
+
+/*******************************************************************************
+ * This method will pass every waiting event to the callback, oldest first.
+ * It must only be called from one (consumer) thread.
+ * @param struct edge_capture *capture - This is the capture object.
+ * @param edge_capture_cb cb - This is the callback.
+ * @param void *ctx - This is passed back to the callback.
+ * @return The number of events that were handled.
+ ******************************************************************************/
+uint32_t edge_capture_drain(struct edge_capture *capture, edge_capture_cb cb, void *ctx)
+{
+	struct gpio_edge_event event;
+	uint64_t count;
+	uint32_t handled = 0;
+
+	// Clear the notification first so an event pushed during the drain wakes us again.
+	(void)read(capture->notifyFd, &count, sizeof(count));
+
+	while (edge_queue_pop(&capture->queue, &event) == 0) {
+		cb(&event, ctx);
+		handled++;
+	}
+	return handled;
+}
@@ -0,0 +1,93 @@
+/*********************************************************************
+ * This module runs a dedicated edge-capture thread.  The thread polls the
+ * value descriptors of the registered input pins, stamps every edge with
+ * CLOCK_MONOTONIC_RAW as soon as poll() returns (or keeps the kernel's own
+ * timestamp when the backend supplies one), and pushes it into a lock-free
+ * queue.  It never blocks on the consumer, and only logs a descriptor which
+ * fails without an edge, which it then stops watching.
+ *
+ * The consumer is told about new events through an eventfd, which can be
+ * registered with the event loop, and empties the queue with edge_capture_drain.
+ */
+#ifndef EDGECAPTURE_H
+#define EDGECAPTURE_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include "edgeQueue.h"
+
+#define EDGE_CAPTURE_MAX_PINS (16)
+
+// Called by edge_capture_drain for every queued event.
+typedef void (*edge_capture_cb)(const struct gpio_edge_event *event, void *ctx);
+
+struct edge_capture {
+	struct edge_queue queue;
+	pthread_t thread;
+	int32_t notifyFd;	// Readable while events are waiting
+	int32_t stopFd;		// Written to stop the capture thread
+	uint32_t pinCount;
+	uint32_t pins[EDGE_CAPTURE_MAX_PINS];
+	int32_t fds[EDGE_CAPTURE_MAX_PINS];
+};
+
+/*******************************************************************************
+ * This method will initialize an edge capture object.
+ * @param struct edge_capture *capture - This is the object that is to be initialized.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t edge_capture_init(struct edge_capture *capture);
+
+/*******************************************************************************
+ * This method will add a pin to be watched.  Pins must be added before the
+ * capture thread is started.
+ * @param struct edge_capture *capture - This is the capture object.
+ * @param uint32_t gpio - This is the pin.
+ * @param int32_t fd - This is the descriptor returned by gpio_fd_open for the pin.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t edge_capture_add_pin(struct edge_capture *capture, uint32_t gpio, int32_t fd);
+
+/*******************************************************************************
+ * This method will start the capture thread.
+ * @param struct edge_capture *capture - This is the capture object.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t edge_capture_start(struct edge_capture *capture);
+
+/*******************************************************************************
+ * This method will stop and join the capture thread and release the object's
+ * descriptors.  The pin descriptors are not closed.
+ * @param struct edge_capture *capture - This is the capture object.
+ ******************************************************************************/
+void edge_capture_stop(struct edge_capture *capture);
+
+/*******************************************************************************
+ * This method will queue an event as if the capture thread had seen it, for
+ * example to replay a recorded trace.  It must only be called from one thread,
+ * and only while the capture thread has no pins to watch.
+ * @param struct edge_capture *capture - This is the capture object.
+ * @param const struct gpio_edge_event *event - This is the event.
+ * @return The return will be 0 if successful or -1 if the queue was full.
+ ******************************************************************************/
+int32_t edge_capture_inject(struct edge_capture *capture, const struct gpio_edge_event *event);
+
+/*******************************************************************************
+ * This method will return the descriptor which becomes readable when events
+ * are waiting in the queue.
+ * @param struct edge_capture *capture - This is the capture object.
+ * @return The notification descriptor.
+ ******************************************************************************/
+int32_t edge_capture_fd(struct edge_capture *capture);
+
+/*******************************************************************************
+ * This method will pass every waiting event to the callback, oldest first.
+ * It must only be called from one (consumer) thread.
+ * @param struct edge_capture *capture - This is the capture object.
+ * @param edge_capture_cb cb - This is the callback.
+ * @param void *ctx - This is passed back to the callback.
+ * @return The number of events that were handled.
+ ******************************************************************************/
+uint32_t edge_capture_drain(struct edge_capture *capture, edge_capture_cb cb, void *ctx);
+
+#endif
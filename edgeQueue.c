@@ -0,0 +1,77 @@
+/*********************************************************************
+ * This module implements a lock-free single-producer / single-consumer
+ * ring of timestamped GPIO edge events.  One thread may push and one
+ * (other) thread may pop at the same time without any locking.  A full
+ * ring never blocks the producer; the event is dropped and counted.
+ *
+ * head and tail run freely and are masked on access; the acquire / release
+ * pairs order the slot contents against the index that publishes them.
+ */
+#include <string.h>
+#include <stdint.h>
+#include "edgeQueue.h"
+
+#define EDGE_QUEUE_MASK (EDGE_QUEUE_CAPACITY - 1)
+
+/*******************************************************************************
+ * This method will initialize an empty queue.
+ * @param struct edge_queue *queue - This is the queue that is to be initialized.
+ ******************************************************************************/
+void edge_queue_init(struct edge_queue *queue)
+{
+	memset(queue, 0, sizeof(*queue));
+}
+
+/*******************************************************************************
+ * This method will add an event to the queue.  It must only be called from the
+ * producing thread.
+ * @param struct edge_queue *queue - This is the queue.
+ * @param const struct gpio_edge_event *event - This is the event that is to be added.
+ * @return The return will be 0 if successful or -1 if the queue was full and the
+ *         event was dropped.
+ ******************************************************************************/
+int32_t edge_queue_push(struct edge_queue *queue, const struct gpio_edge_event *event)
+{
+	uint32_t head = queue->head;
+	uint32_t tail = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+
+	if ((head - tail) == EDGE_QUEUE_CAPACITY) {
+		__atomic_store_n(&queue->dropped, queue->dropped + 1, __ATOMIC_RELAXED);
+		return -1;
+	}
+
+	queue->events[head & EDGE_QUEUE_MASK] = *event;
+	__atomic_store_n(&queue->head, head + 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will remove the oldest event from the queue.  It must only be
+ * called from the consuming thread.
+ * @param struct edge_queue *queue - This is the queue.
+ * @param struct gpio_edge_event *event - This is where the event is placed.
+ * @return The return will be 0 if an event was removed or -1 if the queue was empty.
+ ******************************************************************************/
+int32_t edge_queue_pop(struct edge_queue *queue, struct gpio_edge_event *event)
+{
+	uint32_t tail = queue->tail;
+	uint32_t head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+
+	if (head == tail) {
+		return -1;
+	}
+
+	*event = queue->events[tail & EDGE_QUEUE_MASK];
+	__atomic_store_n(&queue->tail, tail + 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will return the number of events dropped because the queue was full.
+ * @param struct edge_queue *queue - This is the queue.
+ * @return The number of dropped events.
+ ******************************************************************************/
+uint32_t edge_queue_dropped(struct edge_queue *queue)
+{
+	return __atomic_load_n(&queue->dropped, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,67 @@
+/*********************************************************************
+ * This module implements a lock-free single-producer / single-consumer
+ * ring of timestamped GPIO edge events.  One thread may push and one
+ * (other) thread may pop at the same time without any locking.  A full
+ * ring never blocks the producer; the event is dropped and counted.
+ */
+#ifndef EDGEQUEUE_H
+#define EDGEQUEUE_H
+
+#include <stdint.h>
+#include <time.h>
+
+#define EDGE_QUEUE_CAPACITY (256)	// Must be a power of two
+#define EDGE_QUEUE_CACHE_LINE (64)
+
+// A single edge as it was seen by the capture thread.
+struct gpio_edge_event {
+	uint32_t pin;
+	uint32_t value;
+	uint32_t seqno;			// Kernel sequence number, or 0 if the backend has none
+	clockid_t clock;		// The clock of timestamp
+	struct timespec timestamp;	// Kernel event time (CLOCK_MONOTONIC) when the backend
+					// provides one, else CLOCK_MONOTONIC_RAW when poll() returned
+};
+
+struct edge_queue {
+	// Written only by the producer.
+	uint32_t head __attribute__((aligned(EDGE_QUEUE_CACHE_LINE)));
+	uint32_t dropped;
+	// Written only by the consumer.
+	uint32_t tail __attribute__((aligned(EDGE_QUEUE_CACHE_LINE)));
+	struct gpio_edge_event events[EDGE_QUEUE_CAPACITY] __attribute__((aligned(EDGE_QUEUE_CACHE_LINE)));
+};
+
+/*******************************************************************************
+ * This method will initialize an empty queue.
+ * @param struct edge_queue *queue - This is the queue that is to be initialized.
+ ******************************************************************************/
+void edge_queue_init(struct edge_queue *queue);
+
+/*******************************************************************************
+ * This method will add an event to the queue.  It must only be called from the
+ * producing thread.
+ * @param struct edge_queue *queue - This is the queue.
+ * @param const struct gpio_edge_event *event - This is the event that is to be added.
+ * @return The return will be 0 if successful or -1 if the queue was full and the
+ *         event was dropped.
+ ******************************************************************************/
+int32_t edge_queue_push(struct edge_queue *queue, const struct gpio_edge_event *event);
+
+/*******************************************************************************
+ * This method will remove the oldest event from the queue.  It must only be
+ * called from the consuming thread.
+ * @param struct edge_queue *queue - This is the queue.
+ * @param struct gpio_edge_event *event - This is where the event is placed.
+ * @return The return will be 0 if an event was removed or -1 if the queue was empty.
+ ******************************************************************************/
+int32_t edge_queue_pop(struct edge_queue *queue, struct gpio_edge_event *event);
+
+/*******************************************************************************
+ * This method will return the number of events dropped because the queue was full.
+ * @param struct edge_queue *queue - This is the queue.
+ * @return The number of dropped events.
+ ******************************************************************************/
+uint32_t edge_queue_dropped(struct edge_queue *queue);
+
+#endif
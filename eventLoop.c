@@ -0,0 +1,393 @@
+/*********************************************************************
+ * This module implements an epoll based event loop.  Any number of GPIO
+ * value descriptors (woken with EPOLLPRI, or EPOLLIN for backends whose
+ * descriptors are readable on an edge), generic descriptors,
+ * signals (through a signalfd) and a periodic timer (through a timerfd)
+ * can be registered.  Each wakeup dispatches every ready source from a
+ * single epoll_wait call.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include "gpioInterface.h"
+#include "eventLoop.h"
+#include "asyncLog.h"
+
+#define EVENT_SOURCE_PIN (0)
+#define EVENT_SOURCE_FD (1)
+#define EVENT_SOURCE_SIGNAL (2)
+#define EVENT_SOURCE_TIMER (3)
+#define EVENT_SOURCE_WAKE (4)
+
+/*******************************************************************************
+ * This method will place a descriptor into a free source slot and add it to
+ * the epoll set.
+ * @param struct event_loop *loop - This is the loop.
+ * @param int32_t fd - This is the descriptor.
+ * @param uint32_t type - This is the kind of source (EVENT_SOURCE_...).
+ * @param uint32_t events - This is the epoll event mask.
+ * @return A pointer to the slot, or NULL if the loop is full or epoll fails.
+ ******************************************************************************/
+static struct event_source* event_loop_add_source(struct event_loop *loop, int32_t fd, uint32_t type, uint32_t events)
+{
+	struct epoll_event ev;
+	uint32_t i;
+
+	for (i = 0; i < EVENT_LOOP_MAX_SOURCES; i++) {
+		if (loop->sources[i].fd < 0) {
+			break;
+		}
+	}
+	if (i == EVENT_LOOP_MAX_SOURCES) {
+		errno = ENOSPC;
+		log_perror("eventloop/add");
+		return NULL;
+	}
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = events;
+	ev.data.ptr = &loop->sources[i];
+	if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+		log_perror("eventloop/add");
+		return NULL;
+	}
+
+	loop->sources[i].fd = fd;
+	loop->sources[i].type = type;
+	return &loop->sources[i];
+}
+
+/*******************************************************************************
+ * This method will initialize an event loop.
+ * @param struct event_loop *loop - This is the loop that is to be initialized.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t event_loop_init(struct event_loop *loop)
+{
+	uint32_t i;
+	int32_t wakefd;
+
+	memset(loop, 0, sizeof(*loop));
+	for (i = 0; i < EVENT_LOOP_MAX_SOURCES; i++) {
+		loop->sources[i].fd = -1;
+	}
+	loop->sigfd = -1;
+	loop->timerfd = -1;
+	loop->running = 1;
+
+	loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (loop->epfd < 0) {
+		log_perror("eventloop/init");
+		return -1;
+	}
+
+	// Used by event_loop_stop so the loop can be stopped from another thread.
+	wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if ((wakefd < 0) || (event_loop_add_source(loop, wakefd, EVENT_SOURCE_WAKE, EPOLLIN) == NULL)) {
+		log_perror("eventloop/init");
+		if (wakefd >= 0) {
+			close(wakefd);
+		}
+		close(loop->epfd);
+		return -1;
+	}
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will close all descriptors owned by the loop.  Descriptors that
+ * were registered by the caller are not closed.
+ * @param struct event_loop *loop - This is the loop that is to be closed.
+ ******************************************************************************/
+void event_loop_close(struct event_loop *loop)
+{
+	uint32_t i;
+
+	for (i = 0; i < EVENT_LOOP_MAX_SOURCES; i++) {
+		if ((loop->sources[i].fd >= 0) && (loop->sources[i].type >= EVENT_SOURCE_SIGNAL)) {
+			close(loop->sources[i].fd);
+		}
+		loop->sources[i].fd = -1;
+	}
+	loop->sigfd = -1;
+	loop->timerfd = -1;
+	if (loop->epfd >= 0) {
+		close(loop->epfd);
+		loop->epfd = -1;
+	}
+}
+
+/*******************************************************************************
+ * This method will register a GPIO value descriptor.  The callback is invoked
+ * with the new value each time an edge is signalled on the descriptor.
+ * @param struct event_loop *loop - This is the loop.
+ * @param uint32_t gpio - This is the pin, which is passed back to the callback.
+ * @param int32_t fd - This is the descriptor returned by gpio_fd_open.
+ * @param event_pin_cb cb - This is the callback.
+ * @param void *ctx - This is passed back to the callback.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t event_loop_add_pin(struct event_loop *loop, uint32_t gpio, int32_t fd, event_pin_cb cb, void *ctx)
+{
+	struct event_source *source;
+
+	// EPOLLPRI / EPOLLIN have the same values as POLLPRI / POLLIN.
+	source = event_loop_add_source(loop, fd, EVENT_SOURCE_PIN, gpio_fd_events() | EPOLLERR);
+	if (source == NULL) {
+		return -1;
+	}
+	source->gpio = gpio;
+	source->cb.pin = cb;
+	source->ctx = ctx;
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will register a generic descriptor.
+ * @param struct event_loop *loop - This is the loop.
+ * @param int32_t fd - This is the descriptor.
+ * @param uint32_t events - This is the epoll event mask, for example EPOLLIN.
+ * @param event_fd_cb cb - This is the callback.
+ * @param void *ctx - This is passed back to the callback.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t event_loop_add_fd(struct event_loop *loop, int32_t fd, uint32_t events, event_fd_cb cb, void *ctx)
+{
+	struct event_source *source;
+
+	source = event_loop_add_source(loop, fd, EVENT_SOURCE_FD, events);
+	if (source == NULL) {
+		return -1;
+	}
+	source->cb.fd = cb;
+	source->ctx = ctx;
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will remove a pin or generic descriptor from the loop.  The
+ * descriptor itself is not closed.
+ * @param struct event_loop *loop - This is the loop.
+ * @param int32_t fd - This is the descriptor that is to be removed.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t event_loop_remove_fd(struct event_loop *loop, int32_t fd)
+{
+	uint32_t i;
+
+	for (i = 0; i < EVENT_LOOP_MAX_SOURCES; i++) {
+		if ((loop->sources[i].fd == fd) && (loop->sources[i].type <= EVENT_SOURCE_FD)) {
+			epoll_ctl(loop->epfd, EPOLL_CTL_DEL, fd, NULL);
+			loop->sources[i].fd = -1;
+			return 0;
+		}
+	}
+	errno = ENOENT;
+	return -1;
+}
+
+/*******************************************************************************
+ * This method will deliver the given signal through the loop instead of an
+ * asynchronous handler.  The signal is blocked in the calling thread, so this
+ * should be called before any other threads are created.
+ * @param struct event_loop *loop - This is the loop.
+ * @param int32_t signo - This is the signal, for example SIGINT.
+ * @param event_signal_cb cb - This is the callback.
+ * @param void *ctx - This is passed back to the callback.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t event_loop_watch_signal(struct event_loop *loop, int32_t signo, event_signal_cb cb, void *ctx)
+{
+	sigset_t mask;
+	uint32_t i;
+
+	if (loop->signalCount == EVENT_LOOP_MAX_SIGNALS) {
+		errno = ENOSPC;
+		return -1;
+	}
+
+	sigemptyset(&mask);
+	for (i = 0; i < loop->signalCount; i++) {
+		sigaddset(&mask, loop->signals[i].signo);
+	}
+	sigaddset(&mask, signo);
+
+	if (pthread_sigmask(SIG_BLOCK, &mask, NULL) != 0) {
+		log_perror("eventloop/signal");
+		return -1;
+	}
+
+	if (loop->sigfd < 0) {
+		loop->sigfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+		if ((loop->sigfd < 0) || (event_loop_add_source(loop, loop->sigfd, EVENT_SOURCE_SIGNAL, EPOLLIN) == NULL)) {
+			log_perror("eventloop/signal");
+			return -1;
+		}
+	} else if (signalfd(loop->sigfd, &mask, 0) < 0) {
+		log_perror("eventloop/signal");
+		return -1;
+	}
+
+	loop->signals[loop->signalCount].signo = signo;
+	loop->signals[loop->signalCount].cb = cb;
+	loop->signals[loop->signalCount].ctx = ctx;
+	loop->signalCount++;
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will arm the loop's timer.
+ * @param struct event_loop *loop - This is the loop.
+ * @param const struct timespec *initial - This is the delay until the first expiration.
+ * @param const struct timespec *interval - This is the period, or zero for a single shot.
+ * @param event_timer_cb cb - This is the callback.
+ * @param void *ctx - This is passed back to the callback.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t event_loop_set_timer(struct event_loop *loop, const struct timespec *initial,
+	const struct timespec *interval, event_timer_cb cb, void *ctx)
+{
+	struct itimerspec spec;
+	struct event_source *source = NULL;
+	uint32_t i;
+
+	if (loop->timerfd < 0) {
+		loop->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+		if (loop->timerfd < 0) {
+			log_perror("eventloop/timer");
+			return -1;
+		}
+		source = event_loop_add_source(loop, loop->timerfd, EVENT_SOURCE_TIMER, EPOLLIN);
+		if (source == NULL) {
+			close(loop->timerfd);
+			loop->timerfd = -1;
+			return -1;
+		}
+	} else {
+		for (i = 0; i < EVENT_LOOP_MAX_SOURCES; i++) {
+			if (loop->sources[i].fd == loop->timerfd) {
+				source = &loop->sources[i];
+			}
+		}
+	}
+	source->cb.timer = cb;
+	source->ctx = ctx;
+
+	spec.it_value = *initial;
+	spec.it_interval = *interval;
+	if (timerfd_settime(loop->timerfd, 0, &spec, NULL) < 0) {
+		log_perror("eventloop/timer");
+		return -1;
+	}
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will call the handlers of every signal queued on the signalfd.
+ * @param struct event_loop *loop - This is the loop.
+ ******************************************************************************/
+static void event_loop_dispatch_signals(struct event_loop *loop)
+{
+	struct signalfd_siginfo info;
+	uint32_t i;
+
+	while (read(loop->sigfd, &info, sizeof(info)) == sizeof(info)) {
+		for (i = 0; i < loop->signalCount; i++) {
+			if (loop->signals[i].signo == (int32_t)info.ssi_signo) {
+				loop->signals[i].cb(info.ssi_signo, loop->signals[i].ctx);
+			}
+		}
+	}
+}
+
+/*******************************************************************************
+ * This method will dispatch a single ready source.
+ * @param struct event_loop *loop - This is the loop.
+ * @param struct event_source *source - This is the source that is ready.
+ * @param uint32_t events - This is the set of epoll events that occurred.
+ ******************************************************************************/
+static void event_loop_dispatch(struct event_loop *loop, struct event_source *source, uint32_t events)
+{
+	uint32_t value;
+	uint64_t count;
+
+	switch (source->type) {
+	case EVENT_SOURCE_PIN:
+		if (gpio_fd_read_value(source->fd, &value) == 0) {
+			source->cb.pin(source->gpio, value, source->ctx);
+		}
+		break;
+	case EVENT_SOURCE_FD:
+		source->cb.fd(source->fd, events, source->ctx);
+		break;
+	case EVENT_SOURCE_SIGNAL:
+		event_loop_dispatch_signals(loop);
+		break;
+	case EVENT_SOURCE_TIMER:
+		if (read(source->fd, &count, sizeof(count)) == sizeof(count)) {
+			source->cb.timer(count, source->ctx);
+		}
+		break;
+	case EVENT_SOURCE_WAKE:
+		(void)read(source->fd, &count, sizeof(count));
+		break;
+	}
+}
+
+/*******************************************************************************
+ * This method will dispatch events until event_loop_stop is called.
+ * @param struct event_loop *loop - This is the loop that is to be run.
+ * @return The return will be 0 if the loop was stopped or a negative number if
+ *         an error occurs.
+ ******************************************************************************/
+int32_t event_loop_run(struct event_loop *loop)
+{
+	struct epoll_event events[EVENT_LOOP_MAX_EVENTS];
+	struct event_source *source;
+	int32_t rc, i;
+
+	while (loop->running) {
+		rc = epoll_wait(loop->epfd, events, EVENT_LOOP_MAX_EVENTS, -1);
+		if (rc < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			log_perror("eventloop/wait");
+			return -1;
+		}
+
+		for (i = 0; i < rc; i++) {
+			source = (struct event_source*)events[i].data.ptr;
+			// A callback earlier in this batch may have removed the source.
+			if (source->fd >= 0) {
+				event_loop_dispatch(loop, source, events[i].events);
+			}
+		}
+	}
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will make event_loop_run return after the current batch of
+ * events.  It may be called from a callback or from another thread.
+ * @param struct event_loop *loop - This is the loop that is to be stopped.
+ ******************************************************************************/
+void event_loop_stop(struct event_loop *loop)
+{
+	uint64_t one = 1;
+	uint32_t i;
+
+	loop->running = 0;
+	for (i = 0; i < EVENT_LOOP_MAX_SOURCES; i++) {
+		if ((loop->sources[i].fd >= 0) && (loop->sources[i].type == EVENT_SOURCE_WAKE)) {
+			(void)write(loop->sources[i].fd, &one, sizeof(one));
+		}
+	}
+}
@@ -0,0 +1,143 @@
+/*********************************************************************
+ * This module implements an epoll based event loop.  Any number of GPIO
+ * value descriptors (woken with EPOLLPRI, or EPOLLIN for backends whose
+ * descriptors are readable on an edge), generic descriptors,
+ * signals (through a signalfd) and a periodic timer (through a timerfd)
+ * can be registered.  Each wakeup dispatches every ready source from a
+ * single epoll_wait call.
+ */
+#ifndef EVENTLOOP_H
+#define EVENTLOOP_H
+
+#include <stdint.h>
+#include <time.h>
+#include "gpioInterface.h"
+
+// Room for every pin, the wake eventfd, the signalfd, the timerfd and a few descriptors.
+#define EVENT_LOOP_MAX_SOURCES (GPIO_MAX_PINS + 8)
+#define EVENT_LOOP_MAX_SIGNALS (8)
+#define EVENT_LOOP_MAX_EVENTS (16)	// Events taken per epoll_wait call
+
+// Called with the new level when an edge occurs on a registered pin.
+typedef void (*event_pin_cb)(uint32_t gpio, uint32_t value, void *ctx);
+// Called with the epoll events when a registered descriptor is ready.
+typedef void (*event_fd_cb)(int32_t fd, uint32_t events, void *ctx);
+// Called when a watched signal is delivered.
+typedef void (*event_signal_cb)(int32_t signo, void *ctx);
+// Called with the number of expirations when the timer fires.
+typedef void (*event_timer_cb)(uint64_t expirations, void *ctx);
+
+struct event_source {
+	int32_t fd;		// -1 when the slot is free
+	uint32_t type;
+	uint32_t gpio;
+	union {
+		event_pin_cb pin;
+		event_fd_cb fd;
+		event_timer_cb timer;
+	} cb;
+	void *ctx;
+};
+
+struct event_signal {
+	int32_t signo;
+	event_signal_cb cb;
+	void *ctx;
+};
+
+struct event_loop {
+	int32_t epfd;
+	int32_t sigfd;
+	int32_t timerfd;
+	volatile int32_t running;
+	struct event_source sources[EVENT_LOOP_MAX_SOURCES];
+	struct event_signal signals[EVENT_LOOP_MAX_SIGNALS];
+	uint32_t signalCount;
+};
+
+/*******************************************************************************
+ * This method will initialize an event loop.
+ * @param struct event_loop *loop - This is the loop that is to be initialized.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t event_loop_init(struct event_loop *loop);
+
+/*******************************************************************************
+ * This method will close all descriptors owned by the loop.  Descriptors that
+ * were registered by the caller are not closed.
+ * @param struct event_loop *loop - This is the loop that is to be closed.
+ ******************************************************************************/
+void event_loop_close(struct event_loop *loop);
+
+/*******************************************************************************
+ * This method will register a GPIO value descriptor.  The callback is invoked
+ * with the new value each time an edge is signalled on the descriptor.
+ * @param struct event_loop *loop - This is the loop.
+ * @param uint32_t gpio - This is the pin, which is passed back to the callback.
+ * @param int32_t fd - This is the descriptor returned by gpio_fd_open.
+ * @param event_pin_cb cb - This is the callback.
+ * @param void *ctx - This is passed back to the callback.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t event_loop_add_pin(struct event_loop *loop, uint32_t gpio, int32_t fd, event_pin_cb cb, void *ctx);
+
+/*******************************************************************************
+ * This method will register a generic descriptor.
+ * @param struct event_loop *loop - This is the loop.
+ * @param int32_t fd - This is the descriptor.
+ * @param uint32_t events - This is the epoll event mask, for example EPOLLIN.
+ * @param event_fd_cb cb - This is the callback.
+ * @param void *ctx - This is passed back to the callback.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t event_loop_add_fd(struct event_loop *loop, int32_t fd, uint32_t events, event_fd_cb cb, void *ctx);
+
+/*******************************************************************************
+ * This method will remove a pin or generic descriptor from the loop.  The
+ * descriptor itself is not closed.
+ * @param struct event_loop *loop - This is the loop.
+ * @param int32_t fd - This is the descriptor that is to be removed.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t event_loop_remove_fd(struct event_loop *loop, int32_t fd);
+
+/*******************************************************************************
+ * This method will deliver the given signal through the loop instead of an
+ * asynchronous handler.  The signal is blocked in the calling thread, so this
+ * should be called before any other threads are created.
+ * @param struct event_loop *loop - This is the loop.
+ * @param int32_t signo - This is the signal, for example SIGINT.
+ * @param event_signal_cb cb - This is the callback.
+ * @param void *ctx - This is passed back to the callback.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t event_loop_watch_signal(struct event_loop *loop, int32_t signo, event_signal_cb cb, void *ctx);
+
+/*******************************************************************************
+ * This method will arm the loop's timer.
+ * @param struct event_loop *loop - This is the loop.
+ * @param const struct timespec *initial - This is the delay until the first expiration.
+ * @param const struct timespec *interval - This is the period, or zero for a single shot.
+ * @param event_timer_cb cb - This is the callback.
+ * @param void *ctx - This is passed back to the callback.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t event_loop_set_timer(struct event_loop *loop, const struct timespec *initial,
+	const struct timespec *interval, event_timer_cb cb, void *ctx);
+
+/*******************************************************************************
+ * This method will dispatch events until event_loop_stop is called.
+ * @param struct event_loop *loop - This is the loop that is to be run.
+ * @return The return will be 0 if the loop was stopped or a negative number if
+ *         an error occurs.
+ ******************************************************************************/
+int32_t event_loop_run(struct event_loop *loop);
+
+/*******************************************************************************
+ * This method will make event_loop_run return after the current batch of
+ * events.  It may be called from a callback or from another thread.
+ * @param struct event_loop *loop - This is the loop that is to be stopped.
+ ******************************************************************************/
+void event_loop_stop(struct event_loop *loop);
+
+#endif
@@ -0,0 +1,641 @@
+/*********************************************************************
+ * This module runs the game of Anticipation for any number of stations.
+ *
+ * A round is published by storing its prompt time and then setting
+ * roundActive; each worker judges a press against the prompt time using
+ * the press timestamp alone, so a busy worker cannot turn a fast press into
+ * a slow one.  Each station's result is written only by its own worker, and
+ * the coordinator reads the results once the round is over.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include "gpioInterface.h"
+#include "eventLoop.h"
+#include "timeutil.h"
+#include "realtime.h"
+#include "asyncLog.h"
+#include "gpioSetup.h"
+#include "game.h"
+
+#define GAME_LINE_MAX (128)
+
+// A worker may be given every station: one CPU is one worker.  It also
+// registers its prompt timer and disarm eventfd, and the loop its wake eventfd.
+_Static_assert(GAME_MAX_STATIONS + 3 <= EVENT_LOOP_MAX_SOURCES, "a worker's loop cannot hold every station");
+
+static const uint32_t ledsOff[GAME_MAX_STATIONS];
+
+/*******************************************************************************
+ * This method will add a station to a game which has not been started.
+ * @param struct game *game - This is the game.
+ * @param const char *name - This is the player's name.  Longer names are cut short.
+ * @param uint32_t switchPin - This is the pin of the button.
+ * @param uint32_t ledPin - This is the pin of the LED.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t game_add_station(struct game *game, const char *name, uint32_t switchPin, uint32_t ledPin)
+{
+	struct game_station *station;
+
+	if (game->stationCount == GAME_MAX_STATIONS) {
+		errno = ENOSPC;
+		return -1;
+	}
+	station = &game->stations[game->stationCount++];
+	memset(station, 0, sizeof(*station));
+	station->game = game;
+	snprintf(station->name, sizeof(station->name), "%s", name);
+	station->switchPin = switchPin;
+	station->ledPin = ledPin;
+	station->switchFd = -1;
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will read a configuration file into a game.
+ * @param struct game *game - This is the game that is to be initialized.
+ * @param const char *path - This is the configuration file.
+ * @return The return will be 0 if successful or a negative number if the file
+ *         cannot be read or holds an invalid setting.
+ ******************************************************************************/
+int32_t game_load(struct game *game, const char *path)
+{
+	char line[GAME_LINE_MAX], name[GAME_NAME_MAX];
+	char *comment;
+	uint32_t a, b, lineNo = 0;
+	int32_t rc = 0;
+	FILE *file;
+
+	memset(game, 0, sizeof(*game));
+	game->rounds = GAME_DEFAULT_ROUNDS;
+	game->minDelayMs = GAME_DEFAULT_MIN_DELAY_MS;
+	game->maxDelayMs = GAME_DEFAULT_MAX_DELAY_MS;
+	game->timeoutMs = GAME_DEFAULT_TIMEOUT_MS;
+	game->seed = (uint32_t)timens_now(CLOCK_MONOTONIC);
+	game->progressFd = -1;
+	game->stopFd = -1;
+	game->doneFd = -1;
+
+	file = fopen(path, "r");
+	if (file == NULL) {
+		log_perror("game/config");
+		return -1;
+	}
+	while ((rc == 0) && (fgets(line, sizeof(line), file) != NULL)) {
+		lineNo++;
+		comment = strchr(line, '#');
+		if (comment != NULL) {
+			*comment = '\0';
+		}
+		if (sscanf(line, " station %31s %u %u", name, &a, &b) == 3) {
+			if ((a >= GPIO_MAX_PINS) || (b >= GPIO_MAX_PINS) || (game_add_station(game, name, a, b) < 0)) {
+				rc = -1;
+			}
+		} else if (sscanf(line, " rounds %u", &a) == 1) {
+			game->rounds = a;
+		} else if (sscanf(line, " delay %u %u", &a, &b) == 2) {
+			game->minDelayMs = a;
+			game->maxDelayMs = b;
+			rc = (a < b) ? 0 : -1;
+		} else if (sscanf(line, " timeout %u", &a) == 1) {
+			game->timeoutMs = a;
+		} else if (sscanf(line, " workers %u", &a) == 1) {
+			game->workerCount = (a < GAME_MAX_WORKERS) ? a : GAME_MAX_WORKERS;
+		} else if (sscanf(line, " seed %u", &a) == 1) {
+			game->seed = a;
+		} else if (strspn(line, " \t\r\n") != strlen(line)) {
+			rc = -1;
+		}
+	}
+	fclose(file);
+
+	if ((rc == 0) && (game->stationCount == 0)) {
+		rc = -1;
+	}
+	if (rc < 0) {
+		fprintf(stderr, "%s:%u: invalid setting, or no stations\n", path, lineNo);
+		errno = EINVAL;
+	}
+	return rc;
+}
+
+/*******************************************************************************
+ * This method is called by a worker's event loop when one of its buttons has
+ * an edge.  It will judge the press against the prompt of the current round.
+ * @param int32_t fd - This is the switch descriptor.
+ * @param uint32_t events - This is the set of epoll events that occurred.
+ * @param void *ctx - This is the station.
+ ******************************************************************************/
+static void game_press(int32_t fd, uint32_t events, void *ctx)
+{
+	struct game_station *station = (struct game_station*)ctx;
+	struct game *game = station->game;
+	struct gpio_fd_event edge;
+	timens_t now = timens_now(CLOCK_MONOTONIC);
+	timens_t pressed, promptAt;
+	uint64_t one = 1;
+
+	if (gpio_fd_read_event(fd, &edge) < 0) {
+		return;
+	}
+	// The buttons pull low when pressed.  Releases and presses between rounds do not count.
+	if ((edge.value != 0) || !__atomic_load_n(&game->roundActive, __ATOMIC_ACQUIRE) ||
+		(__atomic_load_n(&station->result, __ATOMIC_RELAXED) != GAME_RESULT_NONE)) {
+		return;
+	}
+
+	pressed = (edge.timestamp != 0) ? (timens_t)edge.timestamp : now;
+	promptAt = __atomic_load_n(&game->promptAt, __ATOMIC_RELAXED);
+	if (pressed < promptAt) {
+		__atomic_store_n(&station->result, GAME_RESULT_FALSE_START, __ATOMIC_RELEASE);
+	} else {
+		station->reaction = timens_sub(pressed, promptAt);
+		__atomic_store_n(&station->result, GAME_RESULT_PRESSED, __ATOMIC_RELEASE);
+	}
+	if (__atomic_add_fetch(&game->finished, 1, __ATOMIC_ACQ_REL) == game->stationCount) {
+		(void)write(game->progressFd, &one, sizeof(one));
+	}
+}
+
+/*******************************************************************************
+ * This method will bring the LEDs of a worker's stations, in one call, to what
+ * the round calls for: on from the prompt until the round ends, off otherwise.
+ * It is called only on the worker's thread, so the writes of a worker's LEDs
+ * are serialized, and since it looks at the round rather than at which event
+ * woke it, a prompt and the end of the round may be handled in either order.
+ * @param struct game_worker *worker - This is the worker.
+ ******************************************************************************/
+static void game_update_leds(struct game_worker *worker)
+{
+	struct game *game = worker->game;
+	uint32_t lit;
+
+	lit = __atomic_load_n(&game->roundActive, __ATOMIC_ACQUIRE) &&
+		(timens_now(CLOCK_MONOTONIC) >= __atomic_load_n(&game->promptAt, __ATOMIC_RELAXED));
+	if (lit != worker->lit) {
+		(void)gpio_set_values(worker->leds, lit ? worker->levels : ledsOff, worker->stationCount);
+		worker->lit = lit;
+	}
+}
+
+/*******************************************************************************
+ * This method is called by a worker's event loop at the prompt deadline.  It
+ * will light the LEDs of the worker's stations.
+ * @param int32_t fd - This is the worker's timer.
+ * @param uint32_t events - This is the set of epoll events that occurred.
+ * @param void *ctx - This is the worker.
+ ******************************************************************************/
+static void game_prompt(int32_t fd, uint32_t events, void *ctx)
+{
+	uint64_t expirations;
+
+	if (read(fd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+		game_update_leds((struct game_worker*)ctx);
+	}
+}
+
+/*******************************************************************************
+ * This method is called by a worker's event loop when the coordinator ends a
+ * round.  It will turn the LEDs of the worker's stations off.
+ * @param int32_t fd - This is the worker's disarm eventfd.
+ * @param uint32_t events - This is the set of epoll events that occurred.
+ * @param void *ctx - This is the worker.
+ ******************************************************************************/
+static void game_disarm(int32_t fd, uint32_t events, void *ctx)
+{
+	uint64_t count;
+
+	if (read(fd, &count, sizeof(count)) == sizeof(count)) {
+		game_update_leds((struct game_worker*)ctx);
+	}
+}
+
+/*******************************************************************************
+ * This method is the body of a worker thread.
+ * @param void *arg - This is the worker.
+ * @return Always NULL.
+ ******************************************************************************/
+static void* game_worker_thread(void *arg)
+{
+	struct game_worker *worker = (struct game_worker*)arg;
+	struct rt_config config = { 0, RT_NO_CPU, 0 };
+	struct rt_status status;
+
+	config.cpu = worker->cpu;
+	(void)rt_apply(&config, &status);
+	event_loop_run(&worker->loop);
+	return NULL;
+}
+
+/*******************************************************************************
+ * This method will arm or disarm the prompt timer of every worker.  Disarming
+ * also tells every worker to turn its LEDs off.
+ * @param struct game *game - This is the game.
+ * @param timens_t at - This is the absolute CLOCK_MONOTONIC deadline, or 0 to disarm.
+ ******************************************************************************/
+static void game_arm_prompt(struct game *game, timens_t at)
+{
+	struct itimerspec spec;
+	uint32_t index;
+	uint64_t one = 1;
+
+	memset(&spec, 0, sizeof(spec));
+	timens_to_timespec(at, &spec.it_value);
+	for (index = 0; index < game->workerCount; index++) {
+		(void)timerfd_settime(game->workers[index].timerFd, TFD_TIMER_ABSTIME, &spec, NULL);
+		if (at == 0) {
+			(void)write(game->workers[index].disarmFd, &one, sizeof(one));
+		}
+	}
+}
+
+/*******************************************************************************
+ * This method will rank the stations which pressed in time in the round just
+ * played, log the order and add the round to each station's totals.
+ * @param struct game *game - This is the game.
+ * @param uint32_t round - This is the round number, from 1.
+ ******************************************************************************/
+static void game_rank_round(struct game *game, uint32_t round)
+{
+	struct game_station *station;
+	uint32_t order[GAME_MAX_STATIONS];
+	uint32_t count = 0, index, place;
+
+	for (index = 0; index < game->stationCount; index++) {
+		station = &game->stations[index];
+		switch (__atomic_load_n(&station->result, __ATOMIC_ACQUIRE)) {
+		case GAME_RESULT_PRESSED:
+			// Insertion sort; there are few stations and they arrive nearly sorted.
+			for (place = count; (place > 0) && (game->stations[order[place - 1]].reaction > station->reaction); place--) {
+				order[place] = order[place - 1];
+			}
+			order[place] = index;
+			count++;
+			station->presses++;
+			station->totalReaction = timens_add(station->totalReaction, station->reaction);
+			if ((station->presses == 1) || (station->reaction < station->best)) {
+				station->best = station->reaction;
+			}
+			break;
+		case GAME_RESULT_FALSE_START:
+			station->falseStarts++;
+			log_printf("Round %u: %s jumped the gun\n", round, station->name);
+			break;
+		default:
+			break;
+		}
+	}
+
+	if (count == 0) {
+		log_printf("Round %u: nobody pressed in time\n", round);
+		return;
+	}
+	game->stations[order[0]].wins++;
+	for (place = 0; place < count; place++) {
+		station = &game->stations[order[place]];
+		log_printf("Round %u: %2u. %-16s %8.3f ms\n", round, place + 1, station->name,
+			timens_to_us(station->reaction) / 1000.0);
+	}
+}
+
+/*******************************************************************************
+ * This method is the body of the coordinator thread, which plays the rounds.
+ * @param void *arg - This is the game.
+ * @return Always NULL.
+ ******************************************************************************/
+static void* game_coordinator_thread(void *arg)
+{
+	struct game *game = (struct game*)arg;
+	struct pollfd fds[2];
+	struct timespec wait;
+	uint32_t index, stopped = 0;
+	timens_t promptAt, deadline, remaining, delayNs;
+	uint64_t count, one = 1;
+
+	fds[0].fd = game->progressFd;
+	fds[0].events = POLLIN;
+	fds[1].fd = game->stopFd;
+	fds[1].events = POLLIN;
+
+	while (!stopped && (game->roundsPlayed < game->rounds)) {
+		for (index = 0; index < game->stationCount; index++) {
+			__atomic_store_n(&game->stations[index].result, GAME_RESULT_NONE, __ATOMIC_RELAXED);
+		}
+		__atomic_store_n(&game->finished, 0, __ATOMIC_RELAXED);
+
+		// Drawn in ms: RAND_MAX in ns would be only about 2 s, short of the usual range.
+		delayNs = timens_from_ms(game->minDelayMs +
+			(uint32_t)rand_r(&game->seed) % (game->maxDelayMs - game->minDelayMs));
+		promptAt = timens_add(timens_now(CLOCK_MONOTONIC), timens_add(timens_from_ms(GAME_LEAD_IN_MS), delayNs));
+		deadline = timens_add(promptAt, timens_from_ms(game->timeoutMs));
+
+		// Publish the round, then arm the timers which light the LEDs.
+		__atomic_store_n(&game->promptAt, promptAt, __ATOMIC_RELAXED);
+		__atomic_store_n(&game->roundActive, 1, __ATOMIC_RELEASE);
+		game_arm_prompt(game, promptAt);
+
+		while ((__atomic_load_n(&game->finished, __ATOMIC_ACQUIRE) < game->stationCount) &&
+			((remaining = timens_sub(deadline, timens_now(CLOCK_MONOTONIC))) > 0)) {
+			timens_to_timespec(remaining, &wait);
+			if ((ppoll(fds, 2, &wait, NULL) > 0) && (fds[1].revents & POLLIN)) {
+				stopped = 1;
+				break;
+			}
+			(void)read(game->progressFd, &count, sizeof(count));
+		}
+
+		// The workers turn their own LEDs off, so each LED has a single writer.
+		__atomic_store_n(&game->roundActive, 0, __ATOMIC_RELEASE);
+		game_arm_prompt(game, 0);
+		if (!stopped) {
+			game->roundsPlayed++;
+			game_rank_round(game, game->roundsPlayed);
+		}
+	}
+	(void)write(game->doneFd, &one, sizeof(one));
+	return NULL;
+}
+
+/*******************************************************************************
+ * This method will export and configure the pins of every station, all of
+ * them at once, and log how long each took.
+ * @param struct game *game - This is the game.
+ * @return The return will be 0 if successful or a negative number if a switch
+ *         cannot be opened.
+ ******************************************************************************/
+static int32_t game_setup_pins(struct game *game)
+{
+	struct gpio_pin_setup table[2 * GAME_MAX_STATIONS];
+	struct game_station *station;
+	uint32_t index;
+	int32_t rc = 0;
+
+	memset(table, 0, sizeof(table));
+	for (index = 0; index < game->stationCount; index++) {
+		station = &game->stations[index];
+		table[2 * index].pin = station->switchPin;
+		table[2 * index].edge = GPIO_BOTH_EDGES;
+		table[2 * index].openFd = 1;
+		table[2 * index + 1].pin = station->ledPin;
+		table[2 * index + 1].out = 1;
+		table[2 * index + 1].level = 0;
+	}
+	(void)gpio_setup_pins(table, 2 * game->stationCount);
+	gpio_setup_report(table, 2 * game->stationCount);
+
+	for (index = 0; index < game->stationCount; index++) {
+		game->stations[index].switchFd = table[2 * index].fd;
+		if (table[2 * index].fd < 0) {
+			rc = -1;
+		}
+	}
+	return rc;
+}
+
+/*******************************************************************************
+ * This method will divide the stations among the workers by the bank of their
+ * switch pin, so that each bank is watched, and its LEDs lit, by one thread.
+ * There are never more workers than banks.
+ * @param struct game *game - This is the game.
+ ******************************************************************************/
+static void game_partition(struct game *game)
+{
+	uint32_t banks[GAME_MAX_STATIONS];
+	uint32_t bankCount = 0, index, bank, slot;
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	struct game_worker *worker;
+
+	for (index = 0; index < game->stationCount; index++) {
+		bank = game->stations[index].switchPin / GPIO_PINS_PER_BANK;
+		for (slot = 0; (slot < bankCount) && (banks[slot] != bank); slot++) {
+		}
+		if (slot == bankCount) {
+			banks[bankCount++] = bank;
+		}
+	}
+
+	if (game->workerCount == 0) {
+		game->workerCount = (cpus > 0) ? (uint32_t)cpus : 1;
+	}
+	if (game->workerCount > GAME_MAX_WORKERS) {
+		game->workerCount = GAME_MAX_WORKERS;
+	}
+	if (game->workerCount > bankCount) {
+		game->workerCount = bankCount;
+	}
+
+	for (index = 0; index < game->workerCount; index++) {
+		worker = &game->workers[index];
+		worker->game = game;
+		worker->cpu = (cpus > 0) ? (int32_t)(index % (uint32_t)cpus) : RT_NO_CPU;
+		worker->timerFd = -1;
+		worker->disarmFd = -1;
+		worker->lit = 0;
+		worker->stationCount = 0;
+	}
+	for (index = 0; index < game->stationCount; index++) {
+		bank = game->stations[index].switchPin / GPIO_PINS_PER_BANK;
+		for (slot = 0; banks[slot] != bank; slot++) {
+		}
+		worker = &game->workers[slot % game->workerCount];
+		worker->stations[worker->stationCount] = index;
+		worker->leds[worker->stationCount] = game->stations[index].ledPin;
+		worker->levels[worker->stationCount] = 1;
+		worker->stationCount++;
+	}
+}
+
+/*******************************************************************************
+ * This method will stop the workers and release the descriptors and pins of a
+ * game.  The coordinator must have finished.
+ * @param struct game *game - This is the game.
+ * @param uint32_t ready - This is the number of workers whose loop was initialized.
+ * @param uint32_t started - This is the number of workers whose thread was started.
+ ******************************************************************************/
+static void game_release(struct game *game, uint32_t ready, uint32_t started)
+{
+	struct game_worker *worker;
+	struct game_station *station;
+	uint32_t index;
+
+	for (index = 0; index < ready; index++) {
+		worker = &game->workers[index];
+		if (index < started) {
+			event_loop_stop(&worker->loop);
+			pthread_join(worker->thread, NULL);
+		}
+		event_loop_close(&worker->loop);
+		if (worker->timerFd >= 0) {
+			close(worker->timerFd);
+		}
+		if (worker->disarmFd >= 0) {
+			close(worker->disarmFd);
+		}
+		// A worker may have stopped before it saw the end of the round.
+		if (worker->lit) {
+			(void)gpio_set_values(worker->leds, ledsOff, worker->stationCount);
+			worker->lit = 0;
+		}
+	}
+
+	for (index = 0; index < game->stationCount; index++) {
+		station = &game->stations[index];
+		if (station->switchFd >= 0) {
+			gpio_fd_close(station->switchFd);
+			station->switchFd = -1;
+		}
+		gpio_unexport(station->switchPin);
+		gpio_unexport(station->ledPin);
+	}
+	if (game->progressFd >= 0) {
+		close(game->progressFd);
+	}
+	if (game->stopFd >= 0) {
+		close(game->stopFd);
+	}
+	if (game->doneFd >= 0) {
+		close(game->doneFd);
+	}
+}
+
+/*******************************************************************************
+ * This method will set up the pins of every station, start the worker threads
+ * and start playing rounds.  Signals should be blocked first, since the
+ * threads inherit the signal mask.
+ * @param struct game *game - This is the game.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t game_start(struct game *game)
+{
+	struct game_worker *worker;
+	struct game_station *station;
+	uint32_t index, slot, ready = 0, started = 0;
+	int32_t rc = 0;
+
+	if (game_setup_pins(game) < 0) {
+		return -1;
+	}
+	game_partition(game);
+
+	game->progressFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	game->stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	game->doneFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if ((game->progressFd < 0) || (game->stopFd < 0) || (game->doneFd < 0)) {
+		rc = -1;
+	}
+
+	// Build every worker's loop before starting any thread.
+	for (index = 0; (rc == 0) && (index < game->workerCount); index++) {
+		worker = &game->workers[index];
+		if (event_loop_init(&worker->loop) < 0) {
+			rc = -1;
+			break;
+		}
+		ready++;
+		worker->timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+		worker->disarmFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		rc = ((worker->timerFd < 0) || (worker->disarmFd < 0)) ? -1 :
+			event_loop_add_fd(&worker->loop, worker->timerFd, EPOLLIN, game_prompt, worker);
+		if (rc == 0) {
+			rc = event_loop_add_fd(&worker->loop, worker->disarmFd, EPOLLIN, game_disarm, worker);
+		}
+		for (slot = 0; (rc == 0) && (slot < worker->stationCount); slot++) {
+			station = &game->stations[worker->stations[slot]];
+			rc = event_loop_add_fd(&worker->loop, station->switchFd, gpio_fd_events(), game_press, station);
+		}
+	}
+	for (index = 0; (rc == 0) && (index < game->workerCount); index++) {
+		rc = pthread_create(&game->workers[index].thread, NULL, game_worker_thread, &game->workers[index]);
+		if (rc == 0) {
+			started++;
+		}
+	}
+	if (rc == 0) {
+		rc = pthread_create(&game->coordinator, NULL, game_coordinator_thread, game);
+	}
+
+	if (rc != 0) {
+		if (rc > 0) {
+			errno = rc;
+		}
+		log_perror("game/start");
+		game_release(game, ready, started);
+		return -1;
+	}
+	log_printf("Anticipation: %u stations on %u workers, %u rounds\n", game->stationCount,
+		game->workerCount, game->rounds);
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will return the descriptor which becomes readable when every
+ * round has been played.
+ * @param struct game *game - This is the game.
+ * @return The descriptor.
+ ******************************************************************************/
+int32_t game_fd(struct game *game)
+{
+	return game->doneFd;
+}
+
+/*******************************************************************************
+ * This method will stop the game, join its threads and release the pins.
+ * It may be called before every round has been played.
+ * @param struct game *game - This is the game.
+ ******************************************************************************/
+void game_stop(struct game *game)
+{
+	uint64_t one = 1;
+
+	(void)write(game->stopFd, &one, sizeof(one));
+	pthread_join(game->coordinator, NULL);
+	game_release(game, game->workerCount, game->workerCount);
+}
+
+/*******************************************************************************
+ * This method will log the standings: wins, best and mean reaction time and
+ * false starts of every station.  The game must outlive the log writer, since
+ * the names are formatted later.
+ * @param struct game *game - This is the game.
+ ******************************************************************************/
+void game_report(struct game *game)
+{
+	struct game_station *station, *a, *b;
+	uint32_t order[GAME_MAX_STATIONS];
+	uint32_t index, place;
+
+	// Most wins first; ties go to the lower mean reaction time.
+	for (index = 0; index < game->stationCount; index++) {
+		a = &game->stations[index];
+		for (place = index; place > 0; place--) {
+			b = &game->stations[order[place - 1]];
+			if ((b->wins > a->wins) || ((b->wins == a->wins) && (b->presses > 0) &&
+				((a->presses == 0) || (b->totalReaction / b->presses <= a->totalReaction / a->presses)))) {
+				break;
+			}
+			order[place] = order[place - 1];
+		}
+		order[place] = index;
+	}
+
+	log_printf("After %u rounds:\n", game->roundsPlayed);
+	log_printf("%-16s %5s %10s %10s %6s\n", "player", "wins", "best ms", "mean ms", "early");
+	for (place = 0; place < game->stationCount; place++) {
+		station = &game->stations[order[place]];
+		log_printf("%-16s %5u %10.3f %10.3f %6u\n", station->name, station->wins,
+			timens_to_us(station->best) / 1000.0,
+			(station->presses > 0) ? timens_to_us(station->totalReaction / station->presses) / 1000.0 : 0.0,
+			station->falseStarts);
+	}
+}
@@ -0,0 +1,152 @@
+/*********************************************************************
+ * This module runs the game of Anticipation for any number of stations,
+ * each a button and an LED, read from a configuration file.
+ *
+ * Every round all LEDs are off for a random delay, then all of them are
+ * lit at once on an absolute deadline, and each player presses as quickly
+ * as they can.  Presses are timestamped (by the kernel when the backend
+ * can), a press before the prompt is a false start, and the reaction times
+ * of the round are ranked.
+ *
+ * The stations are partitioned by the bank of their switch pin and the
+ * banks are spread over worker threads, one per CPU, each pinned to its
+ * CPU and running its own event loop.  A worker lights the LEDs of its own
+ * stations from its own absolute timer, so the prompt does not wait for
+ * any other thread, and turns them off when the coordinator, which runs
+ * the rounds, signals the end of a round.  Only the owning worker writes
+ * a station's LED while the game runs.
+ *
+ * Configuration file, one setting per line, '#' starting a comment:
+ *     station <name> <switch pin> <led pin>
+ *     rounds <count>
+ *     delay <min ms> <max ms>	(prompt delay, default 1000 to 4000)
+ *     timeout <ms>		(time allowed after the prompt, default 2000)
+ *     workers <count>		(default: one per online CPU)
+ *     seed <number>		(default: from the clock)
+ */
+#ifndef GAME_H
+#define GAME_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include "eventLoop.h"
+#include "timeutil.h"
+
+#define GAME_MAX_STATIONS (64)
+#define GAME_MAX_WORKERS (8)
+#define GAME_NAME_MAX (32)
+#define GAME_LEAD_IN_MS (500)		// Between the LEDs going off and the random delay starting
+#define GAME_DEFAULT_ROUNDS (5)
+#define GAME_DEFAULT_MIN_DELAY_MS (1000)
+#define GAME_DEFAULT_MAX_DELAY_MS (4000)
+#define GAME_DEFAULT_TIMEOUT_MS (2000)
+
+// The outcome of one station in one round.
+#define GAME_RESULT_NONE (0)		// No press yet, or no press at all
+#define GAME_RESULT_PRESSED (1)
+#define GAME_RESULT_FALSE_START (2)
+
+struct game_station {
+	struct game *game;
+	char name[GAME_NAME_MAX];
+	uint32_t switchPin;
+	uint32_t ledPin;
+	int32_t switchFd;
+	// Written by the station's worker during a round.
+	uint32_t result;
+	timens_t reaction;
+	// Totals over the game.
+	uint32_t wins;
+	uint32_t presses;
+	uint32_t falseStarts;
+	timens_t best;
+	timens_t totalReaction;
+};
+
+struct game_worker {
+	struct game *game;
+	struct event_loop loop;
+	pthread_t thread;
+	int32_t cpu;
+	int32_t timerFd;	// Absolute CLOCK_MONOTONIC timer that lights the LEDs
+	int32_t disarmFd;	// Written by the coordinator when a round ends
+	uint32_t lit;		// The LEDs are on; used only by the worker
+	uint32_t stationCount;
+	uint32_t stations[GAME_MAX_STATIONS];
+	uint32_t leds[GAME_MAX_STATIONS];
+	uint32_t levels[GAME_MAX_STATIONS];	// All high, for lighting the LEDs in one call
+};
+
+struct game {
+	struct game_station stations[GAME_MAX_STATIONS];
+	uint32_t stationCount;
+	struct game_worker workers[GAME_MAX_WORKERS];
+	uint32_t workerCount;
+	uint32_t rounds;
+	uint32_t minDelayMs;
+	uint32_t maxDelayMs;
+	uint32_t timeoutMs;
+	uint32_t seed;
+	// The current round, published by the coordinator before the timers are armed.
+	uint32_t roundActive;
+	timens_t promptAt;
+	uint32_t finished;	// Stations done with the current round
+	uint32_t roundsPlayed;
+	pthread_t coordinator;
+	int32_t progressFd;	// Written by a worker when every station is done
+	int32_t stopFd;		// Written to stop the coordinator
+	int32_t doneFd;		// Readable once every round has been played
+};
+
+/*******************************************************************************
+ * This method will read a configuration file into a game.
+ * @param struct game *game - This is the game that is to be initialized.
+ * @param const char *path - This is the configuration file.
+ * @return The return will be 0 if successful or a negative number if the file
+ *         cannot be read or holds an invalid setting.
+ ******************************************************************************/
+int32_t game_load(struct game *game, const char *path);
+
+/*******************************************************************************
+ * This method will add a station to a game which has not been started.
+ * @param struct game *game - This is the game.
+ * @param const char *name - This is the player's name.  Longer names are cut short.
+ * @param uint32_t switchPin - This is the pin of the button.
+ * @param uint32_t ledPin - This is the pin of the LED.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t game_add_station(struct game *game, const char *name, uint32_t switchPin, uint32_t ledPin);
+
+/*******************************************************************************
+ * This method will set up the pins of every station, start the worker threads
+ * and start playing rounds.  Signals should be blocked first, since the
+ * threads inherit the signal mask.
+ * @param struct game *game - This is the game.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t game_start(struct game *game);
+
+/*******************************************************************************
+ * This method will return the descriptor which becomes readable when every
+ * round has been played.
+ * @param struct game *game - This is the game.
+ * @return The descriptor.
+ ******************************************************************************/
+int32_t game_fd(struct game *game);
+
+/*******************************************************************************
+ * This method will stop the game, join its threads and release the pins.
+ * It may be called before every round has been played.
+ * @param struct game *game - This is the game.
+ ******************************************************************************/
+void game_stop(struct game *game);
+
+/*******************************************************************************
+ * This method will log the standings: wins, best and mean reaction time and
+ * false starts of every station.  The game must outlive the log writer, since
+ * the names are formatted later.
+ * @param struct game *game - This is the game.
+ ******************************************************************************/
+void game_report(struct game *game);
+
+#endif
@@ -0,0 +1,634 @@
+/*********************************************************************
+ * This program benchmarks the GPIO hot path and the time utilities
+ * against the simulated sysfs tree, so that it runs on any Linux host and
+ * regressions are caught before the code is deployed.
+ *
+ * Every benchmark is run for a number of warmup repetitions, which are
+ * discarded, and then for a number of measured repetitions of a fixed
+ * number of operations each.  The mean cost per operation, its standard
+ * deviation and a 95% confidence interval over the repetitions are
+ * written as CSV or JSON.
+ *
+ * The generic calls are compared with the pins specialized at compile time
+ * by gpioFixed.h, both on the simulated sysfs tree and on the register
+ * backend, whose banks are mapped from a plain file standing in for /dev/mem.
+ *
+ * Usage: gpioBench [-f csv|json] [-w warmup] [-r repetitions] [-n operations] [-d dir]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include "gpioInterface.h"
+#include "gpioSim.h"
+#include "gpioMmap.h"
+#include "gpioFixed.h"
+#include "timeutil.h"
+
+#define BENCH_OUTPUT_PIN (44)
+#define BENCH_INPUT_PIN (48)
+#define BENCH_CYCLE_PIN (60)
+#define BENCH_MAX_REPS (1000)
+
+// The benchmark pins again, specialized through sysfs and through the registers.
+GPIO_FIXED_PIN(fixedLed, SYSFS, 44)
+GPIO_FIXED_PIN(fixedSwitch, SYSFS, 48)
+GPIO_FIXED_PIN(regLed, MMAP, 44)
+GPIO_FIXED_PIN(regSwitch, MMAP, 48)
+_Static_assert((fixedLed_gpio == BENCH_OUTPUT_PIN) && (regLed_gpio == BENCH_OUTPUT_PIN) &&
+	(fixedSwitch_gpio == BENCH_INPUT_PIN) && (regSwitch_gpio == BENCH_INPUT_PIN), "benchmark pins differ");
+
+// Runs count operations of one benchmark.  Returns 0 if successful.
+typedef int32_t (*bench_fn)(uint32_t count);
+
+struct bench {
+	const char *name;
+	bench_fn run;
+	uint32_t divisor;	// Divides the -n operation count for slow benchmarks
+	uint8_t selfTimed;	// The benchmark reports its own time in selfElapsed
+};
+
+struct bench_result {
+	double mean;		// ns per operation
+	double stddev;
+	double ciLow;
+	double ciHigh;
+	double min;
+	double max;
+};
+
+struct edge_poller {
+	pthread_t thread;
+	int32_t valueFd;	// gpio_fd_open descriptor of the input pin
+	int32_t ackFd;		// Written once per edge seen
+	timens_t woken;		// When poll() returned for the latest edge
+};
+
+static struct edge_poller poller;
+
+// Keeps the compiler from discarding the time utility results.
+static volatile int64_t sink;
+
+// The time measured by a self-timed benchmark during its last run.
+static timens_t selfElapsed;
+
+// Two-sided 95% Student t quantiles for 1 to 30 degrees of freedom.
+static const double tQuantile[30] = {
+	12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+	2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+	2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+};
+
+/*******************************************************************************
+ * This method toggles the output pin.
+ * @param uint32_t count - This is the number of writes.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t bench_set_value(uint32_t count)
+{
+	uint32_t index;
+
+	for (index = 0; index < count; index++) {
+		if (gpio_set_value(BENCH_OUTPUT_PIN, index & 1) < 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*******************************************************************************
+ * This method writes the level the output pin already holds, which the pin
+ * state shadow turns into no write at all.
+ * @param uint32_t count - This is the number of writes.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t bench_set_unchanged(uint32_t count)
+{
+	uint32_t index;
+
+	for (index = 0; index < count; index++) {
+		if (gpio_set_value(BENCH_OUTPUT_PIN, 1) < 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*******************************************************************************
+ * This method reads the output pin, forcing every read through to the backend.
+ * @param uint32_t count - This is the number of reads.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t bench_get_forced(uint32_t count)
+{
+	uint32_t index, value;
+
+	for (index = 0; index < count; index++) {
+		if (gpio_get_value_flags(BENCH_OUTPUT_PIN, &value, GPIO_FORCE) < 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*******************************************************************************
+ * This method reads the output pin, which is served from the pin state shadow.
+ * @param uint32_t count - This is the number of reads.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t bench_get_output(uint32_t count)
+{
+	uint32_t index, value;
+
+	for (index = 0; index < count; index++) {
+		if (gpio_get_value(BENCH_OUTPUT_PIN, &value) < 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*******************************************************************************
+ * This method reads the input pin.
+ * @param uint32_t count - This is the number of reads.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t bench_get_value(uint32_t count)
+{
+	uint32_t index, value;
+
+	for (index = 0; index < count; index++) {
+		if (gpio_get_value(BENCH_INPUT_PIN, &value) < 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*******************************************************************************
+ * This method exports and unexports a pin.
+ * @param uint32_t count - This is the number of export / unexport cycles.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t bench_export_cycle(uint32_t count)
+{
+	uint32_t index;
+
+	for (index = 0; index < count; index++) {
+		if ((gpio_export(BENCH_CYCLE_PIN) < 0) || (gpio_unexport(BENCH_CYCLE_PIN) < 0)) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*******************************************************************************
+ * This method is the body of the thread which waits for edges on the input pin.
+ * @param void *arg - This is unused.
+ * @return Always NULL.
+ ******************************************************************************/
+static void* bench_poller_thread(void *arg)
+{
+	struct pollfd fdset;
+	uint32_t value;
+	uint64_t one = 1;
+
+	(void)arg;
+	fdset.fd = poller.valueFd;
+	fdset.events = POLLPRI;
+	for (;;) {
+		if (poll(&fdset, 1, -1) < 0) {
+			break;
+		}
+		__atomic_store_n(&poller.woken, timens_now(CLOCK_MONOTONIC), __ATOMIC_RELEASE);
+		if (gpio_fd_read_value(poller.valueFd, &value) < 0) {
+			break;
+		}
+		if (write(poller.ackFd, &one, sizeof(one)) < 0) {
+			break;
+		}
+	}
+	return NULL;
+}
+
+/*******************************************************************************
+ * This method raises edges on the input pin and measures how long the poller
+ * thread takes to wake, from just before the simulator raises each edge to
+ * poll() returning.  The result is the mean edge-to-wakeup latency.
+ * @param uint32_t count - This is the number of edges.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t bench_edge_wakeup(uint32_t count)
+{
+	uint32_t index, level = 0;
+	uint64_t acks;
+	timens_t raised;
+
+	selfElapsed = 0;
+	gpio_sim_read(BENCH_INPUT_PIN, &level);
+	for (index = 0; index < count; index++) {
+		level = !level;
+		raised = timens_now(CLOCK_MONOTONIC);
+		if (gpio_sim_inject(BENCH_INPUT_PIN, level) != 1) {
+			return -1;
+		}
+		if (read(poller.ackFd, &acks, sizeof(acks)) < 0) {
+			return -1;
+		}
+		selfElapsed += timens_sub(__atomic_load_n(&poller.woken, __ATOMIC_ACQUIRE), raised);
+	}
+	return 0;
+}
+
+/*******************************************************************************
+ * This method runs timeval_subtract.
+ * @param uint32_t count - This is the number of calls.
+ * @return Always 0.
+ ******************************************************************************/
+static int32_t bench_timeval_subtract(uint32_t count)
+{
+	struct timespec x = { 1000, 900000000 };
+	struct timespec y = { 2000, 100000000 };
+	struct timespec result;
+	uint32_t index;
+
+	for (index = 0; index < count; index++) {
+		y.tv_nsec = index & 0x1FFFFFFF;
+		timeval_subtract(&result, &x, &y);
+		sink = result.tv_nsec;
+	}
+	return 0;
+}
+
+/*******************************************************************************
+ * This method runs timeval_add.
+ * @param uint32_t count - This is the number of calls.
+ * @return Always 0.
+ ******************************************************************************/
+static int32_t bench_timeval_add(uint32_t count)
+{
+	struct timespec x = { 1000, 900000000 };
+	struct timespec y = { 2000, 100000000 };
+	struct timespec result;
+	uint32_t index;
+
+	for (index = 0; index < count; index++) {
+		y.tv_nsec = index & 0x1FFFFFFF;
+		timeval_add(&result, &x, &y);
+		sink = result.tv_nsec;
+	}
+	return 0;
+}
+
+/*******************************************************************************
+ * This method runs timespectoms.
+ * @param uint32_t count - This is the number of calls.
+ * @return Always 0.
+ ******************************************************************************/
+static int32_t bench_timespectoms(uint32_t count)
+{
+	struct timespec x = { 1000, 0 };
+	uint32_t index;
+
+	for (index = 0; index < count; index++) {
+		x.tv_nsec = index & 0x1FFFFFFF;
+		sink = timespectoms(&x);
+	}
+	return 0;
+}
+
+/*******************************************************************************
+ * This method toggles the output pin through its specialized sysfs value file.
+ * @param uint32_t count - This is the number of writes.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t bench_fixed_set(uint32_t count)
+{
+	uint32_t index;
+
+	for (index = 0; index < count; index++) {
+		if (fixedLed_set(index & 1) < 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*******************************************************************************
+ * This method reads the input pin through its specialized sysfs value file.
+ * @param uint32_t count - This is the number of reads.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t bench_fixed_get(uint32_t count)
+{
+	uint32_t index, value;
+
+	for (index = 0; index < count; index++) {
+		if (fixedSwitch_get(&value) < 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*******************************************************************************
+ * This method toggles the output pin with gpio_set_value on the register backend.
+ * @param uint32_t count - This is the number of writes.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t bench_mmap_set(uint32_t count)
+{
+	const struct gpio_backend *previous = gpio_get_backend();
+	uint32_t index;
+	int32_t rc = 0;
+
+	gpio_set_backend(&gpio_mmap_backend);
+	for (index = 0; index < count; index++) {
+		if (gpio_set_value(BENCH_OUTPUT_PIN, index & 1) < 0) {
+			rc = -1;
+			break;
+		}
+	}
+	gpio_set_backend(previous);
+	return rc;
+}
+
+/*******************************************************************************
+ * This method reads the input pin with gpio_get_value on the register backend.
+ * @param uint32_t count - This is the number of reads.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t bench_mmap_get(uint32_t count)
+{
+	const struct gpio_backend *previous = gpio_get_backend();
+	uint32_t index, value;
+	int32_t rc = 0;
+
+	gpio_set_backend(&gpio_mmap_backend);
+	for (index = 0; index < count; index++) {
+		if (gpio_get_value(BENCH_INPUT_PIN, &value) < 0) {
+			rc = -1;
+			break;
+		}
+	}
+	gpio_set_backend(previous);
+	return rc;
+}
+
+/*******************************************************************************
+ * This method toggles the output pin through its specialized registers.
+ * @param uint32_t count - This is the number of writes.
+ * @return Always 0.
+ ******************************************************************************/
+static int32_t bench_reg_set(uint32_t count)
+{
+	uint32_t index;
+
+	for (index = 0; index < count; index++) {
+		regLed_set(index & 1);
+	}
+	return 0;
+}
+
+/*******************************************************************************
+ * This method reads the input pin through its specialized registers.
+ * @param uint32_t count - This is the number of reads.
+ * @return Always 0.
+ ******************************************************************************/
+static int32_t bench_reg_get(uint32_t count)
+{
+	uint32_t index, value;
+
+	for (index = 0; index < count; index++) {
+		regSwitch_get(&value);
+		sink = value;
+	}
+	return 0;
+}
+
+static const struct bench benches[] = {
+	{ "gpio_set_value", bench_set_value, 1, 0 },
+	{ "gpio_set_unchanged", bench_set_unchanged, 1, 0 },
+	{ "gpio_get_value", bench_get_value, 1, 0 },
+	{ "gpio_get_output", bench_get_output, 1, 0 },
+	{ "gpio_get_forced", bench_get_forced, 1, 0 },
+	{ "export_unexport", bench_export_cycle, 10, 0 },
+	{ "edge_to_wakeup", bench_edge_wakeup, 10, 1 },
+	{ "timeval_subtract", bench_timeval_subtract, 1, 0 },
+	{ "timeval_add", bench_timeval_add, 1, 0 },
+	{ "timespectoms", bench_timespectoms, 1, 0 },
+	// The specialized pins and the register backend, last since changing the
+	// backend forgets the pin state shadow.
+	{ "fixed_set_value", bench_fixed_set, 1, 0 },
+	{ "fixed_get_value", bench_fixed_get, 1, 0 },
+	{ "mmap_set_value", bench_mmap_set, 1, 0 },
+	{ "mmap_get_value", bench_mmap_get, 1, 0 },
+	{ "fixed_mmap_set_value", bench_reg_set, 1, 0 },
+	{ "fixed_mmap_get_value", bench_reg_get, 1, 0 }
+};
+
+/*******************************************************************************
+ * This method will run one benchmark and summarize the repetitions.
+ * @param const struct bench *b - This is the benchmark.
+ * @param uint32_t warmup - This is the number of discarded repetitions.
+ * @param uint32_t reps - This is the number of measured repetitions.
+ * @param uint32_t ops - This is the number of operations per repetition.
+ * @param struct bench_result *result - This is where the summary is placed.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t bench_measure(const struct bench *b, uint32_t warmup, uint32_t reps, uint32_t ops,
+	struct bench_result *result)
+{
+	double samples[BENCH_MAX_REPS];
+	double sum = 0.0, squares = 0.0, half, t;
+	timens_t start, elapsed;
+	uint32_t rep;
+
+	for (rep = 0; rep < warmup; rep++) {
+		if (b->run(ops) < 0) {
+			return -1;
+		}
+	}
+
+	result->min = INFINITY;
+	result->max = 0.0;
+	for (rep = 0; rep < reps; rep++) {
+		start = timens_now(CLOCK_MONOTONIC);
+		if (b->run(ops) < 0) {
+			return -1;
+		}
+		elapsed = b->selfTimed ? selfElapsed : timens_sub(timens_now(CLOCK_MONOTONIC), start);
+		samples[rep] = (double)elapsed / ops;
+		sum += samples[rep];
+		result->min = fmin(result->min, samples[rep]);
+		result->max = fmax(result->max, samples[rep]);
+	}
+
+	result->mean = sum / reps;
+	for (rep = 0; rep < reps; rep++) {
+		squares += (samples[rep] - result->mean) * (samples[rep] - result->mean);
+	}
+	result->stddev = (reps > 1) ? sqrt(squares / (reps - 1)) : 0.0;
+	t = (reps > 1) ? ((reps - 1 <= 30) ? tQuantile[reps - 2] : 1.96) : 0.0;
+	half = t * result->stddev / sqrt((double)reps);
+	result->ciLow = result->mean - half;
+	result->ciHigh = result->mean + half;
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will map the register banks from a temporary file of zeros.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t bench_map_registers(void)
+{
+	char path[] = "/tmp/gpioBench-XXXXXX";
+	off_t bases[GPIO_MMAP_BANKS];
+	long page = sysconf(_SC_PAGESIZE);
+	uint32_t bank;
+	int32_t fd, rc;
+
+	fd = mkstemp(path);
+	if (fd < 0) {
+		perror("bench/registers");
+		return -1;
+	}
+	rc = ftruncate(fd, GPIO_MMAP_BANKS * page);
+	close(fd);
+	for (bank = 0; bank < GPIO_MMAP_BANKS; bank++) {
+		bases[bank] = bank * page;
+	}
+	if ((rc == 0) && (gpio_mmap_open(path, bases) < 0)) {
+		rc = -1;
+	}
+	unlink(path);
+	return rc;
+}
+
+/*******************************************************************************
+ * This method will create the simulated pins, start the edge poller and bind
+ * the specialized pins.
+ * @param const char *dir - This is the directory for the simulated tree, or NULL.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t bench_setup(const char *dir)
+{
+	if ((gpio_sim_start(dir) < 0) || (gpio_sim_add_pin(BENCH_OUTPUT_PIN) < 0) ||
+		(gpio_sim_add_pin(BENCH_INPUT_PIN) < 0) || (gpio_sim_add_pin(BENCH_CYCLE_PIN) < 0)) {
+		return -1;
+	}
+
+	(void)gpio_export(BENCH_OUTPUT_PIN);
+	(void)gpio_set_dir(BENCH_OUTPUT_PIN, 1);
+	(void)gpio_export(BENCH_INPUT_PIN);
+	(void)gpio_set_dir(BENCH_INPUT_PIN, 0);
+	(void)gpio_set_edge(BENCH_INPUT_PIN, GPIO_BOTH_EDGES);
+
+	poller.valueFd = gpio_fd_open(BENCH_INPUT_PIN);
+	poller.ackFd = eventfd(0, EFD_CLOEXEC);
+	if ((poller.valueFd < 0) || (poller.ackFd < 0)) {
+		perror("bench/setup");
+		return -1;
+	}
+	if (pthread_create(&poller.thread, NULL, bench_poller_thread, NULL) != 0) {
+		perror("bench/setup");
+		return -1;
+	}
+
+	if ((fixedLed_bind() < 0) || (fixedSwitch_bind() < 0) || (bench_map_registers() < 0) ||
+		(regLed_bind() < 0) || (regSwitch_bind() < 0)) {
+		return -1;
+	}
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will stop the edge poller, unmap the registers and remove the
+ * simulated pins.
+ ******************************************************************************/
+static void bench_teardown(void)
+{
+	regSwitch_release();
+	regLed_release();
+	gpio_mmap_close();
+	fixedSwitch_release();
+	fixedLed_release();
+	pthread_cancel(poller.thread);
+	pthread_join(poller.thread, NULL);
+	gpio_fd_close(poller.valueFd);
+	close(poller.ackFd);
+	gpio_unexport(BENCH_INPUT_PIN);
+	gpio_unexport(BENCH_OUTPUT_PIN);
+	gpio_sim_stop();
+}
+
+/****************************************************************
+* Main
+****************************************************************/
+int main(int argc, char **argv)
+{
+	const char *format = "csv";
+	const char *dir = NULL;
+	struct bench_result result;
+	uint32_t warmup = 3, reps = 10, ops = 100000;
+	uint32_t index, count = sizeof(benches) / sizeof(benches[0]);
+	int32_t opt, rc = 0;
+
+	while ((opt = getopt(argc, argv, "f:w:r:n:d:")) != -1) {
+		switch (opt) {
+		case 'f': format = optarg; break;
+		case 'w': warmup = (uint32_t)strtoul(optarg, NULL, 0); break;
+		case 'r': reps = (uint32_t)strtoul(optarg, NULL, 0); break;
+		case 'n': ops = (uint32_t)strtoul(optarg, NULL, 0); break;
+		case 'd': dir = optarg; break;
+		default:
+			fprintf(stderr, "Usage: %s [-f csv|json] [-w warmup] [-r repetitions] [-n operations] [-d dir]\n", argv[0]);
+			return 2;
+		}
+	}
+	if ((reps == 0) || (reps > BENCH_MAX_REPS) || (ops < 10) ||
+		((strcmp(format, "csv") != 0) && (strcmp(format, "json") != 0))) {
+		fprintf(stderr, "%s: repetitions must be 1 - %d, operations at least 10, format csv or json\n",
+			argv[0], BENCH_MAX_REPS);
+		return 2;
+	}
+
+	if (bench_setup(dir) < 0) {
+		return 1;
+	}
+
+	if (strcmp(format, "csv") == 0) {
+		printf("benchmark,operations,repetitions,mean_ns,stddev_ns,ci95_low_ns,ci95_high_ns,min_ns,max_ns,ops_per_sec\n");
+	} else {
+		printf("[\n");
+	}
+	for (index = 0; index < count; index++) {
+		if (bench_measure(&benches[index], warmup, reps, ops / benches[index].divisor, &result) < 0) {
+			fprintf(stderr, "%s: %s failed\n", argv[0], benches[index].name);
+			rc = 1;
+			continue;
+		}
+		if (strcmp(format, "csv") == 0) {
+			printf("%s,%u,%u,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.0f\n", benches[index].name,
+				ops / benches[index].divisor, reps, result.mean, result.stddev, result.ciLow,
+				result.ciHigh, result.min, result.max, 1e9 / result.mean);
+		} else {
+			printf("  {\"benchmark\": \"%s\", \"operations\": %u, \"repetitions\": %u, \"mean_ns\": %.2f, "
+				"\"stddev_ns\": %.2f, \"ci95_ns\": [%.2f, %.2f], \"min_ns\": %.2f, \"max_ns\": %.2f, "
+				"\"ops_per_sec\": %.0f}%s\n", benches[index].name, ops / benches[index].divisor, reps,
+				result.mean, result.stddev, result.ciLow, result.ciHigh, result.min, result.max,
+				1e9 / result.mean, (index + 1 < count) ? "," : "");
+		}
+	}
+	if (strcmp(format, "json") == 0) {
+		printf("]\n");
+	}
+
+	bench_teardown();
+	return rc;
+}
@@ -0,0 +1,943 @@
+/*********************************************************************
+ * This module is a GPIO backend built on the GPIO character device
+ * (/dev/gpiochipN) v2 uAPI, which replaces the deprecated sysfs interface.
+ *
+ * The exported lines of a chip which need no descriptor of their own, the
+ * outputs and the inputs without edge detection or debouncing, share one
+ * line request.  A batched call makes one GPIO_V2_LINE_SET_VALUES or
+ * GET_VALUES ioctl per chip for them, so the pins of a chip change, or are
+ * sampled, together.  An input with edge detection or debouncing has a
+ * request of its own, since its edges are read from its own descriptor; it
+ * costs one ioctl in a batch.
+ *
+ * A line leaves or joins the shared request when it is exported or
+ * unexported or its direction, edge or debounce changes, and the shared
+ * request is then made again, driving the outputs back to their last level.
+ * Each chip has a lock, held across these changes and across every operation
+ * which uses one of the chip's requests, so the pins of a chip may be set up
+ * and driven from several threads at once.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+#include "gpioInterface.h"
+#include "gpioCdev.h"
+#include "asyncLog.h"
+
+ /****************************************************************
+ * Constants
+ ****************************************************************/
+#define MAX_PATH_BUF 256
+#define CDEV_MAX_CHIPS (GPIO_MAX_PINS / GPIO_PINS_PER_BANK)
+
+// The state of one requested line.  The configuration is kept so that it can
+// be sent again in full whenever one part of it changes.
+struct cdev_line {
+	int32_t fd;		// The line's own request, or -1 if it has none
+	uint32_t exported;
+	uint32_t grouped;	// Non zero if the line is in its chip's shared request
+	uint32_t bit;		// The line's bit in the shared request
+	uint32_t out;
+	uint32_t edge;
+	uint32_t debounceUs;
+	uint32_t level;		// The last level written, restored when the shared request is made again
+};
+
+// The shared request of one chip.  Bit n of its values is line pins[n].  The
+// lock guards the group and the state of every line of the chip.
+struct cdev_group {
+	int32_t fd;		// -1 if no line of the chip is in it
+	uint32_t count;
+	uint32_t pins[GPIO_PINS_PER_BANK];
+	pthread_mutex_t lock;
+};
+
+static struct cdev_line lines[GPIO_MAX_PINS] = {
+	[0 ... GPIO_MAX_PINS - 1] = { -1, 0, 0, 0, 0, GPIO_NO_EDGE, 0, 0 }
+};
+static struct cdev_group groups[CDEV_MAX_CHIPS] = {
+	[0 ... CDEV_MAX_CHIPS - 1] = { -1, 0, { 0 }, PTHREAD_MUTEX_INITIALIZER }
+};
+static int32_t chips[CDEV_MAX_CHIPS] = { [0 ... CDEV_MAX_CHIPS - 1] = -1 };
+static char devRoot[MAX_PATH_BUF - 32] = GPIO_CDEV_DEFAULT_DIR;	// Leaves room for "/gpiochipN"
+
+/*******************************************************************************
+ * This method opens a chip node.
+ * @param const char *path - This is the path of the node.
+ * @return The return will be a file id for the chip or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t cdev_open_chip(const char *path)
+{
+	return open(path, O_RDWR | O_CLOEXEC);
+}
+
+/*******************************************************************************
+ * This method passes an ioctl to the kernel.
+ * @param int32_t fd - This is the chip or line request.
+ * @param unsigned long request - This is the ioctl.
+ * @param void *arg - This is the ioctl argument.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t cdev_ioctl(int32_t fd, unsigned long request, void *arg)
+{
+	return ioctl(fd, request, arg);
+}
+
+static const struct gpio_cdev_ops kernelOps = { cdev_open_chip, cdev_ioctl };
+static const struct gpio_cdev_ops *ops = &kernelOps;
+
+/*******************************************************************************
+ * This method will return the descriptor of the chip holding a pin, opening
+ * the chip the first time it is needed.
+ * @param uint32_t gpio - This is the pin.
+ * @return The return will be a file id for the chip or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t cdev_chip_fd(uint32_t gpio)
+{
+	uint32_t chip = gpio / GPIO_PINS_PER_BANK;
+	int32_t fd, expected = -1;
+	char path[MAX_PATH_BUF];
+
+	fd = __atomic_load_n(&chips[chip], __ATOMIC_ACQUIRE);
+	if (fd >= 0) {
+		return fd;
+	}
+	snprintf(path, sizeof(path), "%s/gpiochip%d", devRoot, chip);
+	fd = ops->open_chip(path);
+	if (fd < 0) {
+		return fd;
+	}
+
+	// Pins may be set up from several threads.  Keep the first descriptor opened.
+	if (!__atomic_compare_exchange_n(&chips[chip], &expected, fd, 0,
+		__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		close(fd);
+		fd = expected;
+	}
+	return fd;
+}
+
+/*******************************************************************************
+ * This method will take the lock of the chip holding a pin.
+ * @param uint32_t gpio - This is the pin.
+ ******************************************************************************/
+static void cdev_lock(uint32_t gpio)
+{
+	pthread_mutex_lock(&groups[gpio / GPIO_PINS_PER_BANK].lock);
+}
+
+/*******************************************************************************
+ * This method will release the lock of the chip holding a pin.
+ * @param uint32_t gpio - This is the pin.
+ ******************************************************************************/
+static void cdev_unlock(uint32_t gpio)
+{
+	pthread_mutex_unlock(&groups[gpio / GPIO_PINS_PER_BANK].lock);
+}
+
+/*******************************************************************************
+ * This method will decide whether an exported line belongs in its chip's shared
+ * request.  Only inputs whose edges are read, or which the kernel debounces,
+ * need a request of their own.
+ * @param uint32_t gpio - This is the pin.
+ * @return Non zero if the line is to be shared.
+ ******************************************************************************/
+static uint32_t cdev_shares(uint32_t gpio)
+{
+	struct cdev_line *line = &lines[gpio];
+
+	return line->exported && (line->out || ((line->edge == GPIO_NO_EDGE) && (line->debounceUs == 0)));
+}
+
+/*******************************************************************************
+ * This method will fill in a line configuration from the stored state of a pin.
+ * @param uint32_t gpio - This is the pin.
+ * @param struct gpio_v2_line_config *config - This is where the configuration is placed.
+ ******************************************************************************/
+static void cdev_build_config(uint32_t gpio, struct gpio_v2_line_config *config)
+{
+	struct cdev_line *line = &lines[gpio];
+
+	memset(config, 0, sizeof(*config));
+	if (line->out) {
+		config->flags = GPIO_V2_LINE_FLAG_OUTPUT;
+		return;
+	}
+
+	// Edge detection and debouncing are only available on inputs.
+	config->flags = GPIO_V2_LINE_FLAG_INPUT;
+	if (line->edge & GPIO_RISING_EDGE) {
+		config->flags |= GPIO_V2_LINE_FLAG_EDGE_RISING;
+	}
+	if (line->edge & GPIO_FALLING_EDGE) {
+		config->flags |= GPIO_V2_LINE_FLAG_EDGE_FALLING;
+	}
+	if (line->debounceUs != 0) {
+		config->num_attrs = 1;
+		config->attrs[0].attr.id = GPIO_V2_LINE_ATTR_ID_DEBOUNCE;
+		config->attrs[0].attr.debounce_period_us = line->debounceUs;
+		config->attrs[0].mask = 1;
+	}
+}
+
+/*******************************************************************************
+ * This method will fill in the configuration of a chip's shared request.  The
+ * lines are inputs unless an attribute makes them outputs, and the outputs are
+ * driven to their last level.
+ * @param struct cdev_group *group - This is the shared request.
+ * @param struct gpio_v2_line_config *config - This is where the configuration is placed.
+ ******************************************************************************/
+static void cdev_build_group_config(struct cdev_group *group, struct gpio_v2_line_config *config)
+{
+	uint64_t outputs = 0, levels = 0;
+	uint32_t index;
+
+	for (index = 0; index < group->count; index++) {
+		if (lines[group->pins[index]].out) {
+			outputs |= 1ULL << index;
+			levels |= (uint64_t)(lines[group->pins[index]].level != 0) << index;
+		}
+	}
+
+	memset(config, 0, sizeof(*config));
+	config->flags = GPIO_V2_LINE_FLAG_INPUT;
+	if (outputs != 0) {
+		config->num_attrs = 2;
+		config->attrs[0].attr.id = GPIO_V2_LINE_ATTR_ID_FLAGS;
+		config->attrs[0].attr.flags = GPIO_V2_LINE_FLAG_OUTPUT;
+		config->attrs[0].mask = outputs;
+		config->attrs[1].attr.id = GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+		config->attrs[1].attr.values = levels;
+		config->attrs[1].mask = outputs;
+	}
+}
+
+/*******************************************************************************
+ * This method will make a chip's shared request again from the lines which
+ * now belong in it.  A line can only be held by one request, so the old
+ * shared request is released first.  The chip's lock must be held.
+ * @param uint32_t chip - This is the chip.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t cdev_regroup(uint32_t chip)
+{
+	struct cdev_group *group = &groups[chip];
+	struct gpio_v2_line_request request;
+	uint32_t gpio, index;
+	int32_t chipFd;
+
+	if (group->fd >= 0) {
+		close(group->fd);
+		group->fd = -1;
+	}
+	group->count = 0;
+	for (gpio = chip * GPIO_PINS_PER_BANK; gpio < (chip + 1) * GPIO_PINS_PER_BANK; gpio++) {
+		lines[gpio].grouped = cdev_shares(gpio);
+		if (lines[gpio].grouped) {
+			lines[gpio].bit = group->count;
+			group->pins[group->count++] = gpio;
+		}
+	}
+	if (group->count == 0) {
+		return 0;
+	}
+
+	chipFd = cdev_chip_fd(chip * GPIO_PINS_PER_BANK);
+	if (chipFd < 0) {
+		return -1;
+	}
+	memset(&request, 0, sizeof(request));
+	for (index = 0; index < group->count; index++) {
+		request.offsets[index] = group->pins[index] % GPIO_PINS_PER_BANK;
+	}
+	request.num_lines = group->count;
+	strncpy(request.consumer, GPIO_CDEV_CONSUMER, sizeof(request.consumer) - 1);
+	cdev_build_group_config(group, &request.config);
+	if (ops->ioctl(chipFd, GPIO_V2_GET_LINE_IOCTL, &request) < 0) {
+		return -1;
+	}
+	group->fd = request.fd;
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will bring the kernel up to date with the stored state of a pin:
+ * it moves the line between its own request and the shared one as needed, and
+ * otherwise sends the new configuration to whichever request holds it.  The
+ * chip's lock must be held.
+ * @param uint32_t gpio - This is the pin.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t cdev_place(uint32_t gpio)
+{
+	struct cdev_line *line = &lines[gpio];
+	uint32_t chip = gpio / GPIO_PINS_PER_BANK;
+	uint32_t shares = cdev_shares(gpio);
+	struct gpio_v2_line_config config;
+	struct gpio_v2_line_request request;
+	int32_t chipFd;
+
+	if (shares && line->grouped) {
+		cdev_build_group_config(&groups[chip], &config);
+		return ops->ioctl(groups[chip].fd, GPIO_V2_LINE_SET_CONFIG_IOCTL, &config);
+	}
+	if (!shares && (line->fd >= 0)) {
+		if (!line->exported) {
+			close(line->fd);
+			line->fd = -1;
+			return 0;
+		}
+		cdev_build_config(gpio, &config);
+		return ops->ioctl(line->fd, GPIO_V2_LINE_SET_CONFIG_IOCTL, &config);
+	}
+
+	// The line moves.  It is released from where it is before it is requested again.
+	if (line->fd >= 0) {
+		close(line->fd);
+		line->fd = -1;
+	}
+	if ((shares || line->grouped) && (cdev_regroup(chip) < 0)) {
+		return -1;
+	}
+	if (shares || !line->exported) {
+		return 0;
+	}
+
+	chipFd = cdev_chip_fd(gpio);
+	if (chipFd < 0) {
+		return -1;
+	}
+	memset(&request, 0, sizeof(request));
+	request.offsets[0] = gpio % GPIO_PINS_PER_BANK;
+	request.num_lines = 1;
+	strncpy(request.consumer, GPIO_CDEV_CONSUMER, sizeof(request.consumer) - 1);
+	cdev_build_config(gpio, &request.config);
+	if (ops->ioctl(chipFd, GPIO_V2_GET_LINE_IOCTL, &request) < 0) {
+		return -1;
+	}
+	line->fd = request.fd;
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will request the line of the given pin from its chip.  The line
+ * starts as an input with no edge detection.
+ * @param uint32_t gpio - This is the pin that is to be exported.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t cdev_export(uint32_t gpio)
+{
+	if (gpio >= GPIO_MAX_PINS) {
+		errno = EINVAL;
+		log_perror("gpio/cdev-export");
+		return -1;
+	}
+	cdev_lock(gpio);
+	if (lines[gpio].exported) {
+		cdev_unlock(gpio);
+		return 0;
+	}
+
+	lines[gpio].exported = 1;
+	lines[gpio].out = 0;
+	lines[gpio].edge = GPIO_NO_EDGE;
+	lines[gpio].level = 0;
+	if (cdev_place(gpio) < 0) {
+		log_perror("gpio/cdev-export");
+		lines[gpio].exported = 0;
+		(void)cdev_place(gpio);
+		cdev_unlock(gpio);
+		return -1;
+	}
+	cdev_unlock(gpio);
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will release the line of the given pin.
+ * @param uint32_t gpio - This is the pin that is to be unexported.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t cdev_unexport(uint32_t gpio)
+{
+	int32_t rc = 0;
+
+	if (gpio >= GPIO_MAX_PINS) {
+		errno = ENOENT;
+		log_perror("gpio/cdev-unexport");
+		return -1;
+	}
+	cdev_lock(gpio);
+	if (!lines[gpio].exported) {
+		errno = ENOENT;
+		log_perror("gpio/cdev-unexport");
+		rc = -1;
+	} else {
+		lines[gpio].exported = 0;
+		if (cdev_place(gpio) < 0) {
+			log_perror("gpio/cdev-unexport");
+			rc = -1;
+		}
+	}
+	cdev_unlock(gpio);
+	return rc;
+}
+
+/*******************************************************************************
+ * This method will set the direction of the given pin.  An output starts low.
+ * @param uint32_t gpio - This is the pin that is to be set.
+ * @param uint32_t out_flag This is the direction.  A 0 value indicates input.
+ *                          A nonzero value is output.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t cdev_set_dir(uint32_t gpio, uint32_t out_flag)
+{
+	int32_t rc = 0;
+
+	if (gpio >= GPIO_MAX_PINS) {
+		errno = ENOENT;
+		log_perror("gpio/cdev-direction");
+		return -1;
+	}
+	cdev_lock(gpio);
+	if (!lines[gpio].exported) {
+		errno = ENOENT;
+		log_perror("gpio/cdev-direction");
+		rc = -1;
+	} else {
+		if (!lines[gpio].out && out_flag) {
+			lines[gpio].level = 0;
+		}
+		lines[gpio].out = (out_flag != 0);
+		if (cdev_place(gpio) < 0) {
+			log_perror("gpio/cdev-direction");
+			rc = -1;
+		}
+	}
+	cdev_unlock(gpio);
+	return rc;
+}
+
+/*******************************************************************************
+ * This method will return the request holding an exported line, and select
+ * the line's bit in it.  The chip's lock must be held while the request is used.
+ * @param uint32_t gpio - This is the pin.
+ * @param struct gpio_v2_line_values *values - This is where the line's bit is
+ *                                              placed, as the mask.
+ * @return The request, or a negative number if the pin is not exported.
+ ******************************************************************************/
+static int32_t cdev_request_of(uint32_t gpio, struct gpio_v2_line_values *values)
+{
+	if (!lines[gpio].exported) {
+		errno = ENOENT;
+		return -1;
+	}
+	if (lines[gpio].grouped) {
+		values->mask = 1ULL << lines[gpio].bit;
+		return groups[gpio / GPIO_PINS_PER_BANK].fd;
+	}
+	values->mask = 1;
+	return lines[gpio].fd;
+}
+
+/*******************************************************************************
+ * This method will set the value of a pin.  The chip's lock must be held.
+ * @param uint32_t gpio - This is the pin that is to be set.
+ * @param uint32_t value This is the value.  A 0 value is lo / off.  A non zero value is high / on.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t cdev_write(uint32_t gpio, uint32_t value)
+{
+	struct gpio_v2_line_values values = { 0, 0 };
+	int32_t fd = cdev_request_of(gpio, &values);
+
+	values.bits = (value != 0) ? values.mask : 0;
+	if ((fd < 0) || (ops->ioctl(fd, GPIO_V2_LINE_SET_VALUES_IOCTL, &values) < 0)) {
+		log_perror("gpio/cdev-set-value");
+		return -1;
+	}
+	lines[gpio].level = (value != 0);
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will read the value of a pin.  The chip's lock must be held.
+ * @param uint32_t gpio - This is the pin that is to be read.
+ * @param uint32_t * value This is a pointer to where the value is to be placed when it is read.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t cdev_read(uint32_t gpio, uint32_t *value)
+{
+	struct gpio_v2_line_values values = { 0, 0 };
+	int32_t fd = cdev_request_of(gpio, &values);
+
+	values.bits = 0;
+	if ((fd < 0) || (ops->ioctl(fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &values) < 0)) {
+		log_perror("gpio/cdev-get-value");
+		return -1;
+	}
+	*value = ((values.bits & values.mask) != 0);
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will set the value of the given pin.
+ * @param uint32_t gpio - This is the pin that is to be set.
+ * @param uint32_t value This is the value.  A 0 value is lo / off.  A non zero value is high / on.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t cdev_set_value(uint32_t gpio, uint32_t value)
+{
+	int32_t rc;
+
+	if (gpio >= GPIO_MAX_PINS) {
+		errno = ENOENT;
+		log_perror("gpio/cdev-set-value");
+		return -1;
+	}
+	cdev_lock(gpio);
+	rc = cdev_write(gpio, value);
+	cdev_unlock(gpio);
+	return rc;
+}
+
+/*******************************************************************************
+ * This method will read the value of the given pin.
+ * @param uint32_t gpio - This is the pin that is to be read.
+ * @param uint32_t * value This is a pointer to where the value is to be placed when it is read.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t cdev_get_value(uint32_t gpio, uint32_t *value)
+{
+	int32_t rc;
+
+	if (gpio >= GPIO_MAX_PINS) {
+		errno = ENOENT;
+		log_perror("gpio/cdev-get-value");
+		return -1;
+	}
+	cdev_lock(gpio);
+	rc = cdev_read(gpio, value);
+	cdev_unlock(gpio);
+	return rc;
+}
+
+/*******************************************************************************
+ * This method will check that every pin of a batch on a chip is exported.  The
+ * chip's lock must be held.
+ * @param uint32_t chip - This is the chip.
+ * @param const uint32_t *pins - This is the array of pins.
+ * @param uint32_t count - This is the number of pins.
+ * @return The return will be 0 if they are or a negative number if one is not.
+ ******************************************************************************/
+static int32_t cdev_check_chip(uint32_t chip, const uint32_t *pins, uint32_t count)
+{
+	uint32_t index;
+
+	for (index = 0; index < count; index++) {
+		if ((pins[index] / GPIO_PINS_PER_BANK == chip) && !lines[pins[index]].exported) {
+			errno = ENOENT;
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will set the values of the pins of a batch which are on one
+ * chip.  The shared lines are set by one ioctl; a line with its own request is
+ * set on its own.  The chip's lock must be held.
+ * @param uint32_t chip - This is the chip.
+ * @param const uint32_t *pins - This is the array of pins that are to be set.
+ * @param const uint32_t *values - This is the value for each pin.  Non zero is high.
+ * @param uint32_t count - This is the number of pins.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t cdev_write_chip(uint32_t chip, const uint32_t *pins, const uint32_t *values, uint32_t count)
+{
+	struct gpio_v2_line_values chipValues = { 0, 0 };
+	uint64_t bit;
+	uint32_t index;
+	int32_t rc = 0;
+
+	if (cdev_check_chip(chip, pins, count) < 0) {
+		log_perror("gpio/cdev-set-values");
+		return -1;
+	}
+	for (index = 0; index < count; index++) {
+		if (pins[index] / GPIO_PINS_PER_BANK != chip) {
+			continue;
+		}
+		if (!lines[pins[index]].grouped) {
+			if (cdev_write(pins[index], values[index]) < 0) {
+				rc = -1;
+			}
+			continue;
+		}
+		bit = 1ULL << lines[pins[index]].bit;
+		chipValues.mask |= bit;
+		chipValues.bits = (values[index] != 0) ? (chipValues.bits | bit) : (chipValues.bits & ~bit);
+	}
+	if (chipValues.mask == 0) {
+		return rc;
+	}
+	if (ops->ioctl(groups[chip].fd, GPIO_V2_LINE_SET_VALUES_IOCTL, &chipValues) < 0) {
+		log_perror("gpio/cdev-set-values");
+		return -1;
+	}
+
+	// Remember the levels written, for the next time the shared request is made.
+	for (index = 0; index < count; index++) {
+		if ((pins[index] / GPIO_PINS_PER_BANK == chip) && lines[pins[index]].grouped) {
+			lines[pins[index]].level = (uint32_t)((chipValues.bits >> lines[pins[index]].bit) & 1);
+		}
+	}
+	return rc;
+}
+
+/*******************************************************************************
+ * This method will set the values of several pins.  The shared lines of each
+ * chip are set by one ioctl; a line with its own request is set on its own.
+ * @param const uint32_t *pins - This is the array of pins that are to be set.
+ * @param const uint32_t *values - This is the value for each pin.  Non zero is high.
+ * @param uint32_t count - This is the number of pins.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t cdev_set_values(const uint32_t *pins, const uint32_t *values, uint32_t count)
+{
+	uint32_t index, chip, used = 0;
+	int32_t rc = 0;
+
+	for (index = 0; index < count; index++) {
+		if (pins[index] >= GPIO_MAX_PINS) {
+			errno = ENOENT;
+			log_perror("gpio/cdev-set-values");
+			return -1;
+		}
+		used |= 1u << (pins[index] / GPIO_PINS_PER_BANK);
+	}
+
+	// Each chip is written under its own lock, so only one lock is held at a time.
+	for (chip = 0; chip < CDEV_MAX_CHIPS; chip++) {
+		if (!(used & (1u << chip))) {
+			continue;
+		}
+		pthread_mutex_lock(&groups[chip].lock);
+		if (cdev_write_chip(chip, pins, values, count) < 0) {
+			rc = -1;
+		}
+		pthread_mutex_unlock(&groups[chip].lock);
+	}
+	return rc;
+}
+
+/*******************************************************************************
+ * This method will read the values of the pins of a batch which are on one
+ * chip.  The shared lines are sampled together by one ioctl; a line with its
+ * own request is read on its own.  The chip's lock must be held.
+ * @param uint32_t chip - This is the chip.
+ * @param const uint32_t *pins - This is the array of pins that are to be read.
+ * @param uint32_t *values - This is where the value of each pin is placed.
+ * @param uint32_t count - This is the number of pins.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t cdev_read_chip(uint32_t chip, const uint32_t *pins, uint32_t *values, uint32_t count)
+{
+	struct gpio_v2_line_values chipValues = { 0, 0 };
+	uint32_t index;
+
+	if (cdev_check_chip(chip, pins, count) < 0) {
+		log_perror("gpio/cdev-get-values");
+		return -1;
+	}
+	for (index = 0; index < count; index++) {
+		if ((pins[index] / GPIO_PINS_PER_BANK == chip) && lines[pins[index]].grouped) {
+			chipValues.mask |= 1ULL << lines[pins[index]].bit;
+		}
+	}
+	if ((chipValues.mask != 0) &&
+		(ops->ioctl(groups[chip].fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &chipValues) < 0)) {
+		log_perror("gpio/cdev-get-values");
+		return -1;
+	}
+
+	for (index = 0; index < count; index++) {
+		if (pins[index] / GPIO_PINS_PER_BANK != chip) {
+			continue;
+		}
+		if (!lines[pins[index]].grouped) {
+			if (cdev_read(pins[index], &values[index]) < 0) {
+				return -1;
+			}
+			continue;
+		}
+		values[index] = (uint32_t)((chipValues.bits >> lines[pins[index]].bit) & 1);
+	}
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will read the values of several pins.  The shared lines of each
+ * chip are sampled together by one ioctl; a line with its own request is read
+ * on its own.
+ * @param const uint32_t *pins - This is the array of pins that are to be read.
+ * @param uint32_t *values - This is where the value of each pin is placed.
+ * @param uint32_t count - This is the number of pins.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t cdev_get_values(const uint32_t *pins, uint32_t *values, uint32_t count)
+{
+	uint32_t index, chip, used = 0;
+	int32_t rc;
+
+	for (index = 0; index < count; index++) {
+		if (pins[index] >= GPIO_MAX_PINS) {
+			errno = ENOENT;
+			log_perror("gpio/cdev-get-values");
+			return -1;
+		}
+		used |= 1u << (pins[index] / GPIO_PINS_PER_BANK);
+	}
+
+	for (chip = 0; chip < CDEV_MAX_CHIPS; chip++) {
+		if (!(used & (1u << chip))) {
+			continue;
+		}
+		pthread_mutex_lock(&groups[chip].lock);
+		rc = cdev_read_chip(chip, pins, values, count);
+		pthread_mutex_unlock(&groups[chip].lock);
+		if (rc < 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will set the edges on which the given pin queues events.
+ * @param uint32_t gpio - This is the pin that is to be configured.
+ * @param uint32_t edgeType This is the edge type.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t cdev_set_edge(uint32_t gpio, uint32_t edgeType)
+{
+	int32_t rc = 0;
+
+	if (gpio >= GPIO_MAX_PINS) {
+		errno = ENOENT;
+		log_perror("gpio/cdev-edge");
+		return -1;
+	}
+	cdev_lock(gpio);
+	if (!lines[gpio].exported) {
+		errno = ENOENT;
+		log_perror("gpio/cdev-edge");
+		rc = -1;
+	} else {
+		lines[gpio].edge = edgeType & GPIO_BOTH_EDGES;
+		if (cdev_place(gpio) < 0) {
+			log_perror("gpio/cdev-edge");
+			rc = -1;
+		}
+	}
+	cdev_unlock(gpio);
+	return rc;
+}
+
+/*******************************************************************************
+ * This method will return a descriptor on which the pin's edge events can be
+ * read.  It is a non-blocking duplicate of the line request, so closing it
+ * does not release the line.  Only an input with edge detection or debouncing
+ * has a request of its own to duplicate, so the edge must be set first.
+ * @param uint32_t gpio - This is the pin that is to be opened.
+ * @return The return will be a file id for the opened descriptor.
+ ******************************************************************************/
+static int32_t cdev_fd_open(uint32_t gpio)
+{
+	int32_t fd = -1;
+
+	if (gpio >= GPIO_MAX_PINS) {
+		errno = ENOENT;
+		log_perror("gpio/cdev-fd_open");
+		return -1;
+	}
+	cdev_lock(gpio);
+	if (!lines[gpio].exported) {
+		errno = ENOENT;
+		log_perror("gpio/cdev-fd_open");
+	} else if (lines[gpio].fd < 0) {
+		errno = EINVAL;
+		log_perror("gpio/cdev-fd_open");
+	} else {
+		fd = fcntl(lines[gpio].fd, F_DUPFD_CLOEXEC, 0);
+		if (fd < 0) {
+			log_perror("gpio/cdev-fd_open");
+		} else {
+			fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+		}
+	}
+	cdev_unlock(gpio);
+	return fd;
+}
+
+/*******************************************************************************
+ * This method will report the configuration of a pin.  Only lines requested by
+ * this program are exported as far as this backend is concerned.
+ * @param uint32_t gpio - This is the pin.
+ * @param struct gpio_pin_config *config - This is where the configuration is placed.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t cdev_get_config(uint32_t gpio, struct gpio_pin_config *config)
+{
+	if (gpio >= GPIO_MAX_PINS) {
+		errno = EINVAL;
+		return -1;
+	}
+	cdev_lock(gpio);
+	config->exported = lines[gpio].exported;
+	config->out = config->exported && lines[gpio].out;
+	config->edge = config->exported ? lines[gpio].edge : GPIO_NO_EDGE;
+	cdev_unlock(gpio);
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will take the oldest queued edge from a line request.
+ * @param int32_t fd - This is the descriptor that is to be read.
+ * @param struct gpio_fd_event *event - This is where the event is placed.
+ * @return The return will be 0 if successful or a negative number if an error
+ *         occurs or no edge is queued.
+ ******************************************************************************/
+static int32_t cdev_fd_read(int32_t fd, struct gpio_fd_event *event)
+{
+	struct gpio_v2_line_event edge;
+
+	if (read(fd, &edge, sizeof(edge)) != (ssize_t)sizeof(edge)) {
+		return -1;
+	}
+	event->value = (edge.id == GPIO_V2_LINE_EVENT_RISING_EDGE);
+	event->seqno = edge.line_seqno;
+	event->timestamp = edge.timestamp_ns;
+	return 0;
+}
+
+const struct gpio_backend gpio_cdev_backend = {
+	"cdev",
+	cdev_export,
+	cdev_unexport,
+	cdev_set_dir,
+	cdev_set_value,
+	cdev_get_value,
+	cdev_set_edge,
+	cdev_fd_open,
+	cdev_set_values,
+	cdev_get_values,
+	cdev_fd_read,
+	POLLIN,
+	cdev_get_config,
+	1
+};
+
+/*******************************************************************************
+ * This method will prepare the character device backend.  gpiochip0 is opened
+ * to check that the chips are present.
+ * @param const char *devDir - This is the directory holding the gpiochipN nodes.
+ *                             NULL uses /dev.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_cdev_open(const char *devDir)
+{
+	if (devDir == NULL) {
+		devDir = GPIO_CDEV_DEFAULT_DIR;
+	}
+	if (strlen(devDir) >= sizeof(devRoot)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	strcpy(devRoot, devDir);
+
+	if (cdev_chip_fd(0) < 0) {
+		log_perror("gpio/cdev-open");
+		return -1;
+	}
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will release every line request and chip.  If the character
+ * device backend is selected, the sysfs backend is selected again.
+ ******************************************************************************/
+void gpio_cdev_close(void)
+{
+	uint32_t index;
+
+	if (gpio_get_backend() == &gpio_cdev_backend) {
+		gpio_set_backend(NULL);
+	}
+	for (index = 0; index < GPIO_MAX_PINS; index++) {
+		cdev_lock(index);
+		if (lines[index].fd >= 0) {
+			close(lines[index].fd);
+			lines[index].fd = -1;
+		}
+		lines[index].exported = 0;
+		lines[index].grouped = 0;
+		lines[index].debounceUs = 0;
+		cdev_unlock(index);
+	}
+	for (index = 0; index < CDEV_MAX_CHIPS; index++) {
+		pthread_mutex_lock(&groups[index].lock);
+		if (groups[index].fd >= 0) {
+			close(groups[index].fd);
+			groups[index].fd = -1;
+		}
+		groups[index].count = 0;
+		if (chips[index] >= 0) {
+			close(chips[index]);
+			chips[index] = -1;
+		}
+		pthread_mutex_unlock(&groups[index].lock);
+	}
+}
+
+/*******************************************************************************
+ * This method will replace the operations used to reach the chips.  It should
+ * be called before gpio_cdev_open.
+ * @param const struct gpio_cdev_ops *newOps - This is the new set.  NULL restores
+ *                                             the real open and ioctl calls.
+ ******************************************************************************/
+void gpio_cdev_set_ops(const struct gpio_cdev_ops *newOps)
+{
+	ops = (newOps != NULL) ? newOps : &kernelOps;
+}
+
+/*******************************************************************************
+ * This method will set the debounce period the kernel applies to an input pin.
+ * It takes effect immediately if the pin is exported.
+ * @param uint32_t gpio - This is the pin that is to be configured.
+ * @param uint32_t periodUs - This is the period in microseconds.  0 disables debouncing.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_cdev_set_debounce(uint32_t gpio, uint32_t periodUs)
+{
+	if (gpio >= GPIO_MAX_PINS) {
+		errno = EINVAL;
+		return -1;
+	}
+	cdev_lock(gpio);
+	lines[gpio].debounceUs = periodUs;
+	if (lines[gpio].exported && (cdev_place(gpio) < 0)) {
+		log_perror("gpio/cdev-debounce");
+		cdev_unlock(gpio);
+		return -1;
+	}
+	cdev_unlock(gpio);
+	return 0;
+}
@@ -0,0 +1,69 @@
+/*********************************************************************
+ * This module is a GPIO backend built on the GPIO character device
+ * (/dev/gpiochipN) v2 uAPI, which replaces the deprecated sysfs interface.
+ *
+ * Exporting a pin requests its line from the chip, and the line is held
+ * until the pin is unexported.  The outputs and plain inputs of a chip
+ * share one line request, so gpio_set_values and gpio_get_values set or
+ * sample them with one ioctl per chip; each input with edge detection or
+ * debouncing has its own request.  Descriptors returned by
+ * gpio_fd_open become readable (POLLIN) when an edge is queued.  The kernel
+ * queues every edge with its own timestamp and sequence number, so edges
+ * that arrive close together are no longer lost, and no lseek is needed.
+ * Debouncing is done by the kernel when a period is configured.
+ *
+ * Pin N is line N % 32 of gpiochip(N / 32), which matches the AM335x.
+ * The chip open and ioctl calls go through replaceable operations, so
+ * the backend can be exercised without hardware (see gpioCdevMock).
+ */
+#ifndef GPIOCDEV_H
+#define GPIOCDEV_H
+
+#include <stdint.h>
+#include "gpioInterface.h"
+
+#define GPIO_CDEV_DEFAULT_DIR "/dev"
+#define GPIO_CDEV_CONSUMER "anticipation"	// Shown as the owner of requested lines
+
+// The system calls the backend makes on chips and line requests.
+struct gpio_cdev_ops {
+	int32_t (*open_chip)(const char *path);
+	int32_t (*ioctl)(int32_t fd, unsigned long request, void *arg);
+};
+
+// The character device backend.  gpio_cdev_open must succeed before it is selected.
+extern const struct gpio_backend gpio_cdev_backend;
+
+/*******************************************************************************
+ * This method will prepare the character device backend.  gpiochip0 is opened
+ * to check that the chips are present.
+ * @param const char *devDir - This is the directory holding the gpiochipN nodes.
+ *                             NULL uses /dev.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_cdev_open(const char *devDir);
+
+/*******************************************************************************
+ * This method will release every line request and chip.  If the character
+ * device backend is selected, the sysfs backend is selected again.
+ ******************************************************************************/
+void gpio_cdev_close(void);
+
+/*******************************************************************************
+ * This method will replace the operations used to reach the chips.  It should
+ * be called before gpio_cdev_open.
+ * @param const struct gpio_cdev_ops *newOps - This is the new set.  NULL restores
+ *                                             the real open and ioctl calls.
+ ******************************************************************************/
+void gpio_cdev_set_ops(const struct gpio_cdev_ops *newOps);
+
+/*******************************************************************************
+ * This method will set the debounce period the kernel applies to an input pin.
+ * It takes effect immediately if the pin is exported.
+ * @param uint32_t gpio - This is the pin that is to be configured.
+ * @param uint32_t periodUs - This is the period in microseconds.  0 disables debouncing.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_cdev_set_debounce(uint32_t gpio, uint32_t periodUs);
+
+#endif
@@ -0,0 +1,395 @@
+/*********************************************************************
+ * This module is a stand-in for the GPIO character devices so that the
+ * character device backend, and the programs built on it, can be exercised
+ * off target.
+ *
+ * Chips are /dev/null descriptors.  Each line request is a socket pair: one
+ * end is handed to the backend as the request and the other is kept here to
+ * queue edge events.  A request may hold several lines, which then share
+ * both ends.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <stdint.h>
+#include <linux/gpio.h>
+#include "gpioInterface.h"
+#include "gpioCdev.h"
+#include "gpioCdevMock.h"
+
+ /****************************************************************
+ * Constants
+ ****************************************************************/
+#define MOCK_MAX_CHIPS (GPIO_MAX_PINS / GPIO_PINS_PER_BANK)
+
+struct mock_line {
+	int32_t requestFd;	// Owned by the backend; -1 if not requested
+	int32_t eventFd;	// Our end of the request
+	uint32_t bit;		// The line's bit in the request's values
+	uint64_t flags;		// GPIO_V2_LINE_FLAG_* of the last configuration
+	uint32_t debounceUs;
+	uint32_t value;
+	uint32_t seqno;
+	uint64_t lastChange;	// CLOCK_MONOTONIC ns of the last level change
+};
+
+static struct mock_line mockLines[GPIO_MAX_PINS];
+static int32_t mockChips[MOCK_MAX_CHIPS];
+static pthread_mutex_t mockLock = PTHREAD_MUTEX_INITIALIZER;
+
+/*******************************************************************************
+ * This method will return the CLOCK_MONOTONIC time, the clock the kernel uses
+ * for line event timestamps.
+ * @return The time in ns.
+ ******************************************************************************/
+static uint64_t mock_now(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+/*******************************************************************************
+ * This method will store a line configuration against a requested line.  As
+ * in the kernel, attributes override the flags of the lines in their mask, and
+ * an output is driven to its value in GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES, or
+ * low if it has none.
+ * @param struct mock_line *line - This is the line.
+ * @param const struct gpio_v2_line_config *config - This is the configuration.
+ ******************************************************************************/
+static void mock_configure(struct mock_line *line, const struct gpio_v2_line_config *config)
+{
+	const struct gpio_v2_line_config_attribute *attr;
+	uint32_t index, value = 0;
+
+	line->flags = config->flags;
+	line->debounceUs = 0;
+	for (index = 0; index < config->num_attrs; index++) {
+		attr = &config->attrs[index];
+		if (!(attr->mask & (1ULL << line->bit))) {
+			continue;
+		}
+		if (attr->attr.id == GPIO_V2_LINE_ATTR_ID_FLAGS) {
+			line->flags = attr->attr.flags;
+		} else if (attr->attr.id == GPIO_V2_LINE_ATTR_ID_DEBOUNCE) {
+			line->debounceUs = attr->attr.debounce_period_us;
+		} else if (attr->attr.id == GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES) {
+			value = (uint32_t)((attr->attr.values >> line->bit) & 1);
+		}
+	}
+	if (line->flags & GPIO_V2_LINE_FLAG_OUTPUT) {
+		line->value = value;
+	}
+}
+
+/*******************************************************************************
+ * This method will forget the request holding a line, and with it every other
+ * line of the request, since the backend has released it.
+ * @param struct mock_line *line - This is the line.
+ ******************************************************************************/
+static void mock_release(struct mock_line *line)
+{
+	int32_t eventFd = line->eventFd;
+	uint32_t index;
+
+	line->requestFd = -1;
+	if (eventFd < 0) {
+		return;
+	}
+	for (index = 0; index < GPIO_MAX_PINS; index++) {
+		if (mockLines[index].eventFd == eventFd) {
+			mockLines[index].eventFd = -1;
+			mockLines[index].requestFd = -1;
+		}
+	}
+	close(eventFd);
+}
+
+/*******************************************************************************
+ * This method is the open_chip operation of the mock.
+ * @param const char *path - This is the path of the chip node.
+ * @return The return will be a file id for the chip or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t mock_open_chip(const char *path)
+{
+	const char *name = strrchr(path, '/');
+	uint32_t chip;
+	int32_t fd;
+
+	name = (name != NULL) ? name + 1 : path;
+	if ((sscanf(name, "gpiochip%u", &chip) != 1) || (chip >= MOCK_MAX_CHIPS)) {
+		errno = ENOENT;
+		return -1;
+	}
+
+	fd = open("/dev/null", O_RDWR | O_CLOEXEC);
+	if (fd >= 0) {
+		pthread_mutex_lock(&mockLock);
+		mockChips[chip] = fd;
+		pthread_mutex_unlock(&mockLock);
+	}
+	return fd;
+}
+
+/*******************************************************************************
+ * This method will request lines of a mock chip.
+ * @param uint32_t chip - This is the chip.
+ * @param struct gpio_v2_line_request *request - This is the request.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t mock_request_line(uint32_t chip, struct gpio_v2_line_request *request)
+{
+	struct mock_line *line;
+	uint32_t requested = 0;
+	int32_t fds[2];
+	uint32_t index;
+
+	if ((request->num_lines == 0) || (request->num_lines > GPIO_PINS_PER_BANK)) {
+		errno = EINVAL;
+		return -1;
+	}
+	for (index = 0; index < request->num_lines; index++) {
+		if ((request->offsets[index] >= GPIO_PINS_PER_BANK) || (requested & (1u << request->offsets[index]))) {
+			errno = EINVAL;
+			return -1;
+		}
+		requested |= 1u << request->offsets[index];
+	}
+	// A packet socket keeps each event whole, like a real request does.
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) < 0) {
+		return -1;
+	}
+
+	// The backend closes requests without telling us, so a request whose
+	// descriptor number has come back is no longer live.
+	for (index = 0; index < GPIO_MAX_PINS; index++) {
+		if (mockLines[index].requestFd == fds[0]) {
+			mock_release(&mockLines[index]);
+		}
+	}
+
+	for (index = 0; index < request->num_lines; index++) {
+		line = &mockLines[chip * GPIO_PINS_PER_BANK + request->offsets[index]];
+		mock_release(line);
+	}
+	for (index = 0; index < request->num_lines; index++) {
+		line = &mockLines[chip * GPIO_PINS_PER_BANK + request->offsets[index]];
+		line->requestFd = fds[0];
+		line->eventFd = fds[1];
+		line->bit = index;
+		line->seqno = 0;
+		mock_configure(line, &request->config);
+	}
+	request->fd = fds[0];
+	return 0;
+}
+
+/*******************************************************************************
+ * This method is the ioctl operation of the mock.  It handles line requests
+ * on chips and configuration and value calls on line requests.
+ * @param int32_t fd - This is the chip or line request.
+ * @param unsigned long request - This is the ioctl.
+ * @param void *arg - This is the ioctl argument.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t mock_ioctl(int32_t fd, unsigned long request, void *arg)
+{
+	struct gpio_v2_line_values *values = (struct gpio_v2_line_values*)arg;
+	struct mock_line *held[GPIO_PINS_PER_BANK];
+	uint32_t index, count = 0;
+	int32_t rc = 0;
+
+	pthread_mutex_lock(&mockLock);
+	if (request == GPIO_V2_GET_LINE_IOCTL) {
+		for (index = 0; index < MOCK_MAX_CHIPS; index++) {
+			if (mockChips[index] == fd) {
+				break;
+			}
+		}
+		if (index == MOCK_MAX_CHIPS) {
+			errno = EBADF;
+			rc = -1;
+		} else {
+			rc = mock_request_line(index, (struct gpio_v2_line_request*)arg);
+		}
+		pthread_mutex_unlock(&mockLock);
+		return rc;
+	}
+
+	for (index = 0; (index < GPIO_MAX_PINS) && (count < GPIO_PINS_PER_BANK); index++) {
+		if (mockLines[index].requestFd == fd) {
+			held[count++] = &mockLines[index];
+		}
+	}
+	if (count == 0) {
+		pthread_mutex_unlock(&mockLock);
+		errno = EBADF;
+		return -1;
+	}
+
+	switch (request) {
+	case GPIO_V2_LINE_SET_CONFIG_IOCTL:
+		for (index = 0; index < count; index++) {
+			mock_configure(held[index], (struct gpio_v2_line_config*)arg);
+		}
+		break;
+	case GPIO_V2_LINE_GET_VALUES_IOCTL:
+		values->bits = 0;
+		for (index = 0; index < count; index++) {
+			values->bits |= (uint64_t)held[index]->value << held[index]->bit;
+		}
+		values->bits &= values->mask;
+		break;
+	case GPIO_V2_LINE_SET_VALUES_IOCTL:
+		// As in the kernel, nothing is set if any line in the mask is an input.
+		for (index = 0; index < count; index++) {
+			if ((values->mask & (1ULL << held[index]->bit)) && !(held[index]->flags & GPIO_V2_LINE_FLAG_OUTPUT)) {
+				errno = EPERM;
+				rc = -1;
+			}
+		}
+		for (index = 0; (rc == 0) && (index < count); index++) {
+			if (values->mask & (1ULL << held[index]->bit)) {
+				held[index]->value = (uint32_t)((values->bits >> held[index]->bit) & 1);
+			}
+		}
+		break;
+	default:
+		errno = ENOTTY;
+		rc = -1;
+		break;
+	}
+	pthread_mutex_unlock(&mockLock);
+	return rc;
+}
+
+static const struct gpio_cdev_ops mockOps = { mock_open_chip, mock_ioctl };
+
+/*******************************************************************************
+ * This method will install the mock chips and select the character device backend.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_cdev_mock_start(void)
+{
+	uint32_t index;
+
+	for (index = 0; index < GPIO_MAX_PINS; index++) {
+		mockLines[index].requestFd = -1;
+		mockLines[index].eventFd = -1;
+		mockLines[index].bit = 0;
+		mockLines[index].flags = 0;
+		mockLines[index].debounceUs = 0;
+		mockLines[index].value = 0;
+		mockLines[index].lastChange = 0;
+	}
+	for (index = 0; index < MOCK_MAX_CHIPS; index++) {
+		mockChips[index] = -1;
+	}
+
+	gpio_cdev_set_ops(&mockOps);
+	if (gpio_cdev_open(NULL) < 0) {
+		gpio_cdev_set_ops(NULL);
+		return -1;
+	}
+	gpio_set_backend(&gpio_cdev_backend);
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will release the mock chips and restore the sysfs backend.
+ ******************************************************************************/
+void gpio_cdev_mock_stop(void)
+{
+	uint32_t index;
+
+	// The backend closes the chips and its ends of the requests.
+	gpio_cdev_close();
+	gpio_cdev_set_ops(NULL);
+
+	pthread_mutex_lock(&mockLock);
+	for (index = 0; index < GPIO_MAX_PINS; index++) {
+		mock_release(&mockLines[index]);
+	}
+	for (index = 0; index < MOCK_MAX_CHIPS; index++) {
+		mockChips[index] = -1;
+	}
+	pthread_mutex_unlock(&mockLock);
+}
+
+/*******************************************************************************
+ * This method will drive the given pin to a new level, as if it had changed
+ * in hardware.  If the pin is requested as an input and the transition matches
+ * its configured edges, an event is queued on the request.  This may be called
+ * from any thread.
+ * @param uint32_t gpio - This is the pin that is to be driven.
+ * @param uint32_t value - This is the new level.  Non zero is high.
+ * @return The return will be 1 if an event was queued, 0 if not, or a negative
+ *         number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_cdev_mock_inject(uint32_t gpio, uint32_t value)
+{
+	struct gpio_v2_line_event event;
+	struct mock_line *line;
+	uint64_t now = mock_now();
+	uint64_t edgeFlag;
+	int32_t raise;
+
+	if (gpio >= GPIO_MAX_PINS) {
+		errno = EINVAL;
+		return -1;
+	}
+	line = &mockLines[gpio];
+	value = (value != 0);
+
+	pthread_mutex_lock(&mockLock);
+	if (value == line->value) {
+		pthread_mutex_unlock(&mockLock);
+		return 0;
+	}
+	edgeFlag = value ? GPIO_V2_LINE_FLAG_EDGE_RISING : GPIO_V2_LINE_FLAG_EDGE_FALLING;
+	raise = (line->requestFd >= 0) && (line->flags & GPIO_V2_LINE_FLAG_INPUT) && (line->flags & edgeFlag) &&
+		((line->debounceUs == 0) || (now - line->lastChange >= (uint64_t)line->debounceUs * 1000ULL));
+	line->value = value;
+	line->lastChange = now;
+
+	if (raise) {
+		memset(&event, 0, sizeof(event));
+		event.timestamp_ns = now;
+		event.id = value ? GPIO_V2_LINE_EVENT_RISING_EDGE : GPIO_V2_LINE_EVENT_FALLING_EDGE;
+		event.offset = gpio % GPIO_PINS_PER_BANK;
+		event.seqno = ++line->seqno;
+		event.line_seqno = line->seqno;
+		// A full or abandoned request drops the event rather than blocking the injector.
+		if (send(line->eventFd, &event, sizeof(event), MSG_DONTWAIT | MSG_NOSIGNAL) != (ssize_t)sizeof(event)) {
+			raise = 0;
+		}
+	}
+	pthread_mutex_unlock(&mockLock);
+	return raise;
+}
+
+/*******************************************************************************
+ * This method will read the current level of the given pin, for example as
+ * driven by gpio_set_value on an output.
+ * @param uint32_t gpio - This is the pin that is to be read.
+ * @param uint32_t *value - This is where the level is placed.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_cdev_mock_read(uint32_t gpio, uint32_t *value)
+{
+	if (gpio >= GPIO_MAX_PINS) {
+		errno = EINVAL;
+		return -1;
+	}
+	pthread_mutex_lock(&mockLock);
+	*value = mockLines[gpio].value;
+	pthread_mutex_unlock(&mockLock);
+	return 0;
+}
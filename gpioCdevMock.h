@@ -0,0 +1,50 @@
+/*********************************************************************
+ * This module is a stand-in for the GPIO character devices so that the
+ * character device backend, and the programs built on it, can be exercised
+ * off target.
+ *
+ * The mock replaces the backend's open and ioctl operations.  Each line
+ * request is a socket: the backend reads from it exactly as it would read a
+ * real request, and the mock writes a gpio_v2_line_event into it, stamped
+ * with CLOCK_MONOTONIC, whenever an injected change matches the configured
+ * edges.  A configured debounce period suppresses the events of changes which
+ * follow the previous change more closely than the period.
+ */
+#ifndef GPIOCDEVMOCK_H
+#define GPIOCDEVMOCK_H
+
+#include <stdint.h>
+
+/*******************************************************************************
+ * This method will install the mock chips and select the character device backend.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_cdev_mock_start(void);
+
+/*******************************************************************************
+ * This method will release the mock chips and restore the sysfs backend.
+ ******************************************************************************/
+void gpio_cdev_mock_stop(void);
+
+/*******************************************************************************
+ * This method will drive the given pin to a new level, as if it had changed
+ * in hardware.  If the pin is requested as an input and the transition matches
+ * its configured edges, an event is queued on the request.  This may be called
+ * from any thread.
+ * @param uint32_t gpio - This is the pin that is to be driven.
+ * @param uint32_t value - This is the new level.  Non zero is high.
+ * @return The return will be 1 if an event was queued, 0 if not, or a negative
+ *         number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_cdev_mock_inject(uint32_t gpio, uint32_t value);
+
+/*******************************************************************************
+ * This method will read the current level of the given pin, for example as
+ * driven by gpio_set_value on an output.
+ * @param uint32_t gpio - This is the pin that is to be read.
+ * @param uint32_t *value - This is where the level is placed.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_cdev_mock_read(uint32_t gpio, uint32_t *value);
+
+#endif
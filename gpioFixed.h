@@ -0,0 +1,183 @@
+/*********************************************************************
+ * This header specializes the operations on a pin at compile time, for
+ * boards whose pin map is fixed.  GPIO_FIXED_PIN(name, backend, gpio)
+ * defines a set of inline functions for one pin of one backend:
+ *
+ *   name_bind()        finds the pin's file or register; call it once the
+ *                      pin is exported and its direction set
+ *   name_high()        drives the pin high
+ *   name_low()         drives the pin low
+ *   name_set(value)    drives the pin to value
+ *   name_get(&value)   reads the pin
+ *   name_release()     forgets what name_bind found
+ *
+ * and the constant name_gpio.  backend is SYSFS or MMAP.  gpio must be a
+ * plain decimal number, or a macro which expands to one without
+ * parentheses, because it is pasted into the sysfs path.
+ *
+ * The path below the sysfs root, the register offsets and the bit mask
+ * are constants, so nothing is formatted or looked up after name_bind:
+ * name_high is one pwrite of a constant character for SYSFS and one store
+ * of a constant mask to SETDATAOUT for MMAP.
+ *
+ * The calls go straight to the pin.  They bypass the backend selected with
+ * gpio_set_backend, and with it tracing, shared memory publication and the
+ * pin state shadow.  A pin which is also written through gpio_set_value
+ * should be read back with GPIO_FORCE, or checked with gpio_shadow_check.
+ * Exporting, configuring and releasing the pins is left to the generic API.
+ *
+ * For example, for the LED of the first player on the AM335x:
+ *
+ *   GPIO_FIXED_PIN(led1, MMAP, 44)
+ *   ...
+ *   gpio_mmap_open(NULL, NULL);
+ *   led1_bind();
+ *   led1_high();
+ */
+#ifndef GPIOFIXED_H
+#define GPIOFIXED_H
+
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "gpioInterface.h"
+#include "gpioMmap.h"
+#include "asyncLog.h"
+
+#define GPIO_FIXED_STR_(x) #x
+#define GPIO_FIXED_STR(x) GPIO_FIXED_STR_(x)
+
+/*******************************************************************************
+ * This method will open a value file below the sysfs root.
+ * @param int32_t *fd - This is where the descriptor is placed.
+ * @param const char *path - This is the path relative to the root.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static inline int32_t gpio_fixed_sysfs_bind(int32_t *fd, const char *path)
+{
+	int32_t root;
+
+	root = open(gpio_get_root(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (root < 0) {
+		log_perror("gpio/fixed-bind");
+		return -1;
+	}
+	*fd = openat(root, path, O_RDWR | O_CLOEXEC);
+	close(root);
+	if (*fd < 0) {
+		// path is a literal, so it outlives the deferred log; strerror's buffer does not.
+		log_printf("gpio/fixed-bind: %s: errno %d\n", path, errno);
+		return -1;
+	}
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will close a value file opened by gpio_fixed_sysfs_bind.
+ * @param int32_t *fd - This is the descriptor, which is set to -1.
+ ******************************************************************************/
+static inline void gpio_fixed_sysfs_release(int32_t *fd)
+{
+	if (*fd >= 0) {
+		close(*fd);
+		*fd = -1;
+	}
+}
+
+/*******************************************************************************
+ * This method will read a value file.
+ * @param int32_t fd - This is the descriptor.
+ * @param uint32_t *value - This is where the value is placed.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static inline int32_t gpio_fixed_sysfs_get(int32_t fd, uint32_t *value)
+{
+	char ch;
+
+	if (pread(fd, &ch, 1, 0) != 1) {
+		return -1;
+	}
+	*value = (ch != '0');
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will look up the mapped registers of a bank.
+ * @param volatile uint32_t **bank - This is where the registers are placed.
+ * @param uint32_t index - This is the bank.
+ * @return The return will be 0 if successful or a negative number if the bank
+ *         is not mapped.
+ ******************************************************************************/
+static inline int32_t gpio_fixed_mmap_bind(volatile uint32_t **bank, uint32_t index)
+{
+	*bank = gpio_mmap_bank(index);
+	if (*bank == NULL) {
+		log_printf("gpio/fixed-bind: GPIO bank %u is not mapped\n", index);
+		return -1;
+	}
+	return 0;
+}
+
+#define GPIO_FIXED_SYSFS(name, gpio) \
+	enum { name##_gpio = gpio }; \
+	_Static_assert((gpio) < GPIO_MAX_PINS, "GPIO " #gpio " is out of range"); \
+	static int32_t name##Fd = -1; \
+	static inline int32_t name##_bind(void) \
+	{ \
+		return gpio_fixed_sysfs_bind(&name##Fd, "gpio" GPIO_FIXED_STR(gpio) "/value"); \
+	} \
+	static inline void name##_release(void) \
+	{ \
+		gpio_fixed_sysfs_release(&name##Fd); \
+	} \
+	static inline int32_t name##_high(void) \
+	{ \
+		return (pwrite(name##Fd, "1", 1, 0) == 1) ? 0 : -1; \
+	} \
+	static inline int32_t name##_low(void) \
+	{ \
+		return (pwrite(name##Fd, "0", 1, 0) == 1) ? 0 : -1; \
+	} \
+	static inline int32_t name##_get(uint32_t *value) \
+	{ \
+		return gpio_fixed_sysfs_get(name##Fd, value); \
+	}
+
+// DATAIN follows the pin whichever its direction, so name_get needs no look at OE.
+#define GPIO_FIXED_MMAP(name, gpio) \
+	enum { name##_gpio = gpio }; \
+	_Static_assert((gpio) / GPIO_MMAP_PINS_PER_BANK < GPIO_MMAP_BANKS, "GPIO " #gpio " is out of range"); \
+	static volatile uint32_t *name##Bank; \
+	static inline int32_t name##_bind(void) \
+	{ \
+		return gpio_fixed_mmap_bind(&name##Bank, (gpio) / GPIO_MMAP_PINS_PER_BANK); \
+	} \
+	static inline void name##_release(void) \
+	{ \
+		name##Bank = NULL; \
+	} \
+	static inline int32_t name##_high(void) \
+	{ \
+		name##Bank[AM335X_GPIO_SETDATAOUT / sizeof(uint32_t)] = 1u << ((gpio) % GPIO_MMAP_PINS_PER_BANK); \
+		return 0; \
+	} \
+	static inline int32_t name##_low(void) \
+	{ \
+		name##Bank[AM335X_GPIO_CLEARDATAOUT / sizeof(uint32_t)] = 1u << ((gpio) % GPIO_MMAP_PINS_PER_BANK); \
+		return 0; \
+	} \
+	static inline int32_t name##_get(uint32_t *value) \
+	{ \
+		*value = (name##Bank[AM335X_GPIO_DATAIN / sizeof(uint32_t)] >> ((gpio) % GPIO_MMAP_PINS_PER_BANK)) & 1; \
+		return 0; \
+	}
+
+#define GPIO_FIXED_PIN(name, backend, gpio) \
+	GPIO_FIXED_##backend(name, gpio) \
+	static inline int32_t name##_set(uint32_t value) \
+	{ \
+		return value ? name##_high() : name##_low(); \
+	}
+
+#endif
@@ -18,55 +18,541 @@
 #include <fcntl.h>
 #include <poll.h>
 #include <stdint.h>
-
-
-#define GPIO_NO_EDGE (0)
-#define GPIO_RISING_EDGE (1)
-#define GPIO_FALLING_EDGE (2)
-#define GPIO_BOTH_EDGES (3)
+#include <pthread.h>
+#include <sys/inotify.h>
+#include "gpioInterface.h"
+#include "asyncLog.h"
+#include "timeutil.h"
+#include "pool.h"
+#include "gpioRegistry.h"
 
  /****************************************************************
  * Constants
  ****************************************************************/
 #define SYSFS_GPIO_DIR "/sys/class/gpio"
+#define SYSFS_ROOT_ENV "GPIO_SYSFS_ROOT"
 #define MAX_BUF 64
+#define MAX_PATH_BUF 256
+#define EXPORT_TIMEOUT_MS (1000)	// Longest wait for udev to hand over a new gpioN node
+#define EXPORT_RECHECK_MS (20)		// sysfs does not report every change through inotify
+
+// The directory holding export, unexport and the gpioN nodes.  Empty until first use.
+static char sysfsRoot[MAX_PATH_BUF];
+
+/****************************************************************
+ * Pin handle cache
+ *
+ * The value, direction and edge files of every exported pin are opened
+ * once and kept open until the pin is unexported, so the set / get paths
+ * are a single pwrite / pread at offset 0 instead of open/write/close.
+ ****************************************************************/
+#define GPIO_ATTR_VALUE (0)
+#define GPIO_ATTR_DIRECTION (1)
+#define GPIO_ATTR_EDGE (2)
+#define GPIO_ATTR_COUNT (3)
+
+static const char* attrNames[GPIO_ATTR_COUNT] = {"value", "direction", "edge"};
+
+// An entry of -1 indicates that the attribute file is not currently open.
+static int32_t pinHandles[GPIO_MAX_PINS][GPIO_ATTR_COUNT] = {
+	[0 ... GPIO_MAX_PINS - 1] = {-1, -1, -1}
+};
+
+/****************************************************************
+ * Pin paths
+ *
+ * The sysfs paths of a pin are formatted once, into a descriptor taken
+ * from a fixed pool, and kept until the root changes.  The pool is sized
+ * by gpio_reserve_pins, or for every pin the first time a path is needed
+ * if that was not called.  Pins the pool does not cover have their paths
+ * formatted on each use.
+ *
+ * gpio_path returns a pointer into the descriptor without holding any
+ * reference, so a descriptor is never returned to the pool while other
+ * threads may use the pin: not on unexport, since the paths of a pin do
+ * not depend on whether it is exported, only on gpio_set_root, which must
+ * not run alongside other calls into the library.
+ ****************************************************************/
+#define GPIO_PATH_NODE (GPIO_ATTR_COUNT)	// The gpioN directory itself
+#define GPIO_PATH_COUNT (GPIO_ATTR_COUNT + 1)
+
+struct gpio_pin_paths {
+	char path[GPIO_PATH_COUNT][MAX_PATH_BUF];
+};
+
+static struct pool pinPool;
+static uint32_t pinPoolReady;
+static pthread_mutex_t pinPoolLock = PTHREAD_MUTEX_INITIALIZER;
+static struct gpio_pin_paths *pinPaths[GPIO_MAX_PINS];
 
 /*******************************************************************************
- * This method will export the given GPIO pin.
- * @param uint32_t gpio - This is the pin that is to be exported.
+ * This method will create the pool of pin descriptors if it does not exist.
+ * @param uint32_t count - This is the number of pins it must hold.
+ * @return The return will be 0 if the pool exists or a negative number if it
+ *         cannot be created.
+ ******************************************************************************/
+static int32_t gpio_pool_create(uint32_t count)
+{
+	int32_t rc = 0;
+
+	pthread_mutex_lock(&pinPoolLock);
+	if (!__atomic_load_n(&pinPoolReady, __ATOMIC_ACQUIRE)) {
+		rc = pool_init(&pinPool, "pins", sizeof(struct gpio_pin_paths),
+			(count < GPIO_MAX_PINS) ? count : GPIO_MAX_PINS);
+		if (rc == 0) {
+			__atomic_store_n(&pinPoolReady, 1, __ATOMIC_RELEASE);
+		}
+	}
+	pthread_mutex_unlock(&pinPoolLock);
+	return rc;
+}
+
+/*******************************************************************************
+ * This method will return a sysfs path of a pin.
+ * @param uint32_t gpio - This is the pin.
+ * @param uint32_t which - This is an attribute (GPIO_ATTR_VALUE, ...) or GPIO_PATH_NODE.
+ * @param char *buf - This is where the path is formatted if it is not kept.
+ * @param size_t size - This is the size of buf.
+ * @return The path.
+ ******************************************************************************/
+static const char* gpio_path(uint32_t gpio, uint32_t which, char *buf, size_t size)
+{
+	struct gpio_pin_paths *paths, *expected = NULL;
+	uint32_t index;
+
+	if (gpio < GPIO_MAX_PINS) {
+		paths = __atomic_load_n(&pinPaths[gpio], __ATOMIC_ACQUIRE);
+		if (paths != NULL) {
+			return paths->path[which];
+		}
+		if ((__atomic_load_n(&pinPoolReady, __ATOMIC_ACQUIRE) || (gpio_pool_create(GPIO_MAX_PINS) == 0)) &&
+			((paths = (struct gpio_pin_paths*)pool_alloc(&pinPool)) != NULL)) {
+			snprintf(paths->path[GPIO_PATH_NODE], MAX_PATH_BUF, "%s/gpio%d", gpio_get_root(), gpio);
+			for (index = 0; index < GPIO_ATTR_COUNT; index++) {
+				snprintf(paths->path[index], MAX_PATH_BUF, "%s/gpio%d/%s", gpio_get_root(), gpio, attrNames[index]);
+			}
+			// Another thread may have made the same paths in the meantime.  Keep theirs.
+			if (!__atomic_compare_exchange_n(&pinPaths[gpio], &expected, paths, 0,
+				__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+				pool_free(&pinPool, paths);
+				paths = expected;
+			}
+			return paths->path[which];
+		}
+	}
+
+	if (which == GPIO_PATH_NODE) {
+		snprintf(buf, size, "%s/gpio%d", gpio_get_root(), gpio);
+	} else {
+		snprintf(buf, size, "%s/gpio%d/%s", gpio_get_root(), gpio, attrNames[which]);
+	}
+	return buf;
+}
+
+/*******************************************************************************
+ * This method will return the path descriptor of a pin to the pool.  No other
+ * thread may be using the paths of the pin.
+ * @param uint32_t gpio - This is the pin.
+ ******************************************************************************/
+static void gpio_release_paths(uint32_t gpio)
+{
+	struct gpio_pin_paths *paths;
+
+	if (gpio < GPIO_MAX_PINS) {
+		paths = __atomic_exchange_n(&pinPaths[gpio], NULL, __ATOMIC_ACQ_REL);
+		if (paths != NULL) {
+			pool_free(&pinPool, paths);
+		}
+	}
+}
+
+/*******************************************************************************
+ * This method will return the cached file descriptor for the given attribute
+ * of the given pin, opening the sysfs file the first time it is needed.
+ * @param uint32_t gpio - This is the pin whose attribute is wanted.
+ * @param uint32_t attr - This is the attribute (GPIO_ATTR_VALUE, ...).
+ * @return The file descriptor, or a negative number if it could not be opened.
+ ******************************************************************************/
+static int32_t gpio_attr_fd(uint32_t gpio, uint32_t attr)
+{
+	int32_t fd, expected = -1;
+	char buf[MAX_PATH_BUF];
+
+	fd = __atomic_load_n(&pinHandles[gpio][attr], __ATOMIC_ACQUIRE);
+	if (fd >= 0) {
+		return fd;
+	}
+
+	fd = open(gpio_path(gpio, attr, buf, sizeof(buf)), O_RDWR);
+	if (fd < 0) {
+		return fd;
+	}
+
+	// Another thread may have opened the same file in the meantime.  Keep theirs.
+	if (!__atomic_compare_exchange_n(&pinHandles[gpio][attr], &expected, fd, 0,
+		__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		close(fd);
+		fd = expected;
+	}
+	return fd;
+}
+
+/*******************************************************************************
+ * This method will close all cached file descriptors of the given pin.
+ * @param uint32_t gpio - This is the pin whose handles are to be released.
+ ******************************************************************************/
+static void gpio_release_handles(uint32_t gpio)
+{
+	int32_t attr, fd;
+
+	for (attr = 0; attr < GPIO_ATTR_COUNT; attr++) {
+		fd = __atomic_exchange_n(&pinHandles[gpio][attr], -1, __ATOMIC_ACQ_REL);
+		if (fd >= 0) {
+			close(fd);
+		}
+	}
+}
+
+/*******************************************************************************
+ * This method will write the given data to an attribute of a pin.  Pins inside
+ * the handle table use the cached descriptor; any other pin falls back to
+ * opening and closing the file for each write.
+ * @param uint32_t gpio - This is the pin that is to be written.
+ * @param uint32_t attr - This is the attribute (GPIO_ATTR_VALUE, ...).
+ * @param const char *data - This is the data that is to be written.
+ * @param size_t len - This is the number of bytes to write.
  * @return The return will be 0 if successful or a negative number if an error occurs.
  ******************************************************************************/
-int32_t gpio_export(uint32_t gpio)
+static int32_t gpio_attr_write(uint32_t gpio, uint32_t attr, const char *data, size_t len)
 {
-	int32_t fd, len;
-	char buf[MAX_BUF];
- 
-	fd = open(SYSFS_GPIO_DIR "/export", O_WRONLY);
+	int32_t fd;
+	ssize_t rc;
+	char buf[MAX_PATH_BUF];
+
+	if (gpio < GPIO_MAX_PINS) {
+		fd = gpio_attr_fd(gpio, attr);
+		if (fd < 0) {
+			return fd;
+		}
+		return (pwrite(fd, data, len, 0) < 0) ? -1 : 0;
+	}
+
+	snprintf(buf, sizeof(buf), "%s/gpio%d/%s", gpio_get_root(), gpio, attrNames[attr]);
+	fd = open(buf, O_WRONLY);
 	if (fd < 0) {
-		perror("gpio/export");
 		return fd;
 	}
- 
-	len = snprintf(buf, sizeof(buf), "%d", gpio);
-	write(fd, buf, len);
+	rc = write(fd, data, len);
+	close(fd);
+	return (rc < 0) ? -1 : 0;
+}
+
+/*******************************************************************************
+ * This method will read the first character of an attribute of a pin.
+ * @param uint32_t gpio - This is the pin that is to be read.
+ * @param uint32_t attr - This is the attribute (GPIO_ATTR_VALUE, ...).
+ * @param char *ch - This is where the character that was read is placed.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t gpio_attr_read(uint32_t gpio, uint32_t attr, char *ch)
+{
+	int32_t fd;
+	ssize_t rc;
+	char buf[MAX_PATH_BUF];
+
+	if (gpio < GPIO_MAX_PINS) {
+		fd = gpio_attr_fd(gpio, attr);
+		if (fd < 0) {
+			return fd;
+		}
+		return (pread(fd, ch, 1, 0) != 1) ? -1 : 0;
+	}
+
+	snprintf(buf, sizeof(buf), "%s/gpio%d/%s", gpio_get_root(), gpio, attrNames[attr]);
+	fd = open(buf, O_RDONLY);
+	if (fd < 0) {
+		return fd;
+	}
+	rc = read(fd, ch, 1);
 	close(fd);
+	return (rc != 1) ? -1 : 0;
+}
+
+/****************************************************************
+ * Pin state shadow
+ *
+ * The direction and last written level of every pin below GPIO_MAX_PINS
+ * are kept in bitmaps, one bit per pin.  A level is trusted only after it
+ * has been written successfully to a pin made an output through
+ * gpio_set_dir, so a write of the level an output already holds is
+ * skipped and a read of an output needs no system call.  Export, unexport,
+ * a failed write and a change of backend or root forget what is known.
+ *
+ * Writers of the same pin from different threads must be serialized by
+ * the caller, as they always had to be for the pin to end at a known level.
+ ****************************************************************/
+#define SHADOW_WORDS ((GPIO_MAX_PINS + 63) / 64)
+
+struct gpio_shadow {
+	uint64_t output[SHADOW_WORDS];	// Set while the pin is an output
+	uint64_t known[SHADOW_WORDS];	// Set while level holds the pin's level
+	uint64_t level[SHADOW_WORDS];
+} __attribute__((aligned(64)));
+
+// The counters are on their own cache line so counting does not slow the bitmap readers.
+struct gpio_shadow_counters {
+	uint64_t written;
+	uint64_t skipped;
+	uint64_t shadowReads;
+	uint64_t mismatches;
+} __attribute__((aligned(64)));
+
+static struct gpio_shadow shadow;
+static struct gpio_shadow_counters shadowCounts;
+
+/*******************************************************************************
+ * This method will read the shadowed level of a pin.
+ * @param uint32_t gpio - This is the pin.
+ * @param uint32_t *value - This is where the level is placed if it is known.
+ * @return The return will be 1 if the pin is an output at a known level or 0 otherwise.
+ ******************************************************************************/
+static inline uint32_t shadow_get(uint32_t gpio, uint32_t *value)
+{
+	uint64_t bit = 1ull << (gpio % 64);
+	uint32_t word = gpio / 64;
+
+	if ((gpio >= GPIO_MAX_PINS) ||
+		!(__atomic_load_n(&shadow.known[word], __ATOMIC_ACQUIRE) & bit) ||
+		!(__atomic_load_n(&shadow.output[word], __ATOMIC_RELAXED) & bit)) {
+		return 0;
+	}
+	*value = (__atomic_load_n(&shadow.level[word], __ATOMIC_RELAXED) & bit) != 0;
+	return 1;
+}
+
+/*******************************************************************************
+ * This method will record the level of a pin after it has been written or read.
+ * Only outputs are recorded.
+ * @param uint32_t gpio - This is the pin.
+ * @param uint32_t value - This is the level.  Non zero is high.
+ ******************************************************************************/
+static inline void shadow_set(uint32_t gpio, uint32_t value)
+{
+	uint64_t bit = 1ull << (gpio % 64);
+	uint32_t word = gpio / 64;
+
+	if ((gpio >= GPIO_MAX_PINS) || !(__atomic_load_n(&shadow.output[word], __ATOMIC_RELAXED) & bit)) {
+		return;
+	}
+	if (value) {
+		__atomic_fetch_or(&shadow.level[word], bit, __ATOMIC_RELAXED);
+	} else {
+		__atomic_fetch_and(&shadow.level[word], ~bit, __ATOMIC_RELAXED);
+	}
+	__atomic_fetch_or(&shadow.known[word], bit, __ATOMIC_RELEASE);
+}
+
+/*******************************************************************************
+ * This method will forget the level of a pin, and its direction as well if asked.
+ * @param uint32_t gpio - This is the pin.
+ * @param uint32_t direction - This is non zero if the direction is also unknown.
+ ******************************************************************************/
+static inline void shadow_forget(uint32_t gpio, uint32_t direction)
+{
+	uint64_t bit = 1ull << (gpio % 64);
+	uint32_t word = gpio / 64;
+
+	if (gpio >= GPIO_MAX_PINS) {
+		return;
+	}
+	__atomic_fetch_and(&shadow.known[word], ~bit, __ATOMIC_RELEASE);
+	if (direction) {
+		__atomic_fetch_and(&shadow.output[word], ~bit, __ATOMIC_RELAXED);
+	}
+}
+
+/*******************************************************************************
+ * This method will forget the level and direction of every pin.
+ ******************************************************************************/
+static void shadow_forget_all(void)
+{
+	uint32_t word;
+
+	for (word = 0; word < SHADOW_WORDS; word++) {
+		__atomic_store_n(&shadow.known[word], 0, __ATOMIC_RELEASE);
+		__atomic_store_n(&shadow.output[word], 0, __ATOMIC_RELAXED);
+	}
+}
+
+/*******************************************************************************
+ * This method will set the directory in which the sysfs GPIO files are found.
+ * @param const char *root - This is the new root.  NULL restores the default.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_set_root(const char *root)
+{
+	uint32_t gpio;
+
+	if (root == NULL) {
+		root = SYSFS_GPIO_DIR;
+	}
+	if (strlen(root) >= sizeof(sysfsRoot)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+
+	// Cached handles, paths and the shadow refer to pins under the old root.
+	// No other thread may be in the library, so the paths can go back to the pool.
+	for (gpio = 0; gpio < GPIO_MAX_PINS; gpio++) {
+		gpio_release_handles(gpio);
+		gpio_release_paths(gpio);
+	}
+	shadow_forget_all();
+	strcpy(sysfsRoot, root);
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will return the directory in which the sysfs GPIO files are found.
+ * Unless gpio_set_root has been called, this is the GPIO_SYSFS_ROOT environment
+ * variable if it is set, or /sys/class/gpio otherwise.
+ * @return The current sysfs root.
+ ******************************************************************************/
+const char* gpio_get_root(void)
+{
+	const char *env;
+
+	if (sysfsRoot[0] == '\0') {
+		env = getenv(SYSFS_ROOT_ENV);
+		if ((env == NULL) || (strlen(env) >= sizeof(sysfsRoot))) {
+			env = SYSFS_GPIO_DIR;
+		}
+		strcpy(sysfsRoot, env);
+	}
+	return sysfsRoot;
+}
+
+/*******************************************************************************
+ * This method will wait for the direction file of a newly exported pin to be
+ * writable.  The kernel creates the gpioN node, then udev changes its owner
+ * and mode, and until then writes from an unprivileged user fail.  The wait
+ * is woken by inotify on the root (the node appearing) and on the node (its
+ * files changing mode), with a short recheck in case an event is not raised.
+ * @param uint32_t gpio - This is the pin.
+ * @return The return will be 0 if the pin is ready or a negative number, with
+ *         errno set to ETIMEDOUT, if it did not become ready in time.
+ ******************************************************************************/
+static int32_t sysfs_wait_ready(uint32_t gpio)
+{
+	char node[MAX_PATH_BUF];
+	char attr[MAX_PATH_BUF];
+	char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	const char *direction, *nodePath;
+	struct pollfd pfd;
+	int32_t nodeWatch = -1, rc = 0;
+	timens_t deadline, left;
+
+	direction = gpio_path(gpio, GPIO_ATTR_DIRECTION, attr, sizeof(attr));
+	if (access(direction, W_OK) == 0) {
+		return 0;
+	}
+
+	nodePath = gpio_path(gpio, GPIO_PATH_NODE, node, sizeof(node));
+	pfd.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	pfd.events = POLLIN;
+	if (pfd.fd >= 0) {
+		(void)inotify_add_watch(pfd.fd, gpio_get_root(), IN_CREATE);
+	}
+
+	deadline = timens_add(timens_now(CLOCK_MONOTONIC), timens_from_ms(EXPORT_TIMEOUT_MS));
+	while (access(direction, W_OK) < 0) {
+		left = timens_sub(deadline, timens_now(CLOCK_MONOTONIC));
+		if (left <= 0) {
+			errno = ETIMEDOUT;
+			rc = -1;
+			break;
+		}
+		if ((pfd.fd >= 0) && (nodeWatch < 0)) {
+			nodeWatch = inotify_add_watch(pfd.fd, nodePath, IN_ATTRIB | IN_CREATE);
+		}
+		if (timens_to_ms(left) > EXPORT_RECHECK_MS) {
+			left = timens_from_ms(EXPORT_RECHECK_MS);
+		}
+		if (pfd.fd >= 0) {
+			if (poll(&pfd, 1, (int)timens_to_ms(left) + 1) > 0) {
+				while (read(pfd.fd, events, sizeof(events)) > 0) {
+				}
+			}
+		} else {
+			(void)poll(NULL, 0, (int)timens_to_ms(left) + 1);
+		}
+	}
+	if (pfd.fd >= 0) {
+		close(pfd.fd);
+	}
+	return rc;
+}
+
+/*******************************************************************************
+ * This method will export the given GPIO pin through sysfs.
+ * @param uint32_t gpio - This is the pin that is to be exported.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t sysfs_export(uint32_t gpio)
+{
+	int32_t fd, len, attr;
+	char buf[MAX_PATH_BUF];
+
+	// A pin which is already exported is left as it is.
+	if (access(gpio_path(gpio, GPIO_PATH_NODE, buf, sizeof(buf)), F_OK) < 0) {
+		snprintf(buf, sizeof(buf), "%s/export", gpio_get_root());
+		fd = open(buf, O_WRONLY);
+		if (fd < 0) {
+			log_perror("gpio/export");
+			return fd;
+		}
+
+		len = snprintf(buf, sizeof(buf), "%d", gpio);
+		write(fd, buf, len);
+		close(fd);
+	}
+
+	if (sysfs_wait_ready(gpio) < 0) {
+		log_perror("gpio/export");
+		return -1;
+	}
+
+	// Open the attribute files now so the first set / get does not pay for it.
+	// Failures are not fatal here; the handle will be opened on first use.
+	if (gpio < GPIO_MAX_PINS) {
+		for (attr = 0; attr < GPIO_ATTR_COUNT; attr++) {
+			(void)gpio_attr_fd(gpio, attr);
+		}
+	}
  
 	return 0;
 }
 
 /*******************************************************************************
- * This method will unexport the given GPIO pin.
+ * This method will unexport the given GPIO pin through sysfs.  Any file handles that were
+ * cached for the pin are closed.
  * @param uint32_t gpio - This is the pin that is to be exported.
  * @return The return will be 0 if successful or a negative number if an error occurs.
  ******************************************************************************/
-int32_t gpio_unexport(uint32_t gpio)
+static int32_t sysfs_unexport(uint32_t gpio)
 {
 	int32_t fd, len;
-	char buf[MAX_BUF];
+	char buf[MAX_PATH_BUF];
+
+	// The paths are kept: another thread may be using them, and they stay right.
+	if (gpio < GPIO_MAX_PINS) {
+		gpio_release_handles(gpio);
+	}
  
-	fd = open(SYSFS_GPIO_DIR "/unexport", O_WRONLY);
+	snprintf(buf, sizeof(buf), "%s/unexport", gpio_get_root());
+	fd = open(buf, O_WRONLY);
 	if (fd < 0) {
-		perror("gpio/export");
+		log_perror("gpio/export");
 		return fd;
 	}
  
@@ -77,130 +563,571 @@ int32_t gpio_unexport(uint32_t gpio)
 }
 
 /*******************************************************************************
- * This method will set the direction of the given GPIO pin.
+ * This method will set the direction of the given GPIO pin through sysfs.
  * @param uint32_t gpio - This is the pin that is to be set.
  * @param uint32_t out_flag This is the direction.  A 0 value indicates input.  
  *                          A nonzero value is output.
  * @return The return will be 0 if successful or a negative number if an error occurs.
  ******************************************************************************/
-int32_t gpio_set_dir(uint32_t gpio, uint32_t out_flag)
+static int32_t sysfs_set_dir(uint32_t gpio, uint32_t out_flag)
 {
-	int32_t fd, len;
-	char buf[MAX_BUF];
- 
-	len = snprintf(buf, sizeof(buf), SYSFS_GPIO_DIR  "/gpio%d/direction", gpio);
- 
-	fd = open(buf, O_WRONLY);
-	if (fd < 0) {
-		perror("gpio/direction");
-		return fd;
-	}
- 
+	int32_t rc;
+
 	if (out_flag)
 	{	
-		write(fd, "out", 4);
+		rc = gpio_attr_write(gpio, GPIO_ATTR_DIRECTION, "out", 4);
 	}
 	else
 	{
-		write(fd, "in", 3);
+		rc = gpio_attr_write(gpio, GPIO_ATTR_DIRECTION, "in", 3);
 	}
- 
-	close(fd);
-	return 0;
+
+	if (rc < 0) {
+		log_perror("gpio/direction");
+	}
+	return rc;
 }
 
 /*******************************************************************************
- * This method will set the value of the given GPIO pin.
+ * This method will set the value of the given GPIO pin through sysfs.
  * @param uint32_t gpio - This is the pin that is to be set.
  * @param uint32_t value This is the value.  A 0 value is lo / off.  A non zero value is high / on.
  * @return The return will be 0 if successful or a negative number if an error occurs.
  ******************************************************************************/
-int32_t gpio_set_value(uint32_t gpio, uint32_t value)
+static int32_t sysfs_set_value(uint32_t gpio, uint32_t value)
 {
-	int32_t fd, len;
-	char buf[MAX_BUF];
- 
-	len = snprintf(buf, sizeof(buf), SYSFS_GPIO_DIR "/gpio%d/value", gpio);
- 
-	fd = open(buf, O_WRONLY);
-	if (fd < 0) {
-		perror("gpio/set-value");
-		return fd;
-	}
- 
+	int32_t rc;
+
 	if (value)
 	{
-		write(fd, "1", 2);
+		rc = gpio_attr_write(gpio, GPIO_ATTR_VALUE, "1", 2);
 	}
 	else
 	{	
-		write(fd, "0", 2);
+		rc = gpio_attr_write(gpio, GPIO_ATTR_VALUE, "0", 2);
 	}
- 
-	close(fd);
-	return 0;
+
+	if (rc < 0) {
+		log_perror("gpio/set-value");
+	}
+	return rc;
 }
 
 /*******************************************************************************
- * This method will read the value set on a given pin.
+ * This method will read the value set on a given pin through sysfs.
  * @param uint32_t gpio - This is the pin that is to be read.
  * @param uint32_t * value This is a pointer to where the value is to be placed when it is read.
  * @return The return will be 0 if successful or a negative number if an error occurs.
  ******************************************************************************/
-int32_t gpio_get_value(uint32_t gpio, uint32_t *value)
+static int32_t sysfs_get_value(uint32_t gpio, uint32_t *value)
 {
-	int32_t fd, len;
-	char buf[MAX_BUF];
+	int32_t rc;
 	char ch;
 
-	len = snprintf(buf, sizeof(buf), SYSFS_GPIO_DIR "/gpio%d/value", gpio);
- 
-	fd = open(buf, O_RDONLY);
-	if (fd < 0) {
-		perror("gpio/get-value");
-		return fd;
+	rc = gpio_attr_read(gpio, GPIO_ATTR_VALUE, &ch);
+	if (rc < 0) {
+		log_perror("gpio/get-value");
+		return rc;
 	}
- 
-	read(fd, &ch, 1);
 
 	if (ch != '0') {
 		*value = 1;
 	} else {
 		*value = 0;
 	}
- 
-	close(fd);
 	return 0;
 }
 
 
 
 /*******************************************************************************
- * This method will set the edge upon which an interrupt is fired.
+ * This method will set the edge upon which an interrupt is fired through sysfs.
  * @param uint32_t gpio - This is the pin that is to be configured.
  * @param uint32_t edgeType This is the edge type.  It can be either 
  * GPIO_NO_EDGE, GPIO_RISING_EDGE, GPIO_FALLING_EDGE, or GPIO_BOTH_EDGES.
  * @return The return will be 0 if successful or a negative number if an error occurs.
  ******************************************************************************/
- int32_t gpio_set_edge(uint32_t gpio, uint32_t edgeType)
+static int32_t sysfs_set_edge(uint32_t gpio, uint32_t edgeType)
 {
-	int32_t fd, len;
-	char buf[MAX_BUF];
-	char* edgetypes[] = {"none", "rising", "falling", "both"};
+	static const char* const edgetypes[] = {"none", "rising", "falling", "both"};
+	static const size_t edgeLengths[] = {sizeof("none"), sizeof("rising"), sizeof("falling"), sizeof("both")};
+	int32_t rc;
 
-	len = snprintf(buf, sizeof(buf), SYSFS_GPIO_DIR "/gpio%d/edge", gpio);
- 
-	fd = open(buf, O_WRONLY);
+	if (edgeType > GPIO_BOTH_EDGES) {
+		errno = EINVAL;
+		log_perror("gpio/set-edge");
+		return -1;
+	}
+	rc = gpio_attr_write(gpio, GPIO_ATTR_EDGE, edgetypes[edgeType], edgeLengths[edgeType]);
+	if (rc < 0) {
+		log_perror("gpio/set-edge");
+	}
+	return rc;
+}
+
+/*******************************************************************************
+ * This method will read the configuration of a pin from sysfs.
+ * @param uint32_t gpio - This is the pin.
+ * @param struct gpio_pin_config *config - This is where the configuration is placed.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t sysfs_get_config(uint32_t gpio, struct gpio_pin_config *config)
+{
+	char buf[MAX_PATH_BUF];
+	char ch;
+
+	memset(config, 0, sizeof(*config));
+	if (access(gpio_path(gpio, GPIO_PATH_NODE, buf, sizeof(buf)), F_OK) < 0) {
+		return 0;
+	}
+	config->exported = 1;
+
+	// "in" or "out", then "none", "rising", "falling" or "both".
+	if (gpio_attr_read(gpio, GPIO_ATTR_DIRECTION, &ch) < 0) {
+		return -1;
+	}
+	config->out = (ch == 'o');
+	if (gpio_attr_read(gpio, GPIO_ATTR_EDGE, &ch) < 0) {
+		// Pins which cannot interrupt have no edge file.
+		config->edge = GPIO_NO_EDGE;
+		return 0;
+	}
+	config->edge = (ch == 'r') ? GPIO_RISING_EDGE : (ch == 'f') ? GPIO_FALLING_EDGE :
+		(ch == 'b') ? GPIO_BOTH_EDGES : GPIO_NO_EDGE;
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will open the sysfs value file of the given pin for polling.
+ * @param uint32_t gpio - This is the pin that is to be opened.
+ * @return The return will be a file id for the opened file.
+ ******************************************************************************/
+static int32_t sysfs_fd_open(uint32_t gpio)
+{
+	int32_t fd;
+	char buf[MAX_PATH_BUF];
+
+	fd = open(gpio_path(gpio, GPIO_ATTR_VALUE, buf, sizeof(buf)), O_RDONLY | O_NONBLOCK );
 	if (fd < 0) {
-		perror("gpio/set-edge");
-		return fd;
+		log_perror("gpio/fd_open");
+	}
+	return fd;
+}
+
+/*******************************************************************************
+ * This method will read the current value through a sysfs value descriptor.
+ * This is a single pread at offset 0, which also acknowledges the pending
+ * edge so the descriptor can be polled again.
+ * @param int32_t fd - This is the descriptor that is to be read.
+ * @param struct gpio_fd_event *event - This is where the event is placed.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t sysfs_fd_read(int32_t fd, struct gpio_fd_event *event)
+{
+	char buf[MAX_BUF];
+	ssize_t len, i;
+
+	len = pread(fd, buf, sizeof(buf), 0);
+	if ((len < 0) && (errno == ESPIPE)) {
+		// Not seekable (the simulator hands out sockets); the latest level is last.
+		len = read(fd, buf, sizeof(buf));
+	}
+	if (len <= 0) {
+		return -1;
+	}
+
+	for (i = len - 1; i >= 0; i--) {
+		if ((buf[i] == '0') || (buf[i] == '1')) {
+			event->value = (buf[i] == '1');
+			event->seqno = 0;
+			event->timestamp = 0;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+/****************************************************************
+ * Backend selection
+ ****************************************************************/
+const struct gpio_backend gpio_sysfs_backend = {
+	"sysfs",
+	sysfs_export,
+	sysfs_unexport,
+	sysfs_set_dir,
+	sysfs_set_value,
+	sysfs_get_value,
+	sysfs_set_edge,
+	sysfs_fd_open,
+	NULL,
+	NULL,
+	sysfs_fd_read,
+	POLLPRI,
+	sysfs_get_config,
+	1
+};
+
+static const struct gpio_backend *backend = &gpio_sysfs_backend;
+
+/*******************************************************************************
+ * This method will select the backend through which all pin operations go.
+ * @param const struct gpio_backend *newBackend - This is the backend.  NULL
+ *                                                selects gpio_sysfs_backend.
+ ******************************************************************************/
+void gpio_set_backend(const struct gpio_backend *newBackend)
+{
+	newBackend = (newBackend != NULL) ? newBackend : &gpio_sysfs_backend;
+	if (newBackend != backend) {
+		shadow_forget_all();
+	}
+	backend = newBackend;
+}
+
+/*******************************************************************************
+ * This method will return the backend through which all pin operations go.
+ * @return The current backend.
+ ******************************************************************************/
+const struct gpio_backend* gpio_get_backend(void)
+{
+	return backend;
+}
+
+/*******************************************************************************
+ * This method will export the given GPIO pin.
+ * @param uint32_t gpio - This is the pin that is to be exported.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_export(uint32_t gpio)
+{
+	int32_t rc;
+
+	shadow_forget(gpio, 1);
+	rc = backend->export_pin(gpio);
+	if (rc == 0) {
+		gpio_registry_export(gpio);
+	}
+	return rc;
+}
+
+/*******************************************************************************
+ * This method will unexport the given GPIO pin.
+ * @param uint32_t gpio - This is the pin that is to be exported.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_unexport(uint32_t gpio)
+{
+	int32_t rc;
+
+	shadow_forget(gpio, 1);
+	rc = backend->unexport_pin(gpio);
+	if (rc == 0) {
+		gpio_registry_unexport(gpio);
+	}
+	return rc;
+}
+
+/*******************************************************************************
+ * This method will read whether a pin is exported and, if it is, its direction
+ * and edge.
+ * @param uint32_t gpio - This is the pin.
+ * @param struct gpio_pin_config *config - This is where the configuration is placed.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_get_config(uint32_t gpio, struct gpio_pin_config *config)
+{
+	uint64_t bit = 1ull << (gpio % 64);
+
+	if (backend->get_config == NULL) {
+		errno = ENOTSUP;
+		return -1;
+	}
+	if (backend->get_config(gpio, config) < 0) {
+		return -1;
+	}
+	if (gpio < GPIO_MAX_PINS) {
+		if (config->exported && config->out) {
+			__atomic_fetch_or(&shadow.output[gpio / 64], bit, __ATOMIC_RELAXED);
+		} else {
+			shadow_forget(gpio, 1);
+		}
+	}
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will set the direction of the given GPIO pin.
+ * @param uint32_t gpio - This is the pin that is to be set.
+ * @param uint32_t out_flag This is the direction.  A 0 value indicates input.  
+ *                          A nonzero value is output.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_set_dir(uint32_t gpio, uint32_t out_flag)
+{
+	int32_t rc;
+
+	// The level is unknown until the first write, whatever the outcome.
+	shadow_forget(gpio, 1);
+	rc = backend->set_dir(gpio, out_flag);
+	if ((rc == 0) && out_flag && (gpio < GPIO_MAX_PINS)) {
+		__atomic_fetch_or(&shadow.output[gpio / 64], 1ull << (gpio % 64), __ATOMIC_RELAXED);
+	}
+	return rc;
+}
+
+/*******************************************************************************
+ * This method will set the value of the given GPIO pin.
+ * @param uint32_t gpio - This is the pin that is to be set.
+ * @param uint32_t value This is the value.  A 0 value is lo / off.  A non zero value is high / on.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_set_value(uint32_t gpio, uint32_t value)
+{
+	return gpio_set_value_flags(gpio, value, 0);
+}
+
+/*******************************************************************************
+ * This method will set the value of the given GPIO pin unless the pin is an
+ * output already known to hold that value.
+ * @param uint32_t gpio - This is the pin that is to be set.
+ * @param uint32_t value This is the value.  A 0 value is lo / off.  A non zero value is high / on.
+ * @param uint32_t flags This is GPIO_FORCE to write even if the value is unchanged, or 0.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_set_value_flags(uint32_t gpio, uint32_t value, uint32_t flags)
+{
+	uint32_t current;
+
+	value = (value != 0);
+	if (!(flags & GPIO_FORCE) && shadow_get(gpio, &current) && (current == value)) {
+		__atomic_fetch_add(&shadowCounts.skipped, 1, __ATOMIC_RELAXED);
+		return 0;
+	}
+	__atomic_fetch_add(&shadowCounts.written, 1, __ATOMIC_RELAXED);
+	if (backend->set_value(gpio, value) < 0) {
+		shadow_forget(gpio, 0);
+		return -1;
+	}
+	shadow_set(gpio, value);
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will read the value set on a given pin.
+ * @param uint32_t gpio - This is the pin that is to be read.
+ * @param uint32_t * value This is a pointer to where the value is to be placed when it is read.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_get_value(uint32_t gpio, uint32_t *value)
+{
+	return gpio_get_value_flags(gpio, value, 0);
+}
+
+/*******************************************************************************
+ * This method will read the value of a given pin.  The level of an output
+ * is served from the shadow unless it is unknown or the read is forced.
+ * @param uint32_t gpio - This is the pin that is to be read.
+ * @param uint32_t * value This is a pointer to where the value is to be placed when it is read.
+ * @param uint32_t flags This is GPIO_FORCE to read the pin itself, or 0.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_get_value_flags(uint32_t gpio, uint32_t *value, uint32_t flags)
+{
+	if (!(flags & GPIO_FORCE) && shadow_get(gpio, value)) {
+		__atomic_fetch_add(&shadowCounts.shadowReads, 1, __ATOMIC_RELAXED);
+		return 0;
+	}
+	if (backend->get_value(gpio, value) < 0) {
+		return -1;
+	}
+	shadow_set(gpio, *value);
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will set the values of several pins.  The backend coalesces the
+ * writes into as few operations as it can; pins in the same bank change together
+ * where the hardware allows it.
+ * @param const uint32_t *pins - This is the array of pins that are to be set.
+ * @param const uint32_t *values - This is the value for each pin.  Non zero is high.
+ * @param uint32_t count - This is the number of pins.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_set_values(const uint32_t *pins, const uint32_t *values, uint32_t count)
+{
+	uint32_t changedPins[GPIO_MAX_PINS];
+	uint32_t changedValues[GPIO_MAX_PINS];
+	uint32_t index, current, changed = 0;
+	int32_t rc = 0;
+
+	// Drop the pins already at their value.  A longer list than the shadow
+	// covers must repeat pins, so it is written as it is.
+	if (count <= GPIO_MAX_PINS) {
+		for (index = 0; index < count; index++) {
+			if (shadow_get(pins[index], &current) && (current == (values[index] != 0))) {
+				continue;
+			}
+			changedPins[changed] = pins[index];
+			changedValues[changed] = (values[index] != 0);
+			changed++;
+		}
+		__atomic_fetch_add(&shadowCounts.skipped, count - changed, __ATOMIC_RELAXED);
+		if (changed == 0) {
+			return 0;
+		}
+		pins = changedPins;
+		values = changedValues;
+		count = changed;
+	}
+	__atomic_fetch_add(&shadowCounts.written, count, __ATOMIC_RELAXED);
+
+	if (backend->set_values != NULL) {
+		rc = backend->set_values(pins, values, count);
+		for (index = 0; index < count; index++) {
+			if (rc == 0) {
+				shadow_set(pins[index], values[index]);
+			} else {
+				shadow_forget(pins[index], 0);
+			}
+		}
+		return rc;
+	}
+	for (index = 0; index < count; index++) {
+		if (backend->set_value(pins[index], values[index]) < 0) {
+			shadow_forget(pins[index], 0);
+			rc = -1;
+		} else {
+			shadow_set(pins[index], values[index]);
+		}
+	}
+	return rc;
+}
+
+/*******************************************************************************
+ * This method will read the values of several pins.  Where the backend allows
+ * it, all pins of a bank are sampled at the same instant.
+ * @param const uint32_t *pins - This is the array of pins that are to be read.
+ * @param uint32_t *values - This is where the value of each pin is placed.
+ * @param uint32_t count - This is the number of pins.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_get_values(const uint32_t *pins, uint32_t *values, uint32_t count)
+{
+	uint32_t index;
+
+	// Outputs at a known level are served from the shadow.  Any other pin
+	// makes the whole set be read, so the pins are still sampled together.
+	for (index = 0; index < count; index++) {
+		if (!shadow_get(pins[index], &values[index])) {
+			break;
+		}
+	}
+	if (index == count) {
+		__atomic_fetch_add(&shadowCounts.shadowReads, count, __ATOMIC_RELAXED);
+		return 0;
+	}
+
+	if (backend->get_values != NULL) {
+		if (backend->get_values(pins, values, count) < 0) {
+			return -1;
+		}
+	} else {
+		for (index = 0; index < count; index++) {
+			if (backend->get_value(pins[index], &values[index]) < 0) {
+				return -1;
+			}
+		}
+	}
+	for (index = 0; index < count; index++) {
+		shadow_set(pins[index], values[index]);
+	}
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will turn a bank and mask into an array of pins.
+ * @param uint32_t bank - This is the bank.
+ * @param uint32_t mask - This selects the pins.
+ * @param uint32_t *pins - This is where the pins are placed (GPIO_PINS_PER_BANK entries).
+ * @param uint32_t *bits - This is where the bit number of each pin is placed.
+ * @return The number of pins selected by the mask.
+ ******************************************************************************/
+static uint32_t gpio_mask_to_pins(uint32_t bank, uint32_t mask, uint32_t *pins, uint32_t *bits)
+{
+	uint32_t bit, count = 0;
+
+	for (bit = 0; bit < GPIO_PINS_PER_BANK; bit++) {
+		if (mask & (1u << bit)) {
+			pins[count] = bank * GPIO_PINS_PER_BANK + bit;
+			bits[count] = bit;
+			count++;
+		}
+	}
+	return count;
+}
+
+/*******************************************************************************
+ * This method will set the pins of one bank selected by a mask.
+ * @param uint32_t bank - This is the bank.  Pin n of bank b is GPIO b * 32 + n.
+ * @param uint32_t mask - This selects the pins that are to be set.
+ * @param uint32_t values - This holds the new value of each selected pin.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_set_mask(uint32_t bank, uint32_t mask, uint32_t values)
+{
+	uint32_t pins[GPIO_PINS_PER_BANK];
+	uint32_t bits[GPIO_PINS_PER_BANK];
+	uint32_t vals[GPIO_PINS_PER_BANK];
+	uint32_t index, count;
+
+	count = gpio_mask_to_pins(bank, mask, pins, bits);
+	for (index = 0; index < count; index++) {
+		vals[index] = (values >> bits[index]) & 1;
+	}
+	return gpio_set_values(pins, vals, count);
+}
+
+/*******************************************************************************
+ * This method will read the pins of one bank selected by a mask.
+ * @param uint32_t bank - This is the bank.  Pin n of bank b is GPIO b * 32 + n.
+ * @param uint32_t mask - This selects the pins that are to be read.
+ * @param uint32_t *values - This is where the value of each selected pin is placed.
+ *                           Bits outside the mask are zero.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_get_mask(uint32_t bank, uint32_t mask, uint32_t *values)
+{
+	uint32_t pins[GPIO_PINS_PER_BANK];
+	uint32_t bits[GPIO_PINS_PER_BANK];
+	uint32_t vals[GPIO_PINS_PER_BANK];
+	uint32_t index, count;
+
+	count = gpio_mask_to_pins(bank, mask, pins, bits);
+	if (gpio_get_values(pins, vals, count) < 0) {
+		return -1;
+	}
+	*values = 0;
+	for (index = 0; index < count; index++) {
+		*values |= (vals[index] != 0) << bits[index];
 	}
- 
-	write(fd, edgetypes[edgeType], strlen(edgetypes[edgeType]) + 1); 
-	close(fd);
 	return 0;
 }
 
+/*******************************************************************************
+ * This method will set the edge upon which an interrupt is fired.
+ * @param uint32_t gpio - This is the pin that is to be configured.
+ * @param uint32_t edgeType This is the edge type.  It can be either 
+ * GPIO_NO_EDGE, GPIO_RISING_EDGE, GPIO_FALLING_EDGE, or GPIO_BOTH_EDGES.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_set_edge(uint32_t gpio, uint32_t edgeType)
+{
+	if (edgeType > GPIO_BOTH_EDGES) {
+		errno = EINVAL;
+		return -1;
+	}
+	return backend->set_edge(gpio, edgeType);
+}
+
 /*******************************************************************************
  * This method open the given file.
  * @param uint32_t gpio - This is the pin that is to be opened.
@@ -208,18 +1135,55 @@ int32_t gpio_get_value(uint32_t gpio, uint32_t *value)
  ******************************************************************************/
 int32_t gpio_fd_open(uint32_t gpio)
 {
-	int32_t fd, len;
-	char buf[MAX_BUF];
+	int32_t fd = backend->fd_open(gpio);
 
-	len = snprintf(buf, sizeof(buf), SYSFS_GPIO_DIR "/gpio%d/value", gpio);
- 
-	fd = open(buf, O_RDONLY | O_NONBLOCK );
-	if (fd < 0) {
-		perror("gpio/fd_open");
+	if (fd >= 0) {
+		gpio_registry_open(gpio, fd);
 	}
 	return fd;
 }
 
+/*******************************************************************************
+ * This method will read one edge through a descriptor returned by gpio_fd_open.
+ * This also acknowledges the edge so the descriptor can be polled again.
+ * @param int32_t fd - This is the descriptor that is to be read.
+ * @param struct gpio_fd_event *event - This is where the event is placed.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_fd_read_event(int32_t fd, struct gpio_fd_event *event)
+{
+	return backend->fd_read(fd, event);
+}
+
+/*******************************************************************************
+ * This method will return the poll events which signal an edge on descriptors
+ * returned by gpio_fd_open.
+ * @return POLLPRI for sysfs value files; backends may use POLLIN instead.
+ ******************************************************************************/
+uint32_t gpio_fd_events(void)
+{
+	return backend->fdEvents;
+}
+
+/*******************************************************************************
+ * This method will read the current value through a descriptor returned by
+ * gpio_fd_open.  This is a single read, which also acknowledges the pending
+ * edge so the descriptor can be polled again.
+ * @param int32_t fd - This is the descriptor that is to be read.
+ * @param uint32_t *value - This is where the value is placed.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_fd_read_value(int32_t fd, uint32_t *value)
+{
+	struct gpio_fd_event event;
+
+	if (backend->fd_read(fd, &event) < 0) {
+		return -1;
+	}
+	*value = event.value;
+	return 0;
+}
+
 /*******************************************************************************
  * This method close the given file descriptor.
  * @param uint32_t fd This is the file descriptor that is to be closed.
@@ -228,6 +1192,71 @@ int32_t gpio_fd_open(uint32_t gpio)
  ******************************************************************************/
 int32_t gpio_fd_close(int32_t fd)
 {
+	gpio_registry_close(fd);
 	return close(fd);
 }
 
+
+/*******************************************************************************
+ * This method will read every output at a known level from the backend and
+ * compare it with the shadow.  A pin which differs takes the level read.
+ * @return The number of pins which differed.
+ ******************************************************************************/
+uint32_t gpio_shadow_check(void)
+{
+	uint32_t gpio, shadowed, actual, mismatches = 0;
+
+	for (gpio = 0; gpio < GPIO_MAX_PINS; gpio++) {
+		if (!shadow_get(gpio, &shadowed)) {
+			continue;
+		}
+		if (backend->get_value(gpio, &actual) < 0) {
+			shadow_forget(gpio, 0);
+			continue;
+		}
+		if ((actual != 0) != shadowed) {
+			log_printf("gpio/shadow: GPIO %u is %u, expected %u\n", gpio, actual != 0, shadowed);
+			shadow_set(gpio, actual != 0);
+			mismatches++;
+		}
+	}
+	__atomic_fetch_add(&shadowCounts.mismatches, mismatches, __ATOMIC_RELAXED);
+	return mismatches;
+}
+
+/*******************************************************************************
+ * This method will return the counts kept by the pin state shadow.
+ * @param struct gpio_shadow_stats *stats - This is where the counts are placed.
+ ******************************************************************************/
+void gpio_shadow_stats(struct gpio_shadow_stats *stats)
+{
+	stats->written = __atomic_load_n(&shadowCounts.written, __ATOMIC_RELAXED);
+	stats->skipped = __atomic_load_n(&shadowCounts.skipped, __ATOMIC_RELAXED);
+	stats->shadowReads = __atomic_load_n(&shadowCounts.shadowReads, __ATOMIC_RELAXED);
+	stats->mismatches = __atomic_load_n(&shadowCounts.mismatches, __ATOMIC_RELAXED);
+}
+
+/*******************************************************************************
+ * This method will size the pool of pin descriptors.
+ * @param uint32_t count - This is the number of pins the program will use.
+ * @return The return will be 0 if successful or a negative number if the pool
+ *         could not be created or already exists.
+ ******************************************************************************/
+int32_t gpio_reserve_pins(uint32_t count)
+{
+	if (__atomic_load_n(&pinPoolReady, __ATOMIC_ACQUIRE)) {
+		errno = EBUSY;
+		return -1;
+	}
+	return gpio_pool_create(count);
+}
+
+/*******************************************************************************
+ * This method will log the use of the pool of pin descriptors.
+ ******************************************************************************/
+void gpio_pool_report(void)
+{
+	if (__atomic_load_n(&pinPoolReady, __ATOMIC_ACQUIRE)) {
+		pool_report(&pinPool);
+	}
+}
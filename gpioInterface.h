@@ -19,6 +19,115 @@
 #define GPIO_FALLING_EDGE (2)
 #define GPIO_BOTH_EDGES (3)
 
+// Pins below this number have their sysfs files cached from export until unexport.
+// The AM335x has four banks of 32 pins.
+#define GPIO_MAX_PINS (128)
+#define GPIO_PINS_PER_BANK (32)
+
+// Makes gpio_set_value_flags write an unchanged value and gpio_get_value_flags
+// read the pin rather than the shadow.
+#define GPIO_FORCE (1)
+
+// How often the program compares the shadow with the pins themselves.
+#define GPIO_SHADOW_CHECK_MS (5000)
+
+// One edge read from a descriptor returned by gpio_fd_open.
+struct gpio_fd_event {
+	uint32_t value;
+	uint32_t seqno;		// Kernel sequence number, or 0 if the backend has none
+	uint64_t timestamp;	// Kernel CLOCK_MONOTONIC time in ns, or 0 if the backend has none
+};
+
+// The counts kept by the pin state shadow since the program started.
+struct gpio_shadow_stats {
+	uint64_t written;	// Output writes passed to the backend
+	uint64_t skipped;	// Output writes dropped because the pin already held the value
+	uint64_t shadowReads;	// Reads of outputs served without the backend
+	uint64_t mismatches;	// Pins found by gpio_shadow_check at another level
+};
+
+// The configuration of a pin as the backend reports it.
+struct gpio_pin_config {
+	uint32_t exported;
+	uint32_t out;		// Non zero for an output
+	uint32_t edge;		// GPIO_NO_EDGE ... GPIO_BOTH_EDGES
+};
+
+// The set of operations behind the gpio_ calls.  gpio_sysfs_backend is the
+// default; other backends may implement some operations and borrow the rest.
+// The batch operations are optional: when they are NULL, gpio_set_values and
+// gpio_get_values fall back to one set_value / get_value per pin.  get_config
+// is optional as well; without it the configuration of a pin is unknown.
+// threadSafe is set when the operations may be called for different pins from
+// several threads at once; gpio_setup_pins sets pins up in one thread otherwise.
+struct gpio_backend {
+	const char *name;
+	int32_t (*export_pin)(uint32_t gpio);
+	int32_t (*unexport_pin)(uint32_t gpio);
+	int32_t (*set_dir)(uint32_t gpio, uint32_t out_flag);
+	int32_t (*set_value)(uint32_t gpio, uint32_t value);
+	int32_t (*get_value)(uint32_t gpio, uint32_t *value);
+	int32_t (*set_edge)(uint32_t gpio, uint32_t edgeType);
+	int32_t (*fd_open)(uint32_t gpio);
+	int32_t (*set_values)(const uint32_t *pins, const uint32_t *values, uint32_t count);
+	int32_t (*get_values)(const uint32_t *pins, uint32_t *values, uint32_t count);
+	int32_t (*fd_read)(int32_t fd, struct gpio_fd_event *event);
+	uint32_t fdEvents;	// poll events that signal an edge on an fd_open descriptor
+	int32_t (*get_config)(uint32_t gpio, struct gpio_pin_config *config);
+	uint32_t threadSafe;	// Non zero if different pins may be used from several threads at once
+};
+
+// The sysfs (/sys/class/gpio) implementation.
+extern const struct gpio_backend gpio_sysfs_backend;
+
+/*******************************************************************************
+ * This method will select the backend through which all pin operations go.
+ * It should be called before any pins are exported.
+ * @param const struct gpio_backend *newBackend - This is the backend.  NULL
+ *                                                selects gpio_sysfs_backend.
+ ******************************************************************************/
+void gpio_set_backend(const struct gpio_backend *newBackend);
+
+/*******************************************************************************
+ * This method will return the backend through which all pin operations go.
+ * @return The current backend.
+ ******************************************************************************/
+const struct gpio_backend* gpio_get_backend(void);
+
+/*******************************************************************************
+ * This method will set the directory in which the sysfs GPIO files are found.
+ * Any cached pin handles and paths are released, so this must be called
+ * before any pins are exported and while no other thread uses the library.
+ * @param const char *root - This is the new root.  NULL restores /sys/class/gpio.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_set_root(const char *root);
+
+/*******************************************************************************
+ * This method will return the directory in which the sysfs GPIO files are found.
+ * Unless gpio_set_root has been called, this is the GPIO_SYSFS_ROOT environment
+ * variable if it is set, or /sys/class/gpio otherwise.
+ * @return The current sysfs root.
+ ******************************************************************************/
+const char* gpio_get_root(void);
+
+/*******************************************************************************
+ * This method will size the pool from which the sysfs paths of the pins are
+ * kept, so that they are formatted once rather than on every use.  It should
+ * be called once, before any pin is used, with the number of pins in the
+ * configuration; otherwise the pool is sized for GPIO_MAX_PINS pins.
+ * @param uint32_t count - This is the number of pins the program will use.
+ * @return The return will be 0 if successful or a negative number if the pool
+ *         could not be created or already exists.
+ ******************************************************************************/
+int32_t gpio_reserve_pins(uint32_t count);
+
+/*******************************************************************************
+ * This method will log how much of the pool of pin paths is in use and
+ * whether it ran out.
+ ******************************************************************************/
+void gpio_pool_report(void);
+
 /*******************************************************************************
  * This method will export the given GPIO pin.
  * @param uint32_t gpio - This is the pin that is to be exported.
@@ -27,12 +136,23 @@
 int32_t gpio_export(uint32_t gpio);
 
 /*******************************************************************************
- * This method will unexport the given GPIO pin.
+ * This method will unexport the given GPIO pin.  Any file handles that were
+ * cached for the pin are closed.
  * @param uint32_t gpio - This is the pin that is to be exported.
  * @return The return will be 0 if successful or a negative number if an error occurs.
  ******************************************************************************/
 int32_t gpio_unexport(uint32_t gpio);
 
+/*******************************************************************************
+ * This method will read whether a pin is exported and, if it is, its direction
+ * and edge.  An output found this way is known to the pin state shadow.
+ * @param uint32_t gpio - This is the pin.
+ * @param struct gpio_pin_config *config - This is where the configuration is placed.
+ * @return The return will be 0 if successful or a negative number if an error
+ *         occurs or the backend cannot report the configuration.
+ ******************************************************************************/
+int32_t gpio_get_config(uint32_t gpio, struct gpio_pin_config *config);
+
 /*******************************************************************************
  * This method will set the direction of the given GPIO pin.
  * @param uint32_t gpio - This is the pin that is to be set.
@@ -43,7 +163,8 @@ int32_t gpio_unexport(uint32_t gpio);
 int32_t gpio_set_dir(uint32_t gpio, uint32_t out_flag);
 
 /*******************************************************************************
- * This method will set the value of the given GPIO pin.
+ * This method will set the value of the given GPIO pin.  The write is skipped
+ * if the pin is an output already known to hold the value.
  * @param uint32_t gpio - This is the pin that is to be set.
  * @param uint32_t value This is the value.  A 0 value is lo / off.  A non zero value is high / on.
  * @return The return will be 0 if successful or a negative number if an error occurs.
@@ -51,19 +172,93 @@ int32_t gpio_set_dir(uint32_t gpio, uint32_t out_flag);
 int32_t gpio_set_value(uint32_t gpio, uint32_t value);
 
 /*******************************************************************************
- * This method will read the value set on a given pin.
+ * This method will set the value of the given GPIO pin, as gpio_set_value does.
+ * @param uint32_t gpio - This is the pin that is to be set.
+ * @param uint32_t value This is the value.  A 0 value is lo / off.  A non zero value is high / on.
+ * @param uint32_t flags This is GPIO_FORCE to write even if the value is unchanged, or 0.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_set_value_flags(uint32_t gpio, uint32_t value, uint32_t flags);
+
+/*******************************************************************************
+ * This method will read the value set on a given pin.  The level of an output
+ * which has been written is returned without reading the pin.
  * @param uint32_t gpio - This is the pin that is to be read.
  * @param uint32_t * value This is a pointer to where the value is to be placed when it is read.
  * @return The return will be 0 if successful or a negative number if an error occurs.
  ******************************************************************************/
 int32_t gpio_get_value(uint32_t gpio, uint32_t *value);
 
+/*******************************************************************************
+ * This method will read the value set on a given pin, as gpio_get_value does.
+ * @param uint32_t gpio - This is the pin that is to be read.
+ * @param uint32_t * value This is a pointer to where the value is to be placed when it is read.
+ * @param uint32_t flags This is GPIO_FORCE to read the pin rather than the shadow, or 0.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_get_value_flags(uint32_t gpio, uint32_t *value, uint32_t flags);
+
+/*******************************************************************************
+ * This method will compare the shadowed level of every output with the pin
+ * itself, correcting the shadow where they differ.  Something other than this
+ * program writing the pins is the usual cause.
+ * @return The number of pins which differed.
+ ******************************************************************************/
+uint32_t gpio_shadow_check(void);
+
+/*******************************************************************************
+ * This method will return the counts kept by the pin state shadow.
+ * @param struct gpio_shadow_stats *stats - This is where the counts are placed.
+ ******************************************************************************/
+void gpio_shadow_stats(struct gpio_shadow_stats *stats);
+
+/*******************************************************************************
+ * This method will set the values of several pins.  The backend coalesces the
+ * writes into as few operations as it can; pins in the same bank change together
+ * where the hardware allows it.
+ * @param const uint32_t *pins - This is the array of pins that are to be set.
+ * @param const uint32_t *values - This is the value for each pin.  Non zero is high.
+ * @param uint32_t count - This is the number of pins.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_set_values(const uint32_t *pins, const uint32_t *values, uint32_t count);
+
+/*******************************************************************************
+ * This method will read the values of several pins.  Where the backend allows
+ * it, all pins of a bank are sampled at the same instant.
+ * @param const uint32_t *pins - This is the array of pins that are to be read.
+ * @param uint32_t *values - This is where the value of each pin is placed.
+ * @param uint32_t count - This is the number of pins.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_get_values(const uint32_t *pins, uint32_t *values, uint32_t count);
+
+/*******************************************************************************
+ * This method will set the pins of one bank selected by a mask.
+ * @param uint32_t bank - This is the bank.  Pin n of bank b is GPIO b * 32 + n.
+ * @param uint32_t mask - This selects the pins that are to be set.
+ * @param uint32_t values - This holds the new value of each selected pin.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_set_mask(uint32_t bank, uint32_t mask, uint32_t values);
+
+/*******************************************************************************
+ * This method will read the pins of one bank selected by a mask.
+ * @param uint32_t bank - This is the bank.  Pin n of bank b is GPIO b * 32 + n.
+ * @param uint32_t mask - This selects the pins that are to be read.
+ * @param uint32_t *values - This is where the value of each selected pin is placed.
+ *                           Bits outside the mask are zero.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_get_mask(uint32_t bank, uint32_t mask, uint32_t *values);
+
 /*******************************************************************************
  * This method will set the edge upon which an interrupt is fired.
  * @param uint32_t gpio - This is the pin that is to be configured.
  * @param uint32_t edgeType This is the edge type.  It can be either 
  * GPIO_NO_EDGE, GPIO_RISING_EDGE, GPIO_FALLING_EDGE, or GPIO_BOTH_EDGES.
- * @return The return will be 0 if successful or a negative number if an error occurs.
+ * @return The return will be 0 if successful or a negative number if an error
+ *         occurs, with errno set to EINVAL for any other edge type.
  ******************************************************************************/
  int32_t gpio_set_edge(uint32_t gpio, uint32_t edgeType);
 
@@ -74,6 +269,32 @@ int32_t gpio_get_value(uint32_t gpio, uint32_t *value);
  ******************************************************************************/
 int32_t gpio_fd_open(uint32_t gpio);
 
+/*******************************************************************************
+ * This method will read one edge through a descriptor returned by gpio_fd_open.
+ * This also acknowledges the edge so the descriptor can be polled again.
+ * @param int32_t fd - This is the descriptor that is to be read.
+ * @param struct gpio_fd_event *event - This is where the event is placed.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_fd_read_event(int32_t fd, struct gpio_fd_event *event);
+
+/*******************************************************************************
+ * This method will read the current value through a descriptor returned by
+ * gpio_fd_open.  This is a single read, which also acknowledges the pending
+ * edge so the descriptor can be polled again.
+ * @param int32_t fd - This is the descriptor that is to be read.
+ * @param uint32_t *value - This is where the value is placed.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_fd_read_value(int32_t fd, uint32_t *value);
+
+/*******************************************************************************
+ * This method will return the poll events which signal an edge on descriptors
+ * returned by gpio_fd_open.
+ * @return POLLPRI for sysfs value files; backends may use POLLIN instead.
+ ******************************************************************************/
+uint32_t gpio_fd_events(void);
+
 /*******************************************************************************
  * This method close the given file descriptor.
  * @param uint32_t fd This is the file descriptor that is to be closed.
@@ -0,0 +1,351 @@
+/*********************************************************************
+ * This module is a GPIO backend which accesses the AM335x GPIO banks
+ * directly through memory mapped registers, so that setting, clearing and
+ * reading a pin is a single register access instead of a sysfs write.
+ *
+ * Export, unexport, edge configuration and gpio_fd_open still go through
+ * sysfs, since the registers cannot deliver interrupts to user space.  The
+ * configuration of a pin is read from both: the direction from OE, the rest
+ * from sysfs.
+ * The register file and the bank addresses are configurable, so the backend
+ * can be exercised against a plain file standing in for /dev/mem.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include "gpioInterface.h"
+#include "gpioMmap.h"
+#include "asyncLog.h"
+
+static volatile uint32_t *banks[GPIO_MMAP_BANKS];
+
+static const off_t am335xBases[GPIO_MMAP_BANKS] = {
+	AM335X_GPIO0_BASE, AM335X_GPIO1_BASE, AM335X_GPIO2_BASE, AM335X_GPIO3_BASE
+};
+
+/*******************************************************************************
+ * This method will return a pointer to a register of the bank holding a pin.
+ * @param uint32_t gpio - This is the pin.
+ * @param uint32_t offset - This is the register offset within the bank.
+ * @return A pointer to the register, or NULL if the pin is not mapped.
+ ******************************************************************************/
+static volatile uint32_t* mmap_reg(uint32_t gpio, uint32_t offset)
+{
+	uint32_t bank = gpio / GPIO_MMAP_PINS_PER_BANK;
+
+	if ((bank >= GPIO_MMAP_BANKS) || (banks[bank] == NULL)) {
+		errno = ENODEV;
+		return NULL;
+	}
+	return banks[bank] + (offset / sizeof(uint32_t));
+}
+
+/*******************************************************************************
+ * This method will set the direction of the given GPIO pin through the OE
+ * register.  The read-modify-write is not atomic with respect to other
+ * processes changing directions in the same bank.
+ * @param uint32_t gpio - This is the pin that is to be set.
+ * @param uint32_t out_flag This is the direction.  A 0 value indicates input.
+ *                          A nonzero value is output.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t mmap_set_dir(uint32_t gpio, uint32_t out_flag)
+{
+	volatile uint32_t *oe = mmap_reg(gpio, AM335X_GPIO_OE);
+	uint32_t mask = 1u << (gpio % GPIO_MMAP_PINS_PER_BANK);
+
+	if (oe == NULL) {
+		log_perror("gpio/mmap-direction");
+		return -1;
+	}
+	if (out_flag) {
+		*oe &= ~mask;
+	} else {
+		*oe |= mask;
+	}
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will set the value of the given GPIO pin with a single write to
+ * the SETDATAOUT or CLEARDATAOUT register.
+ * @param uint32_t gpio - This is the pin that is to be set.
+ * @param uint32_t value This is the value.  A 0 value is lo / off.  A non zero value is high / on.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t mmap_set_value(uint32_t gpio, uint32_t value)
+{
+	volatile uint32_t *reg = mmap_reg(gpio, value ? AM335X_GPIO_SETDATAOUT : AM335X_GPIO_CLEARDATAOUT);
+
+	if (reg == NULL) {
+		log_perror("gpio/mmap-set-value");
+		return -1;
+	}
+	*reg = 1u << (gpio % GPIO_MMAP_PINS_PER_BANK);
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will read the value of a given pin.  Outputs are read from
+ * DATAOUT and inputs from DATAIN.
+ * @param uint32_t gpio - This is the pin that is to be read.
+ * @param uint32_t * value This is a pointer to where the value is to be placed when it is read.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t mmap_get_value(uint32_t gpio, uint32_t *value)
+{
+	volatile uint32_t *oe = mmap_reg(gpio, AM335X_GPIO_OE);
+	uint32_t mask = 1u << (gpio % GPIO_MMAP_PINS_PER_BANK);
+
+	if (oe == NULL) {
+		log_perror("gpio/mmap-get-value");
+		return -1;
+	}
+	if (*oe & mask) {
+		*value = (*mmap_reg(gpio, AM335X_GPIO_DATAIN) & mask) != 0;
+	} else {
+		*value = (*mmap_reg(gpio, AM335X_GPIO_DATAOUT) & mask) != 0;
+	}
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will set several pins with at most one SETDATAOUT and one
+ * CLEARDATAOUT write per bank, so pins of the same bank change together.
+ * @param const uint32_t *pins - This is the array of pins that are to be set.
+ * @param const uint32_t *values - This is the value for each pin.
+ * @param uint32_t count - This is the number of pins.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t mmap_set_values(const uint32_t *pins, const uint32_t *values, uint32_t count)
+{
+	uint32_t setMask[GPIO_MMAP_BANKS] = {0};
+	uint32_t clearMask[GPIO_MMAP_BANKS] = {0};
+	uint32_t index, bank;
+
+	for (index = 0; index < count; index++) {
+		bank = pins[index] / GPIO_MMAP_PINS_PER_BANK;
+		if ((bank >= GPIO_MMAP_BANKS) || (banks[bank] == NULL)) {
+			errno = ENODEV;
+			log_perror("gpio/mmap-set-values");
+			return -1;
+		}
+		if (values[index]) {
+			setMask[bank] |= 1u << (pins[index] % GPIO_MMAP_PINS_PER_BANK);
+		} else {
+			clearMask[bank] |= 1u << (pins[index] % GPIO_MMAP_PINS_PER_BANK);
+		}
+	}
+
+	for (bank = 0; bank < GPIO_MMAP_BANKS; bank++) {
+		if (setMask[bank]) {
+			banks[bank][AM335X_GPIO_SETDATAOUT / sizeof(uint32_t)] = setMask[bank];
+		}
+		if (clearMask[bank]) {
+			banks[bank][AM335X_GPIO_CLEARDATAOUT / sizeof(uint32_t)] = clearMask[bank];
+		}
+	}
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will read several pins with one read of OE, DATAIN and DATAOUT
+ * per bank, so all pins of a bank come from the same snapshot.
+ * @param const uint32_t *pins - This is the array of pins that are to be read.
+ * @param uint32_t *values - This is where the value of each pin is placed.
+ * @param uint32_t count - This is the number of pins.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t mmap_get_values(const uint32_t *pins, uint32_t *values, uint32_t count)
+{
+	uint32_t snapshot[GPIO_MMAP_BANKS];
+	uint8_t sampled[GPIO_MMAP_BANKS] = {0};
+	uint32_t index, bank, oe;
+
+	for (index = 0; index < count; index++) {
+		bank = pins[index] / GPIO_MMAP_PINS_PER_BANK;
+		if ((bank >= GPIO_MMAP_BANKS) || (banks[bank] == NULL)) {
+			errno = ENODEV;
+			log_perror("gpio/mmap-get-values");
+			return -1;
+		}
+		if (!sampled[bank]) {
+			// Inputs come from DATAIN, outputs from DATAOUT.
+			oe = banks[bank][AM335X_GPIO_OE / sizeof(uint32_t)];
+			snapshot[bank] = (banks[bank][AM335X_GPIO_DATAIN / sizeof(uint32_t)] & oe) |
+				(banks[bank][AM335X_GPIO_DATAOUT / sizeof(uint32_t)] & ~oe);
+			sampled[bank] = 1;
+		}
+		values[index] = (snapshot[bank] >> (pins[index] % GPIO_MMAP_PINS_PER_BANK)) & 1;
+	}
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will export the pin through sysfs, which claims it from the
+ * kernel and makes its edge and value files available.
+ * @param uint32_t gpio - This is the pin that is to be exported.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t mmap_export(uint32_t gpio)
+{
+	return gpio_sysfs_backend.export_pin(gpio);
+}
+
+/*******************************************************************************
+ * This method will unexport the pin through sysfs.
+ * @param uint32_t gpio - This is the pin that is to be unexported.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t mmap_unexport(uint32_t gpio)
+{
+	return gpio_sysfs_backend.unexport_pin(gpio);
+}
+
+/*******************************************************************************
+ * This method will set the interrupt edge of the pin through sysfs.
+ * @param uint32_t gpio - This is the pin that is to be configured.
+ * @param uint32_t edgeType This is the edge type.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t mmap_set_edge(uint32_t gpio, uint32_t edgeType)
+{
+	return gpio_sysfs_backend.set_edge(gpio, edgeType);
+}
+
+/*******************************************************************************
+ * This method will report the configuration of a pin.  Whether it is exported
+ * and its edge come from sysfs, which owns them; its direction is read from
+ * the OE register, where mmap_set_dir puts it.
+ * @param uint32_t gpio - This is the pin.
+ * @param struct gpio_pin_config *config - This is where the configuration is placed.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t mmap_get_config(uint32_t gpio, struct gpio_pin_config *config)
+{
+	volatile uint32_t *oe = mmap_reg(gpio, AM335X_GPIO_OE);
+
+	if (oe == NULL) {
+		return -1;
+	}
+	if (gpio_sysfs_backend.get_config(gpio, config) < 0) {
+		return -1;
+	}
+	config->out = config->exported && !(*oe & (1u << (gpio % GPIO_MMAP_PINS_PER_BANK)));
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will read an edge from a sysfs value descriptor.
+ * @param int32_t fd - This is the descriptor that is to be read.
+ * @param struct gpio_fd_event *event - This is where the event is placed.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t mmap_fd_read(int32_t fd, struct gpio_fd_event *event)
+{
+	return gpio_sysfs_backend.fd_read(fd, event);
+}
+
+/*******************************************************************************
+ * This method will open the sysfs value file of the pin for polling.
+ * @param uint32_t gpio - This is the pin that is to be opened.
+ * @return The return will be a file id for the opened file.
+ ******************************************************************************/
+static int32_t mmap_fd_open(uint32_t gpio)
+{
+	return gpio_sysfs_backend.fd_open(gpio);
+}
+
+const struct gpio_backend gpio_mmap_backend = {
+	"mmap",
+	mmap_export,
+	mmap_unexport,
+	mmap_set_dir,
+	mmap_set_value,
+	mmap_get_value,
+	mmap_set_edge,
+	mmap_fd_open,
+	mmap_set_values,
+	mmap_get_values,
+	mmap_fd_read,
+	POLLPRI,
+	mmap_get_config,
+	0	// Direction changes read, modify and write a bank's OE register
+};
+
+/*******************************************************************************
+ * This method will map the GPIO banks.
+ * @param const char *path - This is the file to map.  NULL uses /dev/mem.
+ * @param const off_t *bases - This is the offset of each of the GPIO_MMAP_BANKS
+ *                             banks in the file.  NULL uses the AM335x addresses.
+ *                             Each must be a multiple of the page size.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_mmap_open(const char *path, const off_t *bases)
+{
+	int32_t fd;
+	uint32_t bank;
+	void *map;
+
+	if (path == NULL) {
+		path = GPIO_MMAP_DEFAULT_PATH;
+	}
+	if (bases == NULL) {
+		bases = am335xBases;
+	}
+
+	fd = open(path, O_RDWR | O_SYNC);
+	if (fd < 0) {
+		log_perror("gpio/mmap-open");
+		return fd;
+	}
+
+	for (bank = 0; bank < GPIO_MMAP_BANKS; bank++) {
+		map = mmap(NULL, GPIO_MMAP_BANK_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, bases[bank]);
+		if (map == MAP_FAILED) {
+			log_perror("gpio/mmap-open");
+			close(fd);
+			gpio_mmap_close();
+			return -1;
+		}
+		banks[bank] = (volatile uint32_t*)map;
+	}
+
+	// The mappings stay valid after the file is closed.
+	close(fd);
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will unmap the GPIO banks.  If the register backend is selected,
+ * the sysfs backend is selected again.
+ ******************************************************************************/
+void gpio_mmap_close(void)
+{
+	uint32_t bank;
+
+	if (gpio_get_backend() == &gpio_mmap_backend) {
+		gpio_set_backend(NULL);
+	}
+	for (bank = 0; bank < GPIO_MMAP_BANKS; bank++) {
+		if (banks[bank] != NULL) {
+			munmap((void*)banks[bank], GPIO_MMAP_BANK_SIZE);
+			banks[bank] = NULL;
+		}
+	}
+}
+
+/*******************************************************************************
+ * This method will return the mapped registers of a bank.
+ * @param uint32_t bank - This is the bank.
+ * @return The first register of the bank, or NULL if the bank is not mapped.
+ ******************************************************************************/
+volatile uint32_t* gpio_mmap_bank(uint32_t bank)
+{
+	return (bank < GPIO_MMAP_BANKS) ? banks[bank] : NULL;
+}
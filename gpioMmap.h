@@ -0,0 +1,63 @@
+/*********************************************************************
+ * This module is a GPIO backend which accesses the AM335x GPIO banks
+ * directly through memory mapped registers, so that setting, clearing and
+ * reading a pin is a single register access instead of a sysfs write.
+ *
+ * Export, unexport, edge configuration and gpio_fd_open still go through
+ * sysfs, since the registers cannot deliver interrupts to user space.
+ * The register file and the bank addresses are configurable, so the backend
+ * can be exercised against a plain file standing in for /dev/mem.
+ */
+#ifndef GPIOMMAP_H
+#define GPIOMMAP_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include "gpioInterface.h"
+
+#define GPIO_MMAP_BANKS (4)
+#define GPIO_MMAP_PINS_PER_BANK (GPIO_PINS_PER_BANK)
+#define GPIO_MMAP_BANK_SIZE (0x1000)
+#define GPIO_MMAP_DEFAULT_PATH "/dev/mem"
+
+// AM335x physical addresses of GPIO0 - GPIO3.
+#define AM335X_GPIO0_BASE (0x44E07000)
+#define AM335X_GPIO1_BASE (0x4804C000)
+#define AM335X_GPIO2_BASE (0x481AC000)
+#define AM335X_GPIO3_BASE (0x481AE000)
+
+// AM335x GPIO register offsets within a bank.
+#define AM335X_GPIO_OE (0x134)		// 1 = input, 0 = output
+#define AM335X_GPIO_DATAIN (0x138)
+#define AM335X_GPIO_DATAOUT (0x13C)
+#define AM335X_GPIO_CLEARDATAOUT (0x190)
+#define AM335X_GPIO_SETDATAOUT (0x194)
+
+// The register backend.  gpio_mmap_open must succeed before it is selected.
+extern const struct gpio_backend gpio_mmap_backend;
+
+/*******************************************************************************
+ * This method will map the GPIO banks.
+ * @param const char *path - This is the file to map.  NULL uses /dev/mem.
+ * @param const off_t *bases - This is the offset of each of the GPIO_MMAP_BANKS
+ *                             banks in the file.  NULL uses the AM335x addresses.
+ *                             Each must be a multiple of the page size.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_mmap_open(const char *path, const off_t *bases);
+
+/*******************************************************************************
+ * This method will unmap the GPIO banks.  If the register backend is selected,
+ * the sysfs backend is selected again.
+ ******************************************************************************/
+void gpio_mmap_close(void);
+
+/*******************************************************************************
+ * This method will return the mapped registers of a bank, for callers which
+ * access the registers themselves (see gpioFixed.h).
+ * @param uint32_t bank - This is the bank.
+ * @return The first register of the bank, or NULL if the bank is not mapped.
+ ******************************************************************************/
+volatile uint32_t* gpio_mmap_bank(uint32_t bank);
+
+#endif
@@ -0,0 +1,305 @@
+/*********************************************************************
+ * This module keeps track of the pins and descriptors held through the
+ * GPIO library and releases them in one pass.  See gpioRegistry.h.
+ *
+ * The journal is not synced to disk.  It only has to survive the process,
+ * not the machine: sysfs exports do not survive a reboot either.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include "gpioInterface.h"
+#include "gpioRegistry.h"
+#include "asyncLog.h"
+
+ /****************************************************************
+ * Constants
+ ****************************************************************/
+#define MAX_PATH_BUF 256
+#define JOURNAL_BUF (GPIO_MAX_PINS * 4)	// "127\n" for every pin
+#define STALE_WORDS ((GPIO_MAX_PINS + 63) / 64)
+
+struct registry_fd {
+	int32_t fd;
+	uint32_t gpio;
+};
+
+static pthread_mutex_t registryLock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t exported[GPIO_MAX_PINS];	// Oldest first
+static uint32_t exportCount;
+static struct registry_fd fds[GPIO_REGISTRY_MAX_FDS];	// Oldest first
+static uint32_t fdCount;
+static uint32_t fdOverflow;
+static uint64_t stale[STALE_WORDS];	// Pins left exported by an earlier run
+static int32_t journalFd = -1;
+static char journalPath[MAX_PATH_BUF];
+
+/*******************************************************************************
+ * This method will rewrite the journal with the registered and stale pins.
+ * It is called with the registry locked.
+ ******************************************************************************/
+static void registry_write_journal(void)
+{
+	char buf[JOURNAL_BUF];
+	uint32_t index, gpio;
+	int32_t len = 0;
+
+	if (journalFd < 0) {
+		return;
+	}
+	for (index = 0; index < exportCount; index++) {
+		len += snprintf(buf + len, sizeof(buf) - len, "%u\n", exported[index]);
+	}
+	for (gpio = 0; gpio < GPIO_MAX_PINS; gpio++) {
+		if (stale[gpio / 64] & (1ull << (gpio % 64))) {
+			len += snprintf(buf + len, sizeof(buf) - len, "%u\n", gpio);
+		}
+	}
+	if ((ftruncate(journalFd, 0) < 0) || (pwrite(journalFd, buf, len, 0) != len)) {
+		log_perror("gpio/journal");
+	}
+}
+
+/*******************************************************************************
+ * This method will add a pin to the registry unless it is already there.
+ * @param uint32_t gpio - This is the pin.
+ ******************************************************************************/
+static void registry_add(uint32_t gpio)
+{
+	uint32_t index;
+
+	if (gpio >= GPIO_MAX_PINS) {
+		return;
+	}
+	pthread_mutex_lock(&registryLock);
+	for (index = 0; index < exportCount; index++) {
+		if (exported[index] == gpio) {
+			break;
+		}
+	}
+	if (index == exportCount) {
+		exported[exportCount++] = gpio;
+		stale[gpio / 64] &= ~(1ull << (gpio % 64));
+		registry_write_journal();
+	}
+	pthread_mutex_unlock(&registryLock);
+}
+
+/*******************************************************************************
+ * This method will record that a pin has been exported.  It is called by gpio_export.
+ * @param uint32_t gpio - This is the pin.
+ ******************************************************************************/
+void gpio_registry_export(uint32_t gpio)
+{
+	registry_add(gpio);
+}
+
+/*******************************************************************************
+ * This method will take over a pin which was found already exported.
+ * @param uint32_t gpio - This is the pin.
+ ******************************************************************************/
+void gpio_registry_adopt(uint32_t gpio)
+{
+	registry_add(gpio);
+}
+
+/*******************************************************************************
+ * This method will record that a pin is no longer exported.  It is called by gpio_unexport.
+ * @param uint32_t gpio - This is the pin.
+ ******************************************************************************/
+void gpio_registry_unexport(uint32_t gpio)
+{
+	uint32_t index;
+
+	pthread_mutex_lock(&registryLock);
+	for (index = 0; index < exportCount; index++) {
+		if (exported[index] == gpio) {
+			memmove(&exported[index], &exported[index + 1], (exportCount - index - 1) * sizeof(exported[0]));
+			exportCount--;
+			registry_write_journal();
+			break;
+		}
+	}
+	pthread_mutex_unlock(&registryLock);
+}
+
+/*******************************************************************************
+ * This method will record a descriptor opened for a pin.  It is called by gpio_fd_open.
+ * @param uint32_t gpio - This is the pin.
+ * @param int32_t fd - This is the descriptor.
+ ******************************************************************************/
+void gpio_registry_open(uint32_t gpio, int32_t fd)
+{
+	pthread_mutex_lock(&registryLock);
+	if (fdCount < GPIO_REGISTRY_MAX_FDS) {
+		fds[fdCount].fd = fd;
+		fds[fdCount].gpio = gpio;
+		fdCount++;
+	} else if (fdOverflow++ == 0) {
+		log_printf("gpio/registry: more than %d descriptors, GPIO %u is not tracked\n",
+			GPIO_REGISTRY_MAX_FDS, gpio);
+	}
+	pthread_mutex_unlock(&registryLock);
+}
+
+/*******************************************************************************
+ * This method will record that a descriptor has been closed.  It is called by gpio_fd_close.
+ * @param int32_t fd - This is the descriptor.
+ ******************************************************************************/
+void gpio_registry_close(int32_t fd)
+{
+	uint32_t index;
+
+	pthread_mutex_lock(&registryLock);
+	for (index = 0; index < fdCount; index++) {
+		if (fds[index].fd == fd) {
+			memmove(&fds[index], &fds[index + 1], (fdCount - index - 1) * sizeof(fds[0]));
+			fdCount--;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&registryLock);
+}
+
+/*******************************************************************************
+ * This method will load the journal left by an earlier run, if any, and keep
+ * the journal from now on.
+ * @param const char *path - This is the journal file.
+ * @return The return will be 0 if successful or a negative number if the
+ *         journal cannot be kept.
+ ******************************************************************************/
+int32_t gpio_registry_journal(const char *path)
+{
+	char buf[JOURNAL_BUF];
+	char *cursor, *end;
+	unsigned long gpio;
+	uint32_t index;
+	ssize_t len;
+	int32_t fd;
+
+	if (strlen(path) >= sizeof(journalPath)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		log_perror("gpio/journal");
+		return -1;
+	}
+	len = pread(fd, buf, sizeof(buf) - 1, 0);
+	buf[(len > 0) ? len : 0] = '\0';
+
+	pthread_mutex_lock(&registryLock);
+	for (cursor = buf; ; cursor = end) {
+		gpio = strtoul(cursor, &end, 10);
+		if (end == cursor) {
+			break;
+		}
+		if (gpio < GPIO_MAX_PINS) {
+			stale[gpio / 64] |= 1ull << (gpio % 64);
+		}
+	}
+	// Pins exported before the journal was opened are not left over.
+	for (index = 0; index < exportCount; index++) {
+		stale[exported[index] / 64] &= ~(1ull << (exported[index] % 64));
+	}
+	if (journalFd >= 0) {
+		close(journalFd);
+	}
+	journalFd = fd;
+	strcpy(journalPath, path);
+	registry_write_journal();
+	pthread_mutex_unlock(&registryLock);
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will unexport every pin left by an earlier run which this run
+ * has not adopted or exported itself.
+ * @return The number of pins which were unexported.
+ ******************************************************************************/
+uint32_t gpio_registry_reclaim(void)
+{
+	char path[MAX_PATH_BUF];
+	uint32_t gpio, reclaimed = 0;
+	uint64_t bit;
+
+	for (gpio = 0; gpio < GPIO_MAX_PINS; gpio++) {
+		bit = 1ull << (gpio % 64);
+		pthread_mutex_lock(&registryLock);
+		if (!(stale[gpio / 64] & bit)) {
+			pthread_mutex_unlock(&registryLock);
+			continue;
+		}
+		stale[gpio / 64] &= ~bit;
+		pthread_mutex_unlock(&registryLock);
+
+		// The path is formatted here rather than kept: the pin is about to go.
+		snprintf(path, sizeof(path), "%s/gpio%u", gpio_get_root(), gpio);
+		if ((access(path, F_OK) == 0) && (gpio_sysfs_backend.unexport_pin(gpio) == 0)) {
+			log_printf("GPIO %u: reclaimed from an earlier run\n", gpio);
+			reclaimed++;
+		}
+	}
+
+	pthread_mutex_lock(&registryLock);
+	registry_write_journal();
+	pthread_mutex_unlock(&registryLock);
+	return reclaimed;
+}
+
+/*******************************************************************************
+ * This method will close every registered descriptor and then unexport every
+ * registered pin, newest first, and remove the journal.
+ * @return The number of descriptors and pins which could not be released.
+ ******************************************************************************/
+uint32_t gpio_release_all(void)
+{
+	struct registry_fd openFds[GPIO_REGISTRY_MAX_FDS];
+	uint32_t pins[GPIO_MAX_PINS];
+	uint32_t index, count, failures = 0;
+
+	// Descriptors first: a cdev request or a sysfs value file should not
+	// outlive the export it belongs to.
+	pthread_mutex_lock(&registryLock);
+	count = fdCount;
+	memcpy(openFds, fds, count * sizeof(fds[0]));
+	pthread_mutex_unlock(&registryLock);
+	for (index = count; index > 0; index--) {
+		if (gpio_fd_close(openFds[index - 1].fd) < 0) {
+			failures++;
+		}
+	}
+
+	// A pin which cannot be unexported stays in the journal, for the next run to reclaim.
+	pthread_mutex_lock(&registryLock);
+	count = exportCount;
+	memcpy(pins, exported, count * sizeof(exported[0]));
+	pthread_mutex_unlock(&registryLock);
+	for (index = count; index > 0; index--) {
+		if (gpio_unexport(pins[index - 1]) < 0) {
+			failures++;
+		}
+	}
+
+	pthread_mutex_lock(&registryLock);
+	if (journalFd >= 0) {
+		for (index = 0; index < STALE_WORDS; index++) {
+			if (stale[index] != 0) {
+				break;
+			}
+		}
+		if ((exportCount == 0) && (index == STALE_WORDS)) {
+			close(journalFd);
+			journalFd = -1;
+			(void)unlink(journalPath);
+		}
+	}
+	pthread_mutex_unlock(&registryLock);
+	return failures;
+}
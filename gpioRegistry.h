@@ -0,0 +1,81 @@
+/*********************************************************************
+ * This module keeps track of every pin the program has exported and every
+ * descriptor it has opened through the GPIO library, so that all of them
+ * can be released in one ordered pass however the program ends: the
+ * descriptors are closed first, newest first, and then the pins are
+ * unexported, newest first.  gpio_export, gpio_unexport, gpio_fd_open and
+ * gpio_fd_close keep the registry up to date.
+ *
+ * A sysfs export outlives the process, so after a crash the pins are still
+ * exported when the program is started again.  To find them the registry
+ * can keep a journal: a file listing the exported pins, rewritten whenever
+ * the list changes and removed once it is empty.  The pins listed in the
+ * journal left by an earlier run are reclaimed at startup: a pin the new
+ * run adopts stays exported, every other one is unexported.
+ */
+#ifndef GPIOREGISTRY_H
+#define GPIOREGISTRY_H
+
+#include <stdint.h>
+
+#define GPIO_REGISTRY_MAX_FDS (64)
+
+/*******************************************************************************
+ * This method will record that a pin has been exported.  It is called by gpio_export.
+ * @param uint32_t gpio - This is the pin.
+ ******************************************************************************/
+void gpio_registry_export(uint32_t gpio);
+
+/*******************************************************************************
+ * This method will record that a pin is no longer exported.  It is called by gpio_unexport.
+ * @param uint32_t gpio - This is the pin.
+ ******************************************************************************/
+void gpio_registry_unexport(uint32_t gpio);
+
+/*******************************************************************************
+ * This method will record a descriptor opened for a pin.  It is called by gpio_fd_open.
+ * @param uint32_t gpio - This is the pin.
+ * @param int32_t fd - This is the descriptor.
+ ******************************************************************************/
+void gpio_registry_open(uint32_t gpio, int32_t fd);
+
+/*******************************************************************************
+ * This method will record that a descriptor has been closed.  It is called by gpio_fd_close.
+ * @param int32_t fd - This is the descriptor.
+ ******************************************************************************/
+void gpio_registry_close(int32_t fd);
+
+/*******************************************************************************
+ * This method will take over a pin which was found already exported, so that
+ * it is released with the pins exported by this program.  If the pin was left
+ * by an earlier run it is no longer reclaimed.
+ * @param uint32_t gpio - This is the pin.
+ ******************************************************************************/
+void gpio_registry_adopt(uint32_t gpio);
+
+/*******************************************************************************
+ * This method will load the journal left by an earlier run, if any, and keep
+ * the journal from now on.  Pins already in the registry are written to it.
+ * @param const char *path - This is the journal file.
+ * @return The return will be 0 if successful or a negative number if the
+ *         journal cannot be kept.
+ ******************************************************************************/
+int32_t gpio_registry_journal(const char *path);
+
+/*******************************************************************************
+ * This method will unexport every pin left by an earlier run which this run
+ * has not adopted or exported itself.  The pins are unexported through sysfs,
+ * the only backend whose exports outlive the process.
+ * @return The number of pins which were unexported.
+ ******************************************************************************/
+uint32_t gpio_registry_reclaim(void);
+
+/*******************************************************************************
+ * This method will close every registered descriptor and then unexport every
+ * registered pin, newest first, and remove the journal.  It may be called
+ * more than once, for example from atexit after an orderly shutdown.
+ * @return The number of descriptors and pins which could not be released.
+ ******************************************************************************/
+uint32_t gpio_release_all(void);
+
+#endif
@@ -0,0 +1,160 @@
+/*********************************************************************
+ * This module brings up a set of pins from a table describing how each
+ * one should end up.  See gpioSetup.h.
+ */
+#include <pthread.h>
+#include <stdint.h>
+#include "gpioInterface.h"
+#include "gpioSetup.h"
+#include "gpioRegistry.h"
+#include "asyncLog.h"
+
+// The work shared by the setup threads.  Rows are claimed one at a time.
+struct gpio_setup_job {
+	struct gpio_pin_setup *table;
+	uint32_t count;
+	uint32_t next;
+};
+
+/*******************************************************************************
+ * This method will set up one pin, skipping the steps already in place.
+ * @param struct gpio_pin_setup *row - This is the pin.
+ ******************************************************************************/
+static void gpio_setup_one(struct gpio_pin_setup *row)
+{
+	struct gpio_pin_config config;
+	uint32_t known, value;
+	timens_t start = timens_now(CLOCK_MONOTONIC);
+
+	row->fd = -1;
+	row->rc = 0;
+	row->skipped = 0;
+
+	// Without a readable configuration every step is carried out.
+	known = (gpio_get_config(row->pin, &config) == 0);
+	if (known && config.exported) {
+		// Released at shutdown like a pin this program exported.
+		row->skipped |= GPIO_SETUP_EXPORT;
+		gpio_registry_adopt(row->pin);
+	} else {
+		if (gpio_export(row->pin) < 0) {
+			row->rc = -1;
+		}
+		// A pin keeps some of its settings from before it was last unexported.
+		known = known && (gpio_get_config(row->pin, &config) == 0) && config.exported;
+	}
+
+	if (known && ((config.out != 0) == (row->out != 0))) {
+		row->skipped |= GPIO_SETUP_DIRECTION;
+	} else if (gpio_set_dir(row->pin, row->out) < 0) {
+		row->rc = -1;
+	}
+
+	if (row->out) {
+		// An output which was already an output may already be at the level.
+		// Reading it puts the level in the shadow, so an equal write is skipped.
+		if ((row->skipped & GPIO_SETUP_DIRECTION) && (gpio_get_value(row->pin, &value) == 0) &&
+			(value == (row->level != 0))) {
+			row->skipped |= GPIO_SETUP_LEVEL;
+		} else if (gpio_set_value(row->pin, row->level) < 0) {
+			row->rc = -1;
+		}
+	} else if (known && (config.edge == row->edge)) {
+		row->skipped |= GPIO_SETUP_EDGE;
+	} else if (gpio_set_edge(row->pin, row->edge) < 0) {
+		row->rc = -1;
+	}
+
+	if (row->openFd) {
+		row->fd = gpio_fd_open(row->pin);
+		if (row->fd < 0) {
+			row->rc = -1;
+		}
+	}
+	row->elapsed = timens_sub(timens_now(CLOCK_MONOTONIC), start);
+}
+
+/*******************************************************************************
+ * This method is the body of each setup thread.  It sets up rows until none
+ * are left.
+ * @param void *arg - This is the shared job.
+ * @return Always NULL.
+ ******************************************************************************/
+static void* gpio_setup_thread(void *arg)
+{
+	struct gpio_setup_job *job = (struct gpio_setup_job*)arg;
+	uint32_t index;
+
+	while ((index = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->count) {
+		gpio_setup_one(&job->table[index]);
+	}
+	return NULL;
+}
+
+/*******************************************************************************
+ * This method will set up every pin of a table and wait for all of them.
+ * @param struct gpio_pin_setup *table - This is the table.
+ * @param uint32_t count - This is the number of rows.
+ * @return The return will be 0 if every pin was set up or a negative number if
+ *         any step of any pin failed.
+ ******************************************************************************/
+int32_t gpio_setup_pins(struct gpio_pin_setup *table, uint32_t count)
+{
+	struct gpio_setup_job job = { table, count, 0 };
+	pthread_t threads[GPIO_SETUP_MAX_THREADS];
+	uint32_t index, started = 0;
+	int32_t rc = 0;
+
+	// The table is the pin configuration, so it sizes the pool of pin paths.
+	// Only the first table does; the pool has a fixed size from then on.
+	(void)gpio_reserve_pins(count);
+
+	// The calling thread works too, so one thread fewer is started.  If a
+	// thread cannot be started the others simply take more rows.  A backend
+	// which cannot serve several threads at once is left to the calling thread.
+	while (gpio_get_backend()->threadSafe &&
+		(started + 1 < count) && (started + 1 < GPIO_SETUP_MAX_THREADS) &&
+		(pthread_create(&threads[started], NULL, gpio_setup_thread, &job) == 0)) {
+		started++;
+	}
+	(void)gpio_setup_thread(&job);
+	for (index = 0; index < started; index++) {
+		pthread_join(threads[index], NULL);
+	}
+
+	// The pins of the table have been taken over, so whatever an earlier run
+	// left exported besides them can go.
+	(void)gpio_registry_reclaim();
+
+	for (index = 0; index < count; index++) {
+		if (table[index].rc < 0) {
+			rc = -1;
+		}
+	}
+	return rc;
+}
+
+/*******************************************************************************
+ * This method will log how long each pin took to set up and which steps were
+ * already in place.
+ * @param const struct gpio_pin_setup *table - This is a table passed to gpio_setup_pins.
+ * @param uint32_t count - This is the number of rows.
+ ******************************************************************************/
+void gpio_setup_report(const struct gpio_pin_setup *table, uint32_t count)
+{
+	const struct gpio_pin_setup *row;
+	uint32_t index;
+
+	for (index = 0; index < count; index++) {
+		row = &table[index];
+		if (row->rc < 0) {
+			log_printf("GPIO %u: setup failed after %lld us\n", row->pin, (long long)timens_to_us(row->elapsed));
+			continue;
+		}
+		log_printf("GPIO %u: set up in %lld us%s%s%s%s\n", row->pin, (long long)timens_to_us(row->elapsed),
+			(row->skipped & GPIO_SETUP_EXPORT) ? ", already exported" : "",
+			(row->skipped & GPIO_SETUP_DIRECTION) ? ", direction in place" : "",
+			(row->skipped & GPIO_SETUP_EDGE) ? ", edge in place" : "",
+			(row->skipped & GPIO_SETUP_LEVEL) ? ", level in place" : "");
+	}
+}
@@ -0,0 +1,65 @@
+/*********************************************************************
+ * This module brings up a set of pins from a table describing how each
+ * one should end up: its direction, its edge, its starting level and
+ * whether a descriptor is wanted for watching it.
+ *
+ * Each pin's current configuration is read first and only the steps
+ * which are not already in place are carried out, so running the same
+ * table twice costs little.  Pins are independent of each other and are
+ * set up by several threads at once, which hides the time spent waiting
+ * for udev to hand over newly exported sysfs nodes.  This is only done when
+ * the selected backend is marked threadSafe; otherwise the pins are set up
+ * one after the other by the calling thread.
+ *
+ * A pin found already exported is adopted into the registry of held pins,
+ * and once the table is set up the pins an earlier run left exported, and
+ * which the table does not use, are reclaimed (see gpioRegistry.h).
+ */
+#ifndef GPIOSETUP_H
+#define GPIOSETUP_H
+
+#include <stdint.h>
+#include "timeutil.h"
+
+#define GPIO_SETUP_MAX_THREADS (8)
+
+// The steps that were found already in place, in gpio_pin_setup.skipped.
+#define GPIO_SETUP_EXPORT (1)
+#define GPIO_SETUP_DIRECTION (2)
+#define GPIO_SETUP_EDGE (4)
+#define GPIO_SETUP_LEVEL (8)
+
+// One row of a setup table.
+struct gpio_pin_setup {
+	uint32_t pin;
+	uint32_t out;		// Non zero for an output
+	uint32_t edge;		// Inputs: GPIO_NO_EDGE ... GPIO_BOTH_EDGES
+	uint32_t level;		// Outputs: the starting level
+	uint32_t openFd;	// Non zero to open a descriptor with gpio_fd_open
+	// Filled in by gpio_setup_pins.
+	int32_t fd;		// The descriptor, or -1
+	int32_t rc;		// 0 if every step succeeded
+	uint32_t skipped;	// GPIO_SETUP_ steps that were already in place
+	timens_t elapsed;	// Time taken to set up this pin
+};
+
+/*******************************************************************************
+ * This method will set up every pin of a table and wait for all of them.
+ * Since the pins are set up by other threads, signals should be blocked first.
+ * @param struct gpio_pin_setup *table - This is the table.  The results are
+ *        placed in each row.
+ * @param uint32_t count - This is the number of rows.
+ * @return The return will be 0 if every pin was set up or a negative number if
+ *         any step of any pin failed.
+ ******************************************************************************/
+int32_t gpio_setup_pins(struct gpio_pin_setup *table, uint32_t count);
+
+/*******************************************************************************
+ * This method will log how long each pin took to set up and which steps were
+ * already in place.
+ * @param const struct gpio_pin_setup *table - This is a table passed to gpio_setup_pins.
+ * @param uint32_t count - This is the number of rows.
+ ******************************************************************************/
+void gpio_setup_report(const struct gpio_pin_setup *table, uint32_t count);
+
+#endif
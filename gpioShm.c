@@ -0,0 +1,473 @@
+/*********************************************************************
+ * This module publishes the state of the pins in shared memory.  See gpioShm.h.
+ *
+ * Readers copy the segment with plain loads between an acquire load of the
+ * count and an acquire fence, the usual form of a sequence lock: a copy
+ * which overlapped a write is thrown away, so its torn values are never used.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "gpioInterface.h"
+#include "gpioShm.h"
+#include "asyncLog.h"
+
+static struct gpio_shm_segment *shmSegment;
+static char shmName[NAME_MAX];
+static const struct gpio_backend *shmInner;
+static uint8_t shmFdPins[GPIO_SHM_MAX_FDS];	// The pin + 1 of each fd_open descriptor
+
+/*******************************************************************************
+ * This method will start a change of the segment, once no other writer is
+ * changing it.
+ * @param struct gpio_shm_segment *segment - This is the segment.
+ * @return The even count the change started from.
+ ******************************************************************************/
+static inline uint32_t shm_begin(struct gpio_shm_segment *segment)
+{
+	uint32_t seq = __atomic_load_n(&segment->seq, __ATOMIC_RELAXED);
+
+	while ((seq & 1) || !__atomic_compare_exchange_n(&segment->seq, &seq, seq + 1, 1,
+		__ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+		seq = __atomic_load_n(&segment->seq, __ATOMIC_RELAXED);
+	}
+	// The odd count must be visible before any of the data changes.
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	return seq;
+}
+
+/*******************************************************************************
+ * This method will finish a change of the segment.
+ * @param struct gpio_shm_segment *segment - This is the segment.
+ * @param uint32_t seq - This is the count returned by shm_begin.
+ * @param timens_t now - This is the time of the change.
+ ******************************************************************************/
+static inline void shm_end(struct gpio_shm_segment *segment, uint32_t seq, timens_t now)
+{
+	segment->updates++;
+	segment->updated = now;
+	__atomic_store_n(&segment->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/*******************************************************************************
+ * This method will publish the level of a pin which was written or read.
+ * @param uint32_t gpio - This is the pin.
+ * @param uint32_t value - This is the level.
+ * @param uint32_t written - This is non zero for an output write.
+ ******************************************************************************/
+static void shm_publish_level(uint32_t gpio, uint32_t value, uint32_t written)
+{
+	struct gpio_shm_segment *segment = shmSegment;
+	struct gpio_shm_pin *pin;
+	timens_t now;
+	uint32_t seq;
+
+	if ((segment == NULL) || (gpio >= GPIO_MAX_PINS)) {
+		return;
+	}
+	now = timens_now(CLOCK_MONOTONIC);
+	pin = &segment->pins[gpio];
+	value = (value != 0);
+
+	seq = shm_begin(segment);
+	if (!(pin->flags & GPIO_SHM_LEVEL_KNOWN) || (pin->level != value)) {
+		pin->lastChange = now;
+	}
+	pin->level = value;
+	pin->flags |= GPIO_SHM_EXPORTED | GPIO_SHM_LEVEL_KNOWN;
+	if (written) {
+		pin->flags |= GPIO_SHM_OUTPUT;
+		pin->writes++;
+	}
+	shm_end(segment, seq, now);
+}
+
+/*******************************************************************************
+ * This method will publish an edge read from a pin.
+ * @param uint32_t gpio - This is the pin.
+ * @param const struct gpio_fd_event *event - This is the edge.
+ ******************************************************************************/
+static void shm_publish_edge(uint32_t gpio, const struct gpio_fd_event *event)
+{
+	struct gpio_shm_segment *segment = shmSegment;
+	struct gpio_shm_pin *pin;
+	timens_t now, latency = 0;
+	uint32_t seq;
+
+	if ((segment == NULL) || (gpio >= GPIO_MAX_PINS)) {
+		return;
+	}
+	now = timens_now(CLOCK_MONOTONIC);
+	if (event->timestamp != 0) {
+		latency = timens_sub(now, (timens_t)event->timestamp);
+	}
+	pin = &segment->pins[gpio];
+
+	seq = shm_begin(segment);
+	pin->flags = (pin->flags & ~GPIO_SHM_OUTPUT) | GPIO_SHM_EXPORTED | GPIO_SHM_LEVEL_KNOWN;
+	pin->level = (event->value != 0);
+	if (pin->level) {
+		pin->rising++;
+	} else {
+		pin->falling++;
+	}
+	pin->lastChange = (event->timestamp != 0) ? (timens_t)event->timestamp : now;
+	pin->lastLatency = latency;
+	if (latency > pin->maxLatency) {
+		pin->maxLatency = latency;
+	}
+	shm_end(segment, seq, now);
+}
+
+/*******************************************************************************
+ * This method will publish a change of the flags of a pin.
+ * @param uint32_t gpio - This is the pin.
+ * @param uint32_t set - These are the flags which are set.
+ * @param uint32_t clear - These are the flags which are cleared.
+ ******************************************************************************/
+static void shm_publish_flags(uint32_t gpio, uint32_t set, uint32_t clear)
+{
+	struct gpio_shm_segment *segment = shmSegment;
+	uint32_t seq;
+
+	if ((segment == NULL) || (gpio >= GPIO_MAX_PINS)) {
+		return;
+	}
+	seq = shm_begin(segment);
+	segment->pins[gpio].flags = (segment->pins[gpio].flags & ~clear) | set;
+	shm_end(segment, seq, timens_now(CLOCK_MONOTONIC));
+}
+
+/****************************************************************
+ * Publishing backend
+ ****************************************************************/
+static int32_t shm_export(uint32_t gpio)
+{
+	int32_t rc = shmInner->export_pin(gpio);
+
+	if (rc == 0) {
+		shm_publish_flags(gpio, GPIO_SHM_EXPORTED, 0);
+	}
+	return rc;
+}
+
+static int32_t shm_unexport(uint32_t gpio)
+{
+	int32_t rc = shmInner->unexport_pin(gpio);
+
+	if (rc == 0) {
+		shm_publish_flags(gpio, 0, GPIO_SHM_EXPORTED | GPIO_SHM_OUTPUT | GPIO_SHM_LEVEL_KNOWN);
+	}
+	return rc;
+}
+
+static int32_t shm_set_dir(uint32_t gpio, uint32_t out_flag)
+{
+	int32_t rc = shmInner->set_dir(gpio, out_flag);
+
+	if (rc == 0) {
+		shm_publish_flags(gpio, out_flag ? GPIO_SHM_OUTPUT : 0,
+			GPIO_SHM_LEVEL_KNOWN | (out_flag ? 0 : GPIO_SHM_OUTPUT));
+	}
+	return rc;
+}
+
+static int32_t shm_set_value(uint32_t gpio, uint32_t value)
+{
+	int32_t rc = shmInner->set_value(gpio, value);
+
+	if (rc == 0) {
+		shm_publish_level(gpio, value, 1);
+	}
+	return rc;
+}
+
+static int32_t shm_get_value(uint32_t gpio, uint32_t *value)
+{
+	int32_t rc = shmInner->get_value(gpio, value);
+
+	if (rc == 0) {
+		shm_publish_level(gpio, *value, 0);
+	}
+	return rc;
+}
+
+static int32_t shm_set_edge(uint32_t gpio, uint32_t edgeType)
+{
+	return shmInner->set_edge(gpio, edgeType);
+}
+
+static int32_t shm_fd_open(uint32_t gpio)
+{
+	int32_t fd = shmInner->fd_open(gpio);
+
+	if ((fd >= 0) && (fd < GPIO_SHM_MAX_FDS) && (gpio < GPIO_MAX_PINS)) {
+		__atomic_store_n(&shmFdPins[fd], (uint8_t)(gpio + 1), __ATOMIC_RELAXED);
+	}
+	return fd;
+}
+
+static int32_t shm_set_values(const uint32_t *pins, const uint32_t *values, uint32_t count)
+{
+	uint32_t index;
+	int32_t rc = 0;
+
+	if (shmInner->set_values != NULL) {
+		rc = shmInner->set_values(pins, values, count);
+		if (rc == 0) {
+			for (index = 0; index < count; index++) {
+				shm_publish_level(pins[index], values[index], 1);
+			}
+		}
+		return rc;
+	}
+	for (index = 0; index < count; index++) {
+		if (shm_set_value(pins[index], values[index]) < 0) {
+			rc = -1;
+		}
+	}
+	return rc;
+}
+
+static int32_t shm_get_values(const uint32_t *pins, uint32_t *values, uint32_t count)
+{
+	uint32_t index;
+	int32_t rc = 0;
+
+	if (shmInner->get_values != NULL) {
+		rc = shmInner->get_values(pins, values, count);
+		if (rc == 0) {
+			for (index = 0; index < count; index++) {
+				shm_publish_level(pins[index], values[index], 0);
+			}
+		}
+		return rc;
+	}
+	for (index = 0; index < count; index++) {
+		if (shm_get_value(pins[index], &values[index]) < 0) {
+			rc = -1;
+		}
+	}
+	return rc;
+}
+
+static int32_t shm_fd_read(int32_t fd, struct gpio_fd_event *event)
+{
+	int32_t rc = shmInner->fd_read(fd, event);
+	uint32_t gpio;
+
+	if ((rc == 0) && (fd >= 0) && (fd < GPIO_SHM_MAX_FDS)) {
+		gpio = __atomic_load_n(&shmFdPins[fd], __ATOMIC_RELAXED);
+		if (gpio != 0) {
+			shm_publish_edge(gpio - 1, event);
+		}
+	}
+	return rc;
+}
+
+static int32_t shm_get_config(uint32_t gpio, struct gpio_pin_config *config)
+{
+	return shmInner->get_config(gpio, config);
+}
+
+// fdEvents, get_config and threadSafe are taken from the wrapped backend when publishing starts.
+static struct gpio_backend gpio_shm_backend = {
+	"shm",
+	shm_export,
+	shm_unexport,
+	shm_set_dir,
+	shm_set_value,
+	shm_get_value,
+	shm_set_edge,
+	shm_fd_open,
+	shm_set_values,
+	shm_get_values,
+	shm_fd_read,
+	0,
+	NULL,
+	0
+};
+
+/*******************************************************************************
+ * This method will create the segment and start publishing the state of the pins.
+ * @param const char *name - This is the name of the segment, for example GPIO_SHM_NAME.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_shm_open(const char *name)
+{
+	struct gpio_shm_segment *segment;
+	int32_t fd;
+
+	if ((shmSegment != NULL) || (strlen(name) >= sizeof(shmName))) {
+		errno = (shmSegment != NULL) ? EBUSY : ENAMETOOLONG;
+		return -1;
+	}
+
+	// A segment left by a crashed run may be mid-update; start from a new one.
+	(void)shm_unlink(name);
+	fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		log_perror("gpio/shm");
+		return -1;
+	}
+	if (ftruncate(fd, sizeof(*segment)) < 0) {
+		log_perror("gpio/shm");
+		close(fd);
+		(void)shm_unlink(name);
+		return -1;
+	}
+	segment = (struct gpio_shm_segment*)mmap(NULL, sizeof(*segment), PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, fd, 0);
+	close(fd);
+	if (segment == MAP_FAILED) {
+		log_perror("gpio/shm");
+		(void)shm_unlink(name);
+		return -1;
+	}
+
+	segment->version = GPIO_SHM_VERSION;
+	segment->size = sizeof(*segment);
+	segment->pid = (int32_t)getpid();
+	__atomic_store_n(&segment->magic, GPIO_SHM_MAGIC, __ATOMIC_RELEASE);
+	strcpy(shmName, name);
+	memset(shmFdPins, 0, sizeof(shmFdPins));
+
+	shmInner = gpio_get_backend();
+	gpio_shm_backend.fdEvents = shmInner->fdEvents;
+	gpio_shm_backend.get_config = (shmInner->get_config != NULL) ? shm_get_config : NULL;
+	gpio_shm_backend.threadSafe = shmInner->threadSafe;
+	__atomic_store_n(&shmSegment, segment, __ATOMIC_RELEASE);
+	gpio_set_backend(&gpio_shm_backend);
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will stop publishing, restore the previous backend and remove the segment.
+ ******************************************************************************/
+void gpio_shm_close(void)
+{
+	struct gpio_shm_segment *segment = shmSegment;
+
+	if (segment == NULL) {
+		return;
+	}
+	gpio_set_backend(shmInner);
+	__atomic_store_n(&shmSegment, NULL, __ATOMIC_RELEASE);
+	munmap(segment, sizeof(*segment));
+	(void)shm_unlink(shmName);
+	shmInner = NULL;
+}
+
+/*******************************************************************************
+ * This method will publish the statistics of one latency stage.
+ * @param uint32_t stage - This is the index of the stage, below GPIO_SHM_MAX_STAGES.
+ * @param const char *name - This is the name of the stage.
+ * @param uint64_t count - This is the number of values recorded.
+ * @param uint64_t p50 - This is the median, in ns.
+ * @param uint64_t p99 - This is the 99th percentile, in ns.
+ * @param uint64_t max - This is the largest value, in ns.
+ ******************************************************************************/
+void gpio_shm_publish_stage(uint32_t stage, const char *name, uint64_t count, uint64_t p50,
+	uint64_t p99, uint64_t max)
+{
+	struct gpio_shm_segment *segment = shmSegment;
+	struct gpio_shm_stage *entry;
+	uint32_t seq;
+
+	if ((segment == NULL) || (stage >= GPIO_SHM_MAX_STAGES)) {
+		return;
+	}
+	entry = &segment->stages[stage];
+	seq = shm_begin(segment);
+	snprintf(entry->name, sizeof(entry->name), "%s", name);
+	entry->count = count;
+	entry->p50 = p50;
+	entry->p99 = p99;
+	entry->max = max;
+	shm_end(segment, seq, timens_now(CLOCK_MONOTONIC));
+}
+
+/*******************************************************************************
+ * This method will map a published segment for reading.
+ * @param const char *name - This is the name of the segment.
+ * @return The segment, or NULL if it does not exist or is not a segment of this version.
+ ******************************************************************************/
+const struct gpio_shm_segment* gpio_shm_attach(const char *name)
+{
+	struct gpio_shm_segment *segment;
+	struct stat st;
+	int32_t fd;
+
+	fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+	if (fd < 0) {
+		return NULL;
+	}
+	if ((fstat(fd, &st) < 0) || (st.st_size < (off_t)sizeof(*segment))) {
+		close(fd);
+		errno = EPROTO;
+		return NULL;
+	}
+	segment = (struct gpio_shm_segment*)mmap(NULL, sizeof(*segment), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (segment == MAP_FAILED) {
+		return NULL;
+	}
+	if ((__atomic_load_n(&segment->magic, __ATOMIC_ACQUIRE) != GPIO_SHM_MAGIC) ||
+		(segment->version != GPIO_SHM_VERSION) || (segment->size != sizeof(*segment))) {
+		munmap(segment, sizeof(*segment));
+		errno = EPROTO;
+		return NULL;
+	}
+	return segment;
+}
+
+/*******************************************************************************
+ * This method will unmap a segment mapped with gpio_shm_attach.
+ * @param const struct gpio_shm_segment *segment - This is the segment.
+ ******************************************************************************/
+void gpio_shm_detach(const struct gpio_shm_segment *segment)
+{
+	if (segment != NULL) {
+		munmap((void*)segment, sizeof(*segment));
+	}
+}
+
+/*******************************************************************************
+ * This method will take a consistent copy of a segment.
+ * @param const struct gpio_shm_segment *segment - This is the segment.
+ * @param struct gpio_shm_segment *copy - This is where the copy is placed.
+ * @param uint32_t *retries - This is where the number of discarded copies is placed, or NULL.
+ * @return The return will be 0 if successful or -1 if no consistent copy was taken.
+ ******************************************************************************/
+int32_t gpio_shm_read(const struct gpio_shm_segment *segment, struct gpio_shm_segment *copy,
+	uint32_t *retries)
+{
+	uint32_t before, attempt;
+
+	for (attempt = 0; attempt < GPIO_SHM_MAX_RETRIES; attempt++) {
+		before = __atomic_load_n(&segment->seq, __ATOMIC_ACQUIRE);
+		if (before & 1) {
+			continue;
+		}
+		memcpy(copy, segment, sizeof(*copy));
+		// The copy must be complete before the count is read again.
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&segment->seq, __ATOMIC_RELAXED) == before) {
+			if (retries != NULL) {
+				*retries = attempt;
+			}
+			return 0;
+		}
+	}
+	if (retries != NULL) {
+		*retries = attempt;
+	}
+	errno = EAGAIN;
+	return -1;
+}
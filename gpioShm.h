@@ -0,0 +1,130 @@
+/*********************************************************************
+ * This module publishes the state of the pins in a POSIX shared memory
+ * segment, so that other processes (the scoreboard, telemetry) can follow
+ * the switches and LEDs without opening sysfs next to the game.
+ *
+ * Publishing installs a backend which forwards every operation to the
+ * current one, like gpio_trace_outputs, and records what passes through:
+ * the level and direction of each pin, its rising and falling edges, its
+ * output writes, the time of its last change and, for backends which
+ * timestamp edges, the time from the edge to its being read.  The program
+ * may add the statistics of its own latency stages; a stage it does not
+ * publish, as when the game is built without INSTRUMENT_LATENCY, keeps a
+ * count of 0 and should be ignored.
+ *
+ * The segment is guarded by a sequence lock.  A writer makes the count odd,
+ * changes the segment and makes it even again; writers wait for each other,
+ * but never for a reader.  A reader copies the segment and keeps the copy
+ * only if the count was even and unchanged across the copy, so reading
+ * needs no system call and no write to the segment, and any number of
+ * readers cost the writer nothing.
+ */
+#ifndef GPIOSHM_H
+#define GPIOSHM_H
+
+#include <stdint.h>
+#include "gpioInterface.h"
+#include "timeutil.h"
+
+#define GPIO_SHM_NAME "/anticipation-pins"
+#define GPIO_SHM_MAGIC (0x4e495047)	// "GPIN"
+#define GPIO_SHM_VERSION (1)
+#define GPIO_SHM_MAX_STAGES (8)
+#define GPIO_SHM_STAGE_NAME (16)
+#define GPIO_SHM_MAX_FDS (1024)		// Descriptors whose pin is known to the edge counters
+#define GPIO_SHM_MAX_RETRIES (100000)	// Copies a reader attempts before giving up
+
+// The flags of a published pin.
+#define GPIO_SHM_EXPORTED (1)
+#define GPIO_SHM_OUTPUT (2)
+#define GPIO_SHM_LEVEL_KNOWN (4)
+
+struct gpio_shm_pin {
+	uint32_t flags;
+	uint32_t level;
+	uint64_t rising;
+	uint64_t falling;
+	uint64_t writes;	// Output writes passed to the backend
+	timens_t lastChange;	// CLOCK_MONOTONIC time of the last edge or change of output
+	timens_t lastLatency;	// Edge timestamp to the edge being read, or 0 without timestamps
+	timens_t maxLatency;
+};
+
+// The statistics of one latency stage of the program, in ns.
+struct gpio_shm_stage {
+	char name[GPIO_SHM_STAGE_NAME];
+	uint64_t count;
+	uint64_t p50;
+	uint64_t p99;
+	uint64_t max;
+};
+
+struct gpio_shm_segment {
+	// Written once, before magic, when the segment is created.
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size;
+	int32_t pid;		// The publishing process
+	// The sequence count is on its own cache line, ahead of the data.
+	uint32_t seq __attribute__((aligned(64)));
+	uint64_t updates;
+	timens_t updated;	// CLOCK_MONOTONIC time of the last update
+	struct gpio_shm_pin pins[GPIO_MAX_PINS] __attribute__((aligned(64)));
+	struct gpio_shm_stage stages[GPIO_SHM_MAX_STAGES];
+};
+
+/*******************************************************************************
+ * This method will create the segment and start publishing the state of the
+ * pins by installing a backend which records and then forwards to the current one.
+ * @param const char *name - This is the name of the segment, for example GPIO_SHM_NAME.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_shm_open(const char *name);
+
+/*******************************************************************************
+ * This method will stop publishing, restore the previous backend and remove
+ * the segment.  Readers which are attached keep their mapping.
+ ******************************************************************************/
+void gpio_shm_close(void);
+
+/*******************************************************************************
+ * This method will publish the statistics of one latency stage.  It does
+ * nothing unless publishing.
+ * @param uint32_t stage - This is the index of the stage, below GPIO_SHM_MAX_STAGES.
+ * @param const char *name - This is the name of the stage.
+ * @param uint64_t count - This is the number of values recorded.
+ * @param uint64_t p50 - This is the median, in ns.
+ * @param uint64_t p99 - This is the 99th percentile, in ns.
+ * @param uint64_t max - This is the largest value, in ns.
+ ******************************************************************************/
+void gpio_shm_publish_stage(uint32_t stage, const char *name, uint64_t count, uint64_t p50,
+	uint64_t p99, uint64_t max);
+
+/*******************************************************************************
+ * This method will map a published segment for reading.
+ * @param const char *name - This is the name of the segment.
+ * @return The segment, or NULL if it does not exist or is not a segment of
+ *         this version.
+ ******************************************************************************/
+const struct gpio_shm_segment* gpio_shm_attach(const char *name);
+
+/*******************************************************************************
+ * This method will unmap a segment mapped with gpio_shm_attach.
+ * @param const struct gpio_shm_segment *segment - This is the segment.
+ ******************************************************************************/
+void gpio_shm_detach(const struct gpio_shm_segment *segment);
+
+/*******************************************************************************
+ * This method will take a consistent copy of a segment.  It makes no system call.
+ * @param const struct gpio_shm_segment *segment - This is the segment.
+ * @param struct gpio_shm_segment *copy - This is where the copy is placed.
+ * @param uint32_t *retries - This is where the number of copies which were
+ *        discarded because the writer was busy is placed.  It may be NULL.
+ * @return The return will be 0 if successful or -1 if no consistent copy was
+ *         taken in GPIO_SHM_MAX_RETRIES attempts, for example because the
+ *         writer died while updating.
+ ******************************************************************************/
+int32_t gpio_shm_read(const struct gpio_shm_segment *segment, struct gpio_shm_segment *copy,
+	uint32_t *retries);
+
+#endif
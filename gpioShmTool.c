@@ -0,0 +1,141 @@
+/*********************************************************************
+ * This program reads the pin state published in shared memory by a
+ * running game (see gpioShm.h), to check the publication and as an example
+ * for the scoreboard and telemetry readers.
+ *
+ * Usage: gpioShmTool [-n name] [-i interval ms] [-c count] [-s samples]
+ *
+ * Every interval the exported pins and the published latency stages are
+ * printed, count times (0 for ever).  With -s the given number of copies
+ * is taken back to back instead, and their cost and the copies discarded
+ * because the writer was busy are reported.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <stdint.h>
+#include "gpioShm.h"
+#include "timeutil.h"
+
+// The snapshot is larger than is comfortable on the stack.
+static struct gpio_shm_segment copy;
+
+/*******************************************************************************
+ * This method will print one snapshot of a segment.
+ * @param const struct gpio_shm_segment *snapshot - This is the snapshot.
+ * @param uint32_t retries - This is the number of copies discarded while taking it.
+ ******************************************************************************/
+static void print_snapshot(const struct gpio_shm_segment *snapshot, uint32_t retries)
+{
+	const struct gpio_shm_pin *pin;
+	const struct gpio_shm_stage *stage;
+	timens_t now = timens_now(CLOCK_MONOTONIC);
+	uint32_t gpio, index;
+
+	printf("pid %d, %llu updates, last %lld ms ago, %u retries\n", snapshot->pid,
+		(unsigned long long)snapshot->updates, (long long)timens_to_ms(timens_sub(now, snapshot->updated)),
+		retries);
+	printf("  pin dir level   rising  falling   writes changed_ms latency_us  max_us\n");
+	for (gpio = 0; gpio < GPIO_MAX_PINS; gpio++) {
+		pin = &snapshot->pins[gpio];
+		if (!(pin->flags & GPIO_SHM_EXPORTED)) {
+			continue;
+		}
+		printf("  %3u %-3s %5s %8llu %8llu %8llu %10lld %10lld %7lld\n", gpio,
+			(pin->flags & GPIO_SHM_OUTPUT) ? "out" : "in",
+			(pin->flags & GPIO_SHM_LEVEL_KNOWN) ? (pin->level ? "1" : "0") : "?",
+			(unsigned long long)pin->rising, (unsigned long long)pin->falling,
+			(unsigned long long)pin->writes,
+			(pin->lastChange != 0) ? (long long)timens_to_ms(timens_sub(now, pin->lastChange)) : -1LL,
+			(long long)timens_to_us(pin->lastLatency), (long long)timens_to_us(pin->maxLatency));
+	}
+	for (index = 0; index < GPIO_SHM_MAX_STAGES; index++) {
+		stage = &snapshot->stages[index];
+		if (stage->count == 0) {
+			continue;
+		}
+		printf("  stage %-12s %10llu values, p50 %llu us, p99 %llu us, max %llu us\n", stage->name,
+			(unsigned long long)stage->count, (unsigned long long)(stage->p50 / 1000),
+			(unsigned long long)(stage->p99 / 1000), (unsigned long long)(stage->max / 1000));
+	}
+	fflush(stdout);
+}
+
+/*******************************************************************************
+ * This method will take copies of a segment back to back and report their cost.
+ * @param const struct gpio_shm_segment *segment - This is the segment.
+ * @param uint32_t samples - This is the number of copies.
+ * @return The return will be 0 if successful or 1 if a copy failed.
+ ******************************************************************************/
+static int32_t time_copies(const struct gpio_shm_segment *segment, uint32_t samples)
+{
+	uint64_t discarded = 0;
+	uint32_t index, retries;
+	timens_t start, elapsed;
+
+	start = timens_now(CLOCK_MONOTONIC);
+	for (index = 0; index < samples; index++) {
+		if (gpio_shm_read(segment, &copy, &retries) < 0) {
+			fprintf(stderr, "gpioShmTool: no consistent copy after %u attempts\n", retries);
+			return 1;
+		}
+		discarded += retries;
+	}
+	elapsed = timens_sub(timens_now(CLOCK_MONOTONIC), start);
+	printf("%u copies of %zu bytes, %.0f ns each, %llu discarded while the writer was busy\n", samples,
+		sizeof(copy), (double)elapsed / samples, (unsigned long long)discarded);
+	return 0;
+}
+
+/****************************************************************
+* Main
+****************************************************************/
+int main(int argc, char **argv)
+{
+	const struct gpio_shm_segment *segment;
+	const char *name = GPIO_SHM_NAME;
+	struct timespec interval;
+	uint32_t intervalMs = 1000, count = 1, samples = 0, index, retries;
+	int32_t opt, rc = 0;
+
+	while ((opt = getopt(argc, argv, "n:i:c:s:")) != -1) {
+		switch (opt) {
+		case 'n': name = optarg; break;
+		case 'i': intervalMs = (uint32_t)strtoul(optarg, NULL, 0); break;
+		case 'c': count = (uint32_t)strtoul(optarg, NULL, 0); break;
+		case 's': samples = (uint32_t)strtoul(optarg, NULL, 0); break;
+		default:
+			fprintf(stderr, "usage: %s [-n name] [-i interval ms] [-c count] [-s samples]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	segment = gpio_shm_attach(name);
+	if (segment == NULL) {
+		fprintf(stderr, "%s: %s is not published: %s\n", argv[0], name, strerror(errno));
+		return 1;
+	}
+	if (samples > 0) {
+		rc = time_copies(segment, samples);
+		gpio_shm_detach(segment);
+		return rc;
+	}
+
+	timens_to_timespec(timens_from_ms(intervalMs), &interval);
+	for (index = 0; (count == 0) || (index < count); index++) {
+		if (index > 0) {
+			nanosleep(&interval, NULL);
+		}
+		if (gpio_shm_read(segment, &copy, &retries) < 0) {
+			fprintf(stderr, "%s: no consistent copy after %u attempts\n", argv[0], retries);
+			rc = 1;
+			break;
+		}
+		print_snapshot(&copy, retries);
+	}
+	gpio_shm_detach(segment);
+	return rc;
+}
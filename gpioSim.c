@@ -0,0 +1,389 @@
+/*********************************************************************
+ * This module simulates the sysfs GPIO interface so that the GPIO library
+ * and the programs built on it can be exercised and timed off target.
+ *
+ * The value, direction and edge attributes are plain files, so the library
+ * reads and writes them exactly as it would on target.  Edge notification
+ * uses loopback TCP connections: the simulator sends the new value as urgent
+ * data, which raises POLLPRI on the reading side until the byte is read.
+ */
+#define _XOPEN_SOURCE 700
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "gpioInterface.h"
+#include "gpioSim.h"
+
+ /****************************************************************
+ * Constants
+ ****************************************************************/
+#define MAX_BUF 64
+#define MAX_PATH_BUF 256
+#define SIM_MAX_LISTENERS (8)	// gpio_fd_open descriptors per pin
+
+struct sim_pin {
+	uint8_t present;
+	int32_t listeners[SIM_MAX_LISTENERS];	// Simulator side of each connection
+};
+
+static struct sim_pin simPins[GPIO_MAX_PINS];
+static pthread_mutex_t simLock = PTHREAD_MUTEX_INITIALIZER;
+static char simRoot[MAX_PATH_BUF - MAX_BUF];	// Leaves room for "/gpioN/attr"
+static uint8_t simOwnsRoot;
+static int32_t simServer = -1;
+static struct sockaddr_in simAddr;
+
+// The sysfs backend with fd_open replaced; filled in by gpio_sim_start.
+static struct gpio_backend simBackend;
+
+/*******************************************************************************
+ * This method will create a file in the simulated tree with the given contents.
+ * @param const char *path - This is the path of the file.
+ * @param const char *contents - This is what is written to the file.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t sim_create_file(const char *path, const char *contents)
+{
+	int32_t fd;
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		perror("gpiosim/create");
+		return fd;
+	}
+	write(fd, contents, strlen(contents));
+	close(fd);
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will read the first word of an attribute of a simulated pin.
+ * @param uint32_t gpio - This is the pin.
+ * @param const char *attr - This is the attribute name.
+ * @param char *buf - This is where the word is placed.
+ * @param size_t size - This is the size of buf.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t sim_read_attr(uint32_t gpio, const char *attr, char *buf, size_t size)
+{
+	int32_t fd;
+	ssize_t len;
+	char path[MAX_PATH_BUF];
+
+	snprintf(path, sizeof(path), "%s/gpio%d/%s", simRoot, gpio, attr);
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return fd;
+	}
+	len = read(fd, buf, size - 1);
+	close(fd);
+	if (len < 0) {
+		return -1;
+	}
+	buf[len] = '\0';
+	buf[strcspn(buf, "\n")] = '\0';
+	return 0;
+}
+
+/*******************************************************************************
+ * This method is the fd_open operation of the simulator backend.  It connects a loopback
+ * socket to the simulator and registers the simulator's end with the pin.
+ * @param uint32_t gpio - This is the pin that is to be opened.
+ * @return The return will be a file id for the opened descriptor.
+ ******************************************************************************/
+static int32_t sim_fd_open(uint32_t gpio)
+{
+	int32_t client, server, slot, one = 1;
+
+	if ((gpio >= GPIO_MAX_PINS) || !simPins[gpio].present) {
+		errno = ENOENT;
+		perror("gpiosim/fd_open");
+		return -1;
+	}
+
+	client = socket(AF_INET, SOCK_STREAM, 0);
+	if (client < 0) {
+		perror("gpiosim/fd_open");
+		return client;
+	}
+	// Keep the urgent byte in the stream so a plain read() returns the value.
+	setsockopt(client, SOL_SOCKET, SO_OOBINLINE, &one, sizeof(one));
+
+	pthread_mutex_lock(&simLock);
+	if (connect(client, (struct sockaddr*)&simAddr, sizeof(simAddr)) < 0) {
+		pthread_mutex_unlock(&simLock);
+		perror("gpiosim/fd_open");
+		close(client);
+		return -1;
+	}
+	server = accept(simServer, NULL, NULL);
+	if (server < 0) {
+		pthread_mutex_unlock(&simLock);
+		perror("gpiosim/fd_open");
+		close(client);
+		return -1;
+	}
+	setsockopt(server, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+	for (slot = 0; slot < SIM_MAX_LISTENERS; slot++) {
+		if (simPins[gpio].listeners[slot] < 0) {
+			simPins[gpio].listeners[slot] = server;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&simLock);
+
+	if (slot == SIM_MAX_LISTENERS) {
+		fprintf(stderr, "gpiosim/fd_open: too many descriptors for pin %d\n", gpio);
+		close(server);
+		close(client);
+		return -1;
+	}
+
+	fcntl(client, F_SETFL, fcntl(client, F_GETFL) | O_NONBLOCK);
+	return client;
+}
+
+/*******************************************************************************
+ * This method is an nftw callback which removes every entry it is given.
+ ******************************************************************************/
+static int sim_remove_entry(const char *path, const struct stat *sb, int flag, struct FTW *ftw)
+{
+	(void)sb;
+	(void)flag;
+
+	// Keep a directory that was handed to us by the caller.
+	if ((ftw->level == 0) && !simOwnsRoot) {
+		return 0;
+	}
+	return remove(path);
+}
+
+/*******************************************************************************
+ * This method will create the simulated sysfs tree and redirect the GPIO
+ * library to it.
+ * @param const char *dir - This is an existing, empty directory in which the tree
+ *                          is built.  If NULL, a directory is created under
+ *                          /dev/shm (or /tmp) and removed again by gpio_sim_stop.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_sim_start(const char *dir)
+{
+	char path[MAX_PATH_BUF];
+	socklen_t len = sizeof(simAddr);
+	uint32_t gpio, slot;
+
+	if (dir == NULL) {
+		strcpy(simRoot, "/dev/shm/gpiosim.XXXXXX");
+		if (mkdtemp(simRoot) == NULL) {
+			strcpy(simRoot, "/tmp/gpiosim.XXXXXX");
+			if (mkdtemp(simRoot) == NULL) {
+				perror("gpiosim/start");
+				return -1;
+			}
+		}
+		simOwnsRoot = 1;
+	} else {
+		if (strlen(dir) >= sizeof(simRoot)) {
+			errno = ENAMETOOLONG;
+			return -1;
+		}
+		strcpy(simRoot, dir);
+		simOwnsRoot = 0;
+	}
+
+	snprintf(path, sizeof(path), "%s/export", simRoot);
+	if (sim_create_file(path, "") < 0) {
+		return -1;
+	}
+	snprintf(path, sizeof(path), "%s/unexport", simRoot);
+	if (sim_create_file(path, "") < 0) {
+		return -1;
+	}
+
+	for (gpio = 0; gpio < GPIO_MAX_PINS; gpio++) {
+		simPins[gpio].present = 0;
+		for (slot = 0; slot < SIM_MAX_LISTENERS; slot++) {
+			simPins[gpio].listeners[slot] = -1;
+		}
+	}
+
+	simServer = socket(AF_INET, SOCK_STREAM, 0);
+	if (simServer < 0) {
+		perror("gpiosim/start");
+		return -1;
+	}
+	memset(&simAddr, 0, sizeof(simAddr));
+	simAddr.sin_family = AF_INET;
+	simAddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	simAddr.sin_port = 0;
+	if ((bind(simServer, (struct sockaddr*)&simAddr, sizeof(simAddr)) < 0) ||
+		(getsockname(simServer, (struct sockaddr*)&simAddr, &len) < 0) ||
+		(listen(simServer, SIM_MAX_LISTENERS) < 0)) {
+		perror("gpiosim/start");
+		close(simServer);
+		simServer = -1;
+		return -1;
+	}
+
+	simBackend = gpio_sysfs_backend;
+	simBackend.name = "sim";
+	simBackend.fd_open = sim_fd_open;
+	gpio_set_root(simRoot);
+	gpio_set_backend(&simBackend);
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will remove the simulated tree and restore the default sysfs root.
+ ******************************************************************************/
+void gpio_sim_stop(void)
+{
+	uint32_t gpio, slot;
+
+	gpio_set_backend(NULL);
+	gpio_set_root(NULL);
+
+	pthread_mutex_lock(&simLock);
+	for (gpio = 0; gpio < GPIO_MAX_PINS; gpio++) {
+		simPins[gpio].present = 0;
+		for (slot = 0; slot < SIM_MAX_LISTENERS; slot++) {
+			if (simPins[gpio].listeners[slot] >= 0) {
+				close(simPins[gpio].listeners[slot]);
+				simPins[gpio].listeners[slot] = -1;
+			}
+		}
+	}
+	if (simServer >= 0) {
+		close(simServer);
+		simServer = -1;
+	}
+	pthread_mutex_unlock(&simLock);
+
+	if (simRoot[0] != '\0') {
+		nftw(simRoot, sim_remove_entry, 8, FTW_DEPTH | FTW_PHYS);
+		simRoot[0] = '\0';
+	}
+}
+
+/*******************************************************************************
+ * This method will create the gpioN node for the given pin.  The pin starts as
+ * an input with value 0 and no edge.  Pins must be added before they are exported.
+ * @param uint32_t gpio - This is the pin that is to be simulated.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_sim_add_pin(uint32_t gpio)
+{
+	char path[MAX_PATH_BUF];
+
+	if (gpio >= GPIO_MAX_PINS) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	snprintf(path, sizeof(path), "%s/gpio%d", simRoot, gpio);
+	if ((mkdir(path, 0755) < 0) && (errno != EEXIST)) {
+		perror("gpiosim/add-pin");
+		return -1;
+	}
+	snprintf(path, sizeof(path), "%s/gpio%d/value", simRoot, gpio);
+	if (sim_create_file(path, "0\n") < 0) {
+		return -1;
+	}
+	snprintf(path, sizeof(path), "%s/gpio%d/direction", simRoot, gpio);
+	if (sim_create_file(path, "in\n") < 0) {
+		return -1;
+	}
+	snprintf(path, sizeof(path), "%s/gpio%d/edge", simRoot, gpio);
+	if (sim_create_file(path, "none\n") < 0) {
+		return -1;
+	}
+
+	simPins[gpio].present = 1;
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will drive the given pin to a new level, as if it had changed
+ * in hardware.  If the transition matches the pin's configured edge, every
+ * descriptor opened with gpio_fd_open for the pin is woken with POLLPRI.
+ * This may be called from any thread.
+ * @param uint32_t gpio - This is the pin that is to be driven.
+ * @param uint32_t value - This is the new level.  Non zero is high.
+ * @return The return will be 1 if an edge was raised, 0 if not, or a negative
+ *         number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_sim_inject(uint32_t gpio, uint32_t value)
+{
+	int32_t fd, slot, raise;
+	uint32_t previous;
+	char path[MAX_PATH_BUF];
+	char edge[MAX_BUF];
+	char ch = value ? '1' : '0';
+
+	if ((gpio >= GPIO_MAX_PINS) || !simPins[gpio].present) {
+		errno = ENOENT;
+		return -1;
+	}
+	if ((gpio_sim_read(gpio, &previous) < 0) || (sim_read_attr(gpio, "edge", edge, sizeof(edge)) < 0)) {
+		return -1;
+	}
+
+	snprintf(path, sizeof(path), "%s/gpio%d/value", simRoot, gpio);
+	fd = open(path, O_WRONLY);
+	if (fd < 0) {
+		return fd;
+	}
+	pwrite(fd, value ? "1\n" : "0\n", 2, 0);
+	close(fd);
+
+	value = (value != 0);
+	raise = (value != previous) &&
+		((strcmp(edge, "both") == 0) ||
+		((strcmp(edge, "rising") == 0) && value) ||
+		((strcmp(edge, "falling") == 0) && !value));
+	if (!raise) {
+		return 0;
+	}
+
+	pthread_mutex_lock(&simLock);
+	for (slot = 0; slot < SIM_MAX_LISTENERS; slot++) {
+		fd = simPins[gpio].listeners[slot];
+		if ((fd >= 0) && (send(fd, &ch, 1, MSG_OOB | MSG_NOSIGNAL) < 0)) {
+			// The reader has closed its end.
+			close(fd);
+			simPins[gpio].listeners[slot] = -1;
+		}
+	}
+	pthread_mutex_unlock(&simLock);
+	return 1;
+}
+
+/*******************************************************************************
+ * This method will read the level most recently written to the given pin,
+ * for example by gpio_set_value on an output.
+ * @param uint32_t gpio - This is the pin that is to be read.
+ * @param uint32_t *value - This is where the level is placed.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_sim_read(uint32_t gpio, uint32_t *value)
+{
+	char buf[MAX_BUF];
+
+	if (sim_read_attr(gpio, "value", buf, sizeof(buf)) < 0) {
+		return -1;
+	}
+	*value = (buf[0] != '0');
+	return 0;
+}
@@ -0,0 +1,60 @@
+/*********************************************************************
+ * This module simulates the sysfs GPIO interface so that the GPIO library
+ * and the programs built on it can be exercised and timed off target.
+ *
+ * The simulator builds a fake export / unexport / gpioN tree in a (tmpfs)
+ * directory and points gpioInterface at it.  Descriptors returned by
+ * gpio_fd_open are loopback sockets on which the simulator raises POLLPRI
+ * when an edge is injected, just like the sysfs value file does on target.
+ * Reading such a descriptor returns the new value character.
+ */
+#ifndef GPIOSIM_H
+#define GPIOSIM_H
+
+#include <stdint.h>
+
+/*******************************************************************************
+ * This method will create the simulated sysfs tree and redirect the GPIO
+ * library to it.
+ * @param const char *dir - This is an existing, empty directory in which the tree
+ *                          is built.  If NULL, a directory is created under
+ *                          /dev/shm (or /tmp) and removed again by gpio_sim_stop.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_sim_start(const char *dir);
+
+/*******************************************************************************
+ * This method will remove the simulated tree and restore the default sysfs root.
+ ******************************************************************************/
+void gpio_sim_stop(void);
+
+/*******************************************************************************
+ * This method will create the gpioN node for the given pin.  The pin starts as
+ * an input with value 0 and no edge.  Pins must be added before they are exported.
+ * @param uint32_t gpio - This is the pin that is to be simulated.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_sim_add_pin(uint32_t gpio);
+
+/*******************************************************************************
+ * This method will drive the given pin to a new level, as if it had changed
+ * in hardware.  If the transition matches the pin's configured edge, every
+ * descriptor opened with gpio_fd_open for the pin is woken with POLLPRI.
+ * This may be called from any thread.
+ * @param uint32_t gpio - This is the pin that is to be driven.
+ * @param uint32_t value - This is the new level.  Non zero is high.
+ * @return The return will be 1 if an edge was raised, 0 if not, or a negative
+ *         number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_sim_inject(uint32_t gpio, uint32_t value);
+
+/*******************************************************************************
+ * This method will read the level most recently written to the given pin,
+ * for example by gpio_set_value on an output.
+ * @param uint32_t gpio - This is the pin that is to be read.
+ * @param uint32_t *value - This is where the level is placed.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_sim_read(uint32_t gpio, uint32_t *value);
+
+#endif
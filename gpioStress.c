@@ -0,0 +1,485 @@
+/*********************************************************************
+ * This program measures how many edges per second the edge path can
+ * deliver before it starts to miss transitions.
+ *
+ * A generator thread toggles an output pin at a fixed rate while the
+ * event loop in the main thread receives the edges of an input pin wired
+ * to it.  With the simulated backends the wire is the simulator: every
+ * write of the output is injected into the input.  On target, pass the
+ * sysfs or cdev backend and two pins joined by a jumper.
+ *
+ * Each backend is run in each event loop configuration:
+ *   loop    - the input's descriptor is registered with the event loop, as
+ *             a program without the capture thread would do, and
+ *   capture - the edge capture thread queues the edges and the event loop
+ *             drains the queue, as the game does.
+ * The rate starts at -r edges per second and is multiplied by -s up to -R.
+ * A curve ends early once the generator itself cannot keep up.
+ *
+ * For every step the generated and delivered edges, the edges missed
+ * (sysfs only reports the latest level, so edges that follow each other
+ * too closely collapse into one), the edges dropped by a full capture
+ * queue and the wakeup latency percentiles are written as CSV or JSON.
+ * The latency of an edge is the time from the write of the newest edge
+ * with the delivered level to its callback, so an edge that collapsed into
+ * a later one is timed from the later one.
+ *
+ * Usage: gpioStress [-b sim|mock|sysfs|cdev]... [-m loop|capture]... [-o output] [-i input]
+ *                   [-r rate] [-R rate] [-s factor] [-t ms] [-f csv|json]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include "gpioInterface.h"
+#include "gpioCdev.h"
+#include "gpioCdevMock.h"
+#include "gpioSetup.h"
+#include "gpioSim.h"
+#include "edgeCapture.h"
+#include "eventLoop.h"
+#include "latencyHist.h"
+#include "timeutil.h"
+
+#define STRESS_OUTPUT_PIN (44)
+#define STRESS_INPUT_PIN (48)
+#define STRESS_MAX_BACKENDS (4)
+#define STRESS_MAX_MODES (2)
+#define STRESS_SETTLE_MS (100)		// Time allowed for late edges after the last write
+#define STRESS_KEEP_UP (0.9)		// Fraction of the target rate the generator must reach
+#define STRESS_HISTORY (4096)		// Write times kept for the latency lookup; a power of two
+
+#define STRESS_MODE_LOOP (0)
+#define STRESS_MODE_CAPTURE (1)
+
+struct stress_backend {
+	const char *name;
+	int32_t (*start)(void);
+	void (*stop)(void);
+	// Carries a new output level to the input, or NULL if the pins are wired.
+	int32_t (*wire)(uint32_t gpio, uint32_t value);
+};
+
+// One step of a curve, shared by the generator and the event loop.
+struct stress_step {
+	const struct stress_backend *backend;
+	struct event_loop *loop;
+	timens_t period;
+	timens_t duration;
+	timens_t elapsed;	// Time the generator took for its writes
+	uint32_t generated;	// Written by the generator, read by the callbacks
+	uint32_t delivered;
+	uint32_t writeErrors;
+	timens_t written[STRESS_HISTORY];	// When each edge was written, by edge number
+	struct latency_hist latency;
+};
+
+static uint32_t outputPin = STRESS_OUTPUT_PIN;
+static uint32_t inputPin = STRESS_INPUT_PIN;
+static struct stress_step step;
+static struct edge_capture capture;
+
+static const char *modeNames[STRESS_MAX_MODES] = { "loop", "capture" };
+
+/*******************************************************************************
+ * This method is the start operation of the sim backend.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t stress_sim_start(void)
+{
+	if ((gpio_sim_start(NULL) < 0) || (gpio_sim_add_pin(outputPin) < 0) || (gpio_sim_add_pin(inputPin) < 0)) {
+		return -1;
+	}
+	return 0;
+}
+
+/*******************************************************************************
+ * This method is the start operation of the on-target cdev backend.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t stress_cdev_start(void)
+{
+	if (gpio_cdev_open(NULL) < 0) {
+		return -1;
+	}
+	gpio_set_backend(&gpio_cdev_backend);
+	return 0;
+}
+
+/*******************************************************************************
+ * This method is the stop operation of the on-target cdev backend.
+ ******************************************************************************/
+static void stress_cdev_stop(void)
+{
+	gpio_set_backend(NULL);
+	gpio_cdev_close();
+}
+
+/*******************************************************************************
+ * This method is the start operation of the on-target sysfs backend.
+ * @return Always 0.
+ ******************************************************************************/
+static int32_t stress_sysfs_start(void)
+{
+	gpio_set_backend(NULL);
+	return 0;
+}
+
+/*******************************************************************************
+ * This method is the stop operation of the on-target sysfs backend.
+ ******************************************************************************/
+static void stress_sysfs_stop(void)
+{
+}
+
+static const struct stress_backend backends[STRESS_MAX_BACKENDS] = {
+	{ "sim", stress_sim_start, gpio_sim_stop, gpio_sim_inject },
+	{ "mock", gpio_cdev_mock_start, gpio_cdev_mock_stop, gpio_cdev_mock_inject },
+	{ "sysfs", stress_sysfs_start, stress_sysfs_stop, NULL },
+	{ "cdev", stress_cdev_start, stress_cdev_stop, NULL },
+};
+
+/*******************************************************************************
+ * This method will record the delivery of an edge.  The edges alternate,
+ * starting with a rising one, so edge n leaves the input high if n is even.
+ * @param uint32_t value - This is the level the edge left the input at.
+ ******************************************************************************/
+static void stress_delivered(uint32_t value)
+{
+	timens_t now = timens_now(CLOCK_MONOTONIC);
+	uint32_t generated = __atomic_load_n(&step.generated, __ATOMIC_ACQUIRE);
+	uint32_t edge;
+
+	step.delivered++;
+	if (generated == 0) {
+		return;
+	}
+	edge = generated - 1;
+	if (((edge & 1) == 0) != (value != 0)) {
+		if (edge == 0) {
+			return;
+		}
+		edge--;
+	}
+	latency_hist_record(&step.latency, timens_sub(now, step.written[edge & (STRESS_HISTORY - 1)]));
+}
+
+/*******************************************************************************
+ * This method is called by the event loop for an edge on the input pin.
+ * @param uint32_t gpio - This is the pin.
+ * @param uint32_t value - This is the new level.
+ * @param void *ctx - This is not used.
+ ******************************************************************************/
+static void stress_pin_edge(uint32_t gpio, uint32_t value, void *ctx)
+{
+	(void)gpio;
+	(void)ctx;
+	stress_delivered(value);
+}
+
+/*******************************************************************************
+ * This method is called by edge_capture_drain for every queued edge.
+ * @param const struct gpio_edge_event *event - This is the edge.
+ * @param void *ctx - This is not used.
+ ******************************************************************************/
+static void stress_queued_edge(const struct gpio_edge_event *event, void *ctx)
+{
+	(void)ctx;
+	stress_delivered(event->value);
+}
+
+/*******************************************************************************
+ * This method is called by the event loop when the capture queue has edges.
+ * @param int32_t fd - This is the notification descriptor.
+ * @param uint32_t events - This is the set of epoll events that occurred.
+ * @param void *ctx - This is not used.
+ ******************************************************************************/
+static void stress_capture_ready(int32_t fd, uint32_t events, void *ctx)
+{
+	(void)fd;
+	(void)events;
+	(void)edge_capture_drain(&capture, stress_queued_edge, ctx);
+}
+
+/*******************************************************************************
+ * This method is the body of the generator thread.  It toggles the output at
+ * the step's rate for the step's duration, waits for late edges and then
+ * stops the event loop.
+ * @param void *arg - This is not used.
+ * @return Always NULL.
+ ******************************************************************************/
+static void* stress_generator(void *arg)
+{
+	struct timespec wake;
+	timens_t start, next, end, now;
+	uint32_t edge = 0;
+
+	(void)arg;
+	start = timens_now(CLOCK_MONOTONIC);
+	end = timens_add(start, step.duration);
+	next = start;
+	// An even number of edges leaves the output low, so no edge of this step
+	// is still queued when the next one starts from low.
+	while (((now = timens_now(CLOCK_MONOTONIC)) < end) || (edge & 1)) {
+		if (next > now) {
+			timens_to_timespec(next, &wake);
+			(void)clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL);
+			now = timens_now(CLOCK_MONOTONIC);
+		}
+
+		// The edge is published before it is written so a callback always finds it.
+		step.written[edge & (STRESS_HISTORY - 1)] = now;
+		__atomic_store_n(&step.generated, edge + 1, __ATOMIC_RELEASE);
+		if ((gpio_set_value(outputPin, (edge & 1) == 0) < 0) ||
+			((step.backend->wire != NULL) && (step.backend->wire(inputPin, (edge & 1) == 0) < 0))) {
+			step.writeErrors++;
+		}
+		edge++;
+		next = timens_add(next, step.period);
+	}
+	step.elapsed = timens_sub(timens_now(CLOCK_MONOTONIC), start);
+
+	timens_to_timespec(timens_add(timens_now(CLOCK_MONOTONIC), timens_from_ms(STRESS_SETTLE_MS)), &wake);
+	(void)clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL);
+	event_loop_stop(step.loop);
+	return NULL;
+}
+
+/*******************************************************************************
+ * This method will run one step of a curve: the edges of one rate through one
+ * event loop configuration.
+ * @param const struct stress_backend *backend - This is the backend in use.
+ * @param uint32_t mode - This is STRESS_MODE_LOOP or STRESS_MODE_CAPTURE.
+ * @param double rate - This is the target rate in edges per second.
+ * @param uint32_t durationMs - This is how long the edges are generated for.
+ * @param uint32_t *dropped - This is where the edges dropped by the capture queue are placed.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t stress_run_step(const struct stress_backend *backend, uint32_t mode, double rate,
+	uint32_t durationMs, uint32_t *dropped)
+{
+	struct event_loop loop;
+	pthread_t generator;
+	int32_t fd, rc = 0;
+	uint32_t capturing = 0;
+
+	memset(&step, 0, sizeof(step));
+	step.backend = backend;
+	step.loop = &loop;
+	step.period = (timens_t)(1e9 / rate);
+	step.duration = timens_from_ms(durationMs);
+	step.latency.name = "wakeup";
+	*dropped = 0;
+
+	// Start from a low output so the first edge is a rising one.
+	(void)gpio_set_value_flags(outputPin, 0, GPIO_FORCE);
+	if (backend->wire != NULL) {
+		(void)backend->wire(inputPin, 0);
+	}
+
+	fd = gpio_fd_open(inputPin);
+	if (fd < 0) {
+		return -1;
+	}
+	if (event_loop_init(&loop) < 0) {
+		gpio_fd_close(fd);
+		return -1;
+	}
+	if (mode == STRESS_MODE_CAPTURE) {
+		if (edge_capture_init(&capture) < 0) {
+			rc = -1;
+		} else if ((edge_capture_add_pin(&capture, inputPin, fd) < 0) ||
+			(event_loop_add_fd(&loop, edge_capture_fd(&capture), EPOLLIN, stress_capture_ready, NULL) < 0) ||
+			(edge_capture_start(&capture) < 0)) {
+			close(capture.stopFd);
+			close(capture.notifyFd);
+			rc = -1;
+		} else {
+			capturing = 1;
+		}
+	} else if (event_loop_add_pin(&loop, inputPin, fd, stress_pin_edge, NULL) < 0) {
+		rc = -1;
+	}
+
+	if ((rc == 0) && (pthread_create(&generator, NULL, stress_generator, NULL) == 0)) {
+		rc = event_loop_run(&loop);
+		pthread_join(generator, NULL);
+	} else {
+		rc = -1;
+	}
+
+	if (capturing) {
+		*dropped = edge_queue_dropped(&capture.queue);
+		edge_capture_stop(&capture);
+	}
+	event_loop_close(&loop);
+	gpio_fd_close(fd);
+	return rc;
+}
+
+/*******************************************************************************
+ * This method will export the pin pair: the output low, the input reporting both edges.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t stress_setup_pins(void)
+{
+	struct gpio_pin_setup table[2];
+
+	memset(table, 0, sizeof(table));
+	table[0].pin = outputPin;
+	table[0].out = 1;
+	table[1].pin = inputPin;
+	table[1].edge = GPIO_BOTH_EDGES;
+	return gpio_setup_pins(table, 2);
+}
+
+/*******************************************************************************
+ * This method will write the result of one step.
+ * @param const char *format - This is "csv" or "json".
+ * @param const char *backend - This is the name of the backend.
+ * @param const char *mode - This is the name of the event loop configuration.
+ * @param double rate - This is the target rate in edges per second.
+ * @param uint32_t dropped - This is the number of edges dropped by the capture queue.
+ * @param uint32_t first - This is nonzero for the first row written.
+ ******************************************************************************/
+static void stress_report(const char *format, const char *backend, const char *mode, double rate,
+	uint32_t dropped, uint32_t first)
+{
+	double seconds = (double)step.elapsed / 1e9;
+	double generatedRate = (seconds > 0) ? step.generated / seconds : 0.0;
+	double deliveredRate = (seconds > 0) ? step.delivered / seconds : 0.0;
+	double percent = (step.generated > 0) ? 100.0 * step.delivered / step.generated : 0.0;
+	uint32_t missed = (step.generated > step.delivered) ? step.generated - step.delivered : 0;
+
+	if (strcmp(format, "csv") == 0) {
+		printf("%s,%s,%.0f,%.0f,%.0f,%u,%u,%u,%u,%u,%.1f,%llu,%llu,%llu,%llu\n", backend, mode, rate,
+			generatedRate, deliveredRate, step.generated, step.delivered, missed, dropped,
+			step.writeErrors, percent,
+			(unsigned long long)latency_hist_percentile(&step.latency, 0.50),
+			(unsigned long long)latency_hist_percentile(&step.latency, 0.99),
+			(unsigned long long)latency_hist_percentile(&step.latency, 0.999),
+			(unsigned long long)step.latency.max);
+	} else {
+		printf("%s  {\"backend\": \"%s\", \"mode\": \"%s\", \"target_per_sec\": %.0f, "
+			"\"generated_per_sec\": %.0f, \"delivered_per_sec\": %.0f, \"generated\": %u, "
+			"\"delivered\": %u, \"missed\": %u, \"dropped\": %u, \"write_errors\": %u, "
+			"\"delivered_pct\": %.1f, \"p50_ns\": %llu, \"p99_ns\": %llu, \"p999_ns\": %llu, "
+			"\"max_ns\": %llu}", first ? "" : ",\n", backend, mode, rate, generatedRate, deliveredRate,
+			step.generated, step.delivered, missed, dropped, step.writeErrors, percent,
+			(unsigned long long)latency_hist_percentile(&step.latency, 0.50),
+			(unsigned long long)latency_hist_percentile(&step.latency, 0.99),
+			(unsigned long long)latency_hist_percentile(&step.latency, 0.999),
+			(unsigned long long)step.latency.max);
+	}
+	fflush(stdout);
+}
+
+/****************************************************************
+* Main
+****************************************************************/
+int main(int argc, char **argv)
+{
+	const char *format = "csv";
+	const struct stress_backend *chosen[STRESS_MAX_BACKENDS];
+	uint32_t modes[STRESS_MAX_MODES];
+	uint32_t backendCount = 0, modeCount = 0, first = 1;
+	uint32_t durationMs = 500, dropped, index, mode;
+	double rate, startRate = 1000, maxRate = 1024000, factor = 2;
+	int32_t opt, rc = 0;
+
+	while ((opt = getopt(argc, argv, "b:m:o:i:r:R:s:t:f:")) != -1) {
+		switch (opt) {
+		case 'b':
+			for (index = 0; index < STRESS_MAX_BACKENDS; index++) {
+				if (strcmp(optarg, backends[index].name) == 0) {
+					break;
+				}
+			}
+			if ((index == STRESS_MAX_BACKENDS) || (backendCount == STRESS_MAX_BACKENDS)) {
+				fprintf(stderr, "%s: unknown backend %s\n", argv[0], optarg);
+				return 2;
+			}
+			chosen[backendCount++] = &backends[index];
+			break;
+		case 'm':
+			if ((strcmp(optarg, "loop") != 0) && (strcmp(optarg, "capture") != 0)) {
+				fprintf(stderr, "%s: unknown mode %s\n", argv[0], optarg);
+				return 2;
+			}
+			if (modeCount < STRESS_MAX_MODES) {
+				modes[modeCount++] = (strcmp(optarg, "loop") == 0) ? STRESS_MODE_LOOP : STRESS_MODE_CAPTURE;
+			}
+			break;
+		case 'o': outputPin = (uint32_t)strtoul(optarg, NULL, 0); break;
+		case 'i': inputPin = (uint32_t)strtoul(optarg, NULL, 0); break;
+		case 'r': startRate = strtod(optarg, NULL); break;
+		case 'R': maxRate = strtod(optarg, NULL); break;
+		case 's': factor = strtod(optarg, NULL); break;
+		case 't': durationMs = (uint32_t)strtoul(optarg, NULL, 0); break;
+		case 'f': format = optarg; break;
+		default:
+			fprintf(stderr, "Usage: %s [-b sim|mock|sysfs|cdev]... [-m loop|capture]... [-o output] [-i input]\n"
+				"       [-r rate] [-R rate] [-s factor] [-t ms] [-f csv|json]\n", argv[0]);
+			return 2;
+		}
+	}
+	if ((startRate < 1) || (maxRate < startRate) || (factor <= 1) || (durationMs < 10) ||
+		(outputPin >= GPIO_MAX_PINS) || (inputPin >= GPIO_MAX_PINS) || (outputPin == inputPin) ||
+		((strcmp(format, "csv") != 0) && (strcmp(format, "json") != 0))) {
+		fprintf(stderr, "%s: rates must be 1 <= -r <= -R, the factor above 1, the duration at least 10 ms,\n"
+			"the pins two different pins below %d and the format csv or json\n", argv[0], GPIO_MAX_PINS);
+		return 2;
+	}
+	// Without a choice the simulated backends are run, so the tool works on any host.
+	if (backendCount == 0) {
+		chosen[backendCount++] = &backends[0];
+		chosen[backendCount++] = &backends[1];
+	}
+	if (modeCount == 0) {
+		modes[modeCount++] = STRESS_MODE_LOOP;
+		modes[modeCount++] = STRESS_MODE_CAPTURE;
+	}
+
+	if (strcmp(format, "csv") == 0) {
+		printf("backend,mode,target_per_sec,generated_per_sec,delivered_per_sec,generated,delivered,missed,"
+			"dropped,write_errors,delivered_pct,p50_ns,p99_ns,p999_ns,max_ns\n");
+	} else {
+		printf("[\n");
+	}
+	for (index = 0; index < backendCount; index++) {
+		if ((chosen[index]->start() < 0) || (stress_setup_pins() < 0)) {
+			fprintf(stderr, "%s: the %s backend could not be set up\n", argv[0], chosen[index]->name);
+			chosen[index]->stop();
+			rc = 1;
+			continue;
+		}
+		for (mode = 0; mode < modeCount; mode++) {
+			for (rate = startRate; rate <= maxRate; rate *= factor) {
+				if (stress_run_step(chosen[index], modes[mode], rate, durationMs, &dropped) < 0) {
+					fprintf(stderr, "%s: %s/%s failed at %.0f edges/s\n", argv[0], chosen[index]->name,
+						modeNames[modes[mode]], rate);
+					rc = 1;
+					break;
+				}
+				stress_report(format, chosen[index]->name, modeNames[modes[mode]], rate, dropped, first);
+				first = 0;
+				// Past this rate the curve would only measure the generator.
+				if (step.generated < STRESS_KEEP_UP * rate * durationMs / 1000.0) {
+					break;
+				}
+			}
+		}
+		gpio_unexport(inputPin);
+		gpio_unexport(outputPin);
+		chosen[index]->stop();
+	}
+	if (strcmp(format, "json") == 0) {
+		printf("%s]\n", first ? "" : "\n");
+	}
+	return rc;
+}
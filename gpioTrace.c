@@ -0,0 +1,657 @@
+/*********************************************************************
+ * This module records GPIO edges and output writes into a compact binary
+ * trace, and replays a trace through the edge-handling path.
+ *
+ * The writer buffers encoded records and writes them GPIO_TRACE_BUF bytes
+ * at a time; the record count in the header is written when the trace is
+ * finished.  The reader walks the mapped file and rebuilds each absolute
+ * time by adding up the deltas.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <time.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+#include "gpioInterface.h"
+#include "edgeQueue.h"
+#include "edgeCapture.h"
+#include "timeutil.h"
+#include "asyncLog.h"
+#include "gpioTrace.h"
+
+#define TRACE_TAG_TYPE_MASK (0x7F)
+#define TRACE_TAG_VALUE (0x80)
+
+/****************************************************************
+ * Encoding
+ ****************************************************************/
+
+/*******************************************************************************
+ * This method will store a value as a LEB128 varint: seven bits per byte, low
+ * bits first, with the top bit set on every byte but the last.
+ * @param uint8_t *out - This is where the bytes are placed.
+ * @param uint64_t value - This is the value.
+ * @return The number of bytes used.
+ ******************************************************************************/
+static uint32_t trace_put_varint(uint8_t *out, uint64_t value)
+{
+	uint32_t len = 0;
+
+	while (value >= 0x80) {
+		out[len++] = (uint8_t)(value | 0x80);
+		value >>= 7;
+	}
+	out[len++] = (uint8_t)value;
+	return len;
+}
+
+/*******************************************************************************
+ * This method will read a LEB128 varint.
+ * @param struct gpio_trace_reader *reader - This is the reader.  Its position
+ *        is moved past the varint.
+ * @param uint64_t *value - This is where the value is placed.
+ * @return The return will be 0 if successful or -1 if the varint is cut short.
+ ******************************************************************************/
+static int32_t trace_get_varint(struct gpio_trace_reader *reader, uint64_t *value)
+{
+	uint32_t shift = 0;
+	uint8_t byte;
+
+	*value = 0;
+	do {
+		if ((reader->pos >= reader->size) || (shift > 63)) {
+			return -1;
+		}
+		byte = reader->map[reader->pos++];
+		*value |= (uint64_t)(byte & 0x7F) << shift;
+		shift += 7;
+	} while (byte & 0x80);
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will write the buffered records.  The lock must be held.
+ * @param struct gpio_trace_writer *writer - This is the writer.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t trace_flush(struct gpio_trace_writer *writer)
+{
+	uint32_t done = 0;
+	ssize_t len;
+
+	while (done < writer->used) {
+		len = write(writer->fd, &writer->buf[done], writer->used - done);
+		if (len < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			log_perror("gpiotrace/write");
+			return -1;
+		}
+		done += (uint32_t)len;
+	}
+	writer->used = 0;
+	return 0;
+}
+
+/****************************************************************
+ * Writer
+ ****************************************************************/
+
+/*******************************************************************************
+ * This method will create a trace file.
+ * @param struct gpio_trace_writer *writer - This is the writer that is to be initialized.
+ * @param const char *path - This is the file.  It is replaced if it exists.
+ * @param clockid_t clock - This is the clock of the recorded times.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_trace_create(struct gpio_trace_writer *writer, const char *path, clockid_t clock)
+{
+	writer->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (writer->fd < 0) {
+		log_perror("gpiotrace/create");
+		return -1;
+	}
+	writer->clock = clock;
+	writer->virtualTime = 0;
+	writer->last = 0;
+	writer->records = 0;
+	pthread_mutex_init(&writer->lock, NULL);
+
+	// The start time is set by the first record and the count by gpio_trace_finish.
+	memset(&writer->header, 0, sizeof(writer->header));
+	memcpy(writer->header.magic, GPIO_TRACE_MAGIC, sizeof(writer->header.magic));
+	writer->header.version = GPIO_TRACE_VERSION;
+	writer->header.clock = (uint32_t)clock;
+	memcpy(writer->buf, &writer->header, sizeof(writer->header));
+	writer->used = sizeof(writer->header);
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will append a record.  Times earlier than the previous record
+ * are recorded as equal to it.  It may be called from any thread.
+ * @param struct gpio_trace_writer *writer - This is the writer.
+ * @param const struct gpio_trace_record *record - This is the record.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_trace_write(struct gpio_trace_writer *writer, const struct gpio_trace_record *record)
+{
+	timens_t time = record->time;
+	int32_t rc = 0;
+
+	pthread_mutex_lock(&writer->lock);
+	if (writer->records == 0) {
+		writer->header.start = time;
+		writer->last = time;
+	}
+	if (time < writer->last) {
+		time = writer->last;
+	}
+	if ((writer->used + GPIO_TRACE_MAX_RECORD > GPIO_TRACE_BUF) && (trace_flush(writer) < 0)) {
+		rc = -1;
+	} else {
+		writer->buf[writer->used++] = (uint8_t)((record->type & TRACE_TAG_TYPE_MASK) |
+			((record->value != 0) ? TRACE_TAG_VALUE : 0));
+		writer->used += trace_put_varint(&writer->buf[writer->used], record->pin);
+		writer->used += trace_put_varint(&writer->buf[writer->used], (uint64_t)timens_sub(time, writer->last));
+		writer->last = time;
+		writer->records++;
+	}
+	pthread_mutex_unlock(&writer->lock);
+	return rc;
+}
+
+/*******************************************************************************
+ * This method will append an edge, moving its timestamp onto the clock of the
+ * trace if it was taken on another clock.
+ * @param struct gpio_trace_writer *writer - This is the writer.
+ * @param const struct gpio_edge_event *event - This is the edge.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_trace_write_edge(struct gpio_trace_writer *writer, const struct gpio_edge_event *event)
+{
+	struct gpio_trace_record record;
+
+	record.type = GPIO_TRACE_EDGE;
+	record.pin = event->pin;
+	record.value = event->value;
+	record.time = timens_from_timespec(&event->timestamp);
+	if (event->clock != writer->clock) {
+		record.time = timens_add(record.time,
+			timens_sub(timens_now(writer->clock), timens_now(event->clock)));
+	}
+	return gpio_trace_write(writer, &record);
+}
+
+/*******************************************************************************
+ * This method will write any buffered records, complete the header and close
+ * the file.
+ * @param struct gpio_trace_writer *writer - This is the writer.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_trace_finish(struct gpio_trace_writer *writer)
+{
+	int32_t rc;
+
+	pthread_mutex_lock(&writer->lock);
+	rc = trace_flush(writer);
+	if (rc == 0) {
+		writer->header.records = writer->records;
+		if (pwrite(writer->fd, &writer->header, sizeof(writer->header), 0) != (ssize_t)sizeof(writer->header)) {
+			log_perror("gpiotrace/finish");
+			rc = -1;
+		}
+	}
+	close(writer->fd);
+	writer->fd = -1;
+	pthread_mutex_unlock(&writer->lock);
+	pthread_mutex_destroy(&writer->lock);
+	return rc;
+}
+
+/****************************************************************
+ * Output recording backend
+ ****************************************************************/
+static const struct gpio_backend *traceInner;
+static struct gpio_trace_writer *traceWriter;
+
+/*******************************************************************************
+ * This method will record an output write.
+ * @param uint32_t gpio - This is the pin.
+ * @param uint32_t value - This is the level.
+ ******************************************************************************/
+static void trace_record_output(uint32_t gpio, uint32_t value)
+{
+	struct gpio_trace_writer *writer = traceWriter;
+	struct gpio_trace_record record;
+
+	if (writer == NULL) {
+		return;
+	}
+	record.type = GPIO_TRACE_OUTPUT;
+	record.pin = gpio;
+	record.value = value;
+	// With virtual time the output takes the time of the edge which caused it
+	// (the previous record), so replays of the same trace produce the same output.
+	record.time = writer->virtualTime ? 0 : timens_now(writer->clock);
+	(void)gpio_trace_write(writer, &record);
+}
+
+static int32_t trace_export(uint32_t gpio)
+{
+	return traceInner->export_pin(gpio);
+}
+
+static int32_t trace_unexport(uint32_t gpio)
+{
+	return traceInner->unexport_pin(gpio);
+}
+
+static int32_t trace_set_dir(uint32_t gpio, uint32_t out_flag)
+{
+	return traceInner->set_dir(gpio, out_flag);
+}
+
+static int32_t trace_set_value(uint32_t gpio, uint32_t value)
+{
+	trace_record_output(gpio, value);
+	return traceInner->set_value(gpio, value);
+}
+
+static int32_t trace_get_value(uint32_t gpio, uint32_t *value)
+{
+	return traceInner->get_value(gpio, value);
+}
+
+static int32_t trace_set_edge(uint32_t gpio, uint32_t edgeType)
+{
+	return traceInner->set_edge(gpio, edgeType);
+}
+
+static int32_t trace_fd_open(uint32_t gpio)
+{
+	return traceInner->fd_open(gpio);
+}
+
+static int32_t trace_set_values(const uint32_t *pins, const uint32_t *values, uint32_t count)
+{
+	uint32_t index;
+	int32_t rc = 0;
+
+	for (index = 0; index < count; index++) {
+		trace_record_output(pins[index], values[index]);
+	}
+	if (traceInner->set_values != NULL) {
+		return traceInner->set_values(pins, values, count);
+	}
+	for (index = 0; index < count; index++) {
+		if (traceInner->set_value(pins[index], values[index]) < 0) {
+			rc = -1;
+		}
+	}
+	return rc;
+}
+
+static int32_t trace_get_values(const uint32_t *pins, uint32_t *values, uint32_t count)
+{
+	uint32_t index;
+	int32_t rc = 0;
+
+	if (traceInner->get_values != NULL) {
+		return traceInner->get_values(pins, values, count);
+	}
+	for (index = 0; index < count; index++) {
+		if (traceInner->get_value(pins[index], &values[index]) < 0) {
+			rc = -1;
+		}
+	}
+	return rc;
+}
+
+static int32_t trace_fd_read(int32_t fd, struct gpio_fd_event *event)
+{
+	return traceInner->fd_read(fd, event);
+}
+
+static int32_t trace_get_config(uint32_t gpio, struct gpio_pin_config *config)
+{
+	return traceInner->get_config(gpio, config);
+}
+
+// fdEvents, get_config and threadSafe are taken from the wrapped backend when recording starts.
+static struct gpio_backend gpio_trace_backend = {
+	"trace",
+	trace_export,
+	trace_unexport,
+	trace_set_dir,
+	trace_set_value,
+	trace_get_value,
+	trace_set_edge,
+	trace_fd_open,
+	trace_set_values,
+	trace_get_values,
+	trace_fd_read,
+	0,
+	NULL,
+	0
+};
+
+/*******************************************************************************
+ * This method will record every output write made through the gpio_ calls by
+ * installing a backend which records and then forwards to the current one.
+ * @param struct gpio_trace_writer *writer - This is where the writes are
+ *        recorded.  NULL stops recording and restores the previous backend.
+ ******************************************************************************/
+void gpio_trace_outputs(struct gpio_trace_writer *writer)
+{
+	if (writer == NULL) {
+		if (traceInner != NULL) {
+			gpio_set_backend(traceInner);
+			traceInner = NULL;
+		}
+		traceWriter = NULL;
+		return;
+	}
+	if (traceInner == NULL) {
+		traceInner = gpio_get_backend();
+		gpio_trace_backend.fdEvents = traceInner->fdEvents;
+		gpio_trace_backend.get_config = (traceInner->get_config != NULL) ? trace_get_config : NULL;
+		gpio_trace_backend.threadSafe = traceInner->threadSafe;
+		gpio_set_backend(&gpio_trace_backend);
+	}
+	traceWriter = writer;
+}
+
+/****************************************************************
+ * Null backend
+ ****************************************************************/
+static uint8_t nullLevels[GPIO_MAX_PINS];
+
+static int32_t null_pin_op(uint32_t gpio)
+{
+	return 0;
+}
+
+static int32_t null_set_flag(uint32_t gpio, uint32_t flag)
+{
+	return 0;
+}
+
+static int32_t null_set_value(uint32_t gpio, uint32_t value)
+{
+	if (gpio < GPIO_MAX_PINS) {
+		nullLevels[gpio] = (value != 0);
+	}
+	return 0;
+}
+
+static int32_t null_get_value(uint32_t gpio, uint32_t *value)
+{
+	*value = (gpio < GPIO_MAX_PINS) ? nullLevels[gpio] : 0;
+	return 0;
+}
+
+static int32_t null_fd_open(uint32_t gpio)
+{
+	errno = ENODEV;
+	return -1;
+}
+
+static int32_t null_fd_read(int32_t fd, struct gpio_fd_event *event)
+{
+	errno = ENODEV;
+	return -1;
+}
+
+const struct gpio_backend gpio_trace_null_backend = {
+	"null",
+	null_pin_op,
+	null_pin_op,
+	null_set_flag,
+	null_set_value,
+	null_get_value,
+	null_set_flag,
+	null_fd_open,
+	NULL,
+	NULL,
+	null_fd_read,
+	POLLPRI,
+	NULL,
+	1
+};
+
+/****************************************************************
+ * Reader
+ ****************************************************************/
+
+/*******************************************************************************
+ * This method will map a trace file for reading.
+ * @param struct gpio_trace_reader *reader - This is the reader that is to be initialized.
+ * @param const char *path - This is the file.
+ * @return The return will be 0 if successful or a negative number if the file
+ *         cannot be read or is not a trace.
+ ******************************************************************************/
+int32_t gpio_trace_open(struct gpio_trace_reader *reader, const char *path)
+{
+	struct stat st;
+	void *map;
+	int32_t fd;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		log_perror("gpiotrace/open");
+		return -1;
+	}
+	if ((fstat(fd, &st) < 0) || ((size_t)st.st_size < sizeof(struct gpio_trace_header))) {
+		close(fd);
+		errno = EINVAL;
+		log_perror("gpiotrace/open");
+		return -1;
+	}
+	map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		log_perror("gpiotrace/mmap");
+		return -1;
+	}
+	// The trace is read front to back.
+	(void)madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+	reader->map = (const uint8_t*)map;
+	reader->size = (size_t)st.st_size;
+	memcpy(&reader->header, reader->map, sizeof(reader->header));
+	if ((memcmp(reader->header.magic, GPIO_TRACE_MAGIC, sizeof(reader->header.magic)) != 0) ||
+		(reader->header.version != GPIO_TRACE_VERSION)) {
+		gpio_trace_close(reader);
+		errno = EINVAL;
+		log_perror("gpiotrace/open");
+		return -1;
+	}
+	gpio_trace_rewind(reader);
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will read the next record.
+ * @param struct gpio_trace_reader *reader - This is the reader.
+ * @param struct gpio_trace_record *record - This is where the record is placed.
+ * @return The return will be 0 if a record was read or -1 at the end of the trace.
+ ******************************************************************************/
+int32_t gpio_trace_next(struct gpio_trace_reader *reader, struct gpio_trace_record *record)
+{
+	uint64_t pin, delta;
+	uint8_t tag;
+
+	if (reader->pos >= reader->size) {
+		return -1;
+	}
+	tag = reader->map[reader->pos++];
+	if ((trace_get_varint(reader, &pin) < 0) || (trace_get_varint(reader, &delta) < 0)) {
+		reader->pos = reader->size;
+		return -1;
+	}
+	reader->time = timens_add(reader->time, (timens_t)delta);
+	record->type = tag & TRACE_TAG_TYPE_MASK;
+	record->value = (tag & TRACE_TAG_VALUE) ? 1 : 0;
+	record->pin = (uint32_t)pin;
+	record->time = reader->time;
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will return to the first record.
+ * @param struct gpio_trace_reader *reader - This is the reader.
+ ******************************************************************************/
+void gpio_trace_rewind(struct gpio_trace_reader *reader)
+{
+	reader->pos = sizeof(struct gpio_trace_header);
+	reader->time = reader->header.start;
+}
+
+/*******************************************************************************
+ * This method will unmap a trace file.
+ * @param struct gpio_trace_reader *reader - This is the reader.
+ ******************************************************************************/
+void gpio_trace_close(struct gpio_trace_reader *reader)
+{
+	if (reader->map != NULL) {
+		munmap((void*)reader->map, reader->size);
+		reader->map = NULL;
+	}
+}
+
+/****************************************************************
+ * Replay
+ ****************************************************************/
+
+/*******************************************************************************
+ * This method is the body of the replay thread.
+ * @param void *arg - This is the replay.
+ * @return Always NULL.
+ ******************************************************************************/
+static void* trace_replay_thread(void *arg)
+{
+	struct gpio_trace_replay *replay = (struct gpio_trace_replay*)arg;
+	struct gpio_trace_record record;
+	struct gpio_edge_event event;
+	struct timespec wait;
+	struct pollfd stop;
+	timens_t start = timens_now(CLOCK_MONOTONIC);
+	timens_t due, remaining;
+	uint64_t one = 1;
+
+	memset(&event, 0, sizeof(event));
+	stop.fd = replay->stopFd;
+	stop.events = POLLIN;
+	while (!replay->stop && (gpio_trace_next(&replay->reader, &record) == 0)) {
+		if (record.type != GPIO_TRACE_EDGE) {
+			continue;
+		}
+		event.pin = record.pin;
+		event.value = record.value;
+		event.seqno++;
+		if (replay->mode == GPIO_TRACE_REAL_TIME) {
+			// Wait on the stop descriptor so that a long gap does not hold up shutdown.
+			due = timens_add(start, timens_sub(record.time, replay->reader.header.start));
+			while (!replay->stop && ((remaining = timens_sub(due, timens_now(CLOCK_MONOTONIC))) > 0)) {
+				timens_to_timespec(remaining, &wait);
+				(void)ppoll(&stop, 1, &wait, NULL);
+			}
+			event.clock = CLOCK_MONOTONIC;
+			clock_gettime(CLOCK_MONOTONIC, &event.timestamp);
+		} else {
+			event.clock = (clockid_t)replay->reader.header.clock;
+			timens_to_timespec(record.time, &event.timestamp);
+		}
+		// Nothing is lost in a replay: wait for the consumer to make room.
+		while (!replay->stop && (edge_capture_inject(replay->capture, &event) < 0)) {
+			sched_yield();
+		}
+		replay->delivered++;
+	}
+	(void)write(replay->doneFd, &one, sizeof(one));
+	return NULL;
+}
+
+/*******************************************************************************
+ * This method will start a thread which queues the edges of a trace on a
+ * capture object, in place of the capture thread reading pin descriptors.
+ * @param struct gpio_trace_replay *replay - This is the replay that is to be started.
+ * @param const char *path - This is the trace file.
+ * @param struct edge_capture *capture - This is where the edges are queued.  Its
+ *        capture thread must have no pins.
+ * @param uint32_t mode - This is GPIO_TRACE_REAL_TIME or GPIO_TRACE_FAST.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_trace_replay_start(struct gpio_trace_replay *replay, const char *path,
+	struct edge_capture *capture, uint32_t mode)
+{
+	int32_t rc;
+
+	if (gpio_trace_open(&replay->reader, path) < 0) {
+		return -1;
+	}
+	replay->capture = capture;
+	replay->mode = mode;
+	replay->stop = 0;
+	replay->delivered = 0;
+	replay->doneFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	replay->stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if ((replay->doneFd < 0) || (replay->stopFd < 0)) {
+		rc = errno;
+	} else {
+		rc = pthread_create(&replay->thread, NULL, trace_replay_thread, replay);
+	}
+	if (rc != 0) {
+		errno = rc;
+		log_perror("gpiotrace/replay");
+		if (replay->doneFd >= 0) {
+			close(replay->doneFd);
+		}
+		if (replay->stopFd >= 0) {
+			close(replay->stopFd);
+		}
+		gpio_trace_close(&replay->reader);
+		return -1;
+	}
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will return the descriptor which becomes readable when every
+ * edge of the trace has been queued.
+ * @param struct gpio_trace_replay *replay - This is the replay.
+ * @return The descriptor.
+ ******************************************************************************/
+int32_t gpio_trace_replay_fd(struct gpio_trace_replay *replay)
+{
+	return replay->doneFd;
+}
+
+/*******************************************************************************
+ * This method will stop and join the replay thread and release the trace.
+ * @param struct gpio_trace_replay *replay - This is the replay.
+ * @return The number of edges that were queued.
+ ******************************************************************************/
+uint64_t gpio_trace_replay_stop(struct gpio_trace_replay *replay)
+{
+	uint64_t one = 1;
+
+	replay->stop = 1;
+	(void)write(replay->stopFd, &one, sizeof(one));
+	pthread_join(replay->thread, NULL);
+	close(replay->stopFd);
+	close(replay->doneFd);
+	gpio_trace_close(&replay->reader);
+	return replay->delivered;
+}
@@ -0,0 +1,193 @@
+/*********************************************************************
+ * This module records GPIO edges and output writes into a compact binary
+ * trace, and replays a trace through the edge-handling path so that field
+ * timing problems can be reproduced and the logic load tested offline.
+ *
+ * A trace is a fixed header followed by variable-length records.  Each
+ * record is a tag byte (type and level), the pin as a LEB128 varint and
+ * the time since the previous record in ns as a LEB128 varint, so a
+ * typical record takes four to six bytes.  Records are in time order and
+ * are read back through mmap.
+ *
+ * Output writes are recorded by a backend which wraps the current one, so
+ * every gpio_set_value / gpio_set_values is seen, whoever makes it.
+ */
+#ifndef GPIOTRACE_H
+#define GPIOTRACE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include <pthread.h>
+#include "gpioInterface.h"
+#include "edgeQueue.h"
+#include "edgeCapture.h"
+#include "timeutil.h"
+
+#define GPIO_TRACE_MAGIC "GPIOTRC1"
+#define GPIO_TRACE_VERSION (1)
+#define GPIO_TRACE_BUF (65536)		// Bytes buffered before a write
+#define GPIO_TRACE_MAX_RECORD (11)	// Tag byte plus two varints
+
+#define GPIO_TRACE_EDGE (0)		// An edge delivered to the application
+#define GPIO_TRACE_OUTPUT (1)		// A level written to an output
+
+#define GPIO_TRACE_REAL_TIME (0)	// Replay with the recorded spacing
+#define GPIO_TRACE_FAST (1)		// Replay as fast as the consumer keeps up
+
+// The start of every trace file.
+struct gpio_trace_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t clock;		// The clockid_t of every timestamp
+	int64_t start;		// Time of the first record; deltas start from here
+	uint64_t records;	// Filled in when the trace is closed
+};
+
+struct gpio_trace_record {
+	uint32_t type;
+	uint32_t pin;
+	uint32_t value;
+	timens_t time;
+};
+
+struct gpio_trace_writer {
+	int32_t fd;
+	clockid_t clock;
+	uint32_t virtualTime;	// Stamp outputs with the last edge's time, not the clock
+	pthread_mutex_t lock;	// Edges and outputs may be recorded from different threads
+	struct gpio_trace_header header;	// Rewritten in place by gpio_trace_finish
+	timens_t last;
+	uint64_t records;
+	uint32_t used;
+	uint8_t buf[GPIO_TRACE_BUF];
+};
+
+struct gpio_trace_reader {
+	const uint8_t *map;
+	size_t size;
+	size_t pos;
+	timens_t time;
+	struct gpio_trace_header header;
+};
+
+struct gpio_trace_replay {
+	struct gpio_trace_reader reader;
+	struct edge_capture *capture;
+	uint32_t mode;
+	pthread_t thread;
+	int32_t doneFd;		// Readable once every edge has been queued
+	int32_t stopFd;		// Written to stop the replay thread
+	volatile uint32_t stop;
+	uint64_t delivered;
+};
+
+// A backend on which every operation succeeds and outputs keep the level last
+// written.  fd_open fails, so a program replaying a trace needs no hardware.
+extern const struct gpio_backend gpio_trace_null_backend;
+
+/*******************************************************************************
+ * This method will create a trace file.
+ * @param struct gpio_trace_writer *writer - This is the writer that is to be initialized.
+ * @param const char *path - This is the file.  It is replaced if it exists.
+ * @param clockid_t clock - This is the clock of the recorded times.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_trace_create(struct gpio_trace_writer *writer, const char *path, clockid_t clock);
+
+/*******************************************************************************
+ * This method will append a record.  Times earlier than the previous record
+ * are recorded as equal to it.  It may be called from any thread.
+ * @param struct gpio_trace_writer *writer - This is the writer.
+ * @param const struct gpio_trace_record *record - This is the record.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_trace_write(struct gpio_trace_writer *writer, const struct gpio_trace_record *record);
+
+/*******************************************************************************
+ * This method will append an edge, moving its timestamp onto the clock of the
+ * trace if it was taken on another clock.
+ * @param struct gpio_trace_writer *writer - This is the writer.
+ * @param const struct gpio_edge_event *event - This is the edge.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_trace_write_edge(struct gpio_trace_writer *writer, const struct gpio_edge_event *event);
+
+/*******************************************************************************
+ * This method will write any buffered records, complete the header and close
+ * the file.
+ * @param struct gpio_trace_writer *writer - This is the writer.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_trace_finish(struct gpio_trace_writer *writer);
+
+/*******************************************************************************
+ * This method will record every output write made through the gpio_ calls by
+ * installing a backend which records and then forwards to the current one.
+ * @param struct gpio_trace_writer *writer - This is where the writes are
+ *        recorded.  NULL stops recording and restores the previous backend.
+ ******************************************************************************/
+void gpio_trace_outputs(struct gpio_trace_writer *writer);
+
+/*******************************************************************************
+ * This method will map a trace file for reading.
+ * @param struct gpio_trace_reader *reader - This is the reader that is to be initialized.
+ * @param const char *path - This is the file.
+ * @return The return will be 0 if successful or a negative number if the file
+ *         cannot be read or is not a trace.
+ ******************************************************************************/
+int32_t gpio_trace_open(struct gpio_trace_reader *reader, const char *path);
+
+/*******************************************************************************
+ * This method will read the next record.
+ * @param struct gpio_trace_reader *reader - This is the reader.
+ * @param struct gpio_trace_record *record - This is where the record is placed.
+ * @return The return will be 0 if a record was read or -1 at the end of the trace.
+ ******************************************************************************/
+int32_t gpio_trace_next(struct gpio_trace_reader *reader, struct gpio_trace_record *record);
+
+/*******************************************************************************
+ * This method will return to the first record.
+ * @param struct gpio_trace_reader *reader - This is the reader.
+ ******************************************************************************/
+void gpio_trace_rewind(struct gpio_trace_reader *reader);
+
+/*******************************************************************************
+ * This method will unmap a trace file.
+ * @param struct gpio_trace_reader *reader - This is the reader.
+ ******************************************************************************/
+void gpio_trace_close(struct gpio_trace_reader *reader);
+
+/*******************************************************************************
+ * This method will start a thread which queues the edges of a trace on a
+ * capture object, in place of the capture thread reading pin descriptors.
+ * Output records are skipped.  In GPIO_TRACE_REAL_TIME mode each edge is
+ * queued at its recorded offset from the start and stamped with the time it
+ * was queued; in GPIO_TRACE_FAST mode edges keep their recorded timestamps and
+ * are queued as soon as there is room.
+ * @param struct gpio_trace_replay *replay - This is the replay that is to be started.
+ * @param const char *path - This is the trace file.
+ * @param struct edge_capture *capture - This is where the edges are queued.  Its
+ *        capture thread must have no pins.
+ * @param uint32_t mode - This is GPIO_TRACE_REAL_TIME or GPIO_TRACE_FAST.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t gpio_trace_replay_start(struct gpio_trace_replay *replay, const char *path,
+	struct edge_capture *capture, uint32_t mode);
+
+/*******************************************************************************
+ * This method will return the descriptor which becomes readable when every
+ * edge of the trace has been queued.
+ * @param struct gpio_trace_replay *replay - This is the replay.
+ * @return The descriptor.
+ ******************************************************************************/
+int32_t gpio_trace_replay_fd(struct gpio_trace_replay *replay);
+
+/*******************************************************************************
+ * This method will stop and join the replay thread and release the trace.
+ * @param struct gpio_trace_replay *replay - This is the replay.
+ * @return The number of edges that were queued.
+ ******************************************************************************/
+uint64_t gpio_trace_replay_stop(struct gpio_trace_replay *replay);
+
+#endif
@@ -0,0 +1,166 @@
+/*********************************************************************
+ * This program prints GPIO traces as text, one record per line, so that
+ * the outputs of two program versions replaying the same trace can be
+ * compared with diff, and generates synthetic traces of button presses
+ * for load testing the game logic.
+ *
+ * Usage: gpioTraceTool dump <trace>
+ *        gpioTraceTool gen [-s seed] [-b bounces] <trace> <presses> <pin>...
+ *
+ * A generated press is a falling edge, held for 50 to 300 ms, then a rising
+ * edge, followed by 100 to 1000 ms of idle time.  Each pin is pressed in
+ * turn.  With -b, every edge is preceded by that many bounces 0.5 ms apart.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <stdint.h>
+#include "gpioTrace.h"
+#include "timeutil.h"
+
+#define GEN_MAX_PINS (64)
+#define GEN_BOUNCE_NS (500000)
+
+/*******************************************************************************
+ * This method will return a pseudo-random time in a range.  rand_r is used so
+ * that a seed always gives the same trace.
+ * @param uint32_t *seed - This is the generator state.
+ * @param int64_t lowMs - This is the shortest time.
+ * @param int64_t highMs - This is the longest time.
+ * @return The time in ns.
+ ******************************************************************************/
+static timens_t gen_between(uint32_t *seed, int64_t lowMs, int64_t highMs)
+{
+	return timens_from_ms(lowMs) + (timens_t)rand_r(seed) % timens_from_ms(highMs - lowMs);
+}
+
+/*******************************************************************************
+ * This method will record an edge, preceded by the requested number of bounces.
+ * @param struct gpio_trace_writer *writer - This is the trace.
+ * @param uint32_t pin - This is the pin.
+ * @param uint32_t value - This is the level the pin settles at.
+ * @param timens_t *now - This is the time of the edge.  It is moved past the bounces.
+ * @param uint32_t bounces - This is the number of bounces.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+static int32_t gen_edge(struct gpio_trace_writer *writer, uint32_t pin, uint32_t value,
+	timens_t *now, uint32_t bounces)
+{
+	struct gpio_trace_record record;
+	uint32_t index;
+
+	record.type = GPIO_TRACE_EDGE;
+	record.pin = pin;
+	for (index = 0; index < 2 * bounces + 1; index++) {
+		// An odd number of transitions ends at the new level.
+		record.value = (index % 2 == 0) ? value : !value;
+		record.time = *now;
+		if (gpio_trace_write(writer, &record) < 0) {
+			return -1;
+		}
+		if (index < 2 * bounces) {
+			*now = timens_add(*now, GEN_BOUNCE_NS);
+		}
+	}
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will write a trace of synthetic presses.
+ * @param int argc - This is the argument count, starting from "gen".
+ * @param char **argv - These are the arguments.
+ * @return The exit status.
+ ******************************************************************************/
+static int gen_trace(int argc, char **argv)
+{
+	static struct gpio_trace_writer writer;
+	uint32_t pins[GEN_MAX_PINS];
+	uint32_t pinCount = 0, bounces = 0, seed = 1;
+	uint64_t presses, press;
+	timens_t now;
+	int32_t opt;
+
+	while ((opt = getopt(argc, argv, "s:b:")) != -1) {
+		switch (opt) {
+		case 's':
+			seed = (uint32_t)strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			bounces = (uint32_t)strtoul(optarg, NULL, 0);
+			break;
+		default:
+			return 1;
+		}
+	}
+	if (argc - optind < 3) {
+		fprintf(stderr, "usage: gpioTraceTool gen [-s seed] [-b bounces] <trace> <presses> <pin>...\n");
+		return 1;
+	}
+	presses = strtoull(argv[optind + 1], NULL, 0);
+	for (opt = optind + 2; (opt < argc) && (pinCount < GEN_MAX_PINS); opt++) {
+		pins[pinCount++] = (uint32_t)strtoul(argv[opt], NULL, 0);
+	}
+
+	if (gpio_trace_create(&writer, argv[optind], CLOCK_MONOTONIC) < 0) {
+		return 1;
+	}
+	now = timens_from_ms(1000);
+	for (press = 0; press < presses; press++) {
+		if ((gen_edge(&writer, pins[press % pinCount], 0, &now, bounces) < 0)) {
+			break;
+		}
+		now = timens_add(now, gen_between(&seed, 50, 300));
+		if (gen_edge(&writer, pins[press % pinCount], 1, &now, bounces) < 0) {
+			break;
+		}
+		now = timens_add(now, gen_between(&seed, 100, 1000));
+	}
+	return (gpio_trace_finish(&writer) == 0) && (press == presses) ? 0 : 1;
+}
+
+/*******************************************************************************
+ * This method will print a trace.  Times are relative to the first record.
+ * @param const char *path - This is the trace file.
+ * @return The exit status.
+ ******************************************************************************/
+static int dump_trace(const char *path)
+{
+	struct gpio_trace_reader reader;
+	struct gpio_trace_record record;
+	uint64_t count = 0;
+
+	if (gpio_trace_open(&reader, path) < 0) {
+		return 1;
+	}
+	printf("# clock %u, %llu records\n", reader.header.clock, (unsigned long long)reader.header.records);
+	while (gpio_trace_next(&reader, &record) == 0) {
+		printf("%lld %s %u %u\n", (long long)timens_sub(record.time, reader.header.start),
+			(record.type == GPIO_TRACE_EDGE) ? "edge" : "out", record.pin, record.value);
+		count++;
+	}
+	gpio_trace_close(&reader);
+	if (count != reader.header.records) {
+		fprintf(stderr, "%s: header has %llu records but %llu were read\n", path,
+			(unsigned long long)reader.header.records, (unsigned long long)count);
+		return 1;
+	}
+	return 0;
+}
+
+/****************************************************************
+* Main
+****************************************************************/
+int main(int argc, char **argv)
+{
+	if ((argc >= 3) && (strcmp(argv[1], "dump") == 0)) {
+		return dump_trace(argv[2]);
+	}
+	if ((argc >= 2) && (strcmp(argv[1], "gen") == 0)) {
+		return gen_trace(argc - 1, argv + 1);
+	}
+	fprintf(stderr, "usage: gpioTraceTool dump <trace>\n"
+		"       gpioTraceTool gen [-s seed] [-b bounces] <trace> <presses> <pin>...\n");
+	return 1;
+}
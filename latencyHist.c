@@ -0,0 +1,144 @@
+/*********************************************************************
+ * This module records hot-path latencies into fixed-size log-linear
+ * histograms.  Values below LATENCY_SUB_BUCKETS have a bucket each; above
+ * that, the bucket is chosen by the position of the highest set bit and
+ * the LATENCY_SUB_BUCKET_BITS bits below it.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include "timeutil.h"
+#include "latencyHist.h"
+
+struct latency_hist latency_stages[LATENCY_STAGE_COUNT] = {
+	[LATENCY_STAGE_WAKEUP] = { .name = "wakeup" },
+	[LATENCY_STAGE_READ] = { .name = "read" },
+	[LATENCY_STAGE_DELIVERY] = { .name = "delivery" },
+	[LATENCY_STAGE_PRINT] = { .name = "print" },
+	[LATENCY_STAGE_SET_VALUE] = { .name = "set_value" },
+	[LATENCY_STAGE_TOTAL] = { .name = "total" }
+};
+
+/*******************************************************************************
+ * This method will return the bucket holding a value.
+ * @param uint64_t value - This is the value.
+ * @return The bucket index.
+ ******************************************************************************/
+static uint32_t latency_bucket(uint64_t value)
+{
+	uint32_t msb;
+
+	if (value < LATENCY_SUB_BUCKETS) {
+		return (uint32_t)value;
+	}
+	msb = 63 - __builtin_clzll(value);
+	return (msb - LATENCY_SUB_BUCKET_BITS + 1) * LATENCY_SUB_BUCKETS +
+		(uint32_t)((value >> (msb - LATENCY_SUB_BUCKET_BITS)) & (LATENCY_SUB_BUCKETS - 1));
+}
+
+/*******************************************************************************
+ * This method will return the largest value held by a bucket.
+ * @param uint32_t bucket - This is the bucket index.
+ * @return The value.
+ ******************************************************************************/
+static uint64_t latency_bucket_top(uint32_t bucket)
+{
+	uint32_t magnitude = bucket / LATENCY_SUB_BUCKETS;
+	uint64_t sub = bucket % LATENCY_SUB_BUCKETS;
+
+	if (magnitude == 0) {
+		return sub;
+	}
+	return (((LATENCY_SUB_BUCKETS + sub + 1) << (magnitude - 1)) - 1);
+}
+
+/*******************************************************************************
+ * This method will add a value to a histogram.  It may be called from any thread.
+ * @param struct latency_hist *hist - This is the histogram.
+ * @param timens_t ns - This is the latency.  Negative values are recorded as 0.
+ ******************************************************************************/
+void latency_hist_record(struct latency_hist *hist, timens_t ns)
+{
+	uint64_t value = (ns > 0) ? (uint64_t)ns : 0;
+	uint64_t max = __atomic_load_n(&hist->max, __ATOMIC_RELAXED);
+
+	__atomic_fetch_add(&hist->buckets[latency_bucket(value)], 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&hist->count, 1, __ATOMIC_RELAXED);
+	while ((value > max) &&
+		!__atomic_compare_exchange_n(&hist->max, &max, value, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+	}
+}
+
+/*******************************************************************************
+ * This method will return the value below which the given fraction of the
+ * recorded values fall.  The result is the upper edge of the bucket holding
+ * that value, so it is never understated.
+ * @param struct latency_hist *hist - This is the histogram.
+ * @param double fraction - This is the fraction, for example 0.99.
+ * @return The value in ns, or 0 if nothing has been recorded.
+ ******************************************************************************/
+uint64_t latency_hist_percentile(struct latency_hist *hist, double fraction)
+{
+	uint64_t count = __atomic_load_n(&hist->count, __ATOMIC_RELAXED);
+	uint64_t max = __atomic_load_n(&hist->max, __ATOMIC_RELAXED);
+	uint64_t target, seen = 0, top;
+	uint32_t bucket;
+
+	if (count == 0) {
+		return 0;
+	}
+	target = (uint64_t)(fraction * (double)count + 0.5);
+	if (target == 0) {
+		target = 1;
+	}
+
+	for (bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+		seen += __atomic_load_n(&hist->buckets[bucket], __ATOMIC_RELAXED);
+		if (seen >= target) {
+			top = latency_bucket_top(bucket);
+			// The exact maximum is known, so never report past it.
+			return (top < max) ? top : max;
+		}
+	}
+	return max;
+}
+
+/*******************************************************************************
+ * This method will empty a histogram.
+ * @param struct latency_hist *hist - This is the histogram.
+ ******************************************************************************/
+void latency_hist_reset(struct latency_hist *hist)
+{
+	uint32_t bucket;
+
+	for (bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+		__atomic_store_n(&hist->buckets[bucket], 0, __ATOMIC_RELAXED);
+	}
+	__atomic_store_n(&hist->count, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&hist->max, 0, __ATOMIC_RELAXED);
+}
+
+/*******************************************************************************
+ * This method will write the count, p50, p99, p99.9 and max of every stage
+ * which has recorded values, in microseconds.
+ * @param FILE *stream - This is where the table is written.
+ ******************************************************************************/
+void latency_dump(FILE *stream)
+{
+	struct latency_hist *hist;
+	uint32_t stage;
+
+	fprintf(stream, "%-10s %10s %10s %10s %10s %10s\n", "stage", "count", "p50 us", "p99 us", "p99.9 us", "max us");
+	for (stage = 0; stage < LATENCY_STAGE_COUNT; stage++) {
+		hist = &latency_stages[stage];
+		if (__atomic_load_n(&hist->count, __ATOMIC_RELAXED) == 0) {
+			continue;
+		}
+		fprintf(stream, "%-10s %10llu %10.3f %10.3f %10.3f %10.3f\n", hist->name,
+			(unsigned long long)__atomic_load_n(&hist->count, __ATOMIC_RELAXED),
+			latency_hist_percentile(hist, 0.50) / 1000.0,
+			latency_hist_percentile(hist, 0.99) / 1000.0,
+			latency_hist_percentile(hist, 0.999) / 1000.0,
+			__atomic_load_n(&hist->max, __ATOMIC_RELAXED) / 1000.0);
+	}
+	fflush(stream);
+}
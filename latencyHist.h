@@ -0,0 +1,87 @@
+/*********************************************************************
+ * This module records hot-path latencies into fixed-size log-linear
+ * histograms, in the style of HdrHistogram: every power of two is split
+ * into LATENCY_SUB_BUCKETS linear buckets, so every value is kept to
+ * within 1/16 (about 6%) of its size, from 1 ns to hours, in a fixed
+ * array.  Recording is a few atomic adds with no locks and no allocation,
+ * so it can be done from any thread.
+ *
+ * The stages of the edge-to-LED pipeline each have a histogram.  The
+ * LATENCY_ macros compile to nothing unless INSTRUMENT_LATENCY is defined,
+ * so release builds pay nothing for the instrumentation.
+ */
+#ifndef LATENCYHIST_H
+#define LATENCYHIST_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "timeutil.h"
+
+#define LATENCY_SUB_BUCKET_BITS (4)
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_SUB_BUCKET_BITS)
+#define LATENCY_BUCKETS ((64 - LATENCY_SUB_BUCKET_BITS + 1) * LATENCY_SUB_BUCKETS)
+
+struct latency_hist {
+	const char *name;
+	uint64_t count;
+	uint64_t max;
+	uint64_t buckets[LATENCY_BUCKETS];
+};
+
+// The stages between a switch edge and the LED following it.
+enum latency_stage {
+	LATENCY_STAGE_WAKEUP,		// Kernel edge timestamp to poll() returning (cdev only)
+	LATENCY_STAGE_READ,		// poll() returning to the edge being read
+	LATENCY_STAGE_DELIVERY,		// Edge timestamp to the application callback
+	LATENCY_STAGE_PRINT,		// Queueing the edge report with log_printf
+	LATENCY_STAGE_SET_VALUE,	// gpio_set_value of the LED
+	LATENCY_STAGE_TOTAL,		// Edge timestamp to the LED having been written
+	LATENCY_STAGE_COUNT
+};
+
+extern struct latency_hist latency_stages[LATENCY_STAGE_COUNT];
+
+#ifdef INSTRUMENT_LATENCY
+// Declares var and sets it to the current time of clock.
+#define LATENCY_STAMP(var, clock) timens_t var = timens_now(clock)
+// Records end - start against a stage.
+#define LATENCY_RECORD(stage, start, end) latency_hist_record(&latency_stages[(stage)], timens_sub((end), (start)))
+// Writes the statistics of every stage to stream.
+#define LATENCY_DUMP(stream) latency_dump(stream)
+#else
+#define LATENCY_STAMP(var, clock)
+#define LATENCY_RECORD(stage, start, end) do { } while (0)
+#define LATENCY_DUMP(stream) do { } while (0)
+#endif
+
+/*******************************************************************************
+ * This method will add a value to a histogram.  It may be called from any thread.
+ * @param struct latency_hist *hist - This is the histogram.
+ * @param timens_t ns - This is the latency.  Negative values are recorded as 0.
+ ******************************************************************************/
+void latency_hist_record(struct latency_hist *hist, timens_t ns);
+
+/*******************************************************************************
+ * This method will return the value below which the given fraction of the
+ * recorded values fall.  The result is the upper edge of the bucket holding
+ * that value, so it is never understated.
+ * @param struct latency_hist *hist - This is the histogram.
+ * @param double fraction - This is the fraction, for example 0.99.
+ * @return The value in ns, or 0 if nothing has been recorded.
+ ******************************************************************************/
+uint64_t latency_hist_percentile(struct latency_hist *hist, double fraction);
+
+/*******************************************************************************
+ * This method will empty a histogram.
+ * @param struct latency_hist *hist - This is the histogram.
+ ******************************************************************************/
+void latency_hist_reset(struct latency_hist *hist);
+
+/*******************************************************************************
+ * This method will write the count, p50, p99, p99.9 and max of every stage
+ * which has recorded values, in microseconds.
+ * @param FILE *stream - This is where the table is written.
+ ******************************************************************************/
+void latency_dump(FILE *stream);
+
+#endif
@@ -1,187 +1,797 @@
-/*
-* main.c
-*
-*  Created on: Mar 27, 2014
-*      Author: se3910
-*/
-
-
-/*********************************************************************
-* This program will allow on to turn a given port on and off at a user
-* defined rate.  The code was initially developed by Dingo_aus, 7 January 2009
-* email: dingo_aus [at] internode <dot> on /dot/ net
-* From http://www.avrfreaks.net/wiki/index.php/Documentation:LinuxGPIO#gpio_framework (Note: This link is now broken.)
-* Created in AVR32 Studio (version 2.0.2) running on Ubuntu 8.04
-* Modified by Mark A. Yoder, 21-July-2011
-* Refactored and further modified by Walter Schilling, Summer 2012 / Winter 2013-2014.
-*/
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <unistd.h>
-#include <poll.h>
-#include <signal.h>	// Defines signal-handling functions (i.e. trap Ctrl-C)
-#include <stdint.h>
-#include "gpioInterface.h"
-
-#define POLL_TIMEOUT (1 * 1000) /* 1 second */
-#define MAX_BUF 64
-
-// create a variable to keep track of the port that is to be opened as a string.
-static int keepgoing = 1;	// Set to 0 when ctrl-c is pressed
-
-/*******************************************************************************
-* This method will read the given pin and perform processing on it.
-*
-* @param FILE *fp - This is a pointer to the io device driver which will be read to determine the state of the pin.
-******************************************************************************/
-int processPin(int gpio_fd, int outputPin, uint32_t gpioInputPort)
-{
-	struct pollfd fdset[2];
-	int timeout, rc;
-	int nfds = 2;
-	char buf[MAX_BUF];
-	int len;
-
-	//create a variable to store whether we are sending a '1' or a '0'
-	char set_value[5];
-	char prevState;
-
-	prevState = '?';
-	timeout = POLL_TIMEOUT;
-
-	while (keepgoing) {
-		memset((void*)fdset, 0, sizeof(fdset));
-
-		//fdset[0].fd = STDIN_FILENO;
-		//fdset[0].events = POLLIN;
-
-		fdset[1].fd = gpio_fd;
-		fdset[1].events = POLLPRI;
-
-		rc = poll(fdset, nfds, timeout);      // Sits and waits for an interrupt.
-
-		if (rc < 0) {
-			printf("\npoll() failed!  Something is going on.  Is the program exiting?\n");
-			return -1;
-		}
-
-		if (rc == 0) {
-			printf(".");
-		}
-
-		if (fdset[1].revents & POLLPRI) {
-			lseek(fdset[1].fd, 0, SEEK_SET);  // Read from the start of the file
-			len = read(fdset[1].fd, buf, MAX_BUF);
-			printf("\npoll() GPIO %d interrupt occurred, value=%c, len=%d\n", gpioInputPort, buf[0], len);
-
-			if (buf[0]!=prevState)
-			{
-				if (buf[0]=='0')
-				{
-					printf("The button is pressed.\n");
-
-					//Write our value of "0" to the file
-					gpio_set_value(outputPin, 0);
-				}
-				else
-				{
-					printf("The button is not pressed.\n");
-
-					//Write our value of "1" to the file
-					gpio_set_value(outputPin, 1);
-				}
-				prevState = buf[0];
-			}
-		}
-
-		fflush(stdout);
-	}
-}
-
-/****************************************************************
-* signal_handler
-****************************************************************/
-// Callback called when SIGINT is sent to the process (Ctrl-C)
-void signal_handler(int sig)
-{
-	printf( "Ctrl-C pressed, cleaning up and exiting..\n" );
-	keepgoing = 0;
-}
-
-
-
-/****************************************************************
-* Main
-****************************************************************/
-int main(int argc, char **argv)
-{
-	/* This variable is a file pointer to the file interface for the GPIO device driver
-	  which controls the input pin. */
-	uint32_t gpio_fd; // This is the file ID for the input file.
-
-	uint8_t gpioSwitchP1 = 48; //Input Switch for Player 1 (GPIO1_16)
-	uint8_t gpioSwitchP2 = 49; //Input Switch for Player 2 (GPIO0_26)
-
-	uint8_t gpioLEDP1= 44; //Output LED light for Player 1 (GPIO1_12)
-	uint8_t gpioLEDP2= 26; //Output LED light for Player 2 (GPIO0_26)
-
-	char ioPort[56];   // This is the IO port that is to be referenced.
-
-	if (argc < 3) {
-		exit(-1);
-	}
-
-	// Set the signal callback for Ctrl-C
-	signal(SIGINT, signal_handler);
-
-	// Convert the input into the appropriate parameters.
-	char player1[32];
-	char player2[32];
-	strcpy(player1, argv[1]);
-	strcpy(player2, argv[2]);
-
-	printf("Welcome to the game of Anticipation, %s and %s!", player1, player2);
-
-	// Setup the input ports
-	(void)gpio_export(gpioSwitchP1);
-	(void)gpio_set_dir(gpioSwitchP1, 0);
-	(void)gpio_set_edge(gpioSwitchP1, GPIO_BOTH_EDGES);  // Both indicates that an interrupt will fire on both a rising and falling edge.
-	gpio_fd = gpio_fd_open(gpioSwitchP1);
-
-	(void)gpio_export(gpioSwitchP2);
-	(void)gpio_set_dir(gpioSwitchP2, 0);
-	(void)gpio_set_edge(gpioSwitchP2, GPIO_BOTH_EDGES);  // Both indicates that an interrupt will fire on both a rising and falling edge.
-	gpio_fd = gpio_fd_open(gpioSwitchP2);
-
-	// Setup the output ports
-	(void)gpio_export(gpioLEDP1);
-	(void)gpio_set_dir(gpioLEDP1, 1);
-	(void)gpio_fd_open(gpioLEDP1);
-
-	(void)gpio_export(gpioLEDP2);
-	(void)gpio_set_dir(gpioLEDP2, 1);
-	(void)gpio_fd_open(gpioLEDP2);
-
-
-	//GAME STUFF HERE
-
-
-
-	// Start the process pin routine which will handle processing the pin.
-	processPin(gpio_fd, gpioLEDP1, gpioSwitchP1);
-
-	//***********************************************************************
-	// cleanup the executing system
-	// Close the pins
-	gpio_fd_close(gpio_fd);
-
-	// Unexport the pins.
-	gpio_unexport(gpioSwitchP1);
-	gpio_unexport(gpioSwitchP2);
-	gpio_unexport(gpioLEDP1);
-	gpio_unexport(gpioLEDP2);
-
-	printf("Peace out girl scout\n");
-	return 0;
+/*
+* main.c
+*
+*  Created on: Mar 27, 2014
+*      Author: se3910
+*/
+
+
+/*********************************************************************
+* This program will allow on to turn a given port on and off at a user
+* defined rate.  The code was initially developed by Dingo_aus, 7 January 2009
+* email: dingo_aus [at] internode <dot> on /dot/ net
+* From http://www.avrfreaks.net/wiki/index.php/Documentation:LinuxGPIO#gpio_framework (Note: This link is now broken.)
+* Created in AVR32 Studio (version 2.0.2) running on Ubuntu 8.04
+* Modified by Mark A. Yoder, 21-July-2011
+* Refactored and further modified by Walter Schilling, Summer 2012 / Winter 2013-2014.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>	// Defines signal numbers (i.e. trap Ctrl-C)
+#include <stdint.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include "gpioInterface.h"
+#include "gpioCdev.h"
+#include "gpioMmap.h"
+#include "eventLoop.h"
+#include "edgeCapture.h"
+#include "debounce.h"
+#include "latencyHist.h"
+#include "asyncLog.h"
+#include "realtime.h"
+#include "gpioTrace.h"
+#include "game.h"
+#include "gpioSetup.h"
+#include "gpioRegistry.h"
+#include "gpioShm.h"
+#include "await.h"
+#include "scheduler.h"
+#include "softPwm.h"
+
+#define PLAYER_COUNT (2)
+#define STATE_UNKNOWN (2)	// Neither 0 nor 1, so the first reading always registers
+#define SWITCH_DEBOUNCE_US (20000)	// Longer than the bounce of the switches
+#define WAKEUP_SAMPLES (1000)		// Wakeups measured when realtime mode is on
+#define IDLE_REMINDER_MS (15000)	// Time without a press before a player's LED blinks
+#define REMINDER_BLINKS (3)
+#define REMINDER_BLINK_MS (200)
+#define PIN_JOURNAL "/run/anticipation.pins"	// The pins held, for the next run after a crash
+#define HEARTBEAT_MAX (4)		// Pins which may be blinked with -b
+#define LED_PWM_HZ (500)		// Fast enough that a dimmed LED does not flicker
+
+// Everything the event loop needs to know about one player's station.
+struct player {
+	char name[32];
+	uint32_t switchPin;
+	uint32_t ledPin;
+	int32_t ledChannel;	// The LED's PWM channel when it is dimmed
+	int32_t switchFd;	// This is the file ID for the input file.
+	uint32_t prevState;
+	// The reminder task, and its state which must outlast a wait.
+	struct await_task reminder;
+	struct await_edge_wait press;
+	uint32_t blink;
+	timens_t blinkUntil;
+};
+
+// The capture thread which timestamps the edges of every switch.
+static struct edge_capture capture;
+
+// Removes switch bounce between the capture thread and processPin.
+static struct debounce_filter debouncer;
+
+// Fires when a switch level held back by the debounce window is due.  It is
+// not used for a fast replay, whose timestamps are not on the wall clock.
+static int32_t debounceTimerFd = -1;
+
+// Records the edges processPin sees and every output write, when -t is given.
+static struct gpio_trace_writer trace;
+static uint32_t tracing;
+
+// The multi-station game, when -g is given.  It must outlive the log writer.
+static struct game game;
+
+// Runs the players' reminder tasks on the main event loop.
+static struct await_scheduler tasks;
+static uint32_t tasksRunning;
+
+// Turns the pins given with -b on and off, each at its own rate.
+static struct scheduler heartbeat;
+static uint32_t heartbeatPins[HEARTBEAT_MAX];
+static timens_t heartbeatPeriods[HEARTBEAT_MAX];
+static uint32_t heartbeatCount;
+static uint32_t heartbeatRunning;
+
+// Drives the players' LEDs at the brightness given with -d, in parts per
+// thousand.  ledDuty is 0 when the LEDs are simply switched.
+static struct soft_pwm dimmer;
+static uint32_t ledDuty;
+
+/*******************************************************************************
+* This method will light or darken a player's LED.  A dimmed LED follows at the
+* start of its next PWM period.
+*
+* @param struct player *p - This is the player.
+* @param uint32_t level - This is non zero to light the LED.
+******************************************************************************/
+static void setLed(struct player *p, uint32_t level)
+{
+	if (ledDuty != 0) {
+		(void)soft_pwm_set_duty(&dimmer, (uint32_t)p->ledChannel, level ? ledDuty : 0);
+	} else {
+		(void)gpio_set_value(p->ledPin, level);
+	}
+}
+
+/*******************************************************************************
+* This method is called for each edge taken from the capture queue.  It will
+* mirror the state of the switch onto the LED of the player who owns it.
+*
+* @param const struct gpio_edge_event *event - This is the edge that was captured.
+* @param void *ctx - This is the array of players.
+******************************************************************************/
+static void processPin(const struct gpio_edge_event *event, void *ctx)
+{
+	struct player *players = (struct player*)ctx;
+	struct player *p = NULL;
+	uint32_t index;
+
+	for (index = 0; index < PLAYER_COUNT; index++) {
+		if (players[index].switchPin == event->pin) {
+			p = &players[index];
+		}
+	}
+	if (p == NULL) {
+		return;
+	}
+	if (tracing) {
+		(void)gpio_trace_write_edge(&trace, event);
+	}
+
+	// Every stage is timed on the clock the edge was stamped with.
+	LATENCY_STAMP(entered, event->clock);
+	LATENCY_RECORD(LATENCY_STAGE_DELIVERY, timens_from_timespec(&event->timestamp), entered);
+
+	log_printf("\nGPIO %d interrupt occurred at %ld.%09ld, value=%d\n", event->pin,
+		(long)event->timestamp.tv_sec, event->timestamp.tv_nsec, event->value);
+	LATENCY_STAMP(printed, event->clock);
+	LATENCY_RECORD(LATENCY_STAGE_PRINT, entered, printed);
+
+	if (event->value != p->prevState)
+	{
+		if (event->value == 0)
+		{
+			log_printf("The button is pressed.\n");
+
+			//Write our value of "0" to the file
+			setLed(p, 0);
+		}
+		else
+		{
+			log_printf("The button is not pressed.\n");
+
+			//Write our value of "1" to the file
+			setLed(p, 1);
+		}
+		LATENCY_STAMP(written, event->clock);
+		LATENCY_RECORD(LATENCY_STAGE_SET_VALUE, printed, written);
+		LATENCY_RECORD(LATENCY_STAGE_TOTAL, timens_from_timespec(&event->timestamp), written);
+		p->prevState = event->value;
+	}
+
+	if (tasksRunning) {
+		await_dispatch_edge(event, &tasks);
+	}
+}
+
+/*******************************************************************************
+* This method is the task which reminds an idle player that the game is on.
+* If the switch is left released for IDLE_REMINDER_MS the LED blinks a few
+* times.  A press ends the blinking at once and restarts the wait.
+*
+* @param struct await_task *task - This is the task.  Its context is the player.
+* @return AWAIT_WAITING while the task waits; it never finishes.
+******************************************************************************/
+static int32_t remindPlayer(struct await_task *task)
+{
+	struct player *p = (struct player*)task->ctx;
+
+	AWAIT_BEGIN(task);
+	for (;;) {
+		await_edge(task, p->switchPin, GPIO_BOTH_EDGES, IDLE_REMINDER_MS);
+		if ((task->woken == AWAIT_WOKE_EDGE) || (p->prevState != 1)) {
+			continue;
+		}
+
+		log_printf("%s, are you still there?\n", p->name);
+		p->press.pin = p->switchPin;
+		p->press.edge = GPIO_FALLING_EDGE;
+		for (p->blink = 0; p->blink < 2 * REMINDER_BLINKS; p->blink++) {
+			// Off, then on again, so the LED ends lit like a released switch leaves it.
+			setLed(p, p->blink & 1);
+			p->blinkUntil = timens_add(timens_now(CLOCK_MONOTONIC), timens_from_ms(REMINDER_BLINK_MS));
+			await_any(task, &p->press, 1, p->blinkUntil);
+			if (task->woken == AWAIT_WOKE_EDGE) {
+				break;
+			}
+		}
+		// processPin has already set the LED for the press; this restores it otherwise.
+		setLed(p, p->prevState != 0);
+	}
+	AWAIT_END(task);
+}
+
+/*******************************************************************************
+* This method will arm the debounce timer for the earliest switch level the
+* filter is holding back, or disarm it if there is none.
+******************************************************************************/
+static void armDebounceTimer(void)
+{
+	struct itimerspec spec;
+	timens_t remaining;
+
+	if (debounceTimerFd < 0) {
+		return;
+	}
+	remaining = debounce_pending(&debouncer);
+
+	// A zero it_value disarms the timer, so a level which is already due waits 1 ns.
+	memset(&spec, 0, sizeof(spec));
+	if (remaining >= 0) {
+		timens_to_timespec((remaining > 0) ? remaining : 1, &spec.it_value);
+	}
+	(void)timerfd_settime(debounceTimerFd, 0, &spec, NULL);
+}
+
+/*******************************************************************************
+* This method is called by the event loop when the capture thread has queued
+* edges.  It will debounce and process all of them.
+*
+* @param int32_t fd - This is the capture notification descriptor.
+* @param uint32_t events - This is the set of epoll events that occurred.
+* @param void *ctx - This is the debounce filter.
+******************************************************************************/
+static void processEdges(int32_t fd, uint32_t events, void *ctx)
+{
+	(void)edge_capture_drain(&capture, debounce_process, ctx);
+	armDebounceTimer();
+}
+
+/*******************************************************************************
+* This method is called by the event loop when a debounce window holding back
+* a switch level has ended.  Edges still queued are processed first, since any
+* of them may fall inside the window.
+*
+* @param int32_t fd - This is the debounce timer.
+* @param uint32_t events - This is the set of epoll events that occurred.
+* @param void *ctx - This is the debounce filter.
+******************************************************************************/
+static void debounceExpired(int32_t fd, uint32_t events, void *ctx)
+{
+	uint64_t expirations;
+
+	(void)read(fd, &expirations, sizeof(expirations));
+	(void)edge_capture_drain(&capture, debounce_process, ctx);
+	(void)debounce_expire((struct debounce_filter*)ctx);
+	armDebounceTimer();
+}
+
+/****************************************************************
+* signal_handler
+****************************************************************/
+// Callback called by the event loop when SIGINT (Ctrl-C) or SIGTERM (the
+// service being stopped) is sent to the process.  It runs on the event loop,
+// not in signal context, so it may log.
+static void signal_handler(int32_t sig, void *ctx)
+{
+	log_printf("%s, cleaning up and exiting..\n", (sig == SIGINT) ? "Ctrl-C pressed" : "Terminated");
+	event_loop_stop((struct event_loop*)ctx);
+}
+
+/*******************************************************************************
+* This method is called at exit.  It will release whatever pins and descriptors
+* are still held, for example when the program exits early with an error.
+******************************************************************************/
+static void releasePins(void)
+{
+	(void)gpio_release_all();
+}
+
+
+
+/*******************************************************************************
+* This method is called by the event loop when every edge of a replayed trace
+* has been queued.  It will process the last of them, pass any switch level
+* still held back by the debounce window, and stop the loop.
+*
+* @param int32_t fd - This is the replay's completion descriptor.
+* @param uint32_t events - This is the set of epoll events that occurred.
+* @param void *ctx - This is the event loop.
+******************************************************************************/
+static void replayDone(int32_t fd, uint32_t events, void *ctx)
+{
+	(void)edge_capture_drain(&capture, debounce_process, &debouncer);
+	(void)debounce_expire(&debouncer);
+	event_loop_stop((struct event_loop*)ctx);
+}
+
+/*******************************************************************************
+* This method is called by the event loop when the game has played every round.
+*
+* @param int32_t fd - This is the game's completion descriptor.
+* @param uint32_t events - This is the set of epoll events that occurred.
+* @param void *ctx - This is the event loop.
+******************************************************************************/
+static void gameOver(int32_t fd, uint32_t events, void *ctx)
+{
+	event_loop_stop((struct event_loop*)ctx);
+}
+
+/*******************************************************************************
+* This method will play the game described by a configuration file, on any
+* number of stations, until every round is played or Ctrl-C is pressed.
+*
+* @param struct event_loop *loop - This is the loop which handles Ctrl-C.
+* @param const char *path - This is the configuration file.
+******************************************************************************/
+static void playGame(struct event_loop *loop, const char *path)
+{
+	if ((game_load(&game, path) < 0) || (game_start(&game) < 0)) {
+		return;
+	}
+	event_loop_add_fd(loop, game_fd(&game), EPOLLIN, gameOver, loop);
+	event_loop_run(loop);
+	game_stop(&game);
+	game_report(&game);
+}
+
+/*******************************************************************************
+* This method will bring up the pins given with -b as outputs and start turning
+* each of them on and off at its own rate.  A pin which cannot be set up is left
+* out.
+******************************************************************************/
+static void startHeartbeat(void)
+{
+	struct gpio_pin_setup table[HEARTBEAT_MAX];
+	uint32_t index;
+
+	memset(table, 0, sizeof(table));
+	for (index = 0; index < heartbeatCount; index++) {
+		table[index].pin = heartbeatPins[index];
+		table[index].out = 1;
+	}
+	(void)gpio_setup_pins(table, heartbeatCount);
+	gpio_setup_report(table, heartbeatCount);
+
+	scheduler_init(&heartbeat);
+	for (index = 0; index < heartbeatCount; index++) {
+		if (table[index].rc == 0) {
+			(void)scheduler_add_pin(&heartbeat, heartbeatPins[index], heartbeatPeriods[index]);
+		}
+	}
+	heartbeatRunning = (scheduler_start(&heartbeat) == 0);
+}
+
+/*******************************************************************************
+* This method will stop the pins given with -b and report how closely each kept
+* to its rate.
+******************************************************************************/
+static void stopHeartbeat(void)
+{
+	struct scheduler_stats stats;
+	uint32_t task;
+
+	if (!heartbeatRunning) {
+		return;
+	}
+	scheduler_stop(&heartbeat);
+	heartbeatRunning = 0;
+	for (task = 0; task < heartbeat.taskCount; task++) {
+		if ((scheduler_get_stats(&heartbeat, task, &stats) < 0) || (stats.runs == 0)) {
+			continue;
+		}
+		log_printf("Heartbeat GPIO %u: %llu toggles, %llu missed, jitter min %lld us, mean %lld us, max %lld us\n",
+			heartbeat.tasks[task].pin, (unsigned long long)stats.runs, (unsigned long long)stats.missed,
+			(long long)timens_to_us(stats.minJitter),
+			(long long)timens_to_us(stats.totalJitter / (timens_t)stats.runs),
+			(long long)timens_to_us(stats.maxJitter));
+	}
+}
+
+/*******************************************************************************
+* This method will hand the players' LEDs to the PWM thread, which runs just
+* below the event thread so that it never holds up a switch.  If the engine
+* cannot start, the LEDs are switched as usual.
+*
+* @param struct player *players - This is the array of players.
+* @param uint32_t priority - This is the SCHED_FIFO priority of the event thread, or 0.
+******************************************************************************/
+static void startDimmer(struct player *players, uint32_t priority)
+{
+	uint32_t index;
+
+	soft_pwm_init(&dimmer, (priority > 1) ? (int32_t)priority - 1 : 0);
+	for (index = 0; index < PLAYER_COUNT; index++) {
+		players[index].ledChannel = soft_pwm_add_channel(&dimmer, players[index].ledPin, LED_PWM_HZ, 0);
+		if (players[index].ledChannel < 0) {
+			ledDuty = 0;
+			return;
+		}
+	}
+	if (soft_pwm_start(&dimmer) < 0) {
+		ledDuty = 0;
+	}
+}
+
+/*******************************************************************************
+* This method will stop the PWM thread, which leaves the LEDs off, and report
+* the frequency each LED achieved.
+*
+* @param struct player *players - This is the array of players.
+******************************************************************************/
+static void stopDimmer(struct player *players)
+{
+	struct soft_pwm_report report;
+	uint32_t index;
+
+	if (ledDuty == 0) {
+		return;
+	}
+	soft_pwm_stop(&dimmer);
+	ledDuty = 0;
+	for (index = 0; index < PLAYER_COUNT; index++) {
+		if (soft_pwm_get_report(&dimmer, (uint32_t)players[index].ledChannel, &report) == 0) {
+			log_printf("%s's LED: %.1f Hz (%+.1f Hz), %llu periods missed\n", players[index].name,
+				report.achievedHz, report.frequencyError, (unsigned long long)report.missed);
+		}
+	}
+}
+
+/*******************************************************************************
+* This method is called by the event loop's timer.  It will compare the output
+* levels the program believes it has written with the pins themselves, and,
+* when built with INSTRUMENT_LATENCY, publish the latency of each stage for the
+* monitoring processes.  Otherwise nothing is recorded, and the stages are left
+* unpublished rather than published as zeros.
+*
+* @param uint64_t expirations - This is the number of periods since the last call.
+* @param void *ctx - This is unused.
+******************************************************************************/
+static void periodicCheck(uint64_t expirations, void *ctx)
+{
+#ifdef INSTRUMENT_LATENCY
+	struct latency_hist *hist;
+	uint32_t stage;
+#endif
+
+	(void)gpio_shadow_check();
+#ifdef INSTRUMENT_LATENCY
+	for (stage = 0; stage < LATENCY_STAGE_COUNT; stage++) {
+		hist = &latency_stages[stage];
+		gpio_shm_publish_stage(stage, hist->name, __atomic_load_n(&hist->count, __ATOMIC_RELAXED),
+			latency_hist_percentile(hist, 0.50), latency_hist_percentile(hist, 0.99),
+			__atomic_load_n(&hist->max, __ATOMIC_RELAXED));
+	}
+#endif
+}
+
+#ifdef INSTRUMENT_LATENCY
+/*******************************************************************************
+* This method is called by the event loop on SIGUSR1.  It will print the
+* latency statistics of every stage.
+*
+* @param int32_t sig - This is the signal.
+* @param void *ctx - This is unused.
+******************************************************************************/
+static void latency_handler(int32_t sig, void *ctx)
+{
+	LATENCY_DUMP(stdout);
+}
+#endif
+
+/****************************************************************
+* Main
+****************************************************************/
+int main(int argc, char **argv)
+{
+	struct event_loop loop;
+	struct player players[PLAYER_COUNT];
+	struct gpio_pin_setup pinTable[2 * PLAYER_COUNT];
+	uint32_t index;
+	uint64_t passed, suppressed;
+	struct rt_config rtConfig = { 0, RT_NO_CPU, 0 };
+	struct gpio_shadow_stats shadowStats;
+	struct timespec checkPeriod;
+	struct rt_status rtStatus;
+	struct rt_wakeup_report wakeup;
+	int32_t wakeupSamples = -1;
+	int32_t opt;
+	struct gpio_trace_replay replay;
+	const char *tracePath = NULL;
+	const char *replayPath = NULL;
+	uint32_t replayMode = GPIO_TRACE_REAL_TIME;
+	const char *gamePath = NULL;
+	uint32_t heartbeatMs;
+	const char *backendName = NULL;
+
+	// -r <priority> runs the event thread SCHED_FIFO with its memory locked,
+	// -c <cpu> pins it and -m <count> measures its wakeup latency.
+	// -t <file> records a trace; -p <file> replays one in place of the switches,
+	// with -F as fast as possible rather than at the recorded speed.
+	// -g <file> plays the game on the stations listed in the file.
+	// -b <gpio>:<ms> turns a pin on and off every ms; it may be given HEARTBEAT_MAX times.
+	// -d <permille> dims the players' LEDs to that brightness.
+	// -B <sysfs|cdev|mmap> picks the pin backend rather than the character devices when present.
+	while ((opt = getopt(argc, argv, "r:c:m:t:p:Fg:b:d:B:")) != -1) {
+		switch (opt) {
+		case 'r':
+			rtConfig.priority = (uint32_t)atoi(optarg);
+			rtConfig.lockMemory = 1;
+			break;
+		case 'c':
+			rtConfig.cpu = atoi(optarg);
+			break;
+		case 'm':
+			wakeupSamples = atoi(optarg);
+			break;
+		case 't':
+			tracePath = optarg;
+			break;
+		case 'p':
+			replayPath = optarg;
+			break;
+		case 'F':
+			replayMode = GPIO_TRACE_FAST;
+			break;
+		case 'g':
+			gamePath = optarg;
+			break;
+		case 'b':
+			if ((heartbeatCount == HEARTBEAT_MAX) ||
+				(sscanf(optarg, "%u:%u", &heartbeatPins[heartbeatCount], &heartbeatMs) != 2) ||
+				(heartbeatMs == 0)) {
+				fprintf(stderr, "-b takes a gpio:ms pair, at most %d times\n", HEARTBEAT_MAX);
+				exit(-1);
+			}
+			heartbeatPeriods[heartbeatCount++] = timens_from_ms(heartbeatMs);
+			break;
+		case 'd':
+			ledDuty = (uint32_t)atoi(optarg);
+			if ((ledDuty == 0) || (ledDuty > SOFT_PWM_DUTY_SCALE)) {
+				fprintf(stderr, "-d takes a brightness from 1 to %d\n", SOFT_PWM_DUTY_SCALE);
+				exit(-1);
+			}
+			break;
+		case 'B':
+			backendName = optarg;
+			if ((strcmp(backendName, "sysfs") != 0) && (strcmp(backendName, "cdev") != 0) &&
+				(strcmp(backendName, "mmap") != 0)) {
+				fprintf(stderr, "-B takes sysfs, cdev or mmap\n");
+				exit(-1);
+			}
+			break;
+		default:
+			exit(-1);
+		}
+	}
+	if ((gamePath == NULL) && (argc - optind < 2)) {
+		fprintf(stderr, "usage: %s [-r priority] [-c cpu] [-m samples] [-B backend] [-b gpio:ms]... [-d permille] [-t trace] [-p trace [-F]] player1 player2\n"
+			"       %s [-r priority] [-c cpu] [-m samples] [-B backend] [-b gpio:ms]... [-t trace] -g config\n", argv[0], argv[0]);
+		exit(-1);
+	}
+	if (wakeupSamples < 0) {
+		wakeupSamples = (rtConfig.priority > 0) ? WAKEUP_SAMPLES : 0;
+	}
+	atexit(releasePins);
+
+	// Convert the input into the appropriate parameters.
+	memset(players, 0, sizeof(players));
+	if (gamePath == NULL) {
+		snprintf(players[0].name, sizeof(players[0].name), "%s", argv[optind]);
+		snprintf(players[1].name, sizeof(players[1].name), "%s", argv[optind + 1]);
+	}
+
+	players[0].switchPin = 48; //Input Switch for Player 1 (GPIO1_16)
+	players[1].switchPin = 49; //Input Switch for Player 2 (GPIO0_26)
+
+	players[0].ledPin = 44; //Output LED light for Player 1 (GPIO1_12)
+	players[1].ledPin = 26; //Output LED light for Player 2 (GPIO0_26)
+
+	if ((event_loop_init(&loop) < 0) || (edge_capture_init(&capture) < 0)) {
+		exit(-1);
+	}
+	debounce_init(&debouncer, processPin, players);
+
+	// Deliver Ctrl-C and SIGTERM through the event loop.  This must come before the
+	// capture thread is started so that the thread inherits the blocked signal mask.
+	event_loop_watch_signal(&loop, SIGINT, signal_handler, &loop);
+	event_loop_watch_signal(&loop, SIGTERM, signal_handler, &loop);
+#ifdef INSTRUMENT_LATENCY
+	event_loop_watch_signal(&loop, SIGUSR1, latency_handler, NULL);
+#endif
+
+	// Outputs are read from, and unchanged writes skipped against, a shadow of
+	// their levels.  Check it now and then in case something else drives them.
+	timens_to_timespec(timens_from_ms(GPIO_SHADOW_CHECK_MS), &checkPeriod);
+	event_loop_set_timer(&loop, &checkPeriod, &checkPeriod, periodicCheck, NULL);
+
+	// Console output is written by a background thread from here on, so a slow
+	// terminal never holds up the response to a switch.  Like the capture thread
+	// it must start after the signals are blocked.
+	(void)log_start();
+
+	// The capture thread inherits the realtime policy and affinity; the log
+	// writer, started above, stays an ordinary thread.
+	if ((rtConfig.priority > 0) || (rtConfig.cpu != RT_NO_CPU)) {
+		(void)rt_apply(&rtConfig, &rtStatus);
+		log_printf("Event thread: %s priority %d, cpu %d, %llu kB locked%s\n",
+			(rtStatus.policy == SCHED_FIFO) ? "SCHED_FIFO" : "SCHED_OTHER", rtStatus.priority,
+			rtStatus.cpu, (unsigned long long)rtStatus.lockedKb,
+			rtStatus.ok ? "" : " (not every setting took effect)");
+	}
+	if (wakeupSamples > 0) {
+		rt_measure_wakeup((uint32_t)wakeupSamples, &wakeup);
+		log_printf("Wakeup latency over %u samples: min %lld us, mean %lld us, p99 %lld us, max %lld us\n",
+			wakeup.samples, (long long)timens_to_us(wakeup.min), (long long)timens_to_us(wakeup.mean),
+			(long long)timens_to_us(wakeup.p99), (long long)timens_to_us(wakeup.max));
+	}
+
+	if (gamePath == NULL) {
+		log_printf("Welcome to the game of Anticipation, %s and %s!", players[0].name, players[1].name);
+	}
+
+	// Use the GPIO character devices when the kernel has them; they queue and
+	// timestamp every edge.  Otherwise fall back to sysfs.  -B mmap writes and
+	// reads the pins through the bank registers, still watching edges through
+	// sysfs.  A replay needs no pins.
+	if (replayPath != NULL) {
+		gpio_set_backend(&gpio_trace_null_backend);
+	} else if ((backendName == NULL) || (strcmp(backendName, "cdev") == 0)) {
+		if (gpio_cdev_open(NULL) == 0) {
+			gpio_set_backend(&gpio_cdev_backend);
+		} else if (backendName != NULL) {
+			log_printf("The GPIO character devices could not be opened; using sysfs\n");
+		}
+	} else if (strcmp(backendName, "mmap") == 0) {
+		if (gpio_mmap_open(NULL, NULL) == 0) {
+			gpio_set_backend(&gpio_mmap_backend);
+		} else {
+			log_printf("The GPIO registers could not be mapped; using sysfs\n");
+		}
+	}
+
+	// Keep a list of the pins held, so that a run after a crash can reclaim them.
+	if (replayPath == NULL) {
+		(void)gpio_registry_journal(PIN_JOURNAL);
+	}
+
+	if ((tracePath != NULL) && (gpio_trace_create(&trace, tracePath, CLOCK_MONOTONIC) == 0)) {
+		// Replaying as fast as possible, outputs take the time of the edge that
+		// caused them, so that two runs over the same trace can be compared.
+		trace.virtualTime = (replayPath != NULL) && (replayMode == GPIO_TRACE_FAST);
+		gpio_trace_outputs(&trace);
+		tracing = 1;
+	}
+
+	// Publish the pins for the scoreboard and telemetry, which read them from
+	// shared memory rather than from sysfs.  The game runs on without it.
+	(void)gpio_shm_open(GPIO_SHM_NAME);
+
+	// The heartbeat runs on the wall clock, so it is left out of a replay to keep it repeatable.
+	if ((heartbeatCount > 0) && (replayPath == NULL)) {
+		startHeartbeat();
+	}
+
+	if (gamePath != NULL) {
+		playGame(&loop, gamePath);
+		event_loop_close(&loop);
+	} else {
+		// Each switch interrupts on both a rising and a falling edge, and both
+		// LEDs start off.  The four pins are brought up together.
+		memset(pinTable, 0, sizeof(pinTable));
+		for (index = 0; index < PLAYER_COUNT; index++) {
+			players[index].prevState = STATE_UNKNOWN;
+			pinTable[2 * index].pin = players[index].switchPin;
+			pinTable[2 * index].edge = GPIO_BOTH_EDGES;
+			pinTable[2 * index].openFd = 1;
+			pinTable[2 * index + 1].pin = players[index].ledPin;
+			pinTable[2 * index + 1].out = 1;
+			pinTable[2 * index + 1].level = 0;
+		}
+		(void)gpio_setup_pins(pinTable, 2 * PLAYER_COUNT);
+		gpio_setup_report(pinTable, 2 * PLAYER_COUNT);
+
+		for (index = 0; index < PLAYER_COUNT; index++) {
+			players[index].switchFd = pinTable[2 * index].fd;
+			if (players[index].switchFd >= 0) {
+				edge_capture_add_pin(&capture, players[index].switchPin, players[index].switchFd);
+			}
+			debounce_add_pin(&debouncer, players[index].switchPin, DEBOUNCE_WINDOW, SWITCH_DEBOUNCE_US);
+		}
+
+		// Every PWM edge would be written to a trace, so the LEDs are only dimmed
+		// when there is none.  Every LED must be up for the PWM thread to drive it.
+		if ((ledDuty != 0) && (tracing || (replayPath != NULL))) {
+			log_printf("The LEDs are not dimmed while tracing or replaying\n");
+			ledDuty = 0;
+		}
+		for (index = 0; index < PLAYER_COUNT; index++) {
+			if (pinTable[2 * index + 1].rc < 0) {
+				ledDuty = 0;
+			}
+		}
+		if (ledDuty != 0) {
+			startDimmer(players, rtConfig.priority);
+		}
+
+		// The reminders share the event loop with everything else.  They run on
+		// the wall clock, so they are left out of a replay to keep it repeatable.
+		if ((replayPath == NULL) && (await_init(&tasks, &loop) == 0)) {
+			tasksRunning = 1;
+			for (index = 0; index < PLAYER_COUNT; index++) {
+				(void)await_spawn(&tasks, &players[index].reminder, remindPlayer, &players[index]);
+			}
+		}
+
+		// Start capturing edges, then run the event loop, which will handle processing
+		// the pins of both players.  When replaying, the capture thread has no pins
+		// and the trace supplies the edges instead.
+		event_loop_add_fd(&loop, edge_capture_fd(&capture), EPOLLIN, processEdges, &debouncer);
+		if ((replayPath == NULL) || (replayMode != GPIO_TRACE_FAST)) {
+			debounceTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+			if (debounceTimerFd < 0) {
+				log_perror("debounce timer");
+			} else {
+				event_loop_add_fd(&loop, debounceTimerFd, EPOLLIN, debounceExpired, &debouncer);
+			}
+		}
+		if (edge_capture_start(&capture) == 0) {
+			if (replayPath == NULL) {
+				event_loop_run(&loop);
+			} else if (gpio_trace_replay_start(&replay, replayPath, &capture, replayMode) == 0) {
+				event_loop_add_fd(&loop, gpio_trace_replay_fd(&replay), EPOLLIN, replayDone, &loop);
+				event_loop_run(&loop);
+				log_printf("Replayed %llu edges\n", (unsigned long long)gpio_trace_replay_stop(&replay));
+			}
+			edge_capture_stop(&capture);
+		}
+		if (tasksRunning) {
+			tasksRunning = 0;
+			await_close(&tasks);
+		}
+		stopDimmer(players);
+
+		for (index = 0; index < PLAYER_COUNT; index++) {
+			if (debounce_get_counts(&debouncer, players[index].switchPin, &passed, &suppressed) == 0) {
+				log_printf("GPIO %d: %llu edges, %llu suppressed as bounce\n", players[index].switchPin,
+					(unsigned long long)passed, (unsigned long long)suppressed);
+			}
+		}
+		if (debounceTimerFd >= 0) {
+			close(debounceTimerFd);
+			debounceTimerFd = -1;
+		}
+		event_loop_close(&loop);
+	}
+
+	//***********************************************************************
+	// cleanup the executing system
+	stopHeartbeat();
+
+	// Close every descriptor and unexport every pin, in one pass.
+	if (gpio_release_all() > 0) {
+		log_printf("Some pins could not be released; the next run will reclaim them\n");
+	}
+	gpio_shm_close();
+	gpio_cdev_close();
+	gpio_mmap_close();
+
+	if (tracing) {
+		gpio_trace_outputs(NULL);
+		(void)gpio_trace_finish(&trace);
+	}
+
+	gpio_pool_report();
+	gpio_shadow_stats(&shadowStats);
+	log_printf("Output writes: %llu made, %llu skipped as unchanged, %llu shadow mismatches\n",
+		(unsigned long long)shadowStats.written, (unsigned long long)shadowStats.skipped,
+		(unsigned long long)shadowStats.mismatches);
+	log_printf("Peace out girl scout\n");
+	log_stop();
+	LATENCY_DUMP(stdout);
+	return 0;
 }
\ No newline at end of file
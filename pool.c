@@ -0,0 +1,136 @@
+/*********************************************************************
+ * This module implements a fixed-capacity pool of equally sized objects.
+ * See pool.h.
+ *
+ * The free stack's head carries a change count next to the index of the
+ * first free object, so a compare-and-swap cannot succeed against a head
+ * which was popped and pushed back in between (the ABA problem).
+ */
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include "asyncLog.h"
+#include "pool.h"
+
+/*******************************************************************************
+ * This method will create a pool and pre-fault its memory.
+ * @param struct pool *pool - This is the pool that is to be initialized.
+ * @param const char *name - This is the name used in reports.
+ * @param size_t objSize - This is the size of each object.
+ * @param uint32_t capacity - This is the number of objects.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t pool_init(struct pool *pool, const char *name, size_t objSize, uint32_t capacity)
+{
+	uint32_t index;
+
+	memset(pool, 0, sizeof(*pool));
+	if ((objSize == 0) || (capacity == 0)) {
+		errno = EINVAL;
+		return -1;
+	}
+	pool->name = name;
+	pool->objSize = (objSize + POOL_ALIGN - 1) & ~((size_t)POOL_ALIGN - 1);
+	pool->capacity = capacity;
+	pool->arenaSize = pool->objSize * capacity + sizeof(uint32_t) * capacity;
+
+	// MAP_POPULATE faults every page in now rather than on first use.
+	pool->arena = (uint8_t*)mmap(NULL, pool->arenaSize, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+	if (pool->arena == MAP_FAILED) {
+		pool->arena = NULL;
+		log_perror("pool/init");
+		return -1;
+	}
+	pool->next = (uint32_t*)(pool->arena + pool->objSize * capacity);
+	for (index = 0; index < capacity; index++) {
+		pool->next[index] = (index + 1 < capacity) ? index + 2 : 0;
+	}
+	pool->freeHead = 1;
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will release the memory of a pool.
+ * @param struct pool *pool - This is the pool.
+ ******************************************************************************/
+void pool_destroy(struct pool *pool)
+{
+	if (pool->arena != NULL) {
+		munmap(pool->arena, pool->arenaSize);
+		pool->arena = NULL;
+	}
+	pool->capacity = 0;
+	pool->freeHead = 0;
+}
+
+/*******************************************************************************
+ * This method will take an object from a pool.
+ * @param struct pool *pool - This is the pool.
+ * @return The object, zero filled, or NULL if the pool is empty.
+ ******************************************************************************/
+void* pool_alloc(struct pool *pool)
+{
+	uint64_t head, newHead;
+	uint32_t index, used, high;
+
+	head = __atomic_load_n(&pool->freeHead, __ATOMIC_ACQUIRE);
+	do {
+		index = (uint32_t)head;
+		if (index == 0) {
+			if (__atomic_fetch_add(&pool->failures, 1, __ATOMIC_RELAXED) == 0) {
+				log_printf("pool/%s: all %u objects are in use\n", pool->name, pool->capacity);
+			}
+			return NULL;
+		}
+		newHead = (((head >> 32) + 1) << 32) | __atomic_load_n(&pool->next[index - 1], __ATOMIC_RELAXED);
+	} while (!__atomic_compare_exchange_n(&pool->freeHead, &head, newHead, 0,
+		__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+	used = __atomic_add_fetch(&pool->used, 1, __ATOMIC_RELAXED);
+	high = __atomic_load_n(&pool->highWater, __ATOMIC_RELAXED);
+	while ((used > high) && !__atomic_compare_exchange_n(&pool->highWater, &high, used, 0,
+		__ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+	}
+
+	memset(pool->arena + (index - 1) * pool->objSize, 0, pool->objSize);
+	return pool->arena + (index - 1) * pool->objSize;
+}
+
+/*******************************************************************************
+ * This method will return an object to its pool.
+ * @param struct pool *pool - This is the pool.
+ * @param void *obj - This is an object taken from the pool, or NULL.
+ ******************************************************************************/
+void pool_free(struct pool *pool, void *obj)
+{
+	uint64_t head, newHead;
+	uint32_t index;
+
+	if (obj == NULL) {
+		return;
+	}
+	index = (uint32_t)(((uint8_t*)obj - pool->arena) / pool->objSize);
+
+	head = __atomic_load_n(&pool->freeHead, __ATOMIC_ACQUIRE);
+	do {
+		__atomic_store_n(&pool->next[index], (uint32_t)head, __ATOMIC_RELAXED);
+		newHead = (((head >> 32) + 1) << 32) | (index + 1);
+	} while (!__atomic_compare_exchange_n(&pool->freeHead, &head, newHead, 0,
+		__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+	__atomic_sub_fetch(&pool->used, 1, __ATOMIC_RELAXED);
+}
+
+/*******************************************************************************
+ * This method will log the capacity, current use, high water mark and failed
+ * allocations of a pool.
+ * @param struct pool *pool - This is the pool.
+ ******************************************************************************/
+void pool_report(struct pool *pool)
+{
+	log_printf("pool/%s: %u of %u in use, at most %u, %llu allocations failed\n", pool->name,
+		__atomic_load_n(&pool->used, __ATOMIC_RELAXED), pool->capacity,
+		__atomic_load_n(&pool->highWater, __ATOMIC_RELAXED),
+		(unsigned long long)__atomic_load_n(&pool->failures, __ATOMIC_RELAXED));
+}
@@ -0,0 +1,72 @@
+/*********************************************************************
+ * This module implements a fixed-capacity pool of equally sized objects.
+ *
+ * The objects live in one arena which is mapped and pre-faulted when the
+ * pool is created, so taking an object never calls malloc and never
+ * touches a fresh page.  Every object starts on its own cache line.  Free
+ * objects are kept on a lock-free stack, so any thread may take or return
+ * an object at any time.
+ *
+ * A pool never grows.  When it is empty an allocation fails, is counted,
+ * and the first failure is logged, so an undersized pool is visible rather
+ * than slowing things down.
+ */
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define POOL_ALIGN (64)
+
+struct pool {
+	const char *name;
+	uint8_t *arena;
+	size_t arenaSize;
+	size_t objSize;		// Rounded up to POOL_ALIGN
+	uint32_t capacity;
+	uint32_t *next;		// For each free object, the index + 1 of the next one
+	uint64_t freeHead;	// Change count << 32 | index + 1 of the first free object
+	uint32_t used;
+	uint32_t highWater;
+	uint64_t failures;
+};
+
+/*******************************************************************************
+ * This method will create a pool and pre-fault its memory.
+ * @param struct pool *pool - This is the pool that is to be initialized.
+ * @param const char *name - This is the name used in reports.  It must stay valid.
+ * @param size_t objSize - This is the size of each object.
+ * @param uint32_t capacity - This is the number of objects.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t pool_init(struct pool *pool, const char *name, size_t objSize, uint32_t capacity);
+
+/*******************************************************************************
+ * This method will release the memory of a pool.  No object may be in use.
+ * @param struct pool *pool - This is the pool.
+ ******************************************************************************/
+void pool_destroy(struct pool *pool);
+
+/*******************************************************************************
+ * This method will take an object from a pool.  It may be called from any thread.
+ * @param struct pool *pool - This is the pool.
+ * @return The object, zero filled, or NULL if the pool is empty.
+ ******************************************************************************/
+void* pool_alloc(struct pool *pool);
+
+/*******************************************************************************
+ * This method will return an object to its pool.  It may be called from any thread.
+ * @param struct pool *pool - This is the pool.
+ * @param void *obj - This is an object taken from the pool, or NULL.
+ ******************************************************************************/
+void pool_free(struct pool *pool, void *obj);
+
+/*******************************************************************************
+ * This method will log the capacity, current use, high water mark and failed
+ * allocations of a pool.
+ * @param struct pool *pool - This is the pool.
+ ******************************************************************************/
+void pool_report(struct pool *pool);
+
+#endif
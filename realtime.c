@@ -0,0 +1,208 @@
+/*********************************************************************
+ * This module puts the calling thread into a realtime execution mode.
+ *
+ * Pre-faulting the heap only helps if freed memory stays in the process,
+ * so trimming and mmap'd allocations are switched off before the block is
+ * touched and released.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
+#include <malloc.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "timeutil.h"
+#include "latencyHist.h"
+#include "asyncLog.h"
+#include "realtime.h"
+
+/*******************************************************************************
+ * This method will touch RT_STACK_PREFAULT bytes of stack below the caller so
+ * that the pages are mapped (and, with mlockall, locked) before they are needed.
+ ******************************************************************************/
+static void __attribute__((noinline)) rt_prefault_stack(void)
+{
+	volatile uint8_t stack[RT_STACK_PREFAULT];
+	uint32_t offset;
+
+	for (offset = 0; offset < RT_STACK_PREFAULT; offset += 4096) {
+		stack[offset] = 0;
+	}
+	(void)stack;
+}
+
+/*******************************************************************************
+ * This method will grow the heap by RT_HEAP_PREFAULT bytes, touch every page
+ * and keep the memory in the process for later allocations.
+ ******************************************************************************/
+static void rt_prefault_heap(void)
+{
+	uint8_t *block;
+
+	mallopt(M_TRIM_THRESHOLD, -1);
+	mallopt(M_MMAP_MAX, 0);
+	block = (uint8_t*)malloc(RT_HEAP_PREFAULT);
+	if (block != NULL) {
+		memset(block, 0, RT_HEAP_PREFAULT);
+		free(block);
+	}
+}
+
+/*******************************************************************************
+ * This method will return the VmLck line of /proc/self/status.
+ * @return The locked memory of the process in kB, or 0 if it cannot be read.
+ ******************************************************************************/
+static uint64_t rt_locked_kb(void)
+{
+	char line[128];
+	unsigned long long kb = 0;
+	FILE *status = fopen("/proc/self/status", "r");
+
+	if (status == NULL) {
+		return 0;
+	}
+	while (fgets(line, sizeof(line), status) != NULL) {
+		if (sscanf(line, "VmLck: %llu", &kb) == 1) {
+			break;
+		}
+	}
+	fclose(status);
+	return kb;
+}
+
+/*******************************************************************************
+ * This method will read the scheduling, affinity and memory locking settings
+ * of the calling thread.
+ * @param struct rt_status *status - This is where the settings are placed.
+ *        ok is left unchanged.
+ ******************************************************************************/
+void rt_get_status(struct rt_status *status)
+{
+	struct sched_param param;
+	cpu_set_t cpus;
+	int32_t policy, cpu;
+
+	if (pthread_getschedparam(pthread_self(), &policy, &param) == 0) {
+		status->policy = policy;
+		status->priority = param.sched_priority;
+	} else {
+		status->policy = -1;
+		status->priority = 0;
+	}
+
+	status->cpu = RT_NO_CPU;
+	CPU_ZERO(&cpus);
+	if ((pthread_getaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0) && (CPU_COUNT(&cpus) == 1)) {
+		for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+			if (CPU_ISSET(cpu, &cpus)) {
+				status->cpu = cpu;
+				break;
+			}
+		}
+	}
+	status->lockedKb = rt_locked_kb();
+}
+
+/*******************************************************************************
+ * This method will apply a realtime configuration to the calling thread and
+ * then read the settings back.  A setting which is not permitted is reported
+ * and skipped; the rest are still applied.
+ * @param const struct rt_config *config - This is the configuration.
+ * @param struct rt_status *status - This is where the settings in effect are placed.
+ * @return The return will be 0 if every setting took effect or -1 if any did not.
+ ******************************************************************************/
+int32_t rt_apply(const struct rt_config *config, struct rt_status *status)
+{
+	struct sched_param param;
+	cpu_set_t cpus;
+	int32_t rc;
+
+	if (config->lockMemory) {
+		if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+			log_perror("realtime/mlockall");
+		}
+		rt_prefault_stack();
+		rt_prefault_heap();
+	}
+
+	if (config->cpu != RT_NO_CPU) {
+		CPU_ZERO(&cpus);
+		CPU_SET(config->cpu, &cpus);
+		rc = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+		if (rc != 0) {
+			errno = rc;
+			log_perror("realtime/affinity");
+		}
+	}
+
+	if (config->priority > 0) {
+		memset(&param, 0, sizeof(param));
+		param.sched_priority = config->priority;
+		rc = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+		if (rc != 0) {
+			errno = rc;
+			log_perror("realtime/SCHED_FIFO");
+		}
+	}
+
+	// Trust what the kernel reports rather than the return codes above.
+	rt_get_status(status);
+	status->ok = 1;
+	if ((config->priority > 0) &&
+		((status->policy != SCHED_FIFO) || (status->priority != (int32_t)config->priority))) {
+		status->ok = 0;
+	}
+	if ((config->cpu != RT_NO_CPU) && (status->cpu != config->cpu)) {
+		status->ok = 0;
+	}
+	if (config->lockMemory && (status->lockedKb == 0)) {
+		status->ok = 0;
+	}
+	return status->ok ? 0 : -1;
+}
+
+/*******************************************************************************
+ * This method will sleep until a series of absolute deadlines, RT_WAKEUP_PERIOD_NS
+ * apart, and measure how late the calling thread woke up for each.
+ * @param uint32_t samples - This is the number of wakeups.
+ * @param struct rt_wakeup_report *report - This is where the results are placed.
+ ******************************************************************************/
+void rt_measure_wakeup(uint32_t samples, struct rt_wakeup_report *report)
+{
+	static struct latency_hist hist;
+	struct timespec wake;
+	timens_t deadline, late, total = 0;
+	uint32_t index;
+
+	latency_hist_reset(&hist);
+	memset(report, 0, sizeof(*report));
+
+	deadline = timens_now(CLOCK_MONOTONIC);
+	for (index = 0; index < samples; index++) {
+		deadline = timens_add(deadline, RT_WAKEUP_PERIOD_NS);
+		timens_to_timespec(deadline, &wake);
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL) == EINTR) {
+		}
+		late = timens_sub(timens_now(CLOCK_MONOTONIC), deadline);
+
+		latency_hist_record(&hist, late);
+		if ((index == 0) || (late < report->min)) {
+			report->min = late;
+		}
+		if (late > report->max) {
+			report->max = late;
+		}
+		total = timens_add(total, late);
+	}
+
+	report->samples = samples;
+	if (samples > 0) {
+		report->mean = total / samples;
+		report->p99 = (timens_t)latency_hist_percentile(&hist, 0.99);
+	}
+}
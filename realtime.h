@@ -0,0 +1,74 @@
+/*********************************************************************
+ * This module puts the calling thread into a realtime execution mode:
+ * SCHED_FIFO at a given priority, pinned to one CPU, with all memory locked
+ * and the stack and heap pre-faulted so that the first use of either does
+ * not page fault.  Threads created afterwards inherit the policy and the
+ * affinity, so start any thread which should stay an ordinary thread (the
+ * log writer, for example) first.
+ *
+ * The settings are read back from the kernel after they are applied, and
+ * the wakeup latency of the thread can be measured to show their effect.
+ */
+#ifndef REALTIME_H
+#define REALTIME_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "timeutil.h"
+
+#define RT_NO_CPU (-1)
+#define RT_STACK_PREFAULT (256 * 1024)		// Bytes of stack touched up front
+#define RT_HEAP_PREFAULT (1024 * 1024)		// Bytes of heap touched and kept
+#define RT_DEFAULT_PRIORITY (50)		// Above softPwm, below the kernel's IRQ threads
+#define RT_WAKEUP_PERIOD_NS (1000000)
+
+struct rt_config {
+	uint32_t priority;	// SCHED_FIFO priority, or 0 to keep the current policy
+	int32_t cpu;		// CPU to pin to, or RT_NO_CPU
+	uint32_t lockMemory;	// Nonzero to mlockall and pre-fault
+};
+
+// What the kernel reports after rt_apply.
+struct rt_status {
+	int32_t policy;
+	int32_t priority;
+	int32_t cpu;		// The only CPU allowed, or RT_NO_CPU if there are several
+	uint64_t lockedKb;	// VmLck of the process
+	uint32_t ok;		// Nonzero if every requested setting took effect
+};
+
+struct rt_wakeup_report {
+	uint32_t samples;
+	timens_t min;
+	timens_t mean;
+	timens_t p99;
+	timens_t max;
+};
+
+/*******************************************************************************
+ * This method will apply a realtime configuration to the calling thread and
+ * then read the settings back.  A setting which is not permitted is reported
+ * and skipped; the rest are still applied.
+ * @param const struct rt_config *config - This is the configuration.
+ * @param struct rt_status *status - This is where the settings in effect are placed.
+ * @return The return will be 0 if every setting took effect or -1 if any did not.
+ ******************************************************************************/
+int32_t rt_apply(const struct rt_config *config, struct rt_status *status);
+
+/*******************************************************************************
+ * This method will read the scheduling, affinity and memory locking settings
+ * of the calling thread.
+ * @param struct rt_status *status - This is where the settings are placed.
+ *        ok is left unchanged.
+ ******************************************************************************/
+void rt_get_status(struct rt_status *status);
+
+/*******************************************************************************
+ * This method will sleep until a series of absolute deadlines, RT_WAKEUP_PERIOD_NS
+ * apart, and measure how late the calling thread woke up for each.
+ * @param uint32_t samples - This is the number of wakeups.
+ * @param struct rt_wakeup_report *report - This is where the results are placed.
+ ******************************************************************************/
+void rt_measure_wakeup(uint32_t samples, struct rt_wakeup_report *report);
+
+#endif
@@ -0,0 +1,235 @@
+/*********************************************************************
+ * This module runs periodic tasks, such as blinking output pins, from a
+ * single thread.  Every task has its own period and an absolute deadline
+ * which advances by exactly one period each time it runs, and the thread
+ * sleeps with clock_nanosleep(TIMER_ABSTIME) until the earliest deadline,
+ * so timing errors never accumulate.
+ *
+ * For every task the scheduler counts missed deadlines and keeps statistics
+ * on the wakeup jitter (how late the task ran relative to its deadline).
+ */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "gpioInterface.h"
+#include "timeutil.h"
+#include "scheduler.h"
+#include "asyncLog.h"
+
+/*******************************************************************************
+ * This method will run one task and account for its deadline.
+ * @param struct scheduler *sched - This is the scheduler.
+ * @param uint32_t id - This is the task number.
+ * @param timens_t now - This is the time at which the scheduler woke up.
+ ******************************************************************************/
+static void scheduler_run_task(struct scheduler *sched, uint32_t id, timens_t now)
+{
+	struct scheduler_task *task = &sched->tasks[id];
+	timens_t jitter = timens_sub(now, task->deadline);
+	int64_t missed = 0;
+
+	if (task->pin != SCHEDULER_NO_PIN) {
+		task->level = !task->level;
+		gpio_set_value(task->pin, task->level);
+	} else {
+		task->cb(id, task->ctx);
+	}
+
+	// The next deadline is always a whole number of periods after the first
+	// one.  If one or more of them have already passed, skip them rather than
+	// running the task several times in a row.
+	task->deadline = timens_add(task->deadline, task->period);
+	if (task->deadline <= now) {
+		missed = timens_sub(now, task->deadline) / task->period + 1;
+		task->deadline = timens_add(task->deadline, missed * task->period);
+	}
+
+	pthread_mutex_lock(&sched->lock);
+	if ((task->stats.runs == 0) || (jitter < task->stats.minJitter)) {
+		task->stats.minJitter = jitter;
+	}
+	if ((task->stats.runs == 0) || (jitter > task->stats.maxJitter)) {
+		task->stats.maxJitter = jitter;
+	}
+	task->stats.totalJitter = timens_add(task->stats.totalJitter, jitter);
+	task->stats.missed += missed;
+	task->stats.runs++;
+	pthread_mutex_unlock(&sched->lock);
+}
+
+/*******************************************************************************
+ * This method is the body of the scheduler thread.
+ * @param void *arg - This is the scheduler.
+ * @return Always NULL.
+ ******************************************************************************/
+static void* scheduler_thread(void *arg)
+{
+	struct scheduler *sched = (struct scheduler*)arg;
+	struct timespec wake;
+	timens_t next, now;
+	uint32_t id;
+
+	// Cancellation is only allowed while sleeping, so a task is never cut short.
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+	for (;;) {
+		next = TIMENS_MAX;
+		for (id = 0; id < sched->taskCount; id++) {
+			if (sched->tasks[id].deadline < next) {
+				next = sched->tasks[id].deadline;
+			}
+		}
+
+		timens_to_timespec(next, &wake);
+		pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL) == EINTR) {
+		}
+		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+		now = timens_now(CLOCK_MONOTONIC);
+		for (id = 0; id < sched->taskCount; id++) {
+			if (sched->tasks[id].deadline <= now) {
+				scheduler_run_task(sched, id, now);
+			}
+		}
+	}
+	return NULL;
+}
+
+/*******************************************************************************
+ * This method will initialize a scheduler without any tasks.
+ * @param struct scheduler *sched - This is the scheduler that is to be initialized.
+ ******************************************************************************/
+void scheduler_init(struct scheduler *sched)
+{
+	memset(sched, 0, sizeof(*sched));
+	pthread_mutex_init(&sched->lock, NULL);
+}
+
+/*******************************************************************************
+ * This method will add a task to the table.
+ * @param struct scheduler *sched - This is the scheduler.
+ * @param timens_t period - This is the period of the task.
+ * @return A pointer to the new task, or NULL if it cannot be added.
+ ******************************************************************************/
+static struct scheduler_task* scheduler_new_task(struct scheduler *sched, timens_t period)
+{
+	struct scheduler_task *task;
+
+	if (sched->started || (sched->taskCount == SCHEDULER_MAX_TASKS) || (period <= 0)) {
+		errno = EINVAL;
+		return NULL;
+	}
+	task = &sched->tasks[sched->taskCount];
+	memset(task, 0, sizeof(*task));
+	task->pin = SCHEDULER_NO_PIN;
+	task->period = period;
+	sched->taskCount++;
+	return task;
+}
+
+/*******************************************************************************
+ * This method will add a task which toggles an output pin once per period.
+ * Tasks must be added before the scheduler is started.
+ * @param struct scheduler *sched - This is the scheduler.
+ * @param uint32_t gpio - This is the pin, which must already be an output.
+ * @param timens_t period - This is the time between toggles.
+ * @return The task number, or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t scheduler_add_pin(struct scheduler *sched, uint32_t gpio, timens_t period)
+{
+	struct scheduler_task *task = scheduler_new_task(sched, period);
+
+	if (task == NULL) {
+		return -1;
+	}
+	task->pin = gpio;
+	return sched->taskCount - 1;
+}
+
+/*******************************************************************************
+ * This method will add a task which calls the given function once per period.
+ * Tasks must be added before the scheduler is started.
+ * @param struct scheduler *sched - This is the scheduler.
+ * @param timens_t period - This is the time between calls.
+ * @param scheduler_task_cb cb - This is the function.
+ * @param void *ctx - This is passed back to the function.
+ * @return The task number, or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t scheduler_add_task(struct scheduler *sched, timens_t period, scheduler_task_cb cb, void *ctx)
+{
+	struct scheduler_task *task = scheduler_new_task(sched, period);
+
+	if (task == NULL) {
+		return -1;
+	}
+	task->cb = cb;
+	task->ctx = ctx;
+	return sched->taskCount - 1;
+}
+
+/*******************************************************************************
+ * This method will start the scheduler thread.  The first deadline of every
+ * task is one period from now.
+ * @param struct scheduler *sched - This is the scheduler.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t scheduler_start(struct scheduler *sched)
+{
+	timens_t now = timens_now(CLOCK_MONOTONIC);
+	uint32_t id;
+	int32_t rc;
+
+	if (sched->taskCount == 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	for (id = 0; id < sched->taskCount; id++) {
+		sched->tasks[id].deadline = timens_add(now, sched->tasks[id].period);
+	}
+
+	rc = pthread_create(&sched->thread, NULL, scheduler_thread, sched);
+	if (rc != 0) {
+		errno = rc;
+		log_perror("scheduler/start");
+		return -1;
+	}
+	sched->started = 1;
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will stop and join the scheduler thread.
+ * @param struct scheduler *sched - This is the scheduler.
+ ******************************************************************************/
+void scheduler_stop(struct scheduler *sched)
+{
+	if (sched->started) {
+		pthread_cancel(sched->thread);
+		pthread_join(sched->thread, NULL);
+		sched->started = 0;
+	}
+}
+
+/*******************************************************************************
+ * This method will copy the statistics of a task.  It may be called while the
+ * scheduler is running.
+ * @param struct scheduler *sched - This is the scheduler.
+ * @param uint32_t task - This is the task number.
+ * @param struct scheduler_stats *stats - This is where the statistics are placed.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t scheduler_get_stats(struct scheduler *sched, uint32_t task, struct scheduler_stats *stats)
+{
+	if (task >= sched->taskCount) {
+		errno = EINVAL;
+		return -1;
+	}
+	pthread_mutex_lock(&sched->lock);
+	*stats = sched->tasks[task].stats;
+	pthread_mutex_unlock(&sched->lock);
+	return 0;
+}
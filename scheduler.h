@@ -0,0 +1,101 @@
+/*********************************************************************
+ * This module runs periodic tasks, such as blinking output pins, from a
+ * single thread.  Every task has its own period and an absolute deadline
+ * which advances by exactly one period each time it runs, and the thread
+ * sleeps with clock_nanosleep(TIMER_ABSTIME) until the earliest deadline,
+ * so timing errors never accumulate.
+ *
+ * For every task the scheduler counts missed deadlines and keeps statistics
+ * on the wakeup jitter (how late the task ran relative to its deadline).
+ */
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include "timeutil.h"
+
+#define SCHEDULER_MAX_TASKS (16)
+#define SCHEDULER_NO_PIN (0xFFFFFFFFu)
+
+// Called each period by a task that was added with scheduler_add_task.
+typedef void (*scheduler_task_cb)(uint32_t task, void *ctx);
+
+struct scheduler_stats {
+	uint64_t runs;
+	uint64_t missed;	// Periods skipped because the task ran more than a period late
+	timens_t minJitter;
+	timens_t maxJitter;
+	timens_t totalJitter;	// Divide by runs for the mean
+};
+
+struct scheduler_task {
+	uint32_t pin;		// SCHEDULER_NO_PIN for callback tasks
+	uint32_t level;
+	timens_t period;
+	timens_t deadline;
+	scheduler_task_cb cb;
+	void *ctx;
+	struct scheduler_stats stats;
+};
+
+struct scheduler {
+	pthread_t thread;
+	pthread_mutex_t lock;	// Protects the statistics
+	uint32_t taskCount;
+	uint8_t started;
+	struct scheduler_task tasks[SCHEDULER_MAX_TASKS];
+};
+
+/*******************************************************************************
+ * This method will initialize a scheduler without any tasks.
+ * @param struct scheduler *sched - This is the scheduler that is to be initialized.
+ ******************************************************************************/
+void scheduler_init(struct scheduler *sched);
+
+/*******************************************************************************
+ * This method will add a task which toggles an output pin once per period.
+ * Tasks must be added before the scheduler is started.
+ * @param struct scheduler *sched - This is the scheduler.
+ * @param uint32_t gpio - This is the pin, which must already be an output.
+ * @param timens_t period - This is the time between toggles.
+ * @return The task number, or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t scheduler_add_pin(struct scheduler *sched, uint32_t gpio, timens_t period);
+
+/*******************************************************************************
+ * This method will add a task which calls the given function once per period.
+ * Tasks must be added before the scheduler is started.
+ * @param struct scheduler *sched - This is the scheduler.
+ * @param timens_t period - This is the time between calls.
+ * @param scheduler_task_cb cb - This is the function.
+ * @param void *ctx - This is passed back to the function.
+ * @return The task number, or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t scheduler_add_task(struct scheduler *sched, timens_t period, scheduler_task_cb cb, void *ctx);
+
+/*******************************************************************************
+ * This method will start the scheduler thread.  The first deadline of every
+ * task is one period from now.
+ * @param struct scheduler *sched - This is the scheduler.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t scheduler_start(struct scheduler *sched);
+
+/*******************************************************************************
+ * This method will stop and join the scheduler thread.
+ * @param struct scheduler *sched - This is the scheduler.
+ ******************************************************************************/
+void scheduler_stop(struct scheduler *sched);
+
+/*******************************************************************************
+ * This method will copy the statistics of a task.  It may be called while the
+ * scheduler is running.
+ * @param struct scheduler *sched - This is the scheduler.
+ * @param uint32_t task - This is the task number.
+ * @param struct scheduler_stats *stats - This is where the statistics are placed.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t scheduler_get_stats(struct scheduler *sched, uint32_t task, struct scheduler_stats *stats);
+
+#endif
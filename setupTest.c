@@ -0,0 +1,168 @@
+/*********************************************************************
+ * This program checks gpio_setup_pins against the mock character devices.
+ * The table is the game's, with more pins added on gpiochip1, so several
+ * threads set up lines which share one request and regroup it as they go.
+ * The table is set up and released many times, and each time every pin is
+ * checked.  It also checks that a backend not marked threadSafe is set up
+ * by the calling thread alone.  The exit status is 0 if every check passed.
+ *   make -f makefile.bb CC=gcc check
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include "gpioInterface.h"
+#include "gpioCdevMock.h"
+#include "gpioSetup.h"
+
+#define RUNS (500)
+#define ROW_COUNT (8)
+
+// The rows.  48, 49, 44 and 26 are the game's switches and LEDs; 44 to 48
+// are all on gpiochip1.
+static const struct gpio_pin_setup rows[ROW_COUNT] = {
+	{ .pin = 48, .edge = GPIO_BOTH_EDGES, .openFd = 1 },
+	{ .pin = 44, .out = 1, .level = 1 },
+	{ .pin = 49, .edge = GPIO_BOTH_EDGES, .openFd = 1 },
+	{ .pin = 26, .out = 1 },
+	{ .pin = 45, .out = 1 },
+	{ .pin = 46, .out = 1, .level = 1 },
+	{ .pin = 47 },
+	{ .pin = 61, .edge = GPIO_RISING_EDGE, .openFd = 1 }
+};
+
+static uint32_t failures;
+static uint32_t checks;
+static pthread_t caller;
+static uint32_t otherThreads;
+static const struct gpio_backend *inner;
+
+/*******************************************************************************
+ * This method will record the result of one check, and print it if it failed.
+ * @param int ok - This is nonzero if the check passed.
+ * @param uint32_t run - This is the run.
+ * @param uint32_t pin - This is the pin checked.
+ * @param const char *what - This is what was checked.
+ ******************************************************************************/
+static void expect(int ok, uint32_t run, uint32_t pin, const char *what)
+{
+	checks++;
+	if (ok) {
+		return;
+	}
+	if (failures++ < 20) {
+		printf("FAIL run %u GPIO %u: %s\n", run, pin, what);
+	}
+}
+
+/*******************************************************************************
+ * This method will export a pin through the wrapped backend, counting the
+ * exports made from other threads than the one which started the setup.
+ * @param uint32_t gpio - This is the pin.
+ * @return The return of the wrapped backend.
+ ******************************************************************************/
+static int32_t serial_export(uint32_t gpio)
+{
+	if (!pthread_equal(pthread_self(), caller)) {
+		__atomic_add_fetch(&otherThreads, 1, __ATOMIC_RELAXED);
+	}
+	return inner->export_pin(gpio);
+}
+
+/*******************************************************************************
+ * This method will set up the table once, check each pin and release them.
+ * @param uint32_t run - This is the run.
+ ******************************************************************************/
+static void check_run(uint32_t run)
+{
+	struct gpio_pin_setup table[ROW_COUNT];
+	struct gpio_fd_event event;
+	uint32_t outputs[ROW_COUNT];
+	uint32_t highs[ROW_COUNT];
+	uint32_t index, count = 0, value;
+
+	memcpy(table, rows, sizeof(table));
+	expect(gpio_setup_pins(table, ROW_COUNT) == 0, run, 0, "gpio_setup_pins");
+
+	for (index = 0; index < ROW_COUNT; index++) {
+		expect(table[index].rc == 0, run, table[index].pin, "row rc");
+		if (table[index].openFd) {
+			expect(table[index].fd >= 0, run, table[index].pin, "descriptor");
+		}
+		if (table[index].out) {
+			expect((gpio_cdev_mock_read(table[index].pin, &value) == 0) && (value == table[index].level),
+				run, table[index].pin, "starting level");
+			outputs[count] = table[index].pin;
+			highs[count++] = 1;
+		}
+	}
+
+	// The outputs are written together, and the edges still reach their descriptors.
+	expect(gpio_set_values(outputs, highs, count) == 0, run, 0, "gpio_set_values");
+	for (index = 0; index < ROW_COUNT; index++) {
+		if (table[index].out) {
+			expect((gpio_cdev_mock_read(table[index].pin, &value) == 0) && (value == 1),
+				run, table[index].pin, "level after gpio_set_values");
+		} else if (table[index].fd >= 0) {
+			expect(gpio_cdev_mock_inject(table[index].pin, 1) == 1, run, table[index].pin, "edge queued");
+			expect((gpio_fd_read_event(table[index].fd, &event) == 0) && (event.value == 1),
+				run, table[index].pin, "edge read");
+			(void)gpio_cdev_mock_inject(table[index].pin, 0);
+		}
+	}
+
+	for (index = 0; index < ROW_COUNT; index++) {
+		if (table[index].fd >= 0) {
+			(void)gpio_fd_close(table[index].fd);
+		}
+		expect(gpio_unexport(table[index].pin) == 0, run, table[index].pin, "gpio_unexport");
+	}
+}
+
+/*******************************************************************************
+ * This method will check that a backend which is not threadSafe is set up by
+ * the calling thread alone.
+ ******************************************************************************/
+static void check_serial(void)
+{
+	struct gpio_backend serial;
+	struct gpio_pin_setup table[ROW_COUNT];
+	uint32_t index;
+
+	inner = gpio_get_backend();
+	serial = *inner;
+	serial.export_pin = serial_export;
+	serial.threadSafe = 0;
+	caller = pthread_self();
+	gpio_set_backend(&serial);
+
+	memcpy(table, rows, sizeof(table));
+	expect(gpio_setup_pins(table, ROW_COUNT) == 0, RUNS, 0, "serial gpio_setup_pins");
+	expect(otherThreads == 0, RUNS, 0, "serial setup stayed on the calling thread");
+	for (index = 0; index < ROW_COUNT; index++) {
+		if (table[index].fd >= 0) {
+			(void)gpio_fd_close(table[index].fd);
+		}
+		(void)gpio_unexport(table[index].pin);
+	}
+	gpio_set_backend(inner);
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t run;
+
+	if (gpio_cdev_mock_start() < 0) {
+		printf("setup: the mock chips could not be started\n");
+		return 1;
+	}
+	expect(gpio_get_backend()->threadSafe != 0, 0, 0, "cdev backend is threadSafe");
+	for (run = 0; run < RUNS; run++) {
+		check_run(run);
+	}
+	check_serial();
+	gpio_cdev_mock_stop();
+
+	printf("setup: %u checks, %u failed\n", checks, failures);
+	return (failures == 0) ? 0 : 1;
+}
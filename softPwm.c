@@ -0,0 +1,334 @@
+/*********************************************************************
+ * This module generates software PWM on ordinary output pins, for dimming
+ * LEDs and driving buzzers on pins without a hardware PWM.
+ *
+ * A dedicated thread (SCHED_FIFO when permitted) computes the next edge of
+ * every channel, sleeps until the earliest one on an absolute deadline and
+ * then performs every edge that falls within the same tick with one
+ * gpio_set_values call.  Each channel has its own frequency and duty cycle,
+ * and the engine measures the frequency and duty cycle it actually achieved.
+ * Locking the memory of the process is left to its realtime setup (see
+ * realtime.h).
+ */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "gpioInterface.h"
+#include "timeutil.h"
+#include "softPwm.h"
+#include "asyncLog.h"
+
+#define PHASE_RISE (0)	// The next edge is the start of a period
+#define PHASE_FALL (1)	// The next edge is the end of the high time
+
+/*******************************************************************************
+ * This method will handle the start of a period on a channel.  The pin is
+ * written by the caller, together with the other edges of the tick.
+ * @param struct soft_pwm *pwm - This is the engine.
+ * @param struct soft_pwm_channel *ch - This is the channel.
+ * @param timens_t now - This is the current time.
+ * @return Non zero if the level of the channel changed.
+ ******************************************************************************/
+static uint32_t soft_pwm_rise(struct soft_pwm *pwm, struct soft_pwm_channel *ch, timens_t now)
+{
+	timens_t high, late;
+	uint64_t skipped = 0;
+	uint32_t changed = 0;
+
+	// If whole periods have gone by, start again from the latest period boundary.
+	late = timens_sub(now, ch->periodStart);
+	if (late >= ch->period) {
+		skipped = late / ch->period;
+		ch->periodStart = timens_add(ch->periodStart, skipped * ch->period);
+	}
+
+	pthread_mutex_lock(&pwm->lock);
+	if (ch->lastRise != 0) {
+		ch->periods++;
+		ch->totalPeriod += timens_sub(now, ch->lastRise);
+		if (ch->level) {
+			// The pin stayed high for the whole period (100% duty).
+			ch->totalHigh += timens_sub(now, ch->lastRise);
+		}
+	}
+	ch->missed += skipped;
+	pthread_mutex_unlock(&pwm->lock);
+	ch->lastRise = now;
+
+	high = ch->period * __atomic_load_n(&ch->duty, __ATOMIC_RELAXED) / SOFT_PWM_DUTY_SCALE;
+	if ((high > 0) != ch->level) {
+		ch->level = (high > 0);
+		changed = 1;
+	}
+
+	if ((high > 0) && (high < ch->period)) {
+		ch->nextEdge = timens_add(ch->periodStart, high);
+	} else {
+		ch->periodStart = timens_add(ch->periodStart, ch->period);
+		ch->nextEdge = ch->periodStart;
+	}
+	return changed;
+}
+
+/*******************************************************************************
+ * This method will handle the end of the high time on a channel.  The pin is
+ * written by the caller, together with the other edges of the tick.
+ * @param struct soft_pwm *pwm - This is the engine.
+ * @param struct soft_pwm_channel *ch - This is the channel.
+ * @param timens_t now - This is the current time.
+ ******************************************************************************/
+static void soft_pwm_fall(struct soft_pwm *pwm, struct soft_pwm_channel *ch, timens_t now)
+{
+	ch->level = 0;
+
+	pthread_mutex_lock(&pwm->lock);
+	ch->totalHigh += timens_sub(now, ch->lastRise);
+	pthread_mutex_unlock(&pwm->lock);
+
+	ch->periodStart = timens_add(ch->periodStart, ch->period);
+	ch->nextEdge = ch->periodStart;
+}
+
+/*******************************************************************************
+ * This method is the body of the PWM thread.
+ * @param void *arg - This is the engine.
+ * @return Always NULL.
+ ******************************************************************************/
+static void* soft_pwm_thread(void *arg)
+{
+	struct soft_pwm *pwm = (struct soft_pwm*)arg;
+	struct soft_pwm_channel *ch;
+	struct timespec wake;
+	timens_t next, now;
+	uint32_t pins[SOFT_PWM_MAX_CHANNELS];
+	uint32_t levels[SOFT_PWM_MAX_CHANNELS];
+	uint32_t id, count;
+	int32_t policy;
+	struct sched_param param;
+
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+	if ((pthread_getschedparam(pthread_self(), &policy, &param) == 0) && (policy == SCHED_FIFO)) {
+		pwm->realtime = 1;
+	}
+
+	for (;;) {
+		next = TIMENS_MAX;
+		for (id = 0; id < pwm->channelCount; id++) {
+			if (pwm->channels[id].nextEdge < next) {
+				next = pwm->channels[id].nextEdge;
+			}
+		}
+
+		timens_to_timespec(next, &wake);
+		pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL) == EINTR) {
+		}
+		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+		// Collect every edge due within this tick, then write them together.
+		now = timens_now(CLOCK_MONOTONIC);
+		count = 0;
+		for (id = 0; id < pwm->channelCount; id++) {
+			ch = &pwm->channels[id];
+			if (ch->nextEdge > timens_add(now, SOFT_PWM_TICK_NS)) {
+				continue;
+			}
+			if (ch->nextEdge == ch->periodStart) {
+				if (!soft_pwm_rise(pwm, ch, now)) {
+					continue;
+				}
+			} else {
+				soft_pwm_fall(pwm, ch, now);
+			}
+			pins[count] = ch->pin;
+			levels[count++] = ch->level;
+		}
+		if (count > 0) {
+			(void)gpio_set_values(pins, levels, count);
+		}
+	}
+	return NULL;
+}
+
+/*******************************************************************************
+ * This method will initialize a PWM engine without any channels.
+ * @param struct soft_pwm *pwm - This is the engine that is to be initialized.
+ * @param int32_t priority - This is the SCHED_FIFO priority of the PWM thread,
+ *                           or 0 to run it as a normal thread.
+ ******************************************************************************/
+void soft_pwm_init(struct soft_pwm *pwm, int32_t priority)
+{
+	memset(pwm, 0, sizeof(*pwm));
+	pthread_mutex_init(&pwm->lock, NULL);
+	pwm->priority = priority;
+}
+
+/*******************************************************************************
+ * This method will add a channel.  Channels must be added before the engine
+ * is started.
+ * @param struct soft_pwm *pwm - This is the engine.
+ * @param uint32_t gpio - This is the pin, which must already be an output.
+ * @param uint32_t frequency - This is the PWM frequency in Hz.
+ * @param uint32_t duty - This is the duty cycle in parts per thousand.
+ * @return The channel number, or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t soft_pwm_add_channel(struct soft_pwm *pwm, uint32_t gpio, uint32_t frequency, uint32_t duty)
+{
+	struct soft_pwm_channel *ch;
+
+	if (pwm->started || (pwm->channelCount == SOFT_PWM_MAX_CHANNELS) ||
+		(frequency == 0) || (duty > SOFT_PWM_DUTY_SCALE)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	ch = &pwm->channels[pwm->channelCount];
+	memset(ch, 0, sizeof(*ch));
+	ch->pin = gpio;
+	ch->period = NSEC_PER_SEC / frequency;
+	ch->duty = duty;
+	return pwm->channelCount++;
+}
+
+/*******************************************************************************
+ * This method will change the duty cycle of a channel.  The change takes
+ * effect at the start of the next period.  It may be called while running.
+ * @param struct soft_pwm *pwm - This is the engine.
+ * @param uint32_t channel - This is the channel number.
+ * @param uint32_t duty - This is the duty cycle in parts per thousand.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t soft_pwm_set_duty(struct soft_pwm *pwm, uint32_t channel, uint32_t duty)
+{
+	if ((channel >= pwm->channelCount) || (duty > SOFT_PWM_DUTY_SCALE)) {
+		errno = EINVAL;
+		return -1;
+	}
+	__atomic_store_n(&pwm->channels[channel].duty, duty, __ATOMIC_RELAXED);
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will start the PWM thread.  The thread is made SCHED_FIFO if a
+ * priority was given; if that is not permitted the engine still runs, as an
+ * ordinary thread.
+ * @param struct soft_pwm *pwm - This is the engine.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t soft_pwm_start(struct soft_pwm *pwm)
+{
+	pthread_attr_t attr;
+	struct sched_param param;
+	timens_t start;
+	uint32_t pins[SOFT_PWM_MAX_CHANNELS];
+	uint32_t lows[SOFT_PWM_MAX_CHANNELS] = { 0 };
+	uint32_t id;
+	int32_t rc = -1;
+
+	if (pwm->channelCount == 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	// Start every channel low, with the first period a little in the future.
+	start = timens_add(timens_now(CLOCK_MONOTONIC), timens_from_ms(1));
+	for (id = 0; id < pwm->channelCount; id++) {
+		pwm->channels[id].level = 0;
+		pwm->channels[id].periodStart = start;
+		pwm->channels[id].nextEdge = start;
+		pins[id] = pwm->channels[id].pin;
+	}
+	(void)gpio_set_values(pins, lows, pwm->channelCount);
+
+	if (pwm->priority > 0) {
+		pthread_attr_init(&attr);
+		pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+		pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+		param.sched_priority = pwm->priority;
+		pthread_attr_setschedparam(&attr, &param);
+		rc = pthread_create(&pwm->thread, &attr, soft_pwm_thread, pwm);
+		pthread_attr_destroy(&attr);
+		if (rc != 0) {
+			errno = rc;
+			log_perror("softpwm/SCHED_FIFO");
+		}
+	}
+	if (rc != 0) {
+		rc = pthread_create(&pwm->thread, NULL, soft_pwm_thread, pwm);
+	}
+	if (rc != 0) {
+		errno = rc;
+		log_perror("softpwm/start");
+		return -1;
+	}
+	pwm->started = 1;
+	return 0;
+}
+
+/*******************************************************************************
+ * This method will stop the PWM thread and drive every channel low.
+ * @param struct soft_pwm *pwm - This is the engine.
+ ******************************************************************************/
+void soft_pwm_stop(struct soft_pwm *pwm)
+{
+	uint32_t pins[SOFT_PWM_MAX_CHANNELS];
+	uint32_t lows[SOFT_PWM_MAX_CHANNELS] = { 0 };
+	uint32_t id;
+
+	if (!pwm->started) {
+		return;
+	}
+	pthread_cancel(pwm->thread);
+	pthread_join(pwm->thread, NULL);
+	pwm->started = 0;
+
+	for (id = 0; id < pwm->channelCount; id++) {
+		pwm->channels[id].level = 0;
+		pins[id] = pwm->channels[id].pin;
+	}
+	(void)gpio_set_values(pins, lows, pwm->channelCount);
+}
+
+/*******************************************************************************
+ * This method will report the frequency and duty cycle achieved by a channel.
+ * @param struct soft_pwm *pwm - This is the engine.
+ * @param uint32_t channel - This is the channel number.
+ * @param struct soft_pwm_report *report - This is where the report is placed.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t soft_pwm_get_report(struct soft_pwm *pwm, uint32_t channel, struct soft_pwm_report *report)
+{
+	struct soft_pwm_channel *ch;
+	uint64_t periods;
+	timens_t totalPeriod, totalHigh;
+
+	if (channel >= pwm->channelCount) {
+		errno = EINVAL;
+		return -1;
+	}
+	ch = &pwm->channels[channel];
+
+	pthread_mutex_lock(&pwm->lock);
+	periods = ch->periods;
+	totalPeriod = ch->totalPeriod;
+	totalHigh = ch->totalHigh;
+	report->missed = ch->missed;
+	pthread_mutex_unlock(&pwm->lock);
+
+	report->requestedHz = (double)NSEC_PER_SEC / ch->period;
+	report->requestedDuty = (double)__atomic_load_n(&ch->duty, __ATOMIC_RELAXED) / SOFT_PWM_DUTY_SCALE;
+	if (totalPeriod > 0) {
+		report->achievedHz = (double)periods * NSEC_PER_SEC / totalPeriod;
+		report->achievedDuty = (double)totalHigh / totalPeriod;
+	} else {
+		report->achievedHz = 0.0;
+		report->achievedDuty = 0.0;
+	}
+	report->frequencyError = report->achievedHz - report->requestedHz;
+	report->dutyError = report->achievedDuty - report->requestedDuty;
+	return 0;
+}
@@ -0,0 +1,113 @@
+/*********************************************************************
+ * This module generates software PWM on ordinary output pins, for dimming
+ * LEDs and driving buzzers on pins without a hardware PWM.
+ *
+ * A dedicated thread (SCHED_FIFO when permitted) computes the next edge of
+ * every channel, sleeps until the earliest one on an absolute deadline and
+ * then performs every edge that falls within the same tick with one
+ * gpio_set_values call.  Each channel has its own frequency and duty cycle,
+ * and the engine measures the frequency and duty cycle it actually achieved.
+ * Locking the memory of the process is left to its realtime setup (see
+ * realtime.h).
+ */
+#ifndef SOFTPWM_H
+#define SOFTPWM_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include "timeutil.h"
+
+#define SOFT_PWM_MAX_CHANNELS (8)
+#define SOFT_PWM_TICK_NS (20000)	// Edges this close together are written in one pass
+#define SOFT_PWM_DUTY_SCALE (1000)	// Duty cycles are given in parts per thousand
+#define SOFT_PWM_DEFAULT_PRIORITY (20)	// Below the input handling, which should run higher
+
+struct soft_pwm_channel {
+	uint32_t pin;
+	timens_t period;
+	uint32_t duty;		// Parts per thousand; may be changed while running
+	uint32_t level;
+	timens_t periodStart;	// Deadline of the current rising edge
+	timens_t nextEdge;
+	// Measured by the PWM thread.
+	timens_t lastRise;
+	uint64_t periods;
+	timens_t totalPeriod;
+	timens_t totalHigh;
+	uint64_t missed;
+};
+
+struct soft_pwm_report {
+	double requestedHz;
+	double achievedHz;
+	double requestedDuty;	// 0.0 - 1.0
+	double achievedDuty;
+	double frequencyError;	// achieved - requested, in Hz
+	double dutyError;	// achieved - requested
+	uint64_t missed;	// Periods skipped because the thread ran too late
+};
+
+struct soft_pwm {
+	pthread_t thread;
+	pthread_mutex_t lock;	// Protects the measurements
+	int32_t priority;
+	uint8_t started;
+	uint8_t realtime;	// Set once the thread is running under SCHED_FIFO
+	uint32_t channelCount;
+	struct soft_pwm_channel channels[SOFT_PWM_MAX_CHANNELS];
+};
+
+/*******************************************************************************
+ * This method will initialize a PWM engine without any channels.
+ * @param struct soft_pwm *pwm - This is the engine that is to be initialized.
+ * @param int32_t priority - This is the SCHED_FIFO priority of the PWM thread,
+ *                           or 0 to run it as a normal thread.
+ ******************************************************************************/
+void soft_pwm_init(struct soft_pwm *pwm, int32_t priority);
+
+/*******************************************************************************
+ * This method will add a channel.  Channels must be added before the engine
+ * is started.
+ * @param struct soft_pwm *pwm - This is the engine.
+ * @param uint32_t gpio - This is the pin, which must already be an output.
+ * @param uint32_t frequency - This is the PWM frequency in Hz.
+ * @param uint32_t duty - This is the duty cycle in parts per thousand.
+ * @return The channel number, or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t soft_pwm_add_channel(struct soft_pwm *pwm, uint32_t gpio, uint32_t frequency, uint32_t duty);
+
+/*******************************************************************************
+ * This method will change the duty cycle of a channel.  The change takes
+ * effect at the start of the next period.  It may be called while running.
+ * @param struct soft_pwm *pwm - This is the engine.
+ * @param uint32_t channel - This is the channel number.
+ * @param uint32_t duty - This is the duty cycle in parts per thousand.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t soft_pwm_set_duty(struct soft_pwm *pwm, uint32_t channel, uint32_t duty);
+
+/*******************************************************************************
+ * This method will start the PWM thread.  The thread is made SCHED_FIFO if a
+ * priority was given; if that is not permitted the engine still runs, as an
+ * ordinary thread.
+ * @param struct soft_pwm *pwm - This is the engine.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t soft_pwm_start(struct soft_pwm *pwm);
+
+/*******************************************************************************
+ * This method will stop the PWM thread and drive every channel low.
+ * @param struct soft_pwm *pwm - This is the engine.
+ ******************************************************************************/
+void soft_pwm_stop(struct soft_pwm *pwm);
+
+/*******************************************************************************
+ * This method will report the frequency and duty cycle achieved by a channel.
+ * @param struct soft_pwm *pwm - This is the engine.
+ * @param uint32_t channel - This is the channel number.
+ * @param struct soft_pwm_report *report - This is where the report is placed.
+ * @return The return will be 0 if successful or a negative number if an error occurs.
+ ******************************************************************************/
+int32_t soft_pwm_get_report(struct soft_pwm *pwm, uint32_t channel, struct soft_pwm_report *report);
+
+#endif
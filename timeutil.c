@@ -13,26 +13,17 @@
  *                                  populated with a timing result.
  * @param struct timespec *x - This is a pointer to a structure that will be populated 
  *                             with a timing result.  This is the starting time.
+ *                             It is not modified.
  * @param struct timespec *y - This is a pointer to a structure that will be populated 
  *                             with a timing result.  This is the ending time.
  * @return The return will be 0 if the difference is positive.  Non zero if negative.
  ******************************************************************************/
 int  timeval_subtract (  struct timespec  *result, struct timespec *x,struct timespec *y)
 {
-	long nsecDelta = x->tv_nsec - y->tv_nsec;
-	time_t secDelta;
-	   
-	if (nsecDelta < 0)
-	{
-		nsecDelta += 1000000000;
-		x->tv_sec-=1;
-	}
- 	secDelta = x->tv_sec - y->tv_sec;
-	   
-	result->tv_sec = secDelta;
-	result->tv_nsec = nsecDelta;
-	   
-	return (secDelta<0);
+	timens_t delta = timens_sub(timens_from_timespec(x), timens_from_timespec(y));
+
+	timens_to_timespec(delta, result);
+	return (delta<0);
 }
 	 
 /*******************************************************************************
@@ -47,19 +38,10 @@ int  timeval_subtract (  struct timespec  *result, struct timespec *x,struct tim
  ******************************************************************************/
 int  timeval_add (  struct timespec  *result, struct timespec *x,struct timespec *y)
 {
-	long nsec = x->tv_nsec + y->tv_nsec;
-	time_t secDelta = x->tv_sec + y->tv_sec;
-	   
-	if (nsec > 1000000000)
-	{
-		nsec -= 1000000000;
-		secDelta++;
-	}
-	   
-	result->tv_sec = secDelta;
-	result->tv_nsec = nsec;
+	timens_t sum = timens_add(timens_from_timespec(x), timens_from_timespec(y));
 
-	return (secDelta<0);
+	timens_to_timespec(sum, result);
+	return (sum<0);
 }
 	 
 /*******************************************************************************
@@ -70,11 +52,6 @@ int  timeval_add (  struct timespec  *result, struct timespec *x,struct timespec
  ******************************************************************************/
 uint32_t timespectoms(struct timespec *structure)
 {
-  uint32_t returnValue;
-	   
-  returnValue = structure -> tv_nsec / 1000000;
-  returnValue += structure -> tv_sec * 1000;
-
-  return returnValue;
+  return (uint32_t)timens_to_ms(timens_from_timespec(structure));
 }
 	 
\ No newline at end of file
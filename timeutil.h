@@ -3,12 +3,142 @@
  * the difference between two times, as well as a method which will sum time, 
  * and a method which will convert time from units into ms.
  * Created by Walter Schilling, Winter 2013-2014.
+ *
+ * Times may also be handled as a single signed 64 bit count of nanoseconds
+ * (timens_t), which covers roughly +/- 292 years.  The timens_ routines are
+ * static inline so that they fold away on hot paths; additions and
+ * subtractions saturate instead of wrapping.
  */
 #ifndef TIMEUTIL_H
 #define TIMEUTIL_H
 
 #include <time.h>
 #include <stdint.h>
+
+#define NSEC_PER_SEC (1000000000LL)
+#define NSEC_PER_MSEC (1000000LL)
+#define NSEC_PER_USEC (1000LL)
+#define TIMENS_MAX (INT64_MAX)
+#define TIMENS_MIN (INT64_MIN)
+
+// A time or a time difference in nanoseconds.
+typedef int64_t timens_t;
+
+/*******************************************************************************
+ * This method will convert a timespec structure into nanoseconds.
+ * @param const struct timespec *ts - This is the time that is to be converted.
+ * @return The number of nanoseconds, saturated to the range of timens_t.
+ ******************************************************************************/
+static inline timens_t timens_from_timespec(const struct timespec *ts)
+{
+	timens_t sec;
+
+	if (__builtin_mul_overflow((timens_t)ts->tv_sec, NSEC_PER_SEC, &sec)) {
+		return (ts->tv_sec < 0) ? TIMENS_MIN : TIMENS_MAX;
+	}
+	if (__builtin_add_overflow(sec, (timens_t)ts->tv_nsec, &sec)) {
+		return (ts->tv_nsec < 0) ? TIMENS_MIN : TIMENS_MAX;
+	}
+	return sec;
+}
+
+/*******************************************************************************
+ * This method will convert nanoseconds into a normalized timespec structure.
+ * tv_nsec is always in [0, 999999999], so negative times have a negative tv_sec.
+ * @param timens_t t - This is the time that is to be converted.
+ * @param struct timespec *ts - This is where the result is placed.
+ ******************************************************************************/
+static inline void timens_to_timespec(timens_t t, struct timespec *ts)
+{
+	timens_t sec = t / NSEC_PER_SEC;
+	timens_t nsec = t % NSEC_PER_SEC;
+
+	// C division truncates toward zero; move the remainder into [0, 1 s).
+	sec -= (nsec < 0);
+	nsec += (nsec < 0) * NSEC_PER_SEC;
+
+	ts->tv_sec = (time_t)sec;
+	ts->tv_nsec = (long)nsec;
+}
+
+/*******************************************************************************
+ * This method will add two times, saturating instead of overflowing.
+ * @param timens_t a - This is the first time.
+ * @param timens_t b - This is the second time.
+ * @return a + b.
+ ******************************************************************************/
+static inline timens_t timens_add(timens_t a, timens_t b)
+{
+	timens_t sum;
+
+	if (__builtin_add_overflow(a, b, &sum)) {
+		return (b < 0) ? TIMENS_MIN : TIMENS_MAX;
+	}
+	return sum;
+}
+
+/*******************************************************************************
+ * This method will subtract two times, saturating instead of overflowing.
+ * @param timens_t a - This is the later time.
+ * @param timens_t b - This is the earlier time.
+ * @return a - b.
+ ******************************************************************************/
+static inline timens_t timens_sub(timens_t a, timens_t b)
+{
+	timens_t diff;
+
+	if (__builtin_sub_overflow(a, b, &diff)) {
+		return (b < 0) ? TIMENS_MAX : TIMENS_MIN;
+	}
+	return diff;
+}
+
+/*******************************************************************************
+ * These methods convert between nanoseconds and coarser units.  Conversions
+ * down truncate toward zero; conversions up saturate.
+ ******************************************************************************/
+static inline int64_t timens_to_us(timens_t t)
+{
+	return t / NSEC_PER_USEC;
+}
+
+static inline int64_t timens_to_ms(timens_t t)
+{
+	return t / NSEC_PER_MSEC;
+}
+
+static inline timens_t timens_from_us(int64_t us)
+{
+	timens_t t;
+
+	if (__builtin_mul_overflow(us, NSEC_PER_USEC, &t)) {
+		return (us < 0) ? TIMENS_MIN : TIMENS_MAX;
+	}
+	return t;
+}
+
+static inline timens_t timens_from_ms(int64_t ms)
+{
+	timens_t t;
+
+	if (__builtin_mul_overflow(ms, NSEC_PER_MSEC, &t)) {
+		return (ms < 0) ? TIMENS_MIN : TIMENS_MAX;
+	}
+	return t;
+}
+
+/*******************************************************************************
+ * This method will read the given clock in nanoseconds.
+ * @param clockid_t clock - This is the clock, for example CLOCK_MONOTONIC.
+ * @return The current time of the clock.
+ ******************************************************************************/
+static inline timens_t timens_now(clockid_t clock)
+{
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+	return timens_from_timespec(&ts);
+}
  
  /*******************************************************************************
  * This method will determine the difference between two timspec structures.
@@ -16,6 +146,7 @@
  *                                  populated with a timing result.
  * @param struct timespec *x - This is a pointer to a structure that will be populated 
  *                             with a timing result.  This is the starting time.
+ *                             It is not modified.
  * @param struct timespec *y - This is a pointer to a structure that will be populated 
  *                             with a timing result.  This is the ending time.
  * @return The return will be 0 if the difference is positive.  Non zero if negative.
@@ -39,6 +170,7 @@ int  timeval_add (  struct timespec  *result, struct timespec *x,struct timespec
  * @param struct timespec *result - This is a pointer to a structure that will be 
  *                                  populated with a timing result.
  * @return The return will be the number of ms represented by the time structure.
+ *         This wraps after about 49 days; use timens_to_ms for longer times.
  ******************************************************************************/
 uint32_t timespectoms(struct timespec *structure);
 
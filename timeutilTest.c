@@ -0,0 +1,222 @@
+/*********************************************************************
+ * This program checks the timens_ routines and the timespec wrappers
+ * built on them against the implementations they replaced.  The legacy
+ * routines are kept here, as they were, as the reference.  Every pair
+ * from a grid of boundary values is checked, followed by a run of random
+ * pairs.  The exit status is 0 if every check passed.
+ *   make -f makefile.bb CC=gcc check
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include "timeutil.h"
+
+#define RANDOM_PAIRS (2000000)
+
+static uint64_t failures;
+static uint64_t checks;
+
+/*******************************************************************************
+ * These methods are timeval_subtract, timeval_add and timespectoms as they
+ * were before they were rebuilt on timens_t.  legacy_subtract modifies x,
+ * so it is given a copy.
+ ******************************************************************************/
+static int legacy_subtract(struct timespec *result, struct timespec *x, struct timespec *y)
+{
+	long nsecDelta = x->tv_nsec - y->tv_nsec;
+	time_t secDelta;
+
+	if (nsecDelta < 0)
+	{
+		nsecDelta += 1000000000;
+		x->tv_sec-=1;
+	}
+	secDelta = x->tv_sec - y->tv_sec;
+
+	result->tv_sec = secDelta;
+	result->tv_nsec = nsecDelta;
+
+	return (secDelta<0);
+}
+
+static int legacy_add(struct timespec *result, struct timespec *x, struct timespec *y)
+{
+	long nsec = x->tv_nsec + y->tv_nsec;
+	time_t secDelta = x->tv_sec + y->tv_sec;
+
+	if (nsec > 1000000000)
+	{
+		nsec -= 1000000000;
+		secDelta++;
+	}
+
+	result->tv_sec = secDelta;
+	result->tv_nsec = nsec;
+	return (secDelta<0);
+}
+
+static uint32_t legacy_toms(struct timespec *structure)
+{
+	uint32_t returnValue;
+
+	returnValue = structure -> tv_nsec / 1000000;
+	returnValue += structure -> tv_sec * 1000;
+
+	return returnValue;
+}
+
+/*******************************************************************************
+ * This method will record the result of one check, and print it if it failed.
+ * @param int ok - This is nonzero if the check passed.
+ * @param const char *what - This is the name of the check.
+ * @param const struct timespec *x - This is the first operand.
+ * @param const struct timespec *y - This is the second operand.
+ ******************************************************************************/
+static void expect(int ok, const char *what, const struct timespec *x, const struct timespec *y)
+{
+	checks++;
+	if (ok) {
+		return;
+	}
+	if (failures++ < 20) {
+		printf("FAIL %s: x = %lld.%09ld y = %lld.%09ld\n", what,
+			(long long)x->tv_sec, x->tv_nsec, (long long)y->tv_sec, y->tv_nsec);
+	}
+}
+
+/*******************************************************************************
+ * This method will compare two timespec structures by the time they represent,
+ * so that the legacy tv_nsec == 1000000000 compares equal to the carried form.
+ * @param const struct timespec *a - This is the first time.
+ * @param const struct timespec *b - This is the second time.
+ * @return Nonzero if the times are equal.
+ ******************************************************************************/
+static int same_time(const struct timespec *a, const struct timespec *b)
+{
+	return ((int64_t)a->tv_sec * NSEC_PER_SEC + a->tv_nsec) == ((int64_t)b->tv_sec * NSEC_PER_SEC + b->tv_nsec);
+}
+
+/*******************************************************************************
+ * This method will check one pair of normalized times.  Times are kept within
+ * +/- 2^30 seconds so that the legacy routines, which do not saturate, cannot
+ * overflow either.
+ * @param const struct timespec *x - This is the first time.
+ * @param const struct timespec *y - This is the second time.
+ ******************************************************************************/
+static void check_pair(const struct timespec *x, const struct timespec *y)
+{
+	struct timespec xCopy = *x;
+	struct timespec yCopy = *y;
+	struct timespec expected;
+	struct timespec actual;
+	struct timespec back;
+	timens_t a = timens_from_timespec(x);
+	timens_t b = timens_from_timespec(y);
+	int expectedRet;
+	int actualRet;
+
+	// Conversions
+	expect(a == (int64_t)x->tv_sec * NSEC_PER_SEC + x->tv_nsec, "timens_from_timespec", x, y);
+	timens_to_timespec(a, &back);
+	expect((back.tv_sec == x->tv_sec) && (back.tv_nsec == x->tv_nsec), "timens_to_timespec round trip", x, y);
+	expect(timens_from_us(timens_to_us(a)) == a - a % NSEC_PER_USEC, "us round trip", x, y);
+	expect(timens_from_ms(timens_to_ms(a)) == a - a % NSEC_PER_MSEC, "ms round trip", x, y);
+
+	// Subtraction: same result, and x is no longer modified.
+	expectedRet = legacy_subtract(&expected, &xCopy, &yCopy);
+	actualRet = timeval_subtract(&actual, (struct timespec*)x, (struct timespec*)y);
+	expect((expected.tv_sec == actual.tv_sec) && (expected.tv_nsec == actual.tv_nsec), "timeval_subtract", x, y);
+	expect(expectedRet == actualRet, "timeval_subtract return", x, y);
+	expect(timens_sub(a, b) == timens_from_timespec(&actual), "timens_sub", x, y);
+	expect(timens_add(timens_sub(a, b), b) == a, "timens_sub inverse", x, y);
+
+	// Addition: same time, but always normalized.
+	xCopy = *x;
+	expectedRet = legacy_add(&expected, &xCopy, &yCopy);
+	actualRet = timeval_add(&actual, (struct timespec*)x, (struct timespec*)y);
+	expect(same_time(&expected, &actual), "timeval_add", x, y);
+	expect((actual.tv_nsec >= 0) && (actual.tv_nsec < NSEC_PER_SEC), "timeval_add normalized", x, y);
+	expect(expected.tv_nsec <= NSEC_PER_SEC, "legacy timeval_add", x, y);
+	if (expected.tv_nsec == NSEC_PER_SEC) {
+		// The legacy carry was missed, leaving tv_sec a second short, so its sign may be wrong.
+		expect(actualRet == (timens_add(a, b) < 0), "timeval_add return after a carry", x, y);
+	} else {
+		expect(expectedRet == actualRet, "timeval_add return", x, y);
+	}
+	expect(timens_add(a, b) == timens_add(b, a), "timens_add commutes", x, y);
+	expect(timens_add(a, b) == timens_from_timespec(&actual), "timens_add", x, y);
+
+	// Milliseconds: the legacy routine is only meaningful for times which are not negative.
+	if (x->tv_sec >= 0) {
+		xCopy = *x;
+		expect(legacy_toms(&xCopy) == timespectoms((struct timespec*)x), "timespectoms", x, y);
+	}
+}
+
+/*******************************************************************************
+ * This method will check the saturation of the timens_ routines at the ends
+ * of the range, where the legacy routines have no defined answer.
+ ******************************************************************************/
+static void check_saturation(void)
+{
+	struct timespec big = { .tv_sec = (time_t)(INT64_MAX / NSEC_PER_SEC) + 1, .tv_nsec = 0 };
+	struct timespec none = { 0, 0 };
+
+	expect(timens_add(TIMENS_MAX, 1) == TIMENS_MAX, "timens_add saturates up", &none, &none);
+	expect(timens_add(TIMENS_MIN, -1) == TIMENS_MIN, "timens_add saturates down", &none, &none);
+	expect(timens_sub(TIMENS_MIN, 1) == TIMENS_MIN, "timens_sub saturates down", &none, &none);
+	expect(timens_sub(TIMENS_MAX, -1) == TIMENS_MAX, "timens_sub saturates up", &none, &none);
+	expect(timens_sub(0, TIMENS_MIN) == TIMENS_MAX, "timens_sub of TIMENS_MIN", &none, &none);
+	expect(timens_sub(TIMENS_MAX, TIMENS_MIN) == TIMENS_MAX, "timens_sub across the range", &none, &none);
+	expect(timens_from_us(INT64_MAX / 10) == TIMENS_MAX, "timens_from_us saturates up", &none, &none);
+	expect(timens_from_us(INT64_MIN / 10) == TIMENS_MIN, "timens_from_us saturates down", &none, &none);
+	expect(timens_from_ms(INT64_MAX / 10) == TIMENS_MAX, "timens_from_ms saturates up", &none, &none);
+	expect(timens_from_ms(INT64_MIN / 10) == TIMENS_MIN, "timens_from_ms saturates down", &none, &none);
+	if (sizeof(time_t) == sizeof(int64_t)) {
+		expect(timens_from_timespec(&big) == TIMENS_MAX, "timens_from_timespec saturates up", &big, &none);
+		big.tv_sec = -big.tv_sec;
+		expect(timens_from_timespec(&big) == TIMENS_MIN, "timens_from_timespec saturates down", &big, &none);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	static const time_t seconds[] = { 0, 1, 2, 59, 60, 3599, 86400, 4294967, 4294968, 2147483647 / 2,
+		-1, -2, -60, -86400, -4294968, -2147483647 / 2 };
+	static const long nanoseconds[] = { 0, 1, 999, 1000, 999999, 1000000, 499999999, 500000000,
+		500000001, 999000000, 999999998, 999999999 };
+	const uint32_t secCount = sizeof(seconds) / sizeof(seconds[0]);
+	const uint32_t nsecCount = sizeof(nanoseconds) / sizeof(nanoseconds[0]);
+	struct timespec x;
+	struct timespec y;
+	uint32_t index;
+	uint32_t other;
+	unsigned int seed = (argc > 1) ? (unsigned int)strtoul(argv[1], NULL, 0) : 1;
+
+	// Every pair of boundary values.
+	for (index = 0; index < secCount * nsecCount; index++) {
+		x.tv_sec = seconds[index / nsecCount];
+		x.tv_nsec = nanoseconds[index % nsecCount];
+		for (other = 0; other < secCount * nsecCount; other++) {
+			y.tv_sec = seconds[other / nsecCount];
+			y.tv_nsec = nanoseconds[other % nsecCount];
+			check_pair(&x, &y);
+		}
+	}
+
+	// Random pairs, seeded so that a failure can be repeated.
+	for (index = 0; index < RANDOM_PAIRS; index++) {
+		x.tv_sec = (time_t)((int32_t)rand_r(&seed) >> 1) * ((rand_r(&seed) & 1) ? -1 : 1);
+		x.tv_nsec = (long)(rand_r(&seed) % NSEC_PER_SEC);
+		y.tv_sec = (time_t)((int32_t)rand_r(&seed) >> 1) * ((rand_r(&seed) & 1) ? -1 : 1);
+		y.tv_nsec = (long)(rand_r(&seed) % NSEC_PER_SEC);
+		check_pair(&x, &y);
+	}
+
+	check_saturation();
+
+	printf("timeutil: %llu checks, %llu failed (seed %u)\n",
+		(unsigned long long)checks, (unsigned long long)failures, (argc > 1) ? (unsigned int)strtoul(argv[1], NULL, 0) : 1);
+	return (failures == 0) ? 0 : 1;
+}